@@ -0,0 +1,156 @@
+// Reads shared memory rings from a forked process while the parent publishes into them, the way a
+// perception or logging process reads /<prefix>_poses and /<prefix>_color of `tine --shm <prefix>`.
+// The rings are only two slots deep, so the writer laps the reader while it copies, and the reader
+// must never accept a frame that changed under it.  Exits with 0 if every frame it accepted was
+// intact.
+
+#include "tine_log.h"
+#include "tine_shm.h"
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static const char *POSE_NAME = "/tine_example_poses";
+static const char *COLOR_NAME = "/tine_example_color";
+static const uint32_t SLOT_COUNT = 2;
+static const uint32_t POSE_COUNT = 256;
+static const uint32_t IMAGE_WIDTH = 64;
+static const uint32_t IMAGE_HEIGHT = 48;
+static const uint32_t BGRA8_UNORM = 44; // VK_FORMAT_B8G8R8A8_UNORM, the usual swapchain format
+static const uint64_t FRAME_COUNT = 20000;
+
+// What a reader has seen of one ring
+struct RingStats {
+    uint64_t accepted = 0;
+    uint64_t torn = 0;
+    uint64_t last_step = 0;
+};
+
+// Every float of a pose frame and every texel of a color frame is the step, so a frame mixing two
+// steps shows up as torn
+static uint32_t get_expected_value(tine::ShmFrameKind kind, uint64_t step) {
+    const float pose_value = static_cast<float>(step);
+    uint32_t value = static_cast<uint32_t>(step);
+    if (kind == tine::ShmFrameKind::POSES) {
+        std::memcpy(&value, &pose_value, sizeof(value));
+    }
+    return value;
+}
+
+// Copies the newest frame of the ring into data and checks it once the copy is known to be a
+// single frame
+static bool read_frame(const tine::ShmReader &reader, tine::ShmFrameKind kind,
+                       std::vector<uint32_t> &data, RingStats &stats) {
+    tine::ShmFrame frame = {};
+    if (!reader.acquire_latest(frame)) {
+        return true;
+    }
+    TINE_CHECK(frame.header.kind == kind && frame.header.size == data.size() * sizeof(uint32_t),
+               "Unexpected frame", Error);
+    if (kind == tine::ShmFrameKind::COLOR) {
+        TINE_CHECK(frame.header.format == BGRA8_UNORM &&
+                       frame.header.width * frame.header.height * 4 == frame.header.size,
+                   "Unexpected image", Error);
+    }
+    std::memcpy(data.data(), frame.data, frame.header.size);
+    // Only now is the copy known to be a single frame
+    if (!reader.is_valid(frame)) {
+        stats.torn++;
+        return true;
+    }
+    for (uint32_t value : data) {
+        TINE_CHECK(value == get_expected_value(kind, frame.header.step), "Torn frame accepted",
+                   Error);
+    }
+    TINE_CHECK(frame.header.step >= stats.last_step, "Frames went backwards", Error);
+    stats.last_step = frame.header.step;
+    stats.accepted++;
+    return true;
+Error:
+    return false;
+}
+
+static bool read_frames() {
+    tine::ShmReader poses;
+    tine::ShmReader color;
+    std::vector<uint32_t> pose_data(POSE_COUNT * 16);
+    std::vector<uint32_t> color_data(IMAGE_WIDTH * IMAGE_HEIGHT);
+    RingStats pose_stats;
+    RingStats color_stats;
+    const std::chrono::steady_clock::time_point deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(10);
+
+    TINE_CHECK(poses.open(POSE_NAME) && color.open(COLOR_NAME), "Failed to open rings", Error);
+    while (pose_stats.last_step + 1 < FRAME_COUNT || color_stats.last_step + 1 < FRAME_COUNT) {
+        TINE_CHECK(std::chrono::steady_clock::now() < deadline, "Writer stopped publishing", Error);
+        TINE_CHECK(read_frame(poses, tine::ShmFrameKind::POSES, pose_data, pose_stats),
+                   "Bad pose frame", Error);
+        TINE_CHECK(read_frame(color, tine::ShmFrameKind::COLOR, color_data, color_stats),
+                   "Bad color frame", Error);
+    }
+    TINE_INFO("Reader accepted {0} pose frames, {1} were overwritten while copied",
+              pose_stats.accepted, pose_stats.torn);
+    TINE_INFO("Reader accepted {0} color frames, {1} were overwritten while copied",
+              color_stats.accepted, color_stats.torn);
+    return true;
+Error:
+    return false;
+}
+
+static void write_frames(tine::ShmWriter &poses, tine::ShmWriter &color) {
+    tine::ShmFrameHeader pose_header = {};
+    tine::ShmFrameHeader color_header = {};
+    pose_header.kind = tine::ShmFrameKind::POSES;
+    pose_header.width = POSE_COUNT;
+    pose_header.height = 1;
+    pose_header.size = POSE_COUNT * 16 * sizeof(float);
+    color_header.kind = tine::ShmFrameKind::COLOR;
+    color_header.width = IMAGE_WIDTH;
+    color_header.height = IMAGE_HEIGHT;
+    color_header.format = BGRA8_UNORM;
+    color_header.size = IMAGE_WIDTH * IMAGE_HEIGHT * 4;
+    for (uint64_t step = 0; step < FRAME_COUNT; step++) {
+        float *pose_data = nullptr;
+        uint32_t *texels = nullptr;
+        pose_header.step = step;
+        pose_data = static_cast<float *>(poses.begin_frame(pose_header));
+        for (uint32_t i = 0; i < POSE_COUNT * 16; i++) {
+            pose_data[i] = static_cast<float>(step);
+        }
+        poses.commit_frame();
+        color_header.step = step;
+        texels = static_cast<uint32_t *>(color.begin_frame(color_header));
+        for (uint32_t i = 0; i < IMAGE_WIDTH * IMAGE_HEIGHT; i++) {
+            texels[i] = static_cast<uint32_t>(step);
+        }
+        color.commit_frame();
+    }
+}
+
+int main() {
+    tine::ShmWriter poses;
+    tine::ShmWriter color;
+    int status = 0;
+    pid_t pid = -1;
+
+    // Created before forking so the reader finds them, it opens the rings by name all the same
+    TINE_CHECK(poses.create(POSE_NAME, SLOT_COUNT, POSE_COUNT * 16 * sizeof(float)) &&
+                   color.create(COLOR_NAME, SLOT_COUNT, IMAGE_WIDTH * IMAGE_HEIGHT * 4),
+               "Failed to create rings", Error);
+    pid = fork();
+    TINE_CHECK(pid >= 0, "Failed to fork", Error);
+    if (pid == 0) {
+        // Skips the destructors, the child's copies of the writers must not unlink the rings
+        _exit(read_frames() ? 0 : 1);
+    }
+    write_frames(poses, color);
+    TINE_CHECK(waitpid(pid, &status, 0) == pid, "Failed to wait for reader", Error);
+    TINE_CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0, "Reader failed", Error);
+    TINE_INFO("Writer published {0} frames to each ring", FRAME_COUNT);
+    return 0;
+Error:
+    return 1;
+}
@@ -1,9 +1,37 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
 
-layout(location = 0) in vec3 fragColor;
+// Bindless resources, see vk_init_bindless in tine_renderer.cpp
+struct Material {
+    vec4 base_color;
+    uint base_color_texture;
+    uint pad0;
+    uint pad1;
+    uint pad2;
+};
+
+const uint NO_TEXTURE = 0xFFFFFFFFu;
+
+layout(std430, set = 0, binding = 0) readonly buffer Materials {
+    Material materials[];
+};
+layout(set = 0, binding = 1) uniform sampler texture_sampler;
+layout(set = 0, binding = 2) uniform texture2D textures[];
+
+layout(location = 0) in vec3 fragNormal;
+layout(location = 1) in vec2 fragUV;
+layout(location = 2) flat in uint fragMaterial;
 
 layout(location = 0) out vec4 outColor;
 
 void main() {
-    outColor = vec4(fragColor, 1.0);
-}
\ No newline at end of file
+    Material material = materials[fragMaterial];
+    vec4 color = material.base_color;
+    if (material.base_color_texture != NO_TEXTURE) {
+        color *= texture(sampler2D(textures[nonuniformEXT(material.base_color_texture)],
+                                   texture_sampler), fragUV);
+    }
+    vec3 light_dir = normalize(vec3(0.3, 1.0, 0.5));
+    float light = 0.25 + 0.75 * max(dot(normalize(fragNormal), light_dir), 0.0);
+    outColor = vec4(color.rgb * light, color.a);
+}
@@ -1,20 +1,44 @@
 #version 450
 
-layout(location = 0) out vec3 fragColor;
+// tine::QuantizedVertex, decoded by the vertex fetch apart from the octahedral normal
+layout(location = 0) in vec4 inPosition; // unorm16, relative to the mesh bounds
+layout(location = 1) in vec2 inNormal;   // snorm16 octahedral
+layout(location = 2) in vec2 inUV;       // half
+// Per instance
+layout(location = 3) in mat4 inModel;
+layout(location = 7) in uint inMaterial;
+layout(location = 8) in uint inMesh;
 
-vec2 positions[3] = vec2[](
-    vec2(0.0, -0.5),
-    vec2(0.5, 0.5),
-    vec2(-0.5, 0.5)
-);
+// tine::MeshQuantization
+struct MeshQuantization {
+    vec4 offset;
+    vec4 scale;
+};
 
-vec3 colors[3] = vec3[](
-    vec3(1.0, 0.0, 0.0),
-    vec3(0.0, 1.0, 0.0),
-    vec3(0.0, 0.0, 1.0)
-);
+layout(std430, set = 0, binding = 3) readonly buffer MeshQuantizations {
+    MeshQuantization quantization[];
+};
+
+layout(push_constant) uniform PushConstants {
+    mat4 view_proj;
+} pc;
+
+layout(location = 0) out vec3 fragNormal;
+layout(location = 1) out vec2 fragUV;
+layout(location = 2) flat out uint fragMaterial;
+
+vec3 octahedral_decode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
 
 void main() {
-    gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
-    fragColor = colors[gl_VertexIndex];
-}
\ No newline at end of file
+    MeshQuantization q = quantization[inMesh];
+    vec3 position = q.offset.xyz + q.scale.xyz * inPosition.xyz;
+    gl_Position = pc.view_proj * inModel * vec4(position, 1.0);
+    fragNormal = mat3(inModel) * octahedral_decode(inNormal);
+    fragUV = inUV;
+    fragMaterial = inMaterial;
+}
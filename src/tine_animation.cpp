@@ -0,0 +1,157 @@
+#include "tine_animation.h"
+#include "tine_arena.h"
+#include "tine_component.h"
+#include "tine_jobs.h"
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+#include <tracy/Tracy.hpp>
+
+// Don't bother fanning out for a handful of characters
+static const size_t MIN_INSTANCES_PER_JOB = 16;
+
+int32_t tine::NodeHierarchy::find(const std::string &name) const {
+    for (size_t i = 0; i < names.size(); i++) {
+        if (names[i] == name) {
+            return static_cast<int32_t>(i);
+        }
+    }
+    return -1;
+}
+
+// Returns the key preceding t and the interpolation factor towards the next one.
+static size_t find_key(const std::vector<float> &times, float t, float &alpha) {
+    size_t key = std::upper_bound(times.begin(), times.end(), t) - times.begin();
+    alpha = 0.0f;
+    if (key == 0) {
+        return 0;
+    }
+    key--;
+    if (key + 1 < times.size()) {
+        const float span = times[key + 1] - times[key];
+        alpha = span > 0.0f ? (t - times[key]) / span : 0.0f;
+    }
+    return key;
+}
+
+static glm::vec3 sample_vec3(const std::vector<float> &times, const std::vector<glm::vec3> &values,
+                             float t, const glm::vec3 &fallback) {
+    float alpha = 0.0f;
+    if (values.empty()) {
+        return fallback;
+    }
+    const size_t key = find_key(times, t, alpha);
+    if (alpha == 0.0f) {
+        return values[key];
+    }
+    return glm::mix(values[key], values[key + 1], alpha);
+}
+
+static glm::quat sample_quat(const std::vector<float> &times, const std::vector<glm::quat> &values,
+                             float t) {
+    float alpha = 0.0f;
+    if (values.empty()) {
+        return glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+    }
+    const size_t key = find_key(times, t, alpha);
+    if (alpha == 0.0f) {
+        return values[key];
+    }
+    return glm::slerp(values[key], values[key + 1], alpha);
+}
+
+static glm::mat4 sample_channel(const tine::AnimationChannel &channel, float t) {
+    const glm::vec3 position =
+        sample_vec3(channel.position_times, channel.positions, t, glm::vec3(0.0f));
+    const glm::quat rotation = sample_quat(channel.rotation_times, channel.rotations, t);
+    const glm::vec3 scale = sample_vec3(channel.scale_times, channel.scales, t, glm::vec3(1.0f));
+    return glm::translate(glm::mat4(1.0f), position) * glm::mat4_cast(rotation) *
+           glm::scale(glm::mat4(1.0f), scale);
+}
+
+struct AnimationInstance {
+    const tine::SkinComponent *skin;
+    tine::AnimationComponent *animation;
+};
+
+static void sample_instance(tine::AnimationData &data, const AnimationInstance &instance,
+                            float dt, glm::mat4 *globals) {
+    const tine::Skin &skin = data.skins[instance.skin->skin];
+    tine::AnimationComponent &animation = *instance.animation;
+    const tine::AnimationClip *clip = nullptr;
+    const std::vector<int32_t> *channels = nullptr;
+    glm::mat4 *palette = data.joint_palette.data() + instance.skin->palette_offset;
+
+    if (animation.clip < data.clips.size()) {
+        clip = &data.clips[animation.clip];
+        channels = &skin.clip_channels[animation.clip];
+        animation.time += dt * animation.speed;
+        if (clip->duration > 0.0f) {
+            animation.time = std::fmod(animation.time, clip->duration);
+            if (animation.time < 0.0f) {
+                animation.time += clip->duration;
+            }
+        }
+    }
+
+    for (size_t n = 0; n < skin.nodes.size(); n++) {
+        const uint32_t node = skin.nodes[n];
+        const int32_t channel = (channels != nullptr) ? (*channels)[n] : -1;
+        const glm::mat4 local = (channel >= 0)
+                                    ? sample_channel(clip->channels[channel], animation.time)
+                                    : data.nodes.local_transforms[node];
+        if (skin.parents[n] >= 0) {
+            globals[n] = globals[skin.parents[n]] * local;
+        } else if (data.nodes.parents[node] >= 0) {
+            globals[n] = data.nodes.global_transforms[data.nodes.parents[node]] * local;
+        } else {
+            globals[n] = local;
+        }
+    }
+
+    for (size_t j = 0; j < skin.joints.size(); j++) {
+        palette[j] = instance.skin->inverse_mesh_transform * globals[skin.joints[j]] *
+                     skin.inverse_bind_matrices[j];
+    }
+}
+
+void tine::sample_animations(AnimationData &data, entt::registry &registry, float dt,
+                             LinearArena &arena, JobSystem *jobs) {
+    ZoneScoped;
+    auto view = registry.view<const SkinComponent, AnimationComponent>();
+    AnimationInstance *instances = arena.allocate_array<AnimationInstance>(view.size_hint());
+    size_t instance_cnt = 0;
+    size_t max_nodes = 0;
+    glm::mat4 *globals = nullptr;
+
+    for (entt::entity entity : view) {
+        AnimationInstance instance = {&view.get<const SkinComponent>(entity),
+                                      &view.get<AnimationComponent>(entity)};
+        instances[instance_cnt++] = instance;
+    }
+    if (instance_cnt == 0) {
+        return;
+    }
+    for (const Skin &skin : data.skins) {
+        max_nodes = std::max(max_nodes, skin.nodes.size());
+    }
+
+    if (jobs == nullptr) {
+        globals = arena.allocate_array<glm::mat4>(max_nodes);
+        for (size_t i = 0; i < instance_cnt; i++) {
+            sample_instance(data, instances[i], dt, globals);
+        }
+        return;
+    }
+
+    // Every instance owns a disjoint range of the palette, so the chunks don't need to sync
+    globals = arena.allocate_array<glm::mat4>(
+        jobs->get_chunk_count(instance_cnt, MIN_INSTANCES_PER_JOB) * max_nodes);
+    jobs->parallel_for("Sample animations", instance_cnt, MIN_INSTANCES_PER_JOB,
+                       [&](size_t begin, size_t end, size_t chunk) {
+                           for (size_t i = begin; i < end; i++) {
+                               sample_instance(data, instances[i], dt,
+                                               globals + chunk * max_nodes);
+                           }
+                       });
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <entt/entt.hpp>
+
+namespace tine {
+
+class JobSystem;
+class LinearArena;
+
+// Flattened node tree of an imported scene, parents always precede their children.
+struct NodeHierarchy {
+    std::vector<std::string> names;
+    std::vector<int32_t> parents;
+    std::vector<glm::mat4> local_transforms;
+    std::vector<glm::mat4> global_transforms;
+
+    int32_t find(const std::string &name) const;
+};
+
+// Joint influences for a single bind pose vertex, at most four per vertex.
+struct SkinVertex {
+    glm::uvec4 joints;
+    glm::vec4 weights;
+};
+static_assert(sizeof(SkinVertex) == 8 * sizeof(uint32_t), "SkinVertex must be tightly packed");
+
+struct Skin {
+    uint32_t mesh;               // Bind pose mesh
+    uint32_t skin_vertex_offset; // First SkinVertex of the bind pose mesh
+    // Skeleton, the subset of the hierarchy needed to pose the joints, in hierarchy order
+    std::vector<uint32_t> nodes;
+    std::vector<int32_t> parents; // Index into nodes, -1 for the skeleton root
+    std::vector<uint32_t> joints; // Index into nodes for each joint
+    std::vector<glm::mat4> inverse_bind_matrices;
+    // [clip][skeleton node] -> channel in the clip, -1 if the node isn't animated by it
+    std::vector<std::vector<int32_t>> clip_channels;
+};
+
+struct AnimationChannel {
+    uint32_t node;
+    std::vector<float> position_times;
+    std::vector<glm::vec3> positions;
+    std::vector<float> rotation_times;
+    std::vector<glm::quat> rotations;
+    std::vector<float> scale_times;
+    std::vector<glm::vec3> scales;
+};
+
+struct AnimationClip {
+    std::string name;
+    float duration; // Seconds
+    std::vector<AnimationChannel> channels;
+};
+
+struct AnimationData {
+    NodeHierarchy nodes;
+    std::vector<SkinVertex> skin_vertices;
+    std::vector<Skin> skins;
+    std::vector<AnimationClip> clips;
+    // Skinning matrices of every skinned instance, see SkinComponent::palette_offset
+    std::vector<glm::mat4> joint_palette;
+};
+
+// Advance every AnimationComponent by dt and rebuild the joint palette, split across jobs unless
+// jobs is null.  Temporaries come from arena, which must outlive the call.
+void sample_animations(AnimationData &data, entt::registry &registry, float dt,
+                       LinearArena &arena, JobSystem *jobs = nullptr);
+
+} // namespace tine
@@ -0,0 +1,146 @@
+#include "tine_log.h"
+#include "tine_api.h"
+#include "tine_engine.h"
+#include "tine_observation.h"
+#include <exception>
+#include <glm/gtc/type_ptr.hpp>
+
+struct tine_engine {
+    tine::Engine engine;
+};
+
+static const tine::Observations *get_observations(const tine_engine *engine) {
+    return (engine != nullptr) ? engine->engine.get_observations() : nullptr;
+}
+
+// Exceptions must not cross the C boundary, every entry point logs them and fails instead.
+// Only called from a catch block.
+static void log_exception(const char *call) {
+    try {
+        throw;
+    } catch (const std::exception &e) {
+        TINE_ERROR("{} failed: {}", call, e.what());
+    } catch (...) {
+        TINE_ERROR("{} failed: unknown exception", call);
+    }
+}
+
+tine_engine *tine_create(void) {
+    tine_engine *engine = nullptr;
+    try {
+        engine = new tine_engine();
+        TINE_CHECK(engine->engine.init_headless(), "Failed to init headless engine", Error);
+        return engine;
+    } catch (...) {
+        log_exception("tine_create");
+    }
+Error:
+    delete engine;
+    return nullptr;
+}
+
+void tine_destroy(tine_engine *engine) {
+    if (engine == nullptr) {
+        return;
+    }
+    try {
+        engine->engine.cleanup();
+    } catch (...) {
+        log_exception("tine_destroy");
+    }
+    delete engine;
+}
+
+int tine_load_scene(tine_engine *engine, const char *path, uint32_t env_count) {
+    try {
+        TINE_CHECK(engine != nullptr && path != nullptr, "Invalid arguments", Error);
+        TINE_CHECK(engine->engine.load_scene(path, env_count), "Failed to load scene", Error);
+        return 0;
+    } catch (...) {
+        log_exception("tine_load_scene");
+    }
+Error:
+    return -1;
+}
+
+int tine_step(tine_engine *engine, const float *actions, uint32_t env_count, float dt) {
+    try {
+        TINE_CHECK(engine != nullptr, "Invalid engine", Error);
+        TINE_CHECK(engine->engine.step(actions, env_count, dt), "Failed to step", Error);
+        return 0;
+    } catch (...) {
+        log_exception("tine_step");
+    }
+Error:
+    return -1;
+}
+
+int tine_reset(tine_engine *engine) {
+    try {
+        TINE_CHECK(engine != nullptr, "Invalid engine", Error);
+        TINE_CHECK(engine->engine.reset(), "Failed to reset", Error);
+        return 0;
+    } catch (...) {
+        log_exception("tine_reset");
+    }
+Error:
+    return -1;
+}
+
+uint32_t tine_get_env_count(const tine_engine *engine) {
+    try {
+        const tine::Observations *obs = get_observations(engine);
+        return (obs != nullptr) ? obs->env_count : 0;
+    } catch (...) {
+        log_exception("tine_get_env_count");
+    }
+    return 0;
+}
+
+uint32_t tine_get_action_count(const tine_engine *engine) {
+    try {
+        const tine::Observations *obs = get_observations(engine);
+        return (obs != nullptr) ? obs->action_count : 0;
+    } catch (...) {
+        log_exception("tine_get_action_count");
+    }
+    return 0;
+}
+
+const float *tine_get_poses(const tine_engine *engine, uint32_t *pose_count) {
+    if (pose_count != nullptr) {
+        *pose_count = 0;
+    }
+    try {
+        const tine::Observations *obs = get_observations(engine);
+        if (pose_count != nullptr) {
+            *pose_count = (obs != nullptr) ? obs->pose_count : 0;
+        }
+        if (obs == nullptr || obs->poses.empty()) {
+            return nullptr;
+        }
+        return glm::value_ptr(obs->poses[0]);
+    } catch (...) {
+        log_exception("tine_get_poses");
+    }
+    return nullptr;
+}
+
+const float *tine_get_joint_states(const tine_engine *engine, uint32_t *joint_count) {
+    if (joint_count != nullptr) {
+        *joint_count = 0;
+    }
+    try {
+        const tine::Observations *obs = get_observations(engine);
+        if (joint_count != nullptr) {
+            *joint_count = (obs != nullptr) ? obs->joint_count : 0;
+        }
+        if (obs == nullptr || obs->joints == nullptr) {
+            return nullptr;
+        }
+        return glm::value_ptr(obs->joints[0]);
+    } catch (...) {
+        log_exception("tine_get_joint_states");
+    }
+    return nullptr;
+}
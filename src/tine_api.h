@@ -0,0 +1,54 @@
+#ifndef TINE_API_H
+#define TINE_API_H
+
+/* Stable C interface of the tine_shared library, for embedding the simulation without a window.
+ * Every call returns 0 on success and -1 on failure unless noted otherwise.  Observation pointers
+ * point into engine owned buffers that each step rewrites in place, they stay valid until the
+ * next tine_load_scene or tine_destroy.  Matrices are 16 column major floats.
+ *
+ * There are no images: the engine is headless, and a rendering engine only draws its view
+ * environment.  Run tine with --shm <prefix> and read /<prefix>_color for the rendered frames. */
+
+#include <stdint.h>
+
+#if defined(_WIN32)
+#if defined(TINE_BUILD_SHARED)
+#define TINE_API __declspec(dllexport)
+#else
+#define TINE_API __declspec(dllimport)
+#endif
+#else
+#define TINE_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct tine_engine tine_engine;
+
+/* Headless engine, NULL on failure */
+TINE_API tine_engine *tine_create(void);
+TINE_API void tine_destroy(tine_engine *engine);
+
+TINE_API int tine_load_scene(tine_engine *engine, const char *path, uint32_t env_count);
+/* actions holds tine_get_action_count() floats for each of env_count environments, or NULL to
+ * keep the previous ones.  Advances every environment by dt seconds. */
+TINE_API int tine_step(tine_engine *engine, const float *actions, uint32_t env_count, float dt);
+/* Every environment back to its state right after tine_load_scene */
+TINE_API int tine_reset(tine_engine *engine);
+
+TINE_API uint32_t tine_get_env_count(const tine_engine *engine);
+/* Per environment, the animation playback speeds actions drive */
+TINE_API uint32_t tine_get_action_count(const tine_engine *engine);
+
+/* [env][pose] entity transforms, pose_count per environment */
+TINE_API const float *tine_get_poses(const tine_engine *engine, uint32_t *pose_count);
+/* [env][joint] skinning matrices, joint_count per environment */
+TINE_API const float *tine_get_joint_states(const tine_engine *engine, uint32_t *joint_count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
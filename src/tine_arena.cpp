@@ -0,0 +1,67 @@
+#include "tine_arena.h"
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+static uint8_t *allocate_block(size_t size) {
+    void *block = std::malloc(size);
+    if (block == nullptr) {
+        throw std::bad_alloc();
+    }
+    return static_cast<uint8_t *>(block);
+}
+
+tine::LinearArena::LinearArena(size_t capacity) {
+    if (capacity > 0) {
+        m_block = allocate_block(capacity);
+        m_capacity = capacity;
+    }
+}
+
+tine::LinearArena::~LinearArena() {
+    for (uint8_t *block : m_overflow) {
+        std::free(block);
+    }
+    std::free(m_block);
+}
+
+void *tine::LinearArena::allocate(size_t size, size_t alignment) {
+    // The address is what has to be aligned, malloc only guarantees max_align_t for the block
+    const uintptr_t base = reinterpret_cast<uintptr_t>(m_block);
+    const uintptr_t addr = (base + m_offset + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    const size_t aligned = static_cast<size_t>(addr - base);
+    if (size == 0) {
+        return nullptr;
+    }
+    if (aligned + size <= m_capacity) {
+        m_used += aligned + size - m_offset;
+        m_offset = aligned + size;
+        return m_block + aligned;
+    }
+
+    // malloc is suitably aligned for anything up to max_align_t
+    {
+        const size_t padding = (alignment > alignof(std::max_align_t)) ? alignment : 0;
+        uint8_t *block = allocate_block(size + padding);
+        const uintptr_t addr = reinterpret_cast<uintptr_t>(block);
+        m_overflow.push_back(block);
+        m_used += size + padding;
+        return block + (((addr + alignment - 1) & ~(uintptr_t)(alignment - 1)) - addr);
+    }
+}
+
+void tine::LinearArena::reset() {
+    if (!m_overflow.empty()) {
+        // Leave some headroom so a slowly growing workload doesn't regrow every frame
+        const size_t capacity = m_used + m_used / 4;
+        for (uint8_t *block : m_overflow) {
+            std::free(block);
+        }
+        m_overflow.clear();
+        std::free(m_block);
+        m_block = allocate_block(capacity);
+        m_capacity = capacity;
+    }
+    m_offset = 0;
+    m_used = 0;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+namespace tine {
+
+// Bump allocator for temporaries that live for a single frame.  Everything is released at once by
+// reset().  Allocations that don't fit go to overflow blocks, and the next reset() grows the main
+// block to what the last frame used, so a steady workload stops touching the heap after a frame.
+// Not thread safe: carve out per-thread ranges up front when fanning out work.
+class LinearArena {
+  public:
+    explicit LinearArena(size_t capacity = 0);
+    ~LinearArena();
+    LinearArena(const LinearArena &) = delete;
+    LinearArena &operator=(const LinearArena &) = delete;
+
+    void *allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+    void reset();
+
+    // Uninitialized storage for count objects, no destructors are ever run.
+    template <typename T> T *allocate_array(size_t count) {
+        static_assert(std::is_trivially_destructible<T>::value,
+                      "Arena allocations are never destroyed");
+        return static_cast<T *>(allocate(count * sizeof(T), alignof(T)));
+    }
+
+    size_t get_used() const { return m_used; }
+    size_t get_capacity() const { return m_capacity; }
+
+  private:
+    uint8_t *m_block = nullptr;
+    size_t m_capacity = 0;
+    size_t m_offset = 0;
+    size_t m_used = 0; // Including overflow blocks
+    std::vector<uint8_t *> m_overflow;
+};
+
+} // namespace tine
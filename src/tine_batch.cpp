@@ -0,0 +1,127 @@
+#include "tine_batch.h"
+#include "tine_arena.h"
+#include "tine_component.h"
+#include "tine_frustum.h"
+#include "tine_material.h"
+#include "tine_mesh.h"
+#include <algorithm>
+#include <cmath>
+#include <tracy/Tracy.hpp>
+
+// Screen space error a LOD may introduce, as a fraction of the viewport half height, about a
+// pixel at 1080p
+static const float LOD_ERROR_THRESHOLD = 1.0f / 540.0f;
+// Bits of the sort key left for the material, see build_draw_list
+static const uint32_t MATERIAL_KEY_BITS = 28;
+static const uint32_t MATERIAL_KEY_MASK = (1u << MATERIAL_KEY_BITS) - 1;
+static_assert(tine::MAX_MATERIALS - 1 <= MATERIAL_KEY_MASK, "Materials must fit the sort key");
+
+struct SortKey {
+    uint64_t key;
+    const glm::mat4 *transform;
+    uint32_t entity;
+};
+
+// What LOD selection needs to know about the camera
+struct LodView {
+    glm::vec3 eye;
+    float projection_scale; // Mesh units at unit distance to screen half heights
+    bool perspective;
+    float threshold;
+};
+
+static LodView make_lod_view(const tine::CameraComponent &camera) {
+    LodView view;
+    view.eye = glm::vec3(glm::inverse(camera.view_matrix)[3]);
+    view.projection_scale = std::abs(camera.projection_matrix[1][1]);
+    view.perspective = camera.projection_matrix[3][3] == 0.0f;
+    view.threshold = LOD_ERROR_THRESHOLD * std::exp2(camera.lod_bias);
+    return view;
+}
+
+// The coarsest LOD whose error projects to less than the threshold at the nearest point of the
+// mesh's bounding sphere.
+static uint32_t select_lod(const tine::MeshData &mesh_data, const tine::Mesh &mesh,
+                           const glm::mat4 &transform, const LodView &view) {
+    const glm::vec3 local_center = 0.5f * (mesh.aabb_min + mesh.aabb_max);
+    const glm::vec3 center = glm::vec3(transform * glm::vec4(local_center, 1.0f));
+    const float scale = std::sqrt(std::max(glm::dot(transform[0], transform[0]),
+                                           std::max(glm::dot(transform[1], transform[1]),
+                                                    glm::dot(transform[2], transform[2]))));
+    const float radius = 0.5f * glm::length(mesh.aabb_max - mesh.aabb_min) * scale;
+    float distance = 1.0f;
+    uint32_t lod = 0;
+
+    if (view.perspective) {
+        distance = glm::length(center - view.eye) - radius;
+        if (distance <= 0.0f) {
+            return 0;
+        }
+    }
+    const float error_scale = view.projection_scale * scale / distance;
+    while (lod + 1 < mesh.lod_count &&
+           mesh_data.lods[mesh.lod_offset + lod + 1].error * error_scale <= view.threshold) {
+        lod++;
+    }
+    return lod;
+}
+
+void tine::build_draw_list(entt::registry &registry, const MeshData &mesh_data,
+                           const CameraComponent &camera, uint32_t env, LinearArena &arena,
+                           DrawList &list) {
+    ZoneScoped;
+    const Frustum frustum = Frustum::from_matrix(camera.projection_matrix * camera.view_matrix);
+    const LodView lod_view = make_lod_view(camera);
+    auto view = registry.view<const TransformComponent, const MeshComponent,
+                              const EnvironmentComponent>();
+    SortKey *sort_keys = arena.allocate_array<SortKey>(view.size_hint());
+    size_t key_cnt = 0;
+
+    list.clear();
+
+    for (entt::entity entity : view) {
+        const glm::mat4 &transform = view.get<const TransformComponent>(entity).transform;
+        const uint32_t mesh_idx = view.get<const MeshComponent>(entity).mesh;
+        const Mesh &mesh = mesh_data.meshes[mesh_idx];
+        const MaterialComponent *material = registry.try_get<MaterialComponent>(entity);
+        if ((view.get<const EnvironmentComponent>(entity).env != env) ||
+            (mesh.index_count == 0) ||
+            !frustum.intersects_aabb(mesh.aabb_min, mesh.aabb_max, transform)) {
+            continue;
+        }
+        // Entities without a material, or with one past what the scene can load, fall back to
+        // the first one rather than spilling into the LOD bits
+        const uint64_t lod = select_lod(mesh_data, mesh, transform, lod_view);
+        const uint32_t material_idx =
+            (material != nullptr && material->material < MAX_MATERIALS) ? material->material : 0;
+        const uint64_t key = (static_cast<uint64_t>(mesh_idx) << 32) |
+                             (lod << MATERIAL_KEY_BITS) | (material_idx & MATERIAL_KEY_MASK);
+        sort_keys[key_cnt].key = key;
+        sort_keys[key_cnt].transform = &transform;
+        sort_keys[key_cnt].entity = static_cast<uint32_t>(entt::to_entity(entity));
+        key_cnt++;
+    }
+
+    std::sort(sort_keys, sort_keys + key_cnt,
+              [](const SortKey &a, const SortKey &b) { return a.key < b.key; });
+
+    for (size_t i = 0; i < key_cnt; i++) {
+        const uint64_t key = sort_keys[i].key;
+        if (list.batches.empty() || (i > 0 && key != sort_keys[i - 1].key)) {
+            DrawBatch batch = {};
+            batch.mesh = static_cast<uint32_t>(key >> 32);
+            batch.lod = static_cast<uint32_t>(key & UINT32_MAX) >> MATERIAL_KEY_BITS;
+            batch.material = static_cast<uint32_t>(key) & MATERIAL_KEY_MASK;
+            batch.first_instance = static_cast<uint32_t>(list.instances.size());
+            list.batches.push_back(batch);
+        }
+        InstanceData instance = {};
+        instance.transform = *sort_keys[i].transform;
+        instance.material = list.batches.back().material;
+        instance.mesh = list.batches.back().mesh;
+        instance.entity = sort_keys[i].entity;
+        instance.batch = static_cast<uint32_t>(list.batches.size() - 1);
+        list.instances.push_back(instance);
+        list.batches.back().instance_count++;
+    }
+}
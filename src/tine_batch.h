@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+#include <entt/entt.hpp>
+
+namespace tine {
+
+struct MeshData;
+struct CameraComponent;
+class LinearArena;
+
+// Per instance vertex stream, mirrors the instance attributes of basic_triangle.vert.
+struct InstanceData {
+    glm::mat4 transform;
+    uint32_t material;
+    uint32_t mesh;   // Selects the vertex dequantization
+    uint32_t entity; // Entity index, keys the occlusion history
+    uint32_t batch;  // Into DrawList::batches
+};
+
+// A single instanced draw of every visible entity sharing a mesh, LOD and material.
+struct DrawBatch {
+    uint32_t mesh;
+    uint32_t lod; // Relative to Mesh::lod_offset
+    uint32_t material;
+    uint32_t first_instance; // Into DrawList::instances
+    uint32_t instance_count;
+};
+
+// Kept between frames so batching doesn't allocate in the steady state.
+struct DrawList {
+    std::vector<DrawBatch> batches;
+    std::vector<InstanceData> instances;
+
+    void clear() {
+        batches.clear();
+        instances.clear();
+    }
+};
+
+// Groups the entities of environment env visible from camera by (mesh, LOD, material) into
+// instanced draws, picking each entity's LOD from its projected size.  The sort keys are taken
+// from arena.  Only one environment is batched per call, and the renderer passes the scene's
+// view environment, so the other environments are simulated but never rendered: captured and
+// published frames always show the view environment.
+void build_draw_list(entt::registry &registry, const MeshData &mesh_data,
+                     const CameraComponent &camera, uint32_t env, LinearArena &arena,
+                     DrawList &list);
+
+} // namespace tine
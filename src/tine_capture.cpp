@@ -0,0 +1,464 @@
+#include "tine_log.h"
+#include "tine_capture.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <tracy/Tracy.hpp>
+
+static const uint32_t MAX_CAPTURE_THREADS = 16;
+// Frames are encoded in a single deflate block addressed with 32 bit positions
+static const size_t MAX_CAPTURE_SIZE = size_t(1) << 30;
+
+static const uint32_t DEFLATE_WINDOW = 32768;
+static const uint32_t DEFLATE_HASH_BITS = 15;
+static const uint32_t DEFLATE_MAX_CHAIN = 8;
+static const uint32_t DEFLATE_MIN_MATCH = 3;
+static const uint32_t DEFLATE_MAX_MATCH = 258;
+
+static const uint16_t DEFLATE_LENGTH_BASE[29] = {3,  4,  5,  6,   7,   8,   9,   10,  11, 13,
+                                                 15, 17, 19, 23,  27,  31,  35,  43,  51, 59,
+                                                 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t DEFLATE_LENGTH_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                                 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t DEFLATE_DIST_BASE[30] = {
+    1,   2,   3,   4,   5,   7,    9,    13,   17,   25,   33,   49,   65,    97,    129,
+    193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t DEFLATE_DIST_EXTRA[30] = {0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+                                               6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+struct CaptureFrame {
+    uint64_t frame = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    tine::CapturePixels pixels = tine::CapturePixels::RGBA8;
+    std::vector<uint8_t> data; // Tightly packed rows
+};
+
+// Per encoder thread, reused from frame to frame
+struct EncoderScratch {
+    std::vector<uint8_t> filtered;
+    std::vector<uint8_t> encoded;
+    std::vector<int32_t> head;
+    std::vector<int32_t> prev;
+};
+
+struct BitWriter {
+    std::vector<uint8_t> *dst;
+    uint64_t bits;
+    uint32_t count;
+};
+
+static void write_bits(BitWriter &bw, uint32_t value, uint32_t count) {
+    bw.bits |= static_cast<uint64_t>(value) << bw.count;
+    bw.count += count;
+    while (bw.count >= 8) {
+        bw.dst->push_back(static_cast<uint8_t>(bw.bits));
+        bw.bits >>= 8;
+        bw.count -= 8;
+    }
+}
+
+static void flush_bits(BitWriter &bw) {
+    if (bw.count > 0) {
+        bw.dst->push_back(static_cast<uint8_t>(bw.bits));
+    }
+    bw.bits = 0;
+    bw.count = 0;
+}
+
+// Huffman codes go out most significant bit first, unlike everything else
+static void write_code(BitWriter &bw, uint32_t code, uint32_t length) {
+    uint32_t reversed = 0;
+    for (uint32_t i = 0; i < length; i++) {
+        reversed |= ((code >> i) & 1) << (length - 1 - i);
+    }
+    write_bits(bw, reversed, length);
+}
+
+// Literal or length symbol of the fixed Huffman code
+static void write_symbol(BitWriter &bw, uint32_t symbol) {
+    if (symbol < 144) {
+        write_code(bw, 0x30 + symbol, 8);
+    } else if (symbol < 256) {
+        write_code(bw, 0x190 + symbol - 144, 9);
+    } else if (symbol < 280) {
+        write_code(bw, symbol - 256, 7);
+    } else {
+        write_code(bw, 0xc0 + symbol - 280, 8);
+    }
+}
+
+static void write_match(BitWriter &bw, uint32_t length, uint32_t distance) {
+    uint32_t l = 28;
+    uint32_t d = 29;
+    while (DEFLATE_LENGTH_BASE[l] > length) {
+        l--;
+    }
+    while (DEFLATE_DIST_BASE[d] > distance) {
+        d--;
+    }
+    write_symbol(bw, 257 + l);
+    write_bits(bw, length - DEFLATE_LENGTH_BASE[l], DEFLATE_LENGTH_EXTRA[l]);
+    write_code(bw, d, 5);
+    write_bits(bw, distance - DEFLATE_DIST_BASE[d], DEFLATE_DIST_EXTRA[d]);
+}
+
+static uint32_t hash3(const uint8_t *src) {
+    const uint32_t value = (uint32_t(src[0]) << 16) | (uint32_t(src[1]) << 8) | src[2];
+    return (value * 2654435761u) >> (32 - DEFLATE_HASH_BITS);
+}
+
+// One deflate block with the fixed Huffman code and greedy matches from short hash chains.
+// Rendered frames are mostly flat or smooth, which the PNG filter turns into runs that this
+// already packs well, without the cost of building dynamic codes.
+static void deflate_fixed(const uint8_t *src, size_t size, std::vector<uint8_t> &dst,
+                          EncoderScratch &scratch) {
+    BitWriter bw = {&dst, 0, 0};
+    size_t pos = 0;
+    scratch.head.assign(size_t(1) << DEFLATE_HASH_BITS, -1);
+    scratch.prev.resize(DEFLATE_WINDOW);
+
+    write_bits(bw, 1, 1); // Final block
+    write_bits(bw, 1, 2); // Fixed Huffman codes
+    while (pos < size) {
+        uint32_t best_length = 0;
+        uint32_t best_distance = 0;
+        uint32_t advance = 1;
+        if (pos + DEFLATE_MIN_MATCH <= size) {
+            const size_t max_length = std::min<size_t>(DEFLATE_MAX_MATCH, size - pos);
+            int32_t candidate = scratch.head[hash3(src + pos)];
+            for (uint32_t chain = 0; candidate >= 0 && pos - candidate <= DEFLATE_WINDOW &&
+                                     chain < DEFLATE_MAX_CHAIN;
+                 chain++) {
+                uint32_t length = 0;
+                while (length < max_length && src[candidate + length] == src[pos + length]) {
+                    length++;
+                }
+                if (length > best_length) {
+                    best_length = length;
+                    best_distance = static_cast<uint32_t>(pos - candidate);
+                    if (length == max_length) {
+                        break;
+                    }
+                }
+                candidate = scratch.prev[candidate % DEFLATE_WINDOW];
+            }
+        }
+        if (best_length >= DEFLATE_MIN_MATCH) {
+            write_match(bw, best_length, best_distance);
+            advance = best_length;
+        } else {
+            write_symbol(bw, src[pos]);
+        }
+        for (; advance > 0; advance--, pos++) {
+            if (pos + DEFLATE_MIN_MATCH <= size) {
+                const uint32_t hash = hash3(src + pos);
+                scratch.prev[pos % DEFLATE_WINDOW] = scratch.head[hash];
+                scratch.head[hash] = static_cast<int32_t>(pos);
+            }
+        }
+    }
+    write_symbol(bw, 256);
+    flush_bits(bw);
+}
+
+static uint32_t update_crc32(uint32_t crc, const uint8_t *data, size_t size) {
+    static const std::vector<uint32_t> table = [] {
+        std::vector<uint32_t> t(256);
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            t[i] = c;
+        }
+        return t;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) {
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static uint32_t get_adler32(const uint8_t *data, size_t size) {
+    uint32_t a = 1;
+    uint32_t b = 0;
+    while (size > 0) {
+        // Largest run before b can overflow
+        const size_t run = std::min<size_t>(size, 5552);
+        for (size_t i = 0; i < run; i++) {
+            a += data[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+        data += run;
+        size -= run;
+    }
+    return (b << 16) | a;
+}
+
+static void append_be32(std::vector<uint8_t> &dst, uint32_t value) {
+    dst.push_back(static_cast<uint8_t>(value >> 24));
+    dst.push_back(static_cast<uint8_t>(value >> 16));
+    dst.push_back(static_cast<uint8_t>(value >> 8));
+    dst.push_back(static_cast<uint8_t>(value));
+}
+
+// Closes the chunk whose length field starts at offset
+static void end_png_chunk(std::vector<uint8_t> &dst, size_t offset) {
+    const size_t size = dst.size() - offset - 8;
+    const uint32_t crc = update_crc32(0, dst.data() + offset + 4, size + 4);
+    for (int i = 0; i < 4; i++) {
+        dst[offset + i] = static_cast<uint8_t>(size >> (24 - 8 * i));
+    }
+    append_be32(dst, crc);
+}
+
+static size_t begin_png_chunk(std::vector<uint8_t> &dst, const char *type) {
+    const size_t offset = dst.size();
+    append_be32(dst, 0);
+    dst.insert(dst.end(), type, type + 4);
+    return offset;
+}
+
+// RGB, 8 bits per channel, every row with the Sub filter
+static void encode_png(const CaptureFrame &frame, EncoderScratch &scratch) {
+    ZoneScoped;
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    const bool is_bgra = frame.pixels == tine::CapturePixels::BGRA8;
+    const size_t row_size = 1 + size_t(frame.width) * 3;
+    std::vector<uint8_t> &png = scratch.encoded;
+    size_t chunk = 0;
+
+    scratch.filtered.resize(row_size * frame.height);
+    for (uint32_t y = 0; y < frame.height; y++) {
+        const uint8_t *src = frame.data.data() + size_t(y) * frame.width * 4;
+        uint8_t *dst = scratch.filtered.data() + y * row_size;
+        uint8_t left[3] = {0, 0, 0};
+        *dst++ = 1;
+        for (uint32_t x = 0; x < frame.width; x++, src += 4) {
+            const uint8_t rgb[3] = {src[is_bgra ? 2 : 0], src[1], src[is_bgra ? 0 : 2]};
+            for (int c = 0; c < 3; c++) {
+                *dst++ = static_cast<uint8_t>(rgb[c] - left[c]);
+                left[c] = rgb[c];
+            }
+        }
+    }
+
+    png.assign(signature, signature + sizeof(signature));
+    chunk = begin_png_chunk(png, "IHDR");
+    append_be32(png, frame.width);
+    append_be32(png, frame.height);
+    png.push_back(8); // Bit depth
+    png.push_back(2); // RGB
+    png.push_back(0); // Deflate
+    png.push_back(0); // Adaptive filtering
+    png.push_back(0); // Not interlaced
+    end_png_chunk(png, chunk);
+
+    chunk = begin_png_chunk(png, "IDAT");
+    png.push_back(0x78); // zlib, 32K window
+    png.push_back(0x01);
+    deflate_fixed(scratch.filtered.data(), scratch.filtered.size(), png, scratch);
+    append_be32(png, get_adler32(scratch.filtered.data(), scratch.filtered.size()));
+    end_png_chunk(png, chunk);
+
+    chunk = begin_png_chunk(png, "IEND");
+    end_png_chunk(png, chunk);
+}
+
+struct tine::FrameCapture::Pimpl {
+    tine::CaptureSettings settings;
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;
+    std::condition_variable pending_cv; // Frames were queued or the capture is closing
+    std::condition_variable free_cv;    // A frame was written
+    std::deque<std::unique_ptr<CaptureFrame>> pending;
+    std::vector<std::unique_ptr<CaptureFrame>> free_frames;
+    bool is_closing = false;
+    bool failed = false;
+    std::atomic<uint64_t> written{0};
+    std::atomic<uint64_t> dropped{0};
+};
+
+static bool write_frame(tine::FrameCapture::Pimpl &cap, const CaptureFrame &frame,
+                        EncoderScratch &scratch) {
+    ZoneScoped;
+    const bool is_png = cap.settings.encoding == tine::CaptureEncoding::PNG;
+    char name[64];
+    std::string path;
+    std::ofstream file;
+
+    snprintf(name, sizeof(name), "/frame_%08llu.%s", static_cast<unsigned long long>(frame.frame),
+             is_png ? "png" : "raw");
+    path = cap.settings.directory + name;
+    file.open(path, std::ios::binary | std::ios::trunc);
+    TINE_CHECK(file.is_open(), path, Error);
+    if (is_png) {
+        encode_png(frame, scratch);
+        file.write(reinterpret_cast<const char *>(scratch.encoded.data()),
+                   static_cast<std::streamsize>(scratch.encoded.size()));
+    } else {
+        const tine::CaptureRawHeader header = {
+            {'T', 'R', 'A', 'W'}, frame.width, frame.height, frame.pixels, frame.frame};
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(frame.data.data()),
+                   static_cast<std::streamsize>(frame.data.size()));
+    }
+    TINE_CHECK(file.good(), path, Error);
+    return true;
+Error:
+    return false;
+}
+
+static void encode_frames(tine::FrameCapture::Pimpl &cap) {
+    EncoderScratch scratch;
+    for (;;) {
+        std::unique_ptr<CaptureFrame> frame;
+        {
+            std::unique_lock<std::mutex> lock(cap.mutex);
+            cap.pending_cv.wait(lock, [&cap] { return !cap.pending.empty() || cap.is_closing; });
+            if (cap.pending.empty()) {
+                return;
+            }
+            frame = std::move(cap.pending.front());
+            cap.pending.pop_front();
+        }
+        const bool ok = write_frame(cap, *frame, scratch);
+        if (ok) {
+            cap.written++;
+        }
+        {
+            std::lock_guard<std::mutex> lock(cap.mutex);
+            cap.failed = cap.failed || !ok;
+            cap.free_frames.push_back(std::move(frame));
+        }
+        cap.free_cv.notify_one();
+    }
+}
+
+tine::FrameCapture::FrameCapture() : m_pimpl(new Pimpl()) {}
+tine::FrameCapture::~FrameCapture() {
+    close();
+}
+
+bool tine::FrameCapture::open(const CaptureSettings &settings) {
+    Pimpl &cap = *m_pimpl;
+
+    close();
+    TINE_CHECK(settings.buffer_count > 0, "Capture needs at least one buffer", Error);
+    TINE_CHECK(settings.thread_count > 0 && settings.thread_count <= MAX_CAPTURE_THREADS,
+               "Bad capture thread count", Error);
+    cap.settings = settings;
+    if (cap.settings.directory.empty()) {
+        cap.settings.directory = ".";
+    }
+    cap.is_closing = false;
+    cap.failed = false;
+    cap.written = 0;
+    cap.dropped = 0;
+    // Their storage is sized by the first frame that lands in them
+    cap.free_frames.clear();
+    for (uint32_t i = 0; i < settings.buffer_count; i++) {
+        cap.free_frames.emplace_back(new CaptureFrame());
+    }
+    for (uint32_t i = 0; i < settings.thread_count; i++) {
+        cap.threads.emplace_back(encode_frames, std::ref(cap));
+    }
+    TINE_INFO("Capturing frames to {0}", cap.settings.directory);
+    return true;
+Error:
+    return false;
+}
+
+bool tine::FrameCapture::submit(uint64_t frame, uint32_t width, uint32_t height,
+                                uint32_t row_pitch, CapturePixels pixels, const void *data) {
+    ZoneScoped;
+    Pimpl &cap = *m_pimpl;
+    const size_t row_size = size_t(width) * 4;
+    std::unique_ptr<CaptureFrame> captured;
+    if (!is_open()) {
+        return false;
+    }
+    TINE_CHECK(row_pitch >= row_size && row_size * height <= MAX_CAPTURE_SIZE,
+               "Bad capture size", Error);
+    {
+        std::unique_lock<std::mutex> lock(cap.mutex);
+        if (cap.settings.overflow == CaptureOverflow::BLOCK) {
+            cap.free_cv.wait(lock, [&cap] { return !cap.free_frames.empty(); });
+        }
+        if (cap.free_frames.empty()) {
+            cap.dropped++;
+            return false;
+        }
+        captured = std::move(cap.free_frames.back());
+        cap.free_frames.pop_back();
+    }
+    captured->frame = frame;
+    captured->width = width;
+    captured->height = height;
+    captured->pixels = pixels;
+    captured->data.resize(row_size * height);
+    if (row_pitch == row_size) {
+        memcpy(captured->data.data(), data, captured->data.size());
+    } else {
+        for (uint32_t y = 0; y < height; y++) {
+            memcpy(captured->data.data() + y * row_size,
+                   static_cast<const uint8_t *>(data) + size_t(y) * row_pitch, row_size);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(cap.mutex);
+        cap.pending.push_back(std::move(captured));
+    }
+    cap.pending_cv.notify_one();
+    return true;
+Error:
+    return false;
+}
+
+bool tine::FrameCapture::close() {
+    Pimpl &cap = *m_pimpl;
+    bool ok = false;
+    if (!is_open()) {
+        return true;
+    }
+    {
+        std::lock_guard<std::mutex> lock(cap.mutex);
+        cap.is_closing = true;
+    }
+    cap.pending_cv.notify_all();
+    for (std::thread &thread : cap.threads) {
+        thread.join();
+    }
+    cap.threads.clear();
+    cap.free_frames.clear();
+    ok = !cap.failed;
+    TINE_INFO("Captured {0} frames, dropped {1}", cap.written.load(), cap.dropped.load());
+    if (!ok) {
+        TINE_ERROR("Capture is incomplete");
+    }
+    return ok;
+}
+
+bool tine::FrameCapture::is_open() const {
+    return !m_pimpl->threads.empty();
+}
+
+uint64_t tine::FrameCapture::get_written_count() const {
+    return m_pimpl->written.load();
+}
+
+uint64_t tine::FrameCapture::get_dropped_count() const {
+    return m_pimpl->dropped.load();
+}
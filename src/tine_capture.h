@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace tine {
+
+enum class CaptureEncoding : uint32_t {
+    PNG, // frame_<n>.png, RGB
+    RAW, // frame_<n>.raw, a CaptureRawHeader and the rows as captured
+};
+
+// What submit does once every buffer is queued or being encoded
+enum class CaptureOverflow : uint32_t {
+    DROP,  // Skips the frame, rendering never waits
+    BLOCK, // Waits for an encoder to free a buffer, no frame is lost
+};
+
+// Byte order of the captured texels
+enum class CapturePixels : uint32_t {
+    RGBA8,
+    BGRA8,
+};
+
+struct CaptureSettings {
+    std::string directory; // Must exist
+    CaptureEncoding encoding = CaptureEncoding::PNG;
+    CaptureOverflow overflow = CaptureOverflow::DROP;
+    uint32_t buffer_count = 8;
+    uint32_t thread_count = 2;
+};
+
+struct CaptureRawHeader {
+    char magic[4]; // "TRAW"
+    uint32_t width;
+    uint32_t height;
+    CapturePixels pixels;
+    uint64_t frame;
+};
+
+// Writes rendered frames to an image sequence.  submit only copies the frame into one of a fixed
+// pool of host buffers, encoder threads compress and write them, so rendering never touches the
+// disk.  When the encoders fall behind, the overflow setting either drops frames or holds
+// rendering back until a buffer frees up.
+class FrameCapture {
+  public:
+    struct Pimpl;
+
+    FrameCapture();
+    ~FrameCapture();
+    FrameCapture(const FrameCapture &) = delete;
+
+    bool open(const CaptureSettings &settings);
+    // Rows of width texels are row_pitch bytes apart in data.  false if the frame was dropped.
+    bool submit(uint64_t frame, uint32_t width, uint32_t height, uint32_t row_pitch,
+                CapturePixels pixels, const void *data);
+    // Writes the queued frames, false if any failed to write
+    bool close();
+    bool is_open() const;
+
+    uint64_t get_written_count() const;
+    uint64_t get_dropped_count() const;
+
+  private:
+    std::unique_ptr<Pimpl> m_pimpl;
+};
+
+} // namespace tine
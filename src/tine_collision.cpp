@@ -0,0 +1,892 @@
+#include "tine_collision.h"
+#include "tine_component.h"
+#include "tine_jobs.h"
+#include "tine_mesh.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <tracy/Tracy.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TINE_COLLISION_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// Directions tried when reducing dense meshes, after the 26 of the cube
+static const uint32_t HULL_SPHERE_DIRECTIONS = 512;
+static const uint32_t GJK_MAX_ITERATIONS = 64;
+// Relative improvement below which GJK has found the closest point
+static const float GJK_TOLERANCE = 1e-6f;
+static const uint32_t EPA_MAX_ITERATIONS = 64;
+static const uint32_t EPA_MAX_VERTICES = 64;
+static const uint32_t EPA_MAX_FACES = 128;
+static const float EPA_TOLERANCE = 1e-4f;
+// Pairs per narrowphase job
+static const size_t MIN_PAIRS_PER_JOB = 32;
+
+static glm::vec3 get_hull_vertex(const tine::HullVertexBlock *blocks, uint32_t index) {
+    const tine::HullVertexBlock &block = blocks[index >> 2];
+    return glm::vec3(block.x[index & 3], block.y[index & 3], block.z[index & 3]);
+}
+
+static glm::vec3 get_hull_direction(uint32_t k) {
+    // Faces, edges and corners of the cube first, they find the bounds
+    if (k < 26) {
+        const uint32_t i = k < 13 ? k : k + 1; // Skip the center
+        return glm::normalize(glm::vec3(static_cast<float>(i % 3) - 1.0f,
+                                        static_cast<float>(i / 3 % 3) - 1.0f,
+                                        static_cast<float>(i / 9) - 1.0f));
+    }
+    // Then a Fibonacci sphere
+    const float golden_angle = 2.39996323f;
+    const float t = (static_cast<float>(k - 26) + 0.5f) / HULL_SPHERE_DIRECTIONS;
+    const float y = 1.0f - 2.0f * t;
+    const float r = std::sqrt(std::max(0.0f, 1.0f - y * y));
+    const float phi = golden_angle * static_cast<float>(k - 26);
+    return glm::vec3(r * std::cos(phi), y, r * std::sin(phi));
+}
+
+uint32_t tine::build_convex_hull(CollisionData &data, const Vertex *vertices,
+                                 size_t vertex_count) {
+    std::vector<glm::vec3> points;
+    std::vector<glm::vec3> kept;
+    ConvexHull hull = {};
+
+    points.reserve(vertex_count);
+    for (size_t v = 0; v < vertex_count; v++) {
+        points.push_back(vertices[v].position);
+    }
+    std::sort(points.begin(), points.end(), [](const glm::vec3 &l, const glm::vec3 &r) {
+        return l.x != r.x ? l.x < r.x : l.y != r.y ? l.y < r.y : l.z < r.z;
+    });
+    points.erase(std::unique(points.begin(), points.end()), points.end());
+
+    if (points.size() <= MAX_HULL_VERTICES) {
+        kept = points;
+    } else {
+        std::vector<uint8_t> is_kept(points.size(), 0);
+        for (uint32_t k = 0; k < 26 + HULL_SPHERE_DIRECTIONS && kept.size() < MAX_HULL_VERTICES;
+             k++) {
+            const glm::vec3 direction = get_hull_direction(k);
+            size_t best = 0;
+            float best_dot = -FLT_MAX;
+            for (size_t i = 0; i < points.size(); i++) {
+                const float d = glm::dot(points[i], direction);
+                if (d > best_dot) {
+                    best_dot = d;
+                    best = i;
+                }
+            }
+            if (!is_kept[best]) {
+                is_kept[best] = 1;
+                kept.push_back(points[best]);
+            }
+        }
+    }
+
+    hull.block_offset = static_cast<uint32_t>(data.hull_blocks.size());
+    hull.vertex_count = static_cast<uint32_t>(kept.size());
+    hull.aabb_min = kept.empty() ? glm::vec3(0.0f) : glm::vec3(FLT_MAX);
+    hull.aabb_max = kept.empty() ? glm::vec3(0.0f) : glm::vec3(-FLT_MAX);
+    data.hull_blocks.resize(data.hull_blocks.size() + (kept.size() + 3) / 4);
+    for (size_t i = 0; i < (kept.size() + 3) / 4 * 4; i++) {
+        const glm::vec3 &p = kept[std::min(i, kept.size() - 1)];
+        HullVertexBlock &block = data.hull_blocks[hull.block_offset + i / 4];
+        block.x[i % 4] = p.x;
+        block.y[i % 4] = p.y;
+        block.z[i % 4] = p.z;
+        hull.aabb_min = glm::min(hull.aabb_min, p);
+        hull.aabb_max = glm::max(hull.aabb_max, p);
+    }
+    data.hulls.push_back(hull);
+    return static_cast<uint32_t>(data.hulls.size() - 1);
+}
+
+tine::ConvexShape tine::make_convex_shape(const CollisionData &data, uint32_t hull,
+                                          const glm::mat4 &transform) {
+    ConvexShape shape;
+    shape.blocks = data.hull_blocks.data() + data.hulls[hull].block_offset;
+    shape.vertex_count = data.hulls[hull].vertex_count;
+    shape.transform = transform;
+    return shape;
+}
+
+// Index of the vertex furthest along direction, four at a time
+static uint32_t find_support_index(const tine::HullVertexBlock *blocks, uint32_t vertex_count,
+                                   const glm::vec3 &direction) {
+    const uint32_t block_count = (vertex_count + 3) / 4;
+#ifdef TINE_COLLISION_SSE2
+    const __m128 dx = _mm_set1_ps(direction.x);
+    const __m128 dy = _mm_set1_ps(direction.y);
+    const __m128 dz = _mm_set1_ps(direction.z);
+    const __m128i step = _mm_set1_epi32(4);
+    __m128 best = _mm_set1_ps(-FLT_MAX);
+    __m128i best_index = _mm_setzero_si128();
+    __m128i index = _mm_setr_epi32(0, 1, 2, 3);
+    for (uint32_t b = 0; b < block_count; b++) {
+        const __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_load_ps(blocks[b].x), dx),
+                                               _mm_mul_ps(_mm_load_ps(blocks[b].y), dy)),
+                                    _mm_mul_ps(_mm_load_ps(blocks[b].z), dz));
+        const __m128i greater = _mm_castps_si128(_mm_cmpgt_ps(d, best));
+        best = _mm_max_ps(d, best);
+        best_index = _mm_or_si128(_mm_and_si128(greater, index),
+                                  _mm_andnot_si128(greater, best_index));
+        index = _mm_add_epi32(index, step);
+    }
+    alignas(16) float dots[4];
+    alignas(16) uint32_t indices[4];
+    _mm_store_ps(dots, best);
+    _mm_store_si128(reinterpret_cast<__m128i *>(indices), best_index);
+    uint32_t lane = 0;
+    for (uint32_t l = 1; l < 4; l++) {
+        if (dots[l] > dots[lane]) {
+            lane = l;
+        }
+    }
+    return indices[lane];
+#else
+    uint32_t best_index = 0;
+    float best = -FLT_MAX;
+    for (uint32_t b = 0; b < block_count; b++) {
+        for (uint32_t l = 0; l < 4; l++) {
+            const float d = blocks[b].x[l] * direction.x + blocks[b].y[l] * direction.y +
+                            blocks[b].z[l] * direction.z;
+            if (d > best) {
+                best = d;
+                best_index = b * 4 + l;
+            }
+        }
+    }
+    return best_index;
+#endif
+}
+
+glm::vec3 tine::find_support_point(const ConvexShape &shape, const glm::vec3 &direction) {
+    // The support of a linearly transformed set is the transformed support along the direction
+    // mapped back by the transpose
+    const glm::vec3 local_direction = glm::transpose(glm::mat3(shape.transform)) * direction;
+    const uint32_t index = find_support_index(shape.blocks, shape.vertex_count, local_direction);
+    return glm::vec3(shape.transform * glm::vec4(get_hull_vertex(shape.blocks, index), 1.0f));
+}
+
+// A point of the Minkowski difference a - b and the support points it came from
+struct SimplexVertex {
+    glm::vec3 w;
+    glm::vec3 a;
+    glm::vec3 b;
+};
+
+struct Simplex {
+    SimplexVertex vertices[4];
+    float weights[4]; // Barycentric coordinates of the closest point to the origin
+    uint32_t count;
+};
+
+static SimplexVertex find_minkowski_support(const tine::ConvexShape &a,
+                                            const tine::ConvexShape &b,
+                                            const glm::vec3 &direction) {
+    SimplexVertex v;
+    v.a = tine::find_support_point(a, direction);
+    v.b = tine::find_support_point(b, -direction);
+    v.w = v.a - v.b;
+    return v;
+}
+
+// Keeps only the listed vertices of the simplex, in that order, with their weights
+static void reduce_simplex(Simplex &simplex, uint32_t count, const uint32_t *keep,
+                           const float *weights) {
+    SimplexVertex vertices[4];
+    for (uint32_t i = 0; i < count; i++) {
+        vertices[i] = simplex.vertices[keep[i]];
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        simplex.vertices[i] = vertices[i];
+        simplex.weights[i] = weights[i];
+    }
+    simplex.count = count;
+}
+
+// Closest point of the segment to the origin
+static void solve_segment(Simplex &simplex, uint32_t i0, uint32_t i1) {
+    const glm::vec3 a = simplex.vertices[i0].w;
+    const glm::vec3 ab = simplex.vertices[i1].w - a;
+    const float length2 = glm::dot(ab, ab);
+    const float t = length2 > 0.0f ? -glm::dot(a, ab) / length2 : 0.0f;
+    if (t <= 0.0f) {
+        const uint32_t keep[] = {i0};
+        const float weights[] = {1.0f};
+        reduce_simplex(simplex, 1, keep, weights);
+    } else if (t >= 1.0f) {
+        const uint32_t keep[] = {i1};
+        const float weights[] = {1.0f};
+        reduce_simplex(simplex, 1, keep, weights);
+    } else {
+        const uint32_t keep[] = {i0, i1};
+        const float weights[] = {1.0f - t, t};
+        reduce_simplex(simplex, 2, keep, weights);
+    }
+}
+
+// Closest point of the triangle to the origin by Voronoi regions, see Ericson's Real-Time
+// Collision Detection 5.1.5
+static void solve_triangle(Simplex &simplex, uint32_t i0, uint32_t i1, uint32_t i2) {
+    const glm::vec3 a = simplex.vertices[i0].w;
+    const glm::vec3 b = simplex.vertices[i1].w;
+    const glm::vec3 c = simplex.vertices[i2].w;
+    const glm::vec3 ab = b - a;
+    const glm::vec3 ac = c - a;
+    const float d1 = -glm::dot(ab, a);
+    const float d2 = -glm::dot(ac, a);
+    if (d1 <= 0.0f && d2 <= 0.0f) {
+        const uint32_t keep[] = {i0};
+        const float weights[] = {1.0f};
+        reduce_simplex(simplex, 1, keep, weights);
+        return;
+    }
+    const float d3 = -glm::dot(ab, b);
+    const float d4 = -glm::dot(ac, b);
+    if (d3 >= 0.0f && d4 <= d3) {
+        const uint32_t keep[] = {i1};
+        const float weights[] = {1.0f};
+        reduce_simplex(simplex, 1, keep, weights);
+        return;
+    }
+    const float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+        const float v = d1 / (d1 - d3);
+        const uint32_t keep[] = {i0, i1};
+        const float weights[] = {1.0f - v, v};
+        reduce_simplex(simplex, 2, keep, weights);
+        return;
+    }
+    const float d5 = -glm::dot(ab, c);
+    const float d6 = -glm::dot(ac, c);
+    if (d6 >= 0.0f && d5 <= d6) {
+        const uint32_t keep[] = {i2};
+        const float weights[] = {1.0f};
+        reduce_simplex(simplex, 1, keep, weights);
+        return;
+    }
+    const float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+        const float w = d2 / (d2 - d6);
+        const uint32_t keep[] = {i0, i2};
+        const float weights[] = {1.0f - w, w};
+        reduce_simplex(simplex, 2, keep, weights);
+        return;
+    }
+    const float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f) {
+        const float w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+        const uint32_t keep[] = {i1, i2};
+        const float weights[] = {1.0f - w, w};
+        reduce_simplex(simplex, 2, keep, weights);
+        return;
+    }
+    const float denom = 1.0f / (va + vb + vc);
+    const float v = vb * denom;
+    const float w = vc * denom;
+    const uint32_t keep[] = {i0, i1, i2};
+    const float weights[] = {1.0f - v - w, v, w};
+    reduce_simplex(simplex, 3, keep, weights);
+}
+
+static glm::vec3 get_simplex_point(const Simplex &simplex) {
+    glm::vec3 p(0.0f);
+    for (uint32_t i = 0; i < simplex.count; i++) {
+        p += simplex.weights[i] * simplex.vertices[i].w;
+    }
+    return p;
+}
+
+// Whether the origin and the opposite vertex d lie on different sides of the face abc.  Flat
+// tetrahedra count every face as facing the origin.
+static bool is_origin_outside_face(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c,
+                                   const glm::vec3 &d) {
+    const glm::vec3 n = glm::cross(b - a, c - a);
+    const float side_origin = -glm::dot(a, n);
+    const float side_d = glm::dot(d - a, n);
+    return side_d * side_d <= 1e-12f * glm::dot(n, n) || side_origin * side_d < 0.0f;
+}
+
+// Reduces the simplex to the smallest one holding its closest point to the origin and returns
+// that point.  A tetrahedron is left whole if it contains the origin.
+static glm::vec3 solve_simplex(Simplex &simplex) {
+    switch (simplex.count) {
+    case 1:
+        simplex.weights[0] = 1.0f;
+        break;
+    case 2:
+        solve_segment(simplex, 0, 1);
+        break;
+    case 3:
+        solve_triangle(simplex, 0, 1, 2);
+        break;
+    case 4: {
+        static const uint32_t faces[4][4] = {{0, 1, 2, 3}, {0, 3, 1, 2}, {0, 2, 3, 1},
+                                             {1, 3, 2, 0}};
+        Simplex best = simplex;
+        float best_distance = FLT_MAX;
+        bool is_inside = true;
+        for (const uint32_t *face : faces) {
+            if (!is_origin_outside_face(simplex.vertices[face[0]].w, simplex.vertices[face[1]].w,
+                                        simplex.vertices[face[2]].w,
+                                        simplex.vertices[face[3]].w)) {
+                continue;
+            }
+            is_inside = false;
+            Simplex candidate = simplex;
+            solve_triangle(candidate, face[0], face[1], face[2]);
+            const glm::vec3 p = get_simplex_point(candidate);
+            if (glm::dot(p, p) < best_distance) {
+                best_distance = glm::dot(p, p);
+                best = candidate;
+            }
+        }
+        if (is_inside) {
+            return glm::vec3(0.0f);
+        }
+        simplex = best;
+        break;
+    }
+    default:
+        break;
+    }
+    return get_simplex_point(simplex);
+}
+
+// GJK, returns the squared distance between the shapes and leaves the simplex around the
+// closest point of the Minkowski difference.  Stops early once a separating plane puts the
+// shapes further than max_distance apart.
+static float run_gjk(const tine::ConvexShape &a, const tine::ConvexShape &b, float max_distance,
+                     Simplex &simplex) {
+    simplex.count = 1;
+    simplex.vertices[0] = find_minkowski_support(a, b, glm::vec3(1.0f, 0.0f, 0.0f));
+    simplex.weights[0] = 1.0f;
+    glm::vec3 v = simplex.vertices[0].w;
+    for (uint32_t iteration = 0; iteration < GJK_MAX_ITERATIONS; iteration++) {
+        const float distance2 = glm::dot(v, v);
+        if (distance2 <= GJK_TOLERANCE * GJK_TOLERANCE) {
+            return 0.0f;
+        }
+        const SimplexVertex w = find_minkowski_support(a, b, -v);
+        const float vw = glm::dot(v, w.w);
+        if (vw > 0.0f && vw * vw > max_distance * max_distance * distance2) {
+            return vw * vw / distance2;
+        }
+        if (distance2 - vw <= GJK_TOLERANCE * distance2) {
+            return distance2;
+        }
+        for (uint32_t i = 0; i < simplex.count; i++) {
+            if (simplex.vertices[i].w == w.w) {
+                return distance2;
+            }
+        }
+        simplex.vertices[simplex.count++] = w;
+        v = solve_simplex(simplex);
+        if (simplex.count == 4) {
+            return 0.0f;
+        }
+    }
+    return glm::dot(v, v);
+}
+
+struct EpaFace {
+    uint32_t v[3];
+    glm::vec3 normal; // Outwards
+    float distance;   // Of the plane from the origin
+};
+
+static bool make_epa_face(const SimplexVertex *vertices, uint32_t i0, uint32_t i1, uint32_t i2,
+                          const glm::vec3 &inside, EpaFace &face) {
+    const glm::vec3 &a = vertices[i0].w;
+    glm::vec3 n = glm::cross(vertices[i1].w - a, vertices[i2].w - a);
+    const float length2 = glm::dot(n, n);
+    face.v[0] = i0;
+    face.v[1] = i1;
+    face.v[2] = i2;
+    if (length2 < 1e-12f) {
+        return false;
+    }
+    n /= std::sqrt(length2);
+    // Only the starting tetrahedron needs its winding fixed, new faces inherit the horizon's
+    if (glm::dot(n, inside - a) > 0.0f) {
+        std::swap(face.v[1], face.v[2]);
+        n = -n;
+    }
+    face.normal = n;
+    face.distance = glm::dot(n, a);
+    return true;
+}
+
+// Grows a simplex touching the origin into a tetrahedron, false if the difference is flat
+static bool expand_simplex(const tine::ConvexShape &a, const tine::ConvexShape &b,
+                           Simplex &simplex) {
+    static const glm::vec3 axes[] = {{1.0f, 0.0f, 0.0f}, {-1.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f},
+                                     {0.0f, -1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, 0.0f, -1.0f}};
+    if (simplex.count == 1) {
+        for (const glm::vec3 &axis : axes) {
+            const SimplexVertex w = find_minkowski_support(a, b, axis);
+            if (glm::length(w.w - simplex.vertices[0].w) > EPA_TOLERANCE) {
+                simplex.vertices[simplex.count++] = w;
+                break;
+            }
+        }
+    }
+    if (simplex.count == 2) {
+        const glm::vec3 d = simplex.vertices[1].w - simplex.vertices[0].w;
+        const glm::vec3 axis = std::abs(d.x) < std::abs(d.y)
+                                   ? (std::abs(d.x) < std::abs(d.z) ? axes[0] : axes[4])
+                                   : (std::abs(d.y) < std::abs(d.z) ? axes[2] : axes[4]);
+        const glm::vec3 perpendicular = glm::cross(d, axis);
+        const glm::vec3 directions[] = {perpendicular, -perpendicular, glm::cross(d, perpendicular),
+                                        -glm::cross(d, perpendicular)};
+        for (const glm::vec3 &direction : directions) {
+            const SimplexVertex w = find_minkowski_support(a, b, direction);
+            const glm::vec3 offset = glm::cross(d, w.w - simplex.vertices[0].w);
+            if (glm::dot(offset, offset) > EPA_TOLERANCE * EPA_TOLERANCE * glm::dot(d, d)) {
+                simplex.vertices[simplex.count++] = w;
+                break;
+            }
+        }
+    }
+    if (simplex.count == 3) {
+        const glm::vec3 n = glm::normalize(
+            glm::cross(simplex.vertices[1].w - simplex.vertices[0].w,
+                       simplex.vertices[2].w - simplex.vertices[0].w));
+        for (const glm::vec3 &direction : {n, -n}) {
+            const SimplexVertex w = find_minkowski_support(a, b, direction);
+            if (std::abs(glm::dot(w.w - simplex.vertices[0].w, n)) > EPA_TOLERANCE) {
+                simplex.vertices[simplex.count++] = w;
+                break;
+            }
+        }
+    }
+    return simplex.count == 4;
+}
+
+// Expanding polytope algorithm, finds the face of the Minkowski difference nearest the origin
+static bool run_epa(const tine::ConvexShape &a, const tine::ConvexShape &b, Simplex &simplex,
+                    tine::ContactResult &contact) {
+    SimplexVertex vertices[EPA_MAX_VERTICES];
+    EpaFace faces[EPA_MAX_FACES];
+    uint32_t edges[EPA_MAX_FACES * 3][2];
+    uint32_t vertex_count = 4;
+    uint32_t face_count = 0;
+    uint32_t closest = 0;
+
+    if (!expand_simplex(a, b, simplex)) {
+        return false;
+    }
+    const glm::vec3 inside = 0.25f * (simplex.vertices[0].w + simplex.vertices[1].w +
+                                      simplex.vertices[2].w + simplex.vertices[3].w);
+    std::copy(simplex.vertices, simplex.vertices + 4, vertices);
+    {
+        static const uint32_t tetrahedron[4][3] = {{0, 1, 2}, {0, 3, 1}, {0, 2, 3}, {1, 3, 2}};
+        for (const uint32_t *f : tetrahedron) {
+            if (!make_epa_face(vertices, f[0], f[1], f[2], inside, faces[face_count++])) {
+                return false;
+            }
+        }
+    }
+
+    for (uint32_t iteration = 0; iteration < EPA_MAX_ITERATIONS; iteration++) {
+        closest = 0;
+        for (uint32_t f = 1; f < face_count; f++) {
+            if (faces[f].distance < faces[closest].distance) {
+                closest = f;
+            }
+        }
+        const EpaFace face = faces[closest];
+        const SimplexVertex w = find_minkowski_support(a, b, face.normal);
+        if (glm::dot(w.w, face.normal) - face.distance < EPA_TOLERANCE ||
+            vertex_count == EPA_MAX_VERTICES) {
+            break;
+        }
+        const uint32_t wi = vertex_count++;
+        vertices[wi] = w;
+
+        // Remove the faces the new vertex sees and patch the hole with faces to its horizon
+        uint32_t edge_count = 0;
+        for (uint32_t f = 0; f < face_count;) {
+            if (glm::dot(faces[f].normal, w.w - vertices[faces[f].v[0]].w) <= 0.0f) {
+                f++;
+                continue;
+            }
+            for (uint32_t e = 0; e < 3; e++) {
+                const uint32_t e0 = faces[f].v[e];
+                const uint32_t e1 = faces[f].v[(e + 1) % 3];
+                bool is_shared = false;
+                for (uint32_t i = 0; i < edge_count; i++) {
+                    if (edges[i][0] == e1 && edges[i][1] == e0) {
+                        edges[i][0] = edges[edge_count - 1][0];
+                        edges[i][1] = edges[edge_count - 1][1];
+                        edge_count--;
+                        is_shared = true;
+                        break;
+                    }
+                }
+                if (!is_shared) {
+                    edges[edge_count][0] = e0;
+                    edges[edge_count][1] = e1;
+                    edge_count++;
+                }
+            }
+            faces[f] = faces[--face_count];
+        }
+        if (face_count + edge_count > EPA_MAX_FACES) {
+            break;
+        }
+        for (uint32_t i = 0; i < edge_count; i++) {
+            EpaFace &new_face = faces[face_count];
+            if (make_epa_face(vertices, edges[i][0], edges[i][1], wi, inside, new_face)) {
+                face_count++;
+            }
+        }
+        if (face_count == 0) {
+            return false;
+        }
+    }
+    // Running out of room may have left the polytope changed since the last search
+    closest = 0;
+    for (uint32_t f = 1; f < face_count; f++) {
+        if (faces[f].distance < faces[closest].distance) {
+            closest = f;
+        }
+    }
+
+    // The witness points are the support points weighted by where the origin projects onto the
+    // closest face
+    const EpaFace &face = faces[closest];
+    const glm::vec3 p = face.normal * face.distance;
+    const glm::vec3 v0 = vertices[face.v[1]].w - vertices[face.v[0]].w;
+    const glm::vec3 v1 = vertices[face.v[2]].w - vertices[face.v[0]].w;
+    const glm::vec3 v2 = p - vertices[face.v[0]].w;
+    const float d00 = glm::dot(v0, v0);
+    const float d01 = glm::dot(v0, v1);
+    const float d11 = glm::dot(v1, v1);
+    const float d20 = glm::dot(v2, v0);
+    const float d21 = glm::dot(v2, v1);
+    const float denom = d00 * d11 - d01 * d01;
+    if (denom <= 0.0f) {
+        return false;
+    }
+    const float v = (d11 * d20 - d01 * d21) / denom;
+    const float w = (d00 * d21 - d01 * d20) / denom;
+    const float u = 1.0f - v - w;
+    contact.normal = face.normal;
+    contact.depth = face.distance;
+    contact.point_a = u * vertices[face.v[0]].a + v * vertices[face.v[1]].a +
+                      w * vertices[face.v[2]].a;
+    contact.point_b = u * vertices[face.v[0]].b + v * vertices[face.v[1]].b +
+                      w * vertices[face.v[2]].b;
+    return true;
+}
+
+bool tine::collide_convex(const ConvexShape &a, const ConvexShape &b, float max_distance,
+                          ContactResult &contact) {
+    Simplex simplex;
+    const float distance2 = run_gjk(a, b, max_distance, simplex);
+    if (distance2 > max_distance * max_distance) {
+        return false;
+    }
+    if (distance2 > GJK_TOLERANCE * GJK_TOLERANCE) {
+        // Separated, but close enough to keep as a speculative contact
+        contact.point_a = glm::vec3(0.0f);
+        contact.point_b = glm::vec3(0.0f);
+        for (uint32_t i = 0; i < simplex.count; i++) {
+            contact.point_a += simplex.weights[i] * simplex.vertices[i].a;
+            contact.point_b += simplex.weights[i] * simplex.vertices[i].b;
+        }
+        const float distance = std::sqrt(distance2);
+        contact.normal = (contact.point_b - contact.point_a) / distance;
+        contact.depth = -distance;
+        return true;
+    }
+    return run_epa(a, b, simplex, contact);
+}
+
+float tine::find_convex_distance(const ConvexShape &a, const ConvexShape &b, glm::vec3 &point_a,
+                                 glm::vec3 &point_b) {
+    Simplex simplex;
+    const float distance2 = run_gjk(a, b, FLT_MAX, simplex);
+    point_a = glm::vec3(0.0f);
+    point_b = glm::vec3(0.0f);
+    for (uint32_t i = 0; i < simplex.count; i++) {
+        point_a += simplex.weights[i] * simplex.vertices[i].a;
+        point_b += simplex.weights[i] * simplex.vertices[i].b;
+    }
+    return std::sqrt(distance2);
+}
+
+struct ColliderProxy {
+    glm::vec3 aabb_min;
+    glm::vec3 aabb_max;
+    entt::entity entity;
+    uint32_t env;
+    uint32_t hull;
+    bool is_active; // Awake rigid body, pairs of inactive colliders are skipped
+    glm::mat4 transform;
+};
+
+struct ColliderPair {
+    uint32_t a; // Into the proxies, a's entity is the lower one
+    uint32_t b;
+};
+
+// Finds a pair's manifold of the last step
+struct ManifoldKey {
+    uint64_t key;
+    uint32_t index; // Into Pimpl::manifolds
+};
+
+// Everything is kept across steps and only cleared, so a steady scene doesn't allocate
+struct tine::CollisionWorld::Pimpl {
+    std::vector<ColliderProxy> proxies;
+    std::vector<ColliderPair> pairs;
+    std::vector<tine::ContactManifold> manifolds;
+    std::vector<tine::ContactManifold> next_manifolds; // Built by update
+    std::vector<ManifoldKey> manifold_keys;            // Sorted by key
+    size_t active_cnt = 0;
+};
+
+tine::CollisionWorld::CollisionWorld() : m_pimpl(new Pimpl) {}
+tine::CollisionWorld::~CollisionWorld() {}
+
+std::vector<tine::ContactManifold> &tine::CollisionWorld::get_manifolds() {
+    return m_pimpl->manifolds;
+}
+
+void tine::CollisionWorld::clear() {
+    m_pimpl->manifolds.clear();
+    m_pimpl->manifold_keys.clear();
+}
+
+static uint64_t pair_key(entt::entity a, entt::entity b) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(a)) << 32) | static_cast<uint32_t>(b);
+}
+
+static bool is_awake(entt::registry &registry, entt::entity entity) {
+    const tine::RigidBodyComponent *body = registry.try_get<tine::RigidBodyComponent>(entity);
+    return body != nullptr && body->inverse_mass > 0.0f && !body->is_sleeping;
+}
+
+static bool is_sleeping(entt::registry &registry, entt::entity entity) {
+    const tine::RigidBodyComponent *body = registry.try_get<tine::RigidBodyComponent>(entity);
+    return body != nullptr && body->is_sleeping;
+}
+
+static void gather_proxies(tine::CollisionWorld::Pimpl &p, const tine::CollisionData &data,
+                           entt::registry &registry) {
+    p.proxies.clear();
+    p.active_cnt = 0;
+    auto view = registry.view<const tine::TransformComponent, const tine::ColliderComponent>();
+    for (entt::entity entity : view) {
+        const uint32_t hull = view.get<const tine::ColliderComponent>(entity).hull;
+        if (hull >= data.hulls.size() || data.hulls[hull].vertex_count == 0) {
+            continue;
+        }
+        const tine::EnvironmentComponent *env =
+            registry.try_get<tine::EnvironmentComponent>(entity);
+        ColliderProxy proxy;
+        proxy.entity = entity;
+        proxy.env = env != nullptr ? env->env : 0;
+        proxy.hull = hull;
+        proxy.is_active = is_awake(registry, entity);
+        p.active_cnt += proxy.is_active ? 1 : 0;
+        proxy.transform = view.get<const tine::TransformComponent>(entity).transform;
+        // Bounds of the transformed box, grown so that resting pairs stay pairs
+        const glm::vec3 center = 0.5f * (data.hulls[hull].aabb_min + data.hulls[hull].aabb_max);
+        const glm::vec3 extent = 0.5f * (data.hulls[hull].aabb_max - data.hulls[hull].aabb_min);
+        const glm::mat3 m(proxy.transform);
+        const glm::mat3 abs_m(glm::abs(m[0]), glm::abs(m[1]), glm::abs(m[2]));
+        const glm::vec3 world_center = glm::vec3(proxy.transform * glm::vec4(center, 1.0f));
+        const glm::vec3 world_extent = abs_m * extent + glm::vec3(tine::CONTACT_BREAKING_THRESHOLD);
+        proxy.aabb_min = world_center - world_extent;
+        proxy.aabb_max = world_center + world_extent;
+        p.proxies.push_back(proxy);
+    }
+}
+
+// Sweep and prune along x
+static void find_pairs(tine::CollisionWorld::Pimpl &p) {
+    ZoneScoped;
+    std::sort(p.proxies.begin(), p.proxies.end(),
+              [](const ColliderProxy &l, const ColliderProxy &r) {
+                  return l.aabb_min.x != r.aabb_min.x ? l.aabb_min.x < r.aabb_min.x
+                                                      : l.entity < r.entity;
+              });
+    p.pairs.clear();
+    for (uint32_t i = 0; i < p.proxies.size(); i++) {
+        const ColliderProxy &a = p.proxies[i];
+        for (uint32_t j = i + 1; j < p.proxies.size(); j++) {
+            const ColliderProxy &b = p.proxies[j];
+            if (b.aabb_min.x > a.aabb_max.x) {
+                break;
+            }
+            if ((!a.is_active && !b.is_active) || a.env != b.env ||
+                a.aabb_max.y < b.aabb_min.y || b.aabb_max.y < a.aabb_min.y ||
+                a.aabb_max.z < b.aabb_min.z || b.aabb_max.z < a.aabb_min.z) {
+                continue;
+            }
+            p.pairs.push_back(a.entity < b.entity ? ColliderPair{i, j} : ColliderPair{j, i});
+        }
+    }
+}
+
+// Drops the points the shapes have moved apart or slid away from
+static void refresh_manifold(tine::ContactManifold &manifold, const glm::mat4 &transform_a,
+                             const glm::mat4 &transform_b) {
+    const float threshold2 = tine::CONTACT_BREAKING_THRESHOLD * tine::CONTACT_BREAKING_THRESHOLD;
+    for (uint32_t i = 0; i < manifold.point_count;) {
+        tine::ContactPoint &point = manifold.points[i];
+        point.position_a = glm::vec3(transform_a * glm::vec4(point.local_a, 1.0f));
+        point.position_b = glm::vec3(transform_b * glm::vec4(point.local_b, 1.0f));
+        point.depth = glm::dot(point.position_a - point.position_b, manifold.normal);
+        const glm::vec3 drift = point.position_a - manifold.normal * point.depth - point.position_b;
+        if (point.depth < -tine::CONTACT_BREAKING_THRESHOLD ||
+            glm::dot(drift, drift) > threshold2) {
+            manifold.points[i] = manifold.points[--manifold.point_count];
+        } else {
+            i++;
+        }
+    }
+}
+
+// Of five points keeps the deepest and the four spanning the largest area
+static void reduce_manifold(tine::ContactPoint *points) {
+    uint32_t deepest = 0;
+    for (uint32_t i = 1; i < tine::MAX_MANIFOLD_POINTS + 1; i++) {
+        if (points[i].depth > points[deepest].depth) {
+            deepest = i;
+        }
+    }
+    uint32_t drop = tine::MAX_MANIFOLD_POINTS;
+    float best_area = -1.0f;
+    for (uint32_t r = 0; r < tine::MAX_MANIFOLD_POINTS + 1; r++) {
+        if (r == deepest) {
+            continue;
+        }
+        glm::vec3 p[4];
+        for (uint32_t i = 0, n = 0; i < tine::MAX_MANIFOLD_POINTS + 1; i++) {
+            if (i != r) {
+                p[n++] = points[i].position_a;
+            }
+        }
+        // Whichever pairing of the points makes the diagonals
+        const float area = std::max(
+            {glm::length(glm::cross(p[0] - p[1], p[2] - p[3])),
+             glm::length(glm::cross(p[0] - p[2], p[1] - p[3])),
+             glm::length(glm::cross(p[0] - p[3], p[1] - p[2]))});
+        if (area > best_area) {
+            best_area = area;
+            drop = r;
+        }
+    }
+    points[drop] = points[tine::MAX_MANIFOLD_POINTS];
+}
+
+static void update_manifold(tine::ContactManifold &manifold, const tine::CollisionData &data,
+                            const ColliderProxy &a, const ColliderProxy &b) {
+    const tine::ConvexShape shape_a = tine::make_convex_shape(data, a.hull, a.transform);
+    const tine::ConvexShape shape_b = tine::make_convex_shape(data, b.hull, b.transform);
+    tine::ContactResult contact;
+    const float threshold2 = tine::CONTACT_BREAKING_THRESHOLD * tine::CONTACT_BREAKING_THRESHOLD;
+
+    if (!tine::collide_convex(shape_a, shape_b, tine::CONTACT_BREAKING_THRESHOLD, contact)) {
+        manifold.point_count = 0;
+        return;
+    }
+    manifold.normal = contact.normal;
+    refresh_manifold(manifold, a.transform, b.transform);
+
+    tine::ContactPoint point = {};
+    point.local_a = glm::vec3(glm::inverse(a.transform) * glm::vec4(contact.point_a, 1.0f));
+    point.local_b = glm::vec3(glm::inverse(b.transform) * glm::vec4(contact.point_b, 1.0f));
+    point.position_a = contact.point_a;
+    point.position_b = contact.point_b;
+    point.depth = contact.depth;
+    // A point close to an existing one replaces it and inherits its impulses
+    for (uint32_t i = 0; i < manifold.point_count; i++) {
+        const glm::vec3 offset = manifold.points[i].local_a - point.local_a;
+        if (glm::dot(offset, offset) < threshold2) {
+            point.normal_impulse = manifold.points[i].normal_impulse;
+            point.tangent_impulse[0] = manifold.points[i].tangent_impulse[0];
+            point.tangent_impulse[1] = manifold.points[i].tangent_impulse[1];
+            manifold.points[i] = point;
+            return;
+        }
+    }
+    if (manifold.point_count < tine::MAX_MANIFOLD_POINTS) {
+        manifold.points[manifold.point_count++] = point;
+        return;
+    }
+    tine::ContactPoint points[tine::MAX_MANIFOLD_POINTS + 1];
+    std::copy(manifold.points, manifold.points + tine::MAX_MANIFOLD_POINTS, points);
+    points[tine::MAX_MANIFOLD_POINTS] = point;
+    reduce_manifold(points);
+    std::copy(points, points + tine::MAX_MANIFOLD_POINTS, manifold.points);
+}
+
+void tine::CollisionWorld::update(const CollisionData &data, entt::registry &registry,
+                                  JobSystem *jobs) {
+    ZoneScoped;
+    Pimpl &p = *m_pimpl;
+    std::vector<ContactManifold> &manifolds = p.next_manifolds;
+
+    gather_proxies(p, data, registry);
+    p.pairs.clear();
+    if (p.active_cnt > 0) {
+        find_pairs(p);
+    }
+
+    // Manifolds carry over by pair, looked up here so the narrowphase jobs never touch the map
+    manifolds.resize(p.pairs.size());
+    for (size_t i = 0; i < p.pairs.size(); i++) {
+        const entt::entity a = p.proxies[p.pairs[i].a].entity;
+        const entt::entity b = p.proxies[p.pairs[i].b].entity;
+        const uint64_t key = pair_key(a, b);
+        auto it = std::lower_bound(
+            p.manifold_keys.begin(), p.manifold_keys.end(), key,
+            [](const ManifoldKey &entry, uint64_t value) { return entry.key < value; });
+        if (it != p.manifold_keys.end() && it->key == key) {
+            manifolds[i] = p.manifolds[it->index];
+        } else {
+            manifolds[i] = {};
+            manifolds[i].a = a;
+            manifolds[i].b = b;
+        }
+    }
+
+    auto narrowphase = [&p, &data, &manifolds](size_t begin, size_t end, size_t) {
+        ZoneScopedN("Narrowphase");
+        for (size_t i = begin; i < end; i++) {
+            update_manifold(manifolds[i], data, p.proxies[p.pairs[i].a], p.proxies[p.pairs[i].b]);
+        }
+    };
+    if (jobs != nullptr) {
+        jobs->parallel_for("Narrowphase", p.pairs.size(), MIN_PAIRS_PER_JOB, narrowphase);
+    } else {
+        narrowphase(0, p.pairs.size(), 0);
+    }
+
+    // Nothing moves a sleeping pair, so its manifold stays as it was for when it wakes up
+    for (const ContactManifold &manifold : p.manifolds) {
+        if (registry.valid(manifold.a) && registry.valid(manifold.b) &&
+            !is_awake(registry, manifold.a) && !is_awake(registry, manifold.b) &&
+            (is_sleeping(registry, manifold.a) || is_sleeping(registry, manifold.b))) {
+            manifolds.push_back(manifold);
+        }
+    }
+    p.manifolds.clear();
+    p.manifold_keys.clear();
+    for (const ContactManifold &manifold : manifolds) {
+        if (manifold.point_count > 0) {
+            p.manifold_keys.push_back({pair_key(manifold.a, manifold.b),
+                                       static_cast<uint32_t>(p.manifolds.size())});
+            p.manifolds.push_back(manifold);
+        }
+    }
+    std::sort(p.manifold_keys.begin(), p.manifold_keys.end(),
+              [](const ManifoldKey &a, const ManifoldKey &b) { return a.key < b.key; });
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <glm/glm.hpp>
+#include <entt/entt.hpp>
+
+namespace tine {
+
+class JobSystem;
+struct Vertex;
+
+// Denser meshes keep their most extreme vertices only
+static const uint32_t MAX_HULL_VERTICES = 64;
+static const uint32_t MAX_MANIFOLD_POINTS = 4;
+// Contacts separated by more than this, or slid apart by more, are dropped from their manifold
+static const float CONTACT_BREAKING_THRESHOLD = 0.02f;
+
+// Four hull vertices laid out for a single SIMD dot product per axis.  The last block of a hull
+// repeats its final vertex into the unused lanes.
+struct alignas(16) HullVertexBlock {
+    float x[4];
+    float y[4];
+    float z[4];
+};
+
+// Convex hull of a mesh in mesh space.  Only the vertices are kept, GJK and EPA never need more
+// than the furthest point along a direction.
+struct ConvexHull {
+    uint32_t block_offset; // Into CollisionData::hull_blocks
+    uint32_t vertex_count;
+    glm::vec3 aabb_min;
+    glm::vec3 aabb_max;
+};
+
+// Collision geometry of a scene, the hull of each imported mesh at the mesh's index.
+struct CollisionData {
+    std::vector<ConvexHull> hulls;
+    std::vector<HullVertexBlock> hull_blocks;
+};
+
+// Appends the hull of the vertices to data and returns its index.  Past MAX_HULL_VERTICES the
+// points furthest along directions spread over the sphere are kept, which slightly shrinks the
+// hull of very dense meshes.
+uint32_t build_convex_hull(CollisionData &data, const Vertex *vertices, size_t vertex_count);
+
+// A hull placed in the world by an affine transform
+struct ConvexShape {
+    const HullVertexBlock *blocks;
+    uint32_t vertex_count;
+    glm::mat4 transform;
+};
+
+ConvexShape make_convex_shape(const CollisionData &data, uint32_t hull,
+                              const glm::mat4 &transform);
+// Furthest point of the shape along direction, in world space
+glm::vec3 find_support_point(const ConvexShape &shape, const glm::vec3 &direction);
+
+// Deepest points of two overlapping shapes, or closest points of two separated ones
+struct ContactResult {
+    glm::vec3 normal; // From a towards b
+    float depth;      // Negative if separated
+    glm::vec3 point_a;
+    glm::vec3 point_b;
+};
+
+// GJK distance between the shapes, then EPA for the penetration if they overlap.  Returns false
+// when they're further than max_distance apart, contact is left untouched then.
+bool collide_convex(const ConvexShape &a, const ConvexShape &b, float max_distance,
+                    ContactResult &contact);
+
+// GJK closest points of the shapes, returns their distance.  0 if they overlap, the points mean
+// nothing then.
+float find_convex_distance(const ConvexShape &a, const ConvexShape &b, glm::vec3 &point_a,
+                           glm::vec3 &point_b);
+
+struct ContactPoint {
+    // Witness points in the space of each shape, so the point follows both shapes between updates
+    glm::vec3 local_a;
+    glm::vec3 local_b;
+    glm::vec3 position_a;
+    glm::vec3 position_b;
+    float depth; // Along the manifold normal, negative if separated
+    // Accumulated by the solver and carried over for warm starting
+    float normal_impulse;
+    float tangent_impulse[2];
+};
+
+// Contacts of a touching pair of colliders, kept across updates while they stay close.  a is
+// always the lower entity.
+struct ContactManifold {
+    entt::entity a;
+    entt::entity b;
+    glm::vec3 normal; // From a towards b
+    uint32_t point_count;
+    ContactPoint points[MAX_MANIFOLD_POINTS];
+};
+
+// Finds the ColliderComponents whose bounds overlap with sweep and prune, then runs the
+// narrowphase over the pairs in parallel batches.  Each update adds at most one new point per pair
+// and refreshes the ones it already had, so a resting pair builds up a stable manifold over a few
+// updates.  Only pairs with an awake RigidBodyComponent are tested, sleeping pairs keep their
+// manifolds untouched and static clutter is never paired with itself.  Colliders of different
+// environments never collide.
+class CollisionWorld {
+  public:
+    struct Pimpl;
+
+    CollisionWorld();
+    ~CollisionWorld();
+    CollisionWorld(const CollisionWorld &) = delete;
+
+    // Fans the pairs out over jobs if given
+    void update(const CollisionData &data, entt::registry &registry, JobSystem *jobs = nullptr);
+    // Touching pairs of the last update, the tested ones ordered by their bounds along x
+    std::vector<ContactManifold> &get_manifolds();
+    // Forgets every manifold, when the colliders were moved by anything but simulation
+    void clear();
+
+  private:
+    std::unique_ptr<Pimpl> m_pimpl;
+};
+
+} // namespace tine
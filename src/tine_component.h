@@ -9,6 +9,12 @@ namespace tine {
 #define CHECK_COMPONENT_POD(Component)                                                             \
     static_assert(std::is_pod<Component>::value, #Component "must be pod type")
 
+// Which of the scene's isolated copies the entity belongs to, see Scene::create_environments
+struct EnvironmentComponent {
+    uint32_t env;
+};
+CHECK_COMPONENT_POD(EnvironmentComponent);
+
 struct TransformComponent {
     glm::mat4 transform;
 };
@@ -17,6 +23,9 @@ CHECK_COMPONENT_POD(TransformComponent);
 struct CameraComponent {
     glm::mat4 projection_matrix;
     glm::mat4 view_matrix;
+    // Each step up doubles the screen space error tolerated when picking mesh LODs, so sensor
+    // cameras that don't need the detail can render far fewer triangles
+    float lod_bias;
     void set_orthographic(float left, float right, float bottom, float top, float z_near,
                           float z_far) {
         projection_matrix = glm::ortho(left, right, bottom, top, z_near, z_far);
@@ -30,12 +39,62 @@ struct CameraComponent {
 };
 CHECK_COMPONENT_POD(CameraComponent);
 
-// TODO
-struct MeshComponent {};
+struct MeshComponent {
+    uint32_t mesh; // Index into MeshData::meshes
+};
 CHECK_COMPONENT_POD(MeshComponent);
 
-// TODO
-struct MaterialComponent {};
+struct MaterialComponent {
+    uint32_t material; // Index of the imported material
+};
 CHECK_COMPONENT_POD(MaterialComponent);
 
-} // namespace tine
\ No newline at end of file
+// Skinned instance, the MeshComponent of the entity holds the deformed output vertices
+struct SkinComponent {
+    uint32_t skin;           // Index into AnimationData::skins
+    uint32_t palette_offset; // First joint matrix in AnimationData::joint_palette
+    glm::mat4 inverse_mesh_transform;
+};
+CHECK_COMPONENT_POD(SkinComponent);
+
+struct AnimationComponent {
+    uint32_t clip; // Index into AnimationData::clips
+    float time;
+    float speed;
+};
+CHECK_COMPONENT_POD(AnimationComponent);
+
+// Collides as a convex hull placed by the entity's TransformComponent, see CollisionWorld
+struct ColliderComponent {
+    uint32_t hull; // Index into CollisionData::hulls
+};
+CHECK_COMPONENT_POD(ColliderComponent);
+
+// Simulated by PhysicsWorld, see make_rigid_body.  Colliders without one are static.
+struct RigidBodyComponent {
+    glm::vec3 linear_velocity;
+    glm::vec3 angular_velocity;
+    glm::vec3 local_center;    // Center of mass in mesh space
+    glm::vec3 inverse_inertia; // Diagonal, about the scale free axes of the transform
+    float inverse_mass;        // 0 for bodies only moved by hand
+    float friction;
+    float sleep_time;     // Seconds spent below the sleep thresholds
+    uint32_t is_sleeping; // Clear to wake the body after moving it by hand
+};
+CHECK_COMPONENT_POD(RigidBodyComponent);
+
+// Keeps the world cells around the entity loaded, see WorldStreamer
+struct StreamingAnchorComponent {
+    float radius; // Load radius, the streamer's own if smaller
+};
+CHECK_COMPONENT_POD(StreamingAnchorComponent);
+
+// Every component that is per environment simulation state, cloned into new environments and
+// captured by RegistrySnapshot.  New components must be added here.
+#define SIMULATION_COMPONENTS                                                                      \
+    tine::EnvironmentComponent, tine::TransformComponent, tine::CameraComponent,                  \
+        tine::MeshComponent, tine::MaterialComponent, tine::SkinComponent,                         \
+        tine::AnimationComponent, tine::StreamingAnchorComponent, tine::ColliderComponent,         \
+        tine::RigidBodyComponent
+
+} // namespace tine
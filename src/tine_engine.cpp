@@ -1,43 +1,408 @@
 #include "tine_log.h"
 #include "tine_engine.h"
+#include "tine_capture.h"
+#include "tine_jobs.h"
+#include "tine_mailbox.h"
+#include "tine_observation.h"
+#include "tine_recording.h"
 #include "tine_renderer.h"
 #include "tine_scene.h"
+#include "tine_shm.h"
+#include "tine_snapshot.h"
+#include "tine_world.h"
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <tracy/Tracy.hpp>
 
-tine::Engine::Engine() : m_renderer(new tine::Renderer(this)) {}
+// Lets a consumer fall a few steps behind before it misses poses
+static const uint32_t SHM_POSE_SLOTS = 8;
+// Step of the headless loop, which runs as fast as it can rather than in real time
+static const double HEADLESS_DT = 1.0 / 60.0;
+// Frames between the GPU timings --gpu-profile logs
+static const uint64_t GPU_PROFILE_INTERVAL = 300;
+
+// Set by SIGINT and SIGTERM while the headless loop runs, which has no window to close
+static volatile std::sig_atomic_t s_interrupted = 0;
+
+static void on_interrupt(int signal) {
+    (void)signal;
+    s_interrupted = 1;
+}
+
+tine::Engine::Engine()
+    : m_jobs(new tine::JobSystem()), m_observations(new tine::Observations()),
+      m_initial_state(new tine::RegistrySnapshot()), m_mailbox(new tine::ControlMailbox()) {}
 tine::Engine::~Engine() {}
 
 bool tine::Engine::init(int argc, const char **argv) {
-    (void)argc;
-    (void)argv;
-
     std::string filename("../../src/assets/box.obj");
+    std::string world;
+    std::string shm;
+    std::string record;
+    std::string replay;
+    tine::CaptureSettings capture;
+    uint32_t env_cnt = 1;
+    bool headless = false;
+    bool gpu_profile = false;
 
     #ifndef NDEBUG
     // TODO: Factor this into arg processing
     spdlog::set_level(spdlog::level::trace);
     #endif
 
-    if (argc > 1) {
-        filename = argv[1];
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--envs") == 0 && i + 1 < argc) {
+            env_cnt = static_cast<uint32_t>(std::max(1, atoi(argv[++i])));
+        } else if (strcmp(argv[i], "--world") == 0 && i + 1 < argc) {
+            world = argv[++i];
+        } else if (strcmp(argv[i], "--shm") == 0 && i + 1 < argc) {
+            shm = argv[++i];
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replay = argv[++i];
+        } else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+            capture.directory = argv[++i];
+            capture.encoding = tine::CaptureEncoding::PNG;
+        } else if (strcmp(argv[i], "--capture-raw") == 0 && i + 1 < argc) {
+            capture.directory = argv[++i];
+            capture.encoding = tine::CaptureEncoding::RAW;
+        } else if (strcmp(argv[i], "--headless") == 0) {
+            headless = true;
+        } else if (strcmp(argv[i], "--steps") == 0 && i + 1 < argc) {
+            m_max_steps = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--gpu-profile") == 0) {
+            gpu_profile = true;
+        } else {
+            filename = argv[i];
+        }
+    }
+
+    if (headless) {
+        if (!init_headless()) {
+            return false;
+        }
+    } else {
+        m_renderer.reset(new tine::Renderer(this));
+        if (!m_renderer->init(1280, 768)) {
+            return false;
+        }
+        if (gpu_profile) {
+            m_renderer->set_gpu_profiling(true);
+            m_gpu_profile = true;
+        }
+    }
+    if (headless && gpu_profile) {
+        TINE_WARN("Nothing to profile on the GPU when headless");
+    }
+
+    if (!load_scene(filename, env_cnt)) {
+        return false;
+    }
+
+    if (!world.empty() && !open_world(world)) {
+        return false;
+    }
+
+    if (!shm.empty() && !open_shm(shm)) {
+        return false;
+    }
+
+    if (!record.empty() && !start_recording(record)) {
+        return false;
     }
 
-    if (!m_renderer->init(1280, 768)) {
+    if (!replay.empty() && !open_replay(replay)) {
         return false;
     }
 
-    if (!tine::Scene::load_from_file(m_scene, filename)) {
+    if (!capture.directory.empty() && !start_capture(capture)) {
         return false;
     }
 
     return true;
 }
 
-void tine::Engine::cleanup() { m_renderer->cleanup(); }
+bool tine::Engine::init_headless() {
+    TINE_CHECK(m_renderer == nullptr, "Already rendering", Error);
+    m_headless = true;
+    return true;
+Error:
+    return false;
+}
+
+bool tine::Engine::load_scene(const std::string &filename, uint32_t env_cnt) {
+    // The cells place the old scene's meshes
+    if (m_world != nullptr) {
+        m_world->close(*m_scene);
+        m_world.reset();
+    }
+    TINE_CHECK(tine::Scene::load_from_file(m_scene, filename, m_jobs.get()),
+               "Failed to load scene", Error);
+    TINE_CHECK(m_scene->create_environments(env_cnt), "Failed to create environments", Error);
+    if (m_renderer != nullptr) {
+        TINE_CHECK(m_renderer->upload_scene(m_scene.get()), "Failed to upload scene", Error);
+    }
+    TINE_CHECK(tine::init_observations(*m_scene, *m_observations),
+               "Failed to set up observations", Error);
+    m_scene->save_snapshot(*m_initial_state);
+    m_mailbox->init(*m_scene, m_observations->pose_entities);
+    m_mailbox->publish_state(*m_scene, m_step_count);
+    // The pose count changed with the scene
+    if (!m_shm_name.empty()) {
+        TINE_CHECK(open_shm(m_shm_name), "Failed to reopen shared memory", Error);
+    }
+    return true;
+Error:
+    m_scene.reset();
+    return false;
+}
+
+bool tine::Engine::step(const float *actions, uint32_t env_cnt, double dt) {
+    ZoneScoped;
+    TINE_CHECK(m_scene != nullptr, "No scene loaded", Error);
+    TINE_CHECK(tine::apply_actions(*m_scene, *m_observations, actions, env_cnt),
+               "Failed to apply actions", Error);
+    m_mailbox->apply_commands(*m_scene);
+    m_jobs->run_main_thread_jobs();
+    if (m_world != nullptr) {
+        m_world->update(*m_scene);
+    }
+    m_scene->on_update(m_renderer.get(), dt);
+    tine::update_observations(*m_scene, *m_observations);
+    m_mailbox->publish_state(*m_scene, ++m_step_count);
+    publish_shm();
+    if (m_recorder != nullptr) {
+        m_recorder->record(m_scene->get_registry(), m_step_count);
+    }
+    return true;
+Error:
+    return false;
+}
+
+bool tine::Engine::reset() {
+    ZoneScoped;
+    TINE_CHECK(m_scene != nullptr, "No scene loaded", Error);
+    TINE_CHECK(m_scene->restore_snapshot(*m_initial_state), "Failed to restore scene", Error);
+    tine::update_observations(*m_scene, *m_observations);
+    m_mailbox->publish_state(*m_scene, ++m_step_count);
+    publish_shm();
+    if (m_recorder != nullptr) {
+        m_recorder->record(m_scene->get_registry(), m_step_count);
+    }
+    return true;
+Error:
+    return false;
+}
+
+bool tine::Engine::start_recording(const std::string &path) {
+    std::unique_ptr<tine::Recorder> recorder(new tine::Recorder());
+    TINE_CHECK(m_scene != nullptr, "No scene loaded", Error);
+    stop_recording();
+    TINE_CHECK(recorder->open(path), "Failed to start recording", Error);
+    // Starts from the current state so replay has something to show before the first step
+    recorder->record(m_scene->get_registry(), m_step_count);
+    m_recorder = std::move(recorder);
+    return true;
+Error:
+    return false;
+}
+
+bool tine::Engine::stop_recording() {
+    bool ok = true;
+    if (m_recorder != nullptr) {
+        ok = m_recorder->close();
+        m_recorder.reset();
+    }
+    return ok;
+}
+
+bool tine::Engine::open_replay(const std::string &path) {
+    std::unique_ptr<tine::Replayer> replayer(new tine::Replayer());
+    TINE_CHECK(m_scene != nullptr, "No scene loaded", Error);
+    TINE_CHECK(m_renderer != nullptr, "Replay needs the renderer", Error);
+    TINE_CHECK(replayer->open(path), "Failed to open replay", Error);
+    m_replayer = std::move(replayer);
+    return true;
+Error:
+    return false;
+}
+
+bool tine::Engine::start_capture(const tine::CaptureSettings &settings) {
+    std::unique_ptr<tine::FrameCapture> capture(new tine::FrameCapture());
+    TINE_CHECK(m_renderer != nullptr, "Capture needs the renderer", Error);
+    stop_capture();
+    TINE_CHECK(capture->open(settings), "Failed to start capture", Error);
+    TINE_CHECK(m_renderer->set_capture(capture.get()), "Failed to start capture", Error);
+    m_capture = std::move(capture);
+    return true;
+Error:
+    return false;
+}
+
+bool tine::Engine::stop_capture() {
+    bool ok = true;
+    if (m_capture != nullptr) {
+        m_renderer->set_capture(nullptr);
+        ok = m_capture->close();
+        m_capture.reset();
+    }
+    return ok;
+}
+
+bool tine::Engine::open_shm(const std::string &prefix) {
+    const size_t pose_size =
+        sizeof(glm::mat4) * m_observations->pose_count * m_observations->env_count;
+    std::unique_ptr<tine::ShmWriter> poses(new tine::ShmWriter());
+    TINE_CHECK(m_scene != nullptr, "No scene loaded", Error);
+    TINE_CHECK(pose_size <= UINT32_MAX, "Too many poses for shared memory", Error);
+    // Unlinks the old object first, it may go by the same name
+    m_shm_poses.reset();
+    TINE_CHECK(poses->create("/" + prefix + "_poses", SHM_POSE_SLOTS,
+                             static_cast<uint32_t>(pose_size)),
+               "Failed to create shared memory", Error);
+    m_shm_poses = std::move(poses);
+    m_shm_name = prefix;
+    publish_shm();
+    if (m_renderer != nullptr) {
+        TINE_CHECK(m_renderer->set_shm(prefix), "Failed to publish rendered frames", Error);
+    }
+    return true;
+Error:
+    return false;
+}
+
+void tine::Engine::publish_shm() {
+    ZoneScoped;
+    tine::ShmFrameHeader header = {};
+    void *payload = nullptr;
+    if (m_shm_poses == nullptr) {
+        return;
+    }
+    header.step = m_step_count;
+    header.kind = tine::ShmFrameKind::POSES;
+    header.width = m_observations->pose_count;
+    header.height = m_observations->env_count;
+    header.size = m_shm_poses->get_slot_size();
+    payload = m_shm_poses->begin_frame(header);
+    if (payload == nullptr) {
+        return;
+    }
+    if (header.size > 0) {
+        std::memcpy(payload, m_observations->poses.data(), header.size);
+    }
+    m_shm_poses->commit_frame();
+}
+
+bool tine::Engine::open_world(const std::string &filename) {
+    std::unique_ptr<tine::WorldStreamer> world(new tine::WorldStreamer());
+    TINE_CHECK(m_scene != nullptr, "No scene loaded", Error);
+    TINE_CHECK(world->open(filename, m_jobs.get(), m_scene->get_view_environment()),
+               "Failed to open world", Error);
+    if (m_world != nullptr) {
+        m_world->close(*m_scene);
+    }
+    m_world = std::move(world);
+    return true;
+Error:
+    return false;
+}
+
+void tine::Engine::cleanup() {
+    stop_recording();
+    stop_capture();
+    if (m_world != nullptr) {
+        m_world->close(*m_scene);
+        m_world.reset();
+    }
+    if (m_renderer != nullptr) {
+        m_renderer->cleanup();
+    }
+}
 
 void tine::Engine::loop() {
+    if (m_headless) {
+        loop_headless();
+        return;
+    }
+    std::chrono::steady_clock::time_point last = std::chrono::steady_clock::now();
     while (!done) {
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        const std::chrono::duration<double> dt = now - last;
+        last = now;
+        m_jobs->run_main_thread_jobs();
+        if (m_replayer != nullptr) {
+            // Rendering only, the recording moves everything and starts over once it ends
+            if (!m_replayer->next(m_scene->get_registry()) &&
+                (!m_replayer->seek(m_replayer->get_first_step()) ||
+                 !m_replayer->next(m_scene->get_registry()))) {
+                TINE_ERROR("Replay failed, simulating instead");
+                m_replayer.reset();
+            }
+            m_renderer->render(m_scene.get());
+            if (m_gpu_profile) {
+                log_gpu_timings();
+            }
+            continue;
+        }
+        m_mailbox->apply_commands(*m_scene);
+        if (m_world != nullptr) {
+            m_world->update(*m_scene);
+        }
+        m_scene->on_update(m_renderer.get(), dt.count());
+        m_mailbox->publish_state(*m_scene, ++m_step_count);
+        if (m_shm_poses != nullptr) {
+            tine::update_observations(*m_scene, *m_observations);
+            publish_shm();
+        }
+        if (m_recorder != nullptr) {
+            m_recorder->record(m_scene->get_registry(), m_step_count);
+        }
         m_renderer->render(m_scene.get());
+        if (m_gpu_profile) {
+            log_gpu_timings();
+        }
+    }
+}
+
+void tine::Engine::log_gpu_timings() {
+    tine::GpuFrameTimings timings;
+    if (!m_renderer->get_gpu_timings(timings) ||
+        timings.frame < m_gpu_profile_frame + GPU_PROFILE_INTERVAL) {
+        return;
+    }
+    m_gpu_profile_frame = timings.frame;
+    TINE_INFO("GPU frame {0}: {1:.3f} ms", timings.frame, timings.milliseconds);
+    for (const tine::GpuPassTiming &pass : timings.passes) {
+        TINE_INFO("  {0}: {1:.3f} ms", pass.name, pass.milliseconds);
+    }
+}
+
+void tine::Engine::loop_headless() {
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const uint64_t first_step = m_step_count;
+    std::chrono::duration<double> elapsed;
+    void (*prev_sigint)(int) = std::signal(SIGINT, on_interrupt);
+    void (*prev_sigterm)(int) = std::signal(SIGTERM, on_interrupt);
+
+    s_interrupted = 0;
+    while (!done && (m_max_steps == 0 || m_step_count - first_step < m_max_steps)) {
+        if (s_interrupted) {
+            on_exit();
+            break;
+        }
+        if (!step(nullptr, m_observations->env_count, HEADLESS_DT)) {
+            break;
+        }
     }
+    std::signal(SIGINT, prev_sigint);
+    std::signal(SIGTERM, prev_sigterm);
+    elapsed = std::chrono::steady_clock::now() - start;
+    TINE_INFO("Simulated {0} steps in {1:.3f}s, {2:.1f} steps/s", m_step_count - first_step,
+              elapsed.count(), (m_step_count - first_step) / std::max(elapsed.count(), 1e-9));
 }
 
 void tine::Engine::on_exit() {
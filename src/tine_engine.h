@@ -1,11 +1,23 @@
 #pragma once
 
+#include <cstdint>
 #include <memory>
+#include <string>
 
 namespace tine {
 
+class ControlMailbox;
+class FrameCapture;
+class JobSystem;
+class Recorder;
+class RegistrySnapshot;
 class Renderer;
+class Replayer;
 class Scene;
+class ShmWriter;
+class WorldStreamer;
+struct CaptureSettings;
+struct Observations;
 
 class Engine {
   public:
@@ -13,17 +25,76 @@ class Engine {
     ~Engine();
     Engine(const Engine &) = delete;
     bool init(int argc = 0, const char **argv = NULL);
+    // No window, Vulkan device or ImGui context, for driving the simulation from training code.
+    // Only before init, which calls it for --headless.
+    bool init_headless();
+    // Replaces the current scene with env_cnt environments of the file
+    bool load_scene(const std::string &filename, uint32_t env_cnt);
+    // Applies one action per Observations::action_count of every environment, advances by dt and
+    // refreshes the observations
+    bool step(const float *actions, uint32_t env_cnt, double dt);
+    // Back to the state right after load_scene
+    bool reset();
+    // Streams the cells of a world file into the loaded scene, whose meshes the cells place
+    bool open_world(const std::string &filename);
+    // Publishes the poses after every step to the POSIX shared memory ring /<prefix>_poses, see
+    // ShmReader, and unless headless the rendered frames, see Renderer::set_shm.  Follows later
+    // load_scene calls.
+    bool open_shm(const std::string &prefix);
+    // Records every following step of the scene to a file, see Recorder
+    bool start_recording(const std::string &path);
+    // false if the recording is incomplete
+    bool stop_recording();
+    // Makes loop play the recording back instead of simulating, the file must have been recorded
+    // from the loaded scene with the same environment count
+    bool open_replay(const std::string &path);
+    // Writes every rendered frame to an image sequence, see FrameCapture
+    bool start_capture(const CaptureSettings &settings);
+    // false if frames failed to write
+    bool stop_capture();
+    // Renders in real time, or when headless steps with a fixed dt as fast as it can until
+    // on_exit, SIGINT, SIGTERM or --steps
     void loop();
     void cleanup();
+    // nullptr when headless
     inline Renderer *get_renderer() const { return m_renderer.get(); }
+    inline JobSystem *get_jobs() const { return m_jobs.get(); }
+    inline Scene *get_scene() const { return m_scene.get(); }
+    inline const Observations *get_observations() const { return m_observations.get(); }
+    // Commands and state of the observed entities for controllers on other threads
+    inline ControlMailbox *get_mailbox() const { return m_mailbox.get(); }
+    inline bool is_headless() const { return m_headless; }
+    // Steps taken since the engine started, counting resets
+    inline uint64_t get_step_count() const { return m_step_count; }
 
     // Events
     void on_exit();
 
   private:
+    void publish_shm();
+    void loop_headless();
+    // Every GPU_PROFILE_INTERVAL frames with --gpu-profile
+    void log_gpu_timings();
+
+    // Declared first so the workers outlive everything that submits to them
+    std::unique_ptr<tine::JobSystem> m_jobs;
     std::unique_ptr<tine::Renderer> m_renderer;
     std::unique_ptr<tine::Scene> m_scene;
+    std::unique_ptr<tine::Observations> m_observations;
+    std::unique_ptr<tine::RegistrySnapshot> m_initial_state;
+    std::unique_ptr<tine::WorldStreamer> m_world;
+    std::unique_ptr<tine::ControlMailbox> m_mailbox;
+    uint64_t m_step_count = 0;
+    std::unique_ptr<tine::ShmWriter> m_shm_poses;
+    std::string m_shm_name;
+    std::unique_ptr<tine::Recorder> m_recorder;
+    std::unique_ptr<tine::Replayer> m_replayer;
+    std::unique_ptr<tine::FrameCapture> m_capture;
+    bool m_headless = false;
+    uint64_t m_max_steps = 0; // Of the headless loop, 0 for no limit
+    bool m_gpu_profile = false;
+    uint64_t m_gpu_profile_frame = 0; // Last logged
     bool done = false;
 };
 
-} // namespace tine
\ No newline at end of file
+} // namespace tine
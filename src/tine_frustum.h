@@ -0,0 +1,57 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+namespace tine {
+
+// View frustum planes (xyz normal pointing inwards, w distance) extracted from a view projection
+// matrix, using the OpenGL clip volume glm produces by default.
+struct Frustum {
+    glm::vec4 planes[6];
+
+    static Frustum from_matrix(const glm::mat4 &m) {
+        Frustum f;
+        const glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+        const glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+        const glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+        const glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+        f.planes[0] = row3 + row0; // Left
+        f.planes[1] = row3 - row0; // Right
+        f.planes[2] = row3 + row1; // Bottom
+        f.planes[3] = row3 - row1; // Top
+        f.planes[4] = row3 + row2; // Near
+        f.planes[5] = row3 - row2; // Far
+        for (int i = 0; i < 6; i++) {
+            f.planes[i] /= glm::length(glm::vec3(f.planes[i]));
+        }
+        return f;
+    }
+
+    bool intersects_sphere(const glm::vec3 &center, float radius) const {
+        for (int i = 0; i < 6; i++) {
+            if (glm::dot(glm::vec3(planes[i]), center) + planes[i].w < -radius) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Tests an object space box, transformed to world space by transform
+    bool intersects_aabb(const glm::vec3 &aabb_min, const glm::vec3 &aabb_max,
+                         const glm::mat4 &transform) const {
+        const glm::vec3 center(transform * glm::vec4((aabb_min + aabb_max) * 0.5f, 1.0f));
+        const glm::vec3 half = (aabb_max - aabb_min) * 0.5f;
+        const glm::mat3 basis(transform);
+        const glm::vec3 extent = glm::abs(basis[0]) * half.x + glm::abs(basis[1]) * half.y +
+                                 glm::abs(basis[2]) * half.z;
+        for (int i = 0; i < 6; i++) {
+            const glm::vec3 normal(planes[i]);
+            if (glm::dot(normal, center) + planes[i].w < -glm::dot(glm::abs(normal), extent)) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+} // namespace tine
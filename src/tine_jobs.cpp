@@ -0,0 +1,319 @@
+#include "tine_jobs.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <thread>
+#include <tracy/Tracy.hpp>
+
+struct tine::Job {
+    const char *name;
+    tine::JobSystem::JobFunction function;
+    // parallel_for chunks call range instead, which saves wrapping each in a JobFunction
+    const tine::JobSystem::RangeFunction *range;
+    size_t begin;
+    size_t end;
+    size_t chunk;
+    tine::JobCounter *counter;
+};
+
+namespace {
+
+// A worker's jobs.  Locked rather than lock free, jobs are coarse enough for that not to matter.
+struct WorkQueue {
+    std::mutex mutex;
+    std::deque<tine::Job *> jobs;
+};
+
+// Which pool the current thread works for, and its deque
+thread_local const tine::JobSystem::Pimpl *t_pool = nullptr;
+thread_local size_t t_worker = 0;
+
+} // namespace
+
+struct tine::JobSystem::Pimpl {
+    std::vector<std::unique_ptr<WorkQueue>> queues; // One per worker, at least one
+    std::vector<std::thread> workers;
+    std::thread::id main_thread;
+    std::atomic<size_t> next_queue{0}; // Round robin for jobs submitted from outside the pool
+
+    // Idle workers sleep until something is queued
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+    std::atomic<size_t> queued{0};
+    bool quit = false;
+
+    std::mutex main_mutex;
+    std::vector<tine::JobSystem::JobFunction> main_jobs;
+
+    // Owns every job, including those held back by a JobCounter.  Finished jobs go back on the
+    // free list, so submitting doesn't allocate once the pool has grown to the workload.
+    std::mutex job_mutex;
+    std::vector<std::unique_ptr<tine::Job>> job_pool;
+    std::vector<tine::Job *> free_jobs;
+
+    // Queues job, or holds it back on dependency until that drains
+    void schedule_job(tine::Job *job, tine::JobCounter *dependency);
+    void finish_job(tine::JobCounter *counter);
+};
+
+bool tine::JobCounter::is_done() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_count == 0;
+}
+
+static tine::Job *allocate_job(tine::JobSystem::Pimpl &p, const char *name,
+                               tine::JobCounter *counter) {
+    tine::Job *job = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(p.job_mutex);
+        if (p.free_jobs.empty()) {
+            p.job_pool.emplace_back(new tine::Job());
+            p.free_jobs.push_back(p.job_pool.back().get());
+        }
+        job = p.free_jobs.back();
+        p.free_jobs.pop_back();
+    }
+    job->name = name;
+    job->range = nullptr;
+    job->counter = counter;
+    return job;
+}
+
+static void release_job(tine::JobSystem::Pimpl &p, tine::Job *job) {
+    // Drops the captures now rather than when the job is reused
+    job->function = nullptr;
+    std::lock_guard<std::mutex> lock(p.job_mutex);
+    p.free_jobs.push_back(job);
+}
+
+static void push_job(tine::JobSystem::Pimpl &p, tine::Job *job) {
+    size_t queue = 0;
+    if (t_pool == &p) {
+        queue = t_worker;
+    } else {
+        queue = p.next_queue.fetch_add(1, std::memory_order_relaxed) % p.queues.size();
+    }
+    {
+        std::lock_guard<std::mutex> lock(p.queues[queue]->mutex);
+        p.queues[queue]->jobs.push_back(job);
+    }
+    {
+        // Under the lock so a worker can't miss the wakeup between its check and its wait
+        std::lock_guard<std::mutex> lock(p.sleep_mutex);
+        p.queued.fetch_add(1);
+    }
+    p.wake.notify_one();
+}
+
+// The newest job of the thread's own deque, the oldest of anyone else's otherwise
+static tine::Job *find_job(tine::JobSystem::Pimpl &p) {
+    const size_t queue_cnt = p.queues.size();
+    const size_t home = (t_pool == &p) ? t_worker : 0;
+    tine::Job *job = nullptr;
+
+    if (p.queued.load() == 0) {
+        return nullptr;
+    }
+    if (t_pool == &p) {
+        WorkQueue &queue = *p.queues[home];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.jobs.empty()) {
+            job = queue.jobs.back();
+            queue.jobs.pop_back();
+        }
+    }
+    for (size_t i = 0; i < queue_cnt && job == nullptr; i++) {
+        WorkQueue &queue = *p.queues[(home + i) % queue_cnt];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.jobs.empty()) {
+            job = queue.jobs.front();
+            queue.jobs.pop_front();
+        }
+    }
+    if (job != nullptr) {
+        p.queued.fetch_sub(1);
+    }
+    return job;
+}
+
+static void run_job(tine::JobSystem::Pimpl &p, tine::Job *job) {
+    {
+        ZoneScopedN("Job");
+        ZoneName(job->name, strlen(job->name));
+        if (job->range != nullptr) {
+            (*job->range)(job->begin, job->end, job->chunk);
+        } else {
+            job->function();
+        }
+    }
+    p.finish_job(job->counter);
+    release_job(p, job);
+}
+
+static void worker_main(tine::JobSystem::Pimpl *p, size_t worker) {
+    const std::string name = "Worker " + std::to_string(worker);
+    tracy::SetThreadName(name.c_str());
+    t_pool = p;
+    t_worker = worker;
+    for (;;) {
+        tine::Job *job = find_job(*p);
+        if (job != nullptr) {
+            run_job(*p, job);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(p->sleep_mutex);
+        p->wake.wait(lock, [p]() { return p->quit || p->queued.load() > 0; });
+        if (p->quit) {
+            break;
+        }
+    }
+    t_pool = nullptr;
+}
+
+tine::JobSystem::JobSystem(size_t worker_cnt) : m_pimpl(new Pimpl) {
+    Pimpl &p = *m_pimpl;
+    if (worker_cnt == 0) {
+        const size_t hardware_cnt = std::thread::hardware_concurrency();
+        worker_cnt = (hardware_cnt > 1) ? hardware_cnt - 1 : 0;
+    }
+    p.main_thread = std::this_thread::get_id();
+    for (size_t i = 0; i < std::max<size_t>(worker_cnt, 1); i++) {
+        p.queues.emplace_back(new WorkQueue);
+    }
+    for (size_t i = 0; i < worker_cnt; i++) {
+        p.workers.emplace_back(worker_main, &p, i);
+    }
+}
+
+tine::JobSystem::~JobSystem() {
+    Pimpl &p = *m_pimpl;
+    {
+        std::lock_guard<std::mutex> lock(p.sleep_mutex);
+        p.quit = true;
+    }
+    p.wake.notify_all();
+    for (std::thread &worker : p.workers) {
+        worker.join();
+    }
+    // Jobs still queued or held back by a counter were never waited on, the pool frees them
+}
+
+void tine::JobSystem::Pimpl::schedule_job(tine::Job *job, tine::JobCounter *dependency) {
+    tine::JobCounter *counter = job->counter;
+    if (counter != nullptr) {
+        std::lock_guard<std::mutex> lock(counter->m_mutex);
+        counter->m_count++;
+    }
+    if (dependency != nullptr) {
+        std::lock_guard<std::mutex> lock(dependency->m_mutex);
+        if (dependency->m_count > 0) {
+            dependency->m_waiting.push_back(job);
+            return;
+        }
+    }
+    push_job(*this, job);
+}
+
+void tine::JobSystem::submit(const char *name, JobFunction function, JobCounter *counter,
+                             JobCounter *dependency) {
+    Pimpl &p = *m_pimpl;
+    tine::Job *job = allocate_job(p, name, counter);
+    job->function = std::move(function);
+    p.schedule_job(job, dependency);
+}
+
+void tine::JobSystem::Pimpl::finish_job(tine::JobCounter *counter) {
+    std::vector<tine::Job *> released;
+    if (counter == nullptr) {
+        return;
+    }
+    {
+        // Nothing touches the counter after the unlock, a waiter may destroy it right away
+        std::lock_guard<std::mutex> lock(counter->m_mutex);
+        if (--counter->m_count == 0) {
+            released.swap(counter->m_waiting);
+        }
+    }
+    for (tine::Job *job : released) {
+        push_job(*this, job);
+    }
+}
+
+void tine::JobSystem::wait(JobCounter &counter) {
+    ZoneScoped;
+    Pimpl &p = *m_pimpl;
+    const bool main_thread = (std::this_thread::get_id() == p.main_thread);
+    while (!counter.is_done()) {
+        tine::Job *job = find_job(p);
+        if (job != nullptr) {
+            run_job(p, job);
+        } else if (main_thread) {
+            // Jobs may be waiting on main thread work themselves
+            run_main_thread_jobs();
+            std::this_thread::yield();
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void tine::JobSystem::run_on_main_thread(JobFunction function) {
+    Pimpl &p = *m_pimpl;
+    std::lock_guard<std::mutex> lock(p.main_mutex);
+    p.main_jobs.push_back(std::move(function));
+}
+
+void tine::JobSystem::run_main_thread_jobs() {
+    Pimpl &p = *m_pimpl;
+    std::vector<JobFunction> jobs;
+    if (std::this_thread::get_id() != p.main_thread) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(p.main_mutex);
+        jobs.swap(p.main_jobs);
+    }
+    for (JobFunction &job : jobs) {
+        ZoneScopedN("Main thread job");
+        job();
+    }
+}
+
+size_t tine::JobSystem::get_worker_count() const { return m_pimpl->workers.size(); }
+
+size_t tine::JobSystem::get_chunk_count(size_t count, size_t min_chunk) const {
+    const size_t max_chunks = get_worker_count() + 1;
+    min_chunk = std::max<size_t>(min_chunk, 1);
+    return std::max<size_t>(1, std::min(max_chunks, (count + min_chunk - 1) / min_chunk));
+}
+
+void tine::JobSystem::parallel_for(const char *name, size_t count, size_t min_chunk,
+                                   const RangeFunction &function) {
+    const size_t chunk_cnt = get_chunk_count(count, min_chunk);
+    const size_t chunk = (count + chunk_cnt - 1) / std::max<size_t>(chunk_cnt, 1);
+    JobCounter counter;
+
+    if (count == 0) {
+        return;
+    }
+    for (size_t c = 1; c < chunk_cnt; c++) {
+        const size_t begin = c * chunk;
+        if (begin >= count) {
+            break;
+        }
+        tine::Job *job = allocate_job(*m_pimpl, name, &counter);
+        job->range = &function;
+        job->begin = begin;
+        job->end = std::min(begin + chunk, count);
+        job->chunk = c;
+        m_pimpl->schedule_job(job, nullptr);
+    }
+    {
+        ZoneScopedN("Job");
+        ZoneName(name, strlen(name));
+        function(0, std::min(chunk, count), 0);
+    }
+    wait(counter);
+}
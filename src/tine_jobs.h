@@ -0,0 +1,100 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <entt/entt.hpp>
+
+namespace tine {
+
+struct Job;
+class JobCounter;
+
+// Work stealing scheduler shared by the engine's subsystems.  Every worker owns a deque, it pushes
+// and pops its own jobs at the back while idle workers steal from the front of the others.  Jobs
+// submitted from outside the pool are spread over the deques.  Waiting threads run jobs instead of
+// blocking, so jobs may wait on other jobs.  Vulkan and GLFW calls belong on the thread that
+// created the system, queue them with run_on_main_thread.
+class JobSystem {
+  public:
+    struct Pimpl;
+    using JobFunction = std::function<void()>;
+    // [begin, end) of the range and the index of the chunk, below get_chunk_count
+    using RangeFunction = std::function<void(size_t, size_t, size_t)>;
+
+    // 0 workers picks one per hardware thread besides the calling one
+    explicit JobSystem(size_t worker_cnt = 0);
+    ~JobSystem();
+    JobSystem(const JobSystem &) = delete;
+    JobSystem &operator=(const JobSystem &) = delete;
+
+    // name must be a string literal, it labels the job's Tracy zone.  The job only becomes
+    // runnable once dependency, if any, has drained.
+    void submit(const char *name, JobFunction function, JobCounter *counter = nullptr,
+                JobCounter *dependency = nullptr);
+    // Runs other jobs until counter drains
+    void wait(JobCounter &counter);
+
+    // Queued until the main thread calls run_main_thread_jobs or waits
+    void run_on_main_thread(JobFunction function);
+    void run_main_thread_jobs();
+
+    size_t get_worker_count() const;
+    // How many chunks parallel_for splits count items into, each of at least min_chunk items
+    size_t get_chunk_count(size_t count, size_t min_chunk) const;
+    // Calls function over chunks of [0, count) and waits for all of them, the calling thread takes
+    // the first chunk
+    void parallel_for(const char *name, size_t count, size_t min_chunk,
+                      const RangeFunction &function);
+
+    // function(entity) for every entity of an EnTT view.  The components the function writes
+    // must not be touched by anything else until this returns.
+    template <typename View, typename Function>
+    void parallel_each(const char *name, View &view, size_t min_chunk, Function function) {
+        // Chunks of the view's leading storage, which may also hold entities the view skips
+        const auto *storage = view.handle();
+        if (storage == nullptr) {
+            return;
+        }
+        const auto first = storage->begin();
+        parallel_for(name, storage->size(), min_chunk,
+                     [first, &view, &function](size_t begin, size_t end, size_t) {
+                         const auto last = first + static_cast<std::ptrdiff_t>(end);
+                         for (auto it = first + static_cast<std::ptrdiff_t>(begin); it != last;
+                              ++it) {
+                             const entt::entity entity = *it;
+                             if (view.contains(entity)) {
+                                 function(entity);
+                             }
+                         }
+                     });
+    }
+
+  private:
+    std::unique_ptr<Pimpl> m_pimpl;
+};
+
+// Counts the unfinished jobs submitted against it.  Jobs can also be held back until a counter
+// drains, see JobSystem::submit.  Must outlive the jobs that reference it, and must not be used
+// with another JobSystem once the one its held back jobs came from is destroyed.
+class JobCounter {
+  public:
+    JobCounter() = default;
+    JobCounter(const JobCounter &) = delete;
+    JobCounter &operator=(const JobCounter &) = delete;
+
+    bool is_done();
+
+  private:
+    friend class JobSystem;
+    friend struct JobSystem::Pimpl;
+    std::mutex m_mutex;
+    uint32_t m_count = 0;
+    std::vector<Job *> m_waiting; // Released when m_count drops to zero
+};
+
+} // namespace tine
@@ -0,0 +1,162 @@
+#include "tine_mailbox.h"
+#include "tine_animation.h"
+#include "tine_component.h"
+#include "tine_scene.h"
+#include <algorithm>
+#include <cstring>
+#include <tracy/Tracy.hpp>
+
+// Set in Slot::middle while the buffer there holds a command the simulation hasn't taken
+static const uint32_t COMMAND_PENDING = 1u << 31;
+static const uint32_t BUFFER_MASK = 3;
+static const uint32_t STATE_WORDS = sizeof(tine::EntityState) / sizeof(uint32_t);
+static const uint32_t JOINT_WORDS = sizeof(glm::mat4) / sizeof(uint32_t);
+
+void tine::ControlMailbox::init(Scene &scene, const std::vector<entt::entity> &entities) {
+    entt::registry &registry = scene.get_registry();
+    const AnimationData &anim = scene.get_animation_data();
+    uint32_t word_cnt = 0;
+    uint32_t max_slot_words = STATE_WORDS;
+
+    m_slot_count = static_cast<uint32_t>(entities.size());
+    m_slots.reset(new Slot[m_slot_count]);
+    m_slot_index.clear();
+    for (uint32_t i = 0; i < m_slot_count; i++) {
+        Slot &slot = m_slots[i];
+        const SkinComponent *skin = registry.try_get<SkinComponent>(entities[i]);
+        slot.entity = entities[i];
+        std::memset(slot.commands, 0, sizeof(slot.commands));
+        slot.middle.store(0, std::memory_order_relaxed);
+        slot.back = 1;
+        slot.front = 2;
+        slot.sequence.store(0, std::memory_order_relaxed);
+        slot.state_offset = word_cnt;
+        slot.joint_count =
+            skin != nullptr ? static_cast<uint32_t>(anim.skins[skin->skin].joints.size()) : 0;
+        word_cnt += STATE_WORDS + slot.joint_count * JOINT_WORDS;
+        max_slot_words = std::max(max_slot_words, STATE_WORDS + slot.joint_count * JOINT_WORDS);
+        m_slot_index[entities[i]] = i;
+    }
+    m_state_words.reset(new std::atomic<uint32_t>[word_cnt]);
+    for (uint32_t w = 0; w < word_cnt; w++) {
+        m_state_words[w].store(0, std::memory_order_relaxed);
+    }
+    m_words.resize(max_slot_words);
+    // Controllers started after this see every slot as set up here
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+uint32_t tine::ControlMailbox::find_slot(entt::entity entity) const {
+    auto it = m_slot_index.find(entity);
+    return it != m_slot_index.end() ? it->second : UINT32_MAX;
+}
+
+void tine::ControlMailbox::write_command(uint32_t slot, const ActuatorCommand &command) {
+    Slot &s = m_slots[slot];
+    s.commands[s.back] = command;
+    // Hand the filled buffer over and take back whichever one was waiting
+    s.back = s.middle.exchange(s.back | COMMAND_PENDING, std::memory_order_acq_rel) & BUFFER_MASK;
+}
+
+bool tine::ControlMailbox::read_state(uint32_t slot, EntityState &state, glm::mat4 *joints,
+                                      uint32_t max_joints) const {
+    const Slot &s = m_slots[slot];
+    const uint32_t joint_words =
+        joints != nullptr ? std::min(max_joints, s.joint_count) * JOINT_WORDS : 0;
+    uint32_t header[STATE_WORDS];
+    for (;;) {
+        const uint32_t sequence = s.sequence.load(std::memory_order_acquire);
+        if (sequence == 0) {
+            return false;
+        }
+        if (sequence & 1) {
+            continue;
+        }
+        for (uint32_t w = 0; w < STATE_WORDS; w++) {
+            header[w] = m_state_words[s.state_offset + w].load(std::memory_order_relaxed);
+        }
+        for (uint32_t w = 0; w < joint_words; w++) {
+            const uint32_t word =
+                m_state_words[s.state_offset + STATE_WORDS + w].load(std::memory_order_relaxed);
+            std::memcpy(reinterpret_cast<uint32_t *>(joints) + w, &word, sizeof(word));
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (s.sequence.load(std::memory_order_relaxed) == sequence) {
+            break;
+        }
+    }
+    std::memcpy(&state, header, sizeof(state));
+    return true;
+}
+
+void tine::ControlMailbox::apply_commands(Scene &scene) {
+    ZoneScoped;
+    entt::registry &registry = scene.get_registry();
+    for (uint32_t i = 0; i < m_slot_count; i++) {
+        Slot &s = m_slots[i];
+        if (!(s.middle.load(std::memory_order_acquire) & COMMAND_PENDING)) {
+            continue;
+        }
+        s.front = s.middle.exchange(s.front, std::memory_order_acq_rel) & BUFFER_MASK;
+        const ActuatorCommand &command = s.commands[s.front];
+        if (!registry.valid(s.entity)) {
+            continue;
+        }
+        RigidBodyComponent *body = registry.try_get<RigidBodyComponent>(s.entity);
+        if (command.flags & COMMAND_ANIMATION_SPEED) {
+            AnimationComponent *animation = registry.try_get<AnimationComponent>(s.entity);
+            if (animation != nullptr) {
+                animation->speed = command.animation_speed;
+            }
+        }
+        if (command.flags & COMMAND_TRANSFORM) {
+            TransformComponent *transform = registry.try_get<TransformComponent>(s.entity);
+            if (transform != nullptr) {
+                transform->transform = command.transform;
+            }
+        }
+        if (body != nullptr && (command.flags & COMMAND_VELOCITY)) {
+            body->linear_velocity = command.linear_velocity;
+            body->angular_velocity = command.angular_velocity;
+        }
+        if (body != nullptr && (command.flags & (COMMAND_VELOCITY | COMMAND_TRANSFORM))) {
+            body->is_sleeping = 0;
+            body->sleep_time = 0.0f;
+        }
+    }
+}
+
+void tine::ControlMailbox::publish_state(Scene &scene, uint64_t step) {
+    ZoneScoped;
+    entt::registry &registry = scene.get_registry();
+    const AnimationData &anim = scene.get_animation_data();
+    for (uint32_t i = 0; i < m_slot_count; i++) {
+        Slot &s = m_slots[i];
+        if (!registry.valid(s.entity)) {
+            continue;
+        }
+        const TransformComponent *transform = registry.try_get<TransformComponent>(s.entity);
+        const RigidBodyComponent *body = registry.try_get<RigidBodyComponent>(s.entity);
+        const SkinComponent *skin = registry.try_get<SkinComponent>(s.entity);
+        EntityState state = {};
+        state.step = step;
+        state.transform = transform != nullptr ? transform->transform : glm::mat4(1.0f);
+        state.linear_velocity = body != nullptr ? body->linear_velocity : glm::vec3(0.0f);
+        state.angular_velocity = body != nullptr ? body->angular_velocity : glm::vec3(0.0f);
+        state.joint_count = skin != nullptr ? s.joint_count : 0;
+        std::memcpy(m_words.data(), &state, sizeof(state));
+        if (state.joint_count > 0) {
+            std::memcpy(m_words.data() + STATE_WORDS, &anim.joint_palette[skin->palette_offset],
+                        state.joint_count * sizeof(glm::mat4));
+        }
+
+        const uint32_t word_cnt = STATE_WORDS + state.joint_count * JOINT_WORDS;
+        const uint32_t sequence = s.sequence.load(std::memory_order_relaxed);
+        s.sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (uint32_t w = 0; w < word_cnt; w++) {
+            m_state_words[s.state_offset + w].store(m_words[w], std::memory_order_relaxed);
+        }
+        s.sequence.store(sequence + 2, std::memory_order_release);
+    }
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+#include <entt/entt.hpp>
+
+namespace tine {
+
+class Scene;
+
+enum ActuatorCommandFlags : uint32_t {
+    COMMAND_ANIMATION_SPEED = 1 << 0, // AnimationComponent::speed
+    COMMAND_VELOCITY = 1 << 1,        // RigidBodyComponent velocities, wakes the body
+    COMMAND_TRANSFORM = 1 << 2,       // Teleports the entity, wakes the body
+};
+
+// The latest wish of a controller for one entity, flags says which fields hold one
+struct ActuatorCommand {
+    uint32_t flags;
+    float animation_speed;
+    glm::vec3 linear_velocity;
+    glm::vec3 angular_velocity;
+    glm::mat4 transform;
+};
+
+// One entity as of the end of a step, followed by its joint matrices if it's skinned
+struct EntityState {
+    uint64_t step;
+    glm::mat4 transform;
+    glm::vec3 linear_velocity; // Zero without a RigidBodyComponent
+    glm::vec3 angular_velocity;
+    uint32_t joint_count;
+};
+static_assert(sizeof(EntityState) % sizeof(uint32_t) == 0, "EntityState is copied as words");
+
+// Exchanges commands and state between the simulation and controllers running at their own rate
+// on other threads, without either side ever waiting on the other.  Each entity has a slot.
+// Commands go through a triple buffer per slot: the newest command written before a step starts
+// is applied by that step, older ones are overwritten.  Any number of controllers may write at
+// once as long as each slot has a single writer.  State comes back through a seqlock per slot,
+// read by any number of threads, which retry the copy on the rare read that overlaps a publish.
+// Slots are set up on the main thread while no controller runs, after which they're fixed.
+class ControlMailbox {
+  public:
+    ControlMailbox() = default;
+    ControlMailbox(const ControlMailbox &) = delete;
+
+    // Main thread, a slot for each entity in that order
+    void init(Scene &scene, const std::vector<entt::entity> &entities);
+    // UINT32_MAX if the entity has no slot
+    uint32_t find_slot(entt::entity entity) const;
+    uint32_t get_slot_count() const { return m_slot_count; }
+
+    // Controller side, any thread
+    void write_command(uint32_t slot, const ActuatorCommand &command);
+    // Copies up to max_joints of the joint matrices, false before the first publish
+    bool read_state(uint32_t slot, EntityState &state, glm::mat4 *joints = nullptr,
+                    uint32_t max_joints = 0) const;
+
+    // Simulation side, main thread, before and after every step
+    void apply_commands(Scene &scene);
+    void publish_state(Scene &scene, uint64_t step);
+
+  private:
+    struct alignas(64) Slot {
+        entt::entity entity;
+        ActuatorCommand commands[3];
+        // Index of the buffer handed over last, with COMMAND_PENDING set until the simulation
+        // takes it.  The writer fills back and the simulation reads front, neither is shared.
+        std::atomic<uint32_t> middle;
+        uint32_t back;
+        uint32_t front;
+        // Odd while the simulation rewrites the slot's state words
+        alignas(64) std::atomic<uint32_t> sequence;
+        uint32_t state_offset; // Into m_state_words
+        uint32_t joint_count;
+    };
+
+    std::unique_ptr<Slot[]> m_slots;
+    uint32_t m_slot_count = 0;
+    std::unordered_map<entt::entity, uint32_t> m_slot_index;
+    // Copied word by word with relaxed atomics so readers racing a publish stay well defined
+    std::unique_ptr<std::atomic<uint32_t>[]> m_state_words;
+    std::vector<uint32_t> m_words; // Staging for publish_state
+};
+
+} // namespace tine
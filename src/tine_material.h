@@ -0,0 +1,27 @@
+#pragma once
+
+#include "tine_texture.h"
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace tine {
+
+static const uint32_t NO_TEXTURE = UINT32_MAX;
+// Draw batching packs the material index into the low bits of its sort key
+static const uint32_t MAX_MATERIALS = 1u << 28;
+
+// Mirrors Material in basic_triangle.frag, indexed by MaterialComponent::material.
+struct Material {
+    glm::vec4 base_color;
+    uint32_t base_color_texture; // Index into MaterialData::textures, or NO_TEXTURE
+    uint32_t pad[3];
+};
+static_assert(sizeof(Material) == 8 * sizeof(float), "Material must match the std430 layout");
+
+struct MaterialData {
+    std::vector<Material> materials;
+    // The index is also the texture's slot in the renderer's bindless array
+    std::vector<TextureSource> textures;
+};
+
+} // namespace tine
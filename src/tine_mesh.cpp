@@ -0,0 +1,698 @@
+#include "tine_mesh.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <glm/gtc/packing.hpp>
+#include <tracy/Tracy.hpp>
+
+// Modelled cache for the vertex cache optimization, a bit larger than the hardware tends to be
+static const size_t CACHE_SIZE = 32;
+// FIFO cache used to find the cluster boundaries for overdraw optimization
+static const uint32_t OVERDRAW_CACHE_SIZE = 16;
+// Meshes this small aren't worth simplifying any further
+static const size_t MIN_LOD_TRIANGLES = 64;
+// Coarser levels are cheaper to draw whole than to cull
+static const size_t MIN_MESHLET_LOD_TRIANGLES = 4 * tine::MESHLET_MAX_TRIANGLES;
+// Clusters whose normals spread wider than this are never backface culled
+static const float MIN_CONE_SPREAD = 0.1f;
+
+// Tom Forsyth, "Linear-Speed Vertex Cache Optimisation"
+static float vertex_score(int32_t cache_pos, uint32_t remaining) {
+    float score = 0.0f;
+    if (remaining == 0) {
+        return -1.0f;
+    }
+    if (cache_pos >= 0) {
+        if (cache_pos < 3) {
+            // The last triangle's vertices, deliberately lower so strips don't get too long
+            score = 0.75f;
+        } else {
+            const float scale = 1.0f / (CACHE_SIZE - 3);
+            score = std::pow(1.0f - (cache_pos - 3) * scale, 1.5f);
+        }
+    }
+    // Prefer finishing off vertices with few remaining triangles
+    return score + 2.0f / std::sqrt(static_cast<float>(remaining));
+}
+
+void tine::optimize_vertex_cache(uint32_t *indices, size_t index_count, size_t vertex_count) {
+    ZoneScoped;
+    const size_t tri_count = index_count / 3;
+    std::vector<uint32_t> remaining(vertex_count, 0);
+    std::vector<uint32_t> offsets(vertex_count + 1, 0);
+    std::vector<uint32_t> adjacency(tri_count * 3);
+    std::vector<float> vscores(vertex_count);
+    std::vector<float> tscores(tri_count, 0.0f);
+    std::vector<char> emitted(tri_count, 0);
+    std::vector<uint32_t> output;
+    uint32_t cache[CACHE_SIZE + 3];
+    size_t cache_cnt = 0;
+    size_t scan = 0;
+    int64_t best = -1;
+
+    if (tri_count == 0) {
+        return;
+    }
+
+    for (size_t i = 0; i < tri_count * 3; i++) {
+        remaining[indices[i]]++;
+    }
+    for (size_t v = 0; v < vertex_count; v++) {
+        offsets[v + 1] = offsets[v] + remaining[v];
+    }
+    {
+        std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < tri_count * 3; i++) {
+            adjacency[cursor[indices[i]]++] = static_cast<uint32_t>(i / 3);
+        }
+    }
+    for (size_t v = 0; v < vertex_count; v++) {
+        vscores[v] = vertex_score(-1, remaining[v]);
+    }
+    for (size_t i = 0; i < tri_count * 3; i++) {
+        tscores[i / 3] += vscores[indices[i]];
+    }
+
+    output.reserve(tri_count * 3);
+    for (size_t emitted_cnt = 0; emitted_cnt < tri_count; emitted_cnt++) {
+        uint32_t new_cache[CACHE_SIZE + 3];
+        size_t new_cnt = 0;
+        float best_score = -1.0f;
+
+        if (best < 0) {
+            // Nothing in the cache is connected to anything left, start over somewhere else
+            while (emitted[scan]) {
+                scan++;
+            }
+            best = static_cast<int64_t>(scan);
+        }
+
+        const uint32_t *tri = indices + best * 3;
+        emitted[best] = 1;
+        output.insert(output.end(), tri, tri + 3);
+
+        for (size_t k = 0; k < 3; k++) {
+            const uint32_t v = tri[k];
+            uint32_t *adj = adjacency.data() + offsets[v];
+            for (uint32_t j = 0; j < remaining[v]; j++) {
+                if (adj[j] == best) {
+                    adj[j] = adj[remaining[v] - 1];
+                    break;
+                }
+            }
+            remaining[v]--;
+            // Degenerate triangles reference the same vertex more than once
+            if (std::find(new_cache, new_cache + new_cnt, v) == new_cache + new_cnt) {
+                new_cache[new_cnt++] = v;
+            }
+        }
+        for (size_t c = 0; c < cache_cnt; c++) {
+            if (std::find(tri, tri + 3, cache[c]) == tri + 3) {
+                new_cache[new_cnt++] = cache[c];
+            }
+        }
+
+        // Rescore everything that moved in or out of the cache
+        for (size_t c = 0; c < new_cnt; c++) {
+            const uint32_t v = new_cache[c];
+            const int32_t pos = (c < CACHE_SIZE) ? static_cast<int32_t>(c) : -1;
+            const float score = vertex_score(pos, remaining[v]);
+            const float delta = score - vscores[v];
+            vscores[v] = score;
+            for (uint32_t j = 0; j < remaining[v]; j++) {
+                tscores[adjacency[offsets[v] + j]] += delta;
+            }
+        }
+        cache_cnt = std::min(new_cnt, CACHE_SIZE);
+        std::copy(new_cache, new_cache + cache_cnt, cache);
+
+        best = -1;
+        for (size_t c = 0; c < cache_cnt; c++) {
+            const uint32_t v = cache[c];
+            for (uint32_t j = 0; j < remaining[v]; j++) {
+                const uint32_t t = adjacency[offsets[v] + j];
+                if (tscores[t] > best_score) {
+                    best_score = tscores[t];
+                    best = t;
+                }
+            }
+        }
+    }
+
+    std::copy(output.begin(), output.end(), indices);
+}
+
+// Sander et al., "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw".  The cache
+// optimized order is split into clusters wherever the cache is flushed anyway, and the clusters
+// facing away from the center of the mesh are drawn first since they tend to occlude the rest.
+void tine::optimize_overdraw(uint32_t *indices, size_t index_count, const Vertex *vertices,
+                             size_t vertex_count) {
+    ZoneScoped;
+    const size_t tri_count = index_count / 3;
+    std::vector<uint32_t> cluster_starts;
+    std::vector<uint32_t> cache_time(vertex_count, 0);
+    std::vector<glm::vec3> centroids;
+    std::vector<float> sort_keys;
+    std::vector<uint32_t> order;
+    std::vector<uint32_t> output;
+    uint32_t time = OVERDRAW_CACHE_SIZE + 1;
+    glm::vec3 mesh_centroid(0.0f);
+    float mesh_area = 0.0f;
+
+    if (tri_count == 0) {
+        return;
+    }
+
+    for (size_t t = 0; t < tri_count; t++) {
+        uint32_t misses = 0;
+        for (size_t k = 0; k < 3; k++) {
+            const uint32_t v = indices[t * 3 + k];
+            if (time - cache_time[v] > OVERDRAW_CACHE_SIZE) {
+                cache_time[v] = time++;
+                misses++;
+            }
+        }
+        if (t == 0 || misses == 3) {
+            cluster_starts.push_back(static_cast<uint32_t>(t));
+        }
+    }
+    cluster_starts.push_back(static_cast<uint32_t>(tri_count));
+
+    const size_t cluster_cnt = cluster_starts.size() - 1;
+    centroids.resize(cluster_cnt);
+    sort_keys.resize(cluster_cnt);
+    std::vector<glm::vec3> normals(cluster_cnt, glm::vec3(0.0f));
+    for (size_t c = 0; c < cluster_cnt; c++) {
+        glm::vec3 centroid(0.0f);
+        float area = 0.0f;
+        for (uint32_t t = cluster_starts[c]; t < cluster_starts[c + 1]; t++) {
+            const glm::vec3 &a = vertices[indices[t * 3 + 0]].position;
+            const glm::vec3 &b = vertices[indices[t * 3 + 1]].position;
+            const glm::vec3 &d = vertices[indices[t * 3 + 2]].position;
+            const glm::vec3 normal = glm::cross(b - a, d - a);
+            const float tri_area = glm::length(normal);
+            centroid += (a + b + d) * (tri_area / 3.0f);
+            normals[c] += normal;
+            area += tri_area;
+        }
+        mesh_centroid += centroid;
+        mesh_area += area;
+        centroids[c] = (area > 0.0f) ? centroid / area : centroid;
+    }
+    if (mesh_area > 0.0f) {
+        mesh_centroid /= mesh_area;
+    }
+
+    for (size_t c = 0; c < cluster_cnt; c++) {
+        const float len = glm::length(normals[c]);
+        sort_keys[c] = (len > 0.0f) ? glm::dot(centroids[c] - mesh_centroid, normals[c] / len) : 0;
+        order.push_back(static_cast<uint32_t>(c));
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [&sort_keys](uint32_t a, uint32_t b) { return sort_keys[a] > sort_keys[b]; });
+
+    output.reserve(tri_count * 3);
+    for (uint32_t c : order) {
+        output.insert(output.end(), indices + cluster_starts[c] * 3,
+                      indices + cluster_starts[c + 1] * 3);
+    }
+    std::copy(output.begin(), output.end(), indices);
+}
+
+size_t tine::optimize_vertex_fetch(uint32_t *indices, size_t index_count, size_t vertex_count,
+                                   std::vector<uint32_t> &remap) {
+    ZoneScoped;
+    uint32_t next = 0;
+    remap.assign(vertex_count, UINT32_MAX);
+    for (size_t i = 0; i < index_count; i++) {
+        uint32_t &v = remap[indices[i]];
+        if (v == UINT32_MAX) {
+            v = next++;
+        }
+        indices[i] = v;
+    }
+    return next;
+}
+
+// Garland and Heckbert, "Surface Simplification Using Quadric Error Metrics".  Area weighted, so
+// the error of a collapse can be normalized back to a distance.
+struct Quadric {
+    double a00, a01, a02, a11, a12, a22;
+    double b0, b1, b2;
+    double c;
+    double w;
+};
+
+static void quadric_add(Quadric &q, const Quadric &o) {
+    q.a00 += o.a00;
+    q.a01 += o.a01;
+    q.a02 += o.a02;
+    q.a11 += o.a11;
+    q.a12 += o.a12;
+    q.a22 += o.a22;
+    q.b0 += o.b0;
+    q.b1 += o.b1;
+    q.b2 += o.b2;
+    q.c += o.c;
+    q.w += o.w;
+}
+
+// Squared distance to the planes of q at p, averaged over their area
+static double quadric_error(const Quadric &q, const glm::vec3 &p) {
+    const double x = p.x, y = p.y, z = p.z;
+    const double e = q.a00 * x * x + q.a11 * y * y + q.a22 * z * z +
+                     2.0 * (q.a01 * x * y + q.a02 * x * z + q.a12 * y * z) +
+                     2.0 * (q.b0 * x + q.b1 * y + q.b2 * z) + q.c;
+    return (q.w > 0.0) ? std::abs(e) / q.w : 0.0;
+}
+
+struct Collapse {
+    uint32_t from; // Position IDs, every vertex sharing the position of from moves
+    uint32_t to;
+    double error;
+};
+
+// Vertices split along UV or normal seams share a position ID, the simplifier works on those so
+// hard edged CAD meshes aren't all seams.
+static void build_position_ids(const tine::Vertex *vertices, size_t vertex_count,
+                               std::vector<uint32_t> &ids, std::vector<uint32_t> &next) {
+    std::vector<uint32_t> order(vertex_count);
+    ids.resize(vertex_count);
+    next.resize(vertex_count);
+    for (size_t v = 0; v < vertex_count; v++) {
+        order[v] = static_cast<uint32_t>(v);
+    }
+    auto less = [vertices](uint32_t a, uint32_t b) {
+        const glm::vec3 &pa = vertices[a].position;
+        const glm::vec3 &pb = vertices[b].position;
+        return (pa.x != pb.x) ? pa.x < pb.x : (pa.y != pb.y) ? pa.y < pb.y : pa.z < pb.z;
+    };
+    std::sort(order.begin(), order.end(), less);
+    for (size_t i = 0; i < vertex_count;) {
+        size_t end = i + 1;
+        while (end < vertex_count && !less(order[i], order[end])) {
+            end++;
+        }
+        // Circular list through every vertex at this position
+        for (size_t j = i; j < end; j++) {
+            ids[order[j]] = order[i];
+            next[order[j]] = order[(j + 1 < end) ? j + 1 : i];
+        }
+        i = end;
+    }
+}
+
+static glm::vec3 triangle_normal(const tine::Vertex *vertices, uint32_t a, uint32_t b, uint32_t c) {
+    return glm::cross(vertices[b].position - vertices[a].position,
+                      vertices[c].position - vertices[a].position);
+}
+
+// The vertex at position `to` sharing a triangle with v, so on the same side of any seam.
+static uint32_t find_collapse_target(const std::vector<uint32_t> &indices,
+                                     const std::vector<uint32_t> &offsets,
+                                     const std::vector<uint32_t> &adjacency,
+                                     const std::vector<uint32_t> &ids, uint32_t v, uint32_t to) {
+    for (uint32_t j = offsets[v]; j < offsets[v + 1]; j++) {
+        const uint32_t *tri = &indices[adjacency[j] * 3];
+        for (uint32_t k = 0; k < 3; k++) {
+            if (ids[tri[k]] == to) {
+                return tri[k];
+            }
+        }
+    }
+    return UINT32_MAX;
+}
+
+// Moves every vertex at the position `from` to its target at `to`.  Fails if a vertex has no
+// target, or if any remaining triangle would flip.
+static bool plan_collapse(const std::vector<uint32_t> &indices,
+                          const std::vector<uint32_t> &offsets,
+                          const std::vector<uint32_t> &adjacency, const std::vector<uint32_t> &ids,
+                          const std::vector<uint32_t> &next, const tine::Vertex *vertices,
+                          std::vector<uint32_t> &remap, uint32_t from, uint32_t to) {
+    uint32_t v = from;
+    do {
+        const uint32_t target = find_collapse_target(indices, offsets, adjacency, ids, v, to);
+        if (target == UINT32_MAX) {
+            return false;
+        }
+        for (uint32_t j = offsets[v]; j < offsets[v + 1]; j++) {
+            const uint32_t *tri = &indices[adjacency[j] * 3];
+            uint32_t moved[3];
+            bool degenerate = false;
+            for (uint32_t k = 0; k < 3; k++) {
+                moved[k] = (tri[k] == v) ? target : remap[tri[k]];
+                degenerate |= (ids[moved[k]] == to) && (tri[k] != v);
+            }
+            if (degenerate) {
+                continue;
+            }
+            const glm::vec3 before =
+                triangle_normal(vertices, remap[tri[0]], remap[tri[1]], remap[tri[2]]);
+            const glm::vec3 after = triangle_normal(vertices, moved[0], moved[1], moved[2]);
+            if (glm::dot(before, after) <= 0.0f) {
+                return false;
+            }
+        }
+        v = next[v];
+    } while (v != from);
+
+    // Only commit once every vertex at the position has somewhere to go
+    v = from;
+    do {
+        remap[v] = find_collapse_target(indices, offsets, adjacency, ids, v, to);
+        v = next[v];
+    } while (v != from);
+    return true;
+}
+
+size_t tine::simplify_mesh(uint32_t *dst, const uint32_t *indices, size_t index_count,
+                           const Vertex *vertices, size_t vertex_count, size_t target_index_count,
+                           float &error) {
+    ZoneScoped;
+    std::vector<uint32_t> result(indices, indices + index_count - index_count % 3);
+    std::vector<uint32_t> ids;
+    std::vector<uint32_t> next;
+    std::vector<Quadric> quadrics(vertex_count, Quadric{});
+    std::vector<uint32_t> offsets(vertex_count + 1);
+    std::vector<uint32_t> adjacency;
+    std::vector<uint32_t> remap(vertex_count);
+    std::vector<char> locked(vertex_count);
+    std::vector<char> touched(vertex_count);
+    std::vector<uint64_t> edges;
+    std::vector<Collapse> collapses;
+    double max_error = 0.0;
+
+    build_position_ids(vertices, vertex_count, ids, next);
+    for (size_t t = 0; t < result.size() / 3; t++) {
+        const uint32_t *tri = &result[t * 3];
+        glm::vec3 n = triangle_normal(vertices, tri[0], tri[1], tri[2]);
+        const float area = glm::length(n);
+        if (area == 0.0f) {
+            continue;
+        }
+        n /= area;
+        const double d = -glm::dot(n, vertices[tri[0]].position);
+        const double w = 0.5 * area;
+        const Quadric q = {w * n.x * n.x, w * n.x * n.y, w * n.x * n.z, w * n.y * n.y,
+                           w * n.y * n.z, w * n.z * n.z, w * d * n.x,   w * d * n.y,
+                           w * d * n.z,   w * d * d,     w};
+        for (uint32_t k = 0; k < 3; k++) {
+            quadric_add(quadrics[ids[tri[k]]], q);
+        }
+    }
+
+    while (result.size() > target_index_count) {
+        const size_t tri_count = result.size() / 3;
+        size_t removed = 0;
+        size_t write = 0;
+
+        // Vertex to triangle adjacency
+        std::fill(offsets.begin(), offsets.end(), 0);
+        for (uint32_t v : result) {
+            offsets[v + 1]++;
+        }
+        for (size_t v = 0; v < vertex_count; v++) {
+            offsets[v + 1] += offsets[v];
+        }
+        adjacency.resize(result.size());
+        {
+            std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+            for (size_t i = 0; i < result.size(); i++) {
+                adjacency[cursor[result[i]]++] = static_cast<uint32_t>(i / 3);
+            }
+        }
+
+        // Edges between positions, anything that isn't shared by exactly two triangles is a
+        // border or non manifold and stays put
+        edges.clear();
+        for (size_t t = 0; t < tri_count; t++) {
+            for (uint32_t k = 0; k < 3; k++) {
+                const uint32_t a = ids[result[t * 3 + k]];
+                const uint32_t b = ids[result[t * 3 + (k + 1) % 3]];
+                if (a != b) {
+                    edges.push_back((uint64_t)std::min(a, b) << 32 | std::max(a, b));
+                }
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+        std::fill(locked.begin(), locked.end(), 0);
+        collapses.clear();
+        for (size_t i = 0; i < edges.size();) {
+            size_t end = i + 1;
+            while (end < edges.size() && edges[end] == edges[i]) {
+                end++;
+            }
+            const uint32_t a = static_cast<uint32_t>(edges[i] >> 32);
+            const uint32_t b = static_cast<uint32_t>(edges[i] & UINT32_MAX);
+            if (end - i != 2) {
+                locked[a] = 1;
+                locked[b] = 1;
+            } else {
+                Quadric q = quadrics[a];
+                quadric_add(q, quadrics[b]);
+                const double ab = quadric_error(q, vertices[b].position);
+                const double ba = quadric_error(q, vertices[a].position);
+                collapses.push_back(ab <= ba ? Collapse{a, b, ab} : Collapse{b, a, ba});
+            }
+            i = end;
+        }
+        std::sort(collapses.begin(), collapses.end(),
+                  [](const Collapse &a, const Collapse &b) { return a.error < b.error; });
+
+        // Collapse the cheapest edges, each position at most once per pass
+        for (size_t v = 0; v < vertex_count; v++) {
+            remap[v] = static_cast<uint32_t>(v);
+        }
+        std::fill(touched.begin(), touched.end(), 0);
+        for (const Collapse &collapse : collapses) {
+            if (tri_count - removed <= target_index_count / 3) {
+                break;
+            }
+            if (locked[collapse.from] || touched[collapse.from] || touched[collapse.to]) {
+                continue;
+            }
+            if (!plan_collapse(result, offsets, adjacency, ids, next, vertices, remap,
+                               collapse.from, collapse.to)) {
+                continue;
+            }
+            touched[collapse.from] = 1;
+            touched[collapse.to] = 1;
+            quadric_add(quadrics[collapse.to], quadrics[collapse.from]);
+            max_error = std::max(max_error, collapse.error);
+            // The two triangles on the edge
+            removed += 2;
+        }
+        if (removed == 0) {
+            break;
+        }
+
+        for (size_t t = 0; t < tri_count; t++) {
+            const uint32_t a = remap[result[t * 3 + 0]];
+            const uint32_t b = remap[result[t * 3 + 1]];
+            const uint32_t c = remap[result[t * 3 + 2]];
+            if (ids[a] == ids[b] || ids[b] == ids[c] || ids[a] == ids[c]) {
+                continue;
+            }
+            result[write++] = a;
+            result[write++] = b;
+            result[write++] = c;
+        }
+        result.resize(write);
+    }
+
+    error = static_cast<float>(std::sqrt(max_error));
+    std::copy(result.begin(), result.end(), dst);
+    return result.size();
+}
+
+void tine::build_mesh_lods(MeshData &data, Mesh &mesh) {
+    ZoneScoped;
+    std::vector<uint32_t> indices(data.indices.begin() + mesh.index_offset,
+                                  data.indices.begin() + mesh.index_offset + mesh.index_count);
+    MeshLod lod = {mesh.index_offset, mesh.index_count, 0.0f, 0, 0};
+
+    mesh.lod_offset = static_cast<uint32_t>(data.lods.size());
+    mesh.lod_count = 1;
+    data.lods.push_back(lod);
+
+    // Each level is simplified from the previous one, so the errors add up
+    while (mesh.lod_count < MAX_MESH_LODS && lod.index_count / 3 > MIN_LOD_TRIANGLES) {
+        float error = 0.0f;
+        const size_t index_count =
+            simplify_mesh(indices.data(), indices.data(), lod.index_count,
+                          &data.vertices[mesh.vertex_offset], mesh.vertex_count,
+                          lod.index_count / 6 * 3, error);
+        // Simplification has stalled, usually on borders, not worth another level
+        if (index_count > lod.index_count * 3 / 4) {
+            break;
+        }
+        optimize_vertex_cache(indices.data(), index_count, mesh.vertex_count);
+
+        lod.index_offset = static_cast<uint32_t>(data.indices.size());
+        lod.index_count = static_cast<uint32_t>(index_count);
+        lod.error += error;
+        data.indices.insert(data.indices.end(), indices.begin(), indices.begin() + index_count);
+        data.lods.push_back(lod);
+        mesh.lod_count++;
+    }
+}
+
+// Bounding sphere around the box center and the cone of the triangle normals of a meshlet.
+static void compute_meshlet_bounds(const tine::MeshData &data, const tine::Mesh &mesh,
+                                   tine::Meshlet &meshlet) {
+    const tine::Vertex *vertices = &data.vertices[mesh.vertex_offset];
+    const uint32_t *meshlet_vertices = &data.meshlet_vertices[meshlet.vertex_offset];
+    const uint32_t *triangles = &data.meshlet_triangles[meshlet.triangle_offset];
+    std::vector<glm::vec3> normals(meshlet.triangle_count);
+    glm::vec3 lo(std::numeric_limits<float>::max());
+    glm::vec3 hi(-std::numeric_limits<float>::max());
+    glm::vec3 axis(0.0f);
+    float radius = 0.0f;
+    float min_dp = 1.0f;
+
+    for (uint32_t v = 0; v < meshlet.vertex_count; v++) {
+        lo = glm::min(lo, vertices[meshlet_vertices[v]].position);
+        hi = glm::max(hi, vertices[meshlet_vertices[v]].position);
+    }
+    const glm::vec3 center = 0.5f * (lo + hi);
+    for (uint32_t v = 0; v < meshlet.vertex_count; v++) {
+        radius = std::max(radius, glm::length(vertices[meshlet_vertices[v]].position - center));
+    }
+
+    for (uint32_t t = 0; t < meshlet.triangle_count; t++) {
+        const glm::vec3 &a = vertices[meshlet_vertices[triangles[t] & 0xff]].position;
+        const glm::vec3 &b = vertices[meshlet_vertices[(triangles[t] >> 8) & 0xff]].position;
+        const glm::vec3 &c = vertices[meshlet_vertices[(triangles[t] >> 16) & 0xff]].position;
+        const glm::vec3 normal = glm::cross(b - a, c - a);
+        const float len = glm::length(normal);
+        normals[t] = (len > 0.0f) ? normal / len : glm::vec3(0.0f);
+        axis += normals[t];
+    }
+    if (glm::length(axis) > 0.0f) {
+        axis = glm::normalize(axis);
+        for (uint32_t t = 0; t < meshlet.triangle_count; t++) {
+            min_dp = std::min(min_dp, glm::dot(normals[t], axis));
+        }
+    } else {
+        min_dp = 0.0f;
+    }
+
+    meshlet.sphere = glm::vec4(center, radius);
+    // The cluster is backfacing when the view direction to the sphere is within the cone's
+    // complement, see meshlet_cull.comp
+    const float cutoff = (min_dp <= MIN_CONE_SPREAD) ? 1.0f : std::sqrt(1.0f - min_dp * min_dp);
+    meshlet.cone = glm::vec4(axis, cutoff);
+}
+
+void tine::build_mesh_meshlets(MeshData &data, const Mesh &mesh) {
+    ZoneScoped;
+    // Local index of each mesh vertex in the meshlet being built
+    std::vector<uint32_t> local(mesh.vertex_count, UINT32_MAX);
+
+    for (uint32_t l = mesh.lod_offset; l < mesh.lod_offset + mesh.lod_count; l++) {
+        MeshLod &lod = data.lods[l];
+        Meshlet meshlet = {};
+        if (lod.index_count / 3 < MIN_MESHLET_LOD_TRIANGLES) {
+            continue;
+        }
+        lod.meshlet_offset = static_cast<uint32_t>(data.meshlets.size());
+        meshlet.vertex_offset = static_cast<uint32_t>(data.meshlet_vertices.size());
+        meshlet.triangle_offset = static_cast<uint32_t>(data.meshlet_triangles.size());
+
+        for (uint32_t i = lod.index_offset; i < lod.index_offset + lod.index_count; i += 3) {
+            const uint32_t *tri = &data.indices[i];
+            const uint32_t new_vertices = (local[tri[0]] == UINT32_MAX) +
+                                          (local[tri[1]] == UINT32_MAX && tri[1] != tri[0]) +
+                                          (local[tri[2]] == UINT32_MAX && tri[2] != tri[0] &&
+                                           tri[2] != tri[1]);
+            if (meshlet.vertex_count + new_vertices > MESHLET_MAX_VERTICES ||
+                meshlet.triangle_count == MESHLET_MAX_TRIANGLES) {
+                compute_meshlet_bounds(data, mesh, meshlet);
+                data.meshlets.push_back(meshlet);
+                for (uint32_t v = 0; v < meshlet.vertex_count; v++) {
+                    local[data.meshlet_vertices[meshlet.vertex_offset + v]] = UINT32_MAX;
+                }
+                meshlet.vertex_offset = static_cast<uint32_t>(data.meshlet_vertices.size());
+                meshlet.triangle_offset = static_cast<uint32_t>(data.meshlet_triangles.size());
+                meshlet.vertex_count = 0;
+                meshlet.triangle_count = 0;
+            }
+            for (uint32_t k = 0; k < 3; k++) {
+                if (local[tri[k]] == UINT32_MAX) {
+                    local[tri[k]] = meshlet.vertex_count++;
+                    data.meshlet_vertices.push_back(tri[k]);
+                }
+            }
+            data.meshlet_triangles.push_back(local[tri[0]] | (local[tri[1]] << 8) |
+                                             (local[tri[2]] << 16));
+            meshlet.triangle_count++;
+        }
+        if (meshlet.triangle_count > 0) {
+            compute_meshlet_bounds(data, mesh, meshlet);
+            data.meshlets.push_back(meshlet);
+            for (uint32_t v = 0; v < meshlet.vertex_count; v++) {
+                local[data.meshlet_vertices[meshlet.vertex_offset + v]] = UINT32_MAX;
+            }
+        }
+        lod.meshlet_count = static_cast<uint32_t>(data.meshlets.size()) - lod.meshlet_offset;
+    }
+}
+
+static uint16_t quantize_unorm16(float v) {
+    return static_cast<uint16_t>(std::floor(glm::clamp(v, 0.0f, 1.0f) * 65535.0f + 0.5f));
+}
+
+static int16_t quantize_snorm16(float v) {
+    return static_cast<int16_t>(std::floor(glm::clamp(v, -1.0f, 1.0f) * 32767.0f + 0.5f));
+}
+
+// Cigolle et al., "A Survey of Efficient Representations for Independent Unit Vectors"
+static glm::vec2 octahedral_encode(const glm::vec3 &n) {
+    const float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    glm::vec2 e(0.0f);
+    if (l1 == 0.0f) {
+        return e;
+    }
+    e = glm::vec2(n.x, n.y) / l1;
+    if (n.z < 0.0f) {
+        const glm::vec2 sign(e.x >= 0.0f ? 1.0f : -1.0f, e.y >= 0.0f ? 1.0f : -1.0f);
+        e = (glm::vec2(1.0f) - glm::abs(glm::vec2(e.y, e.x))) * sign;
+    }
+    return e;
+}
+
+void tine::quantize_mesh_data(const MeshData &data, std::vector<QuantizedVertex> &vertices,
+                              std::vector<MeshQuantization> &quantization) {
+    ZoneScoped;
+    vertices.resize(data.vertices.size());
+    quantization.resize(data.meshes.size());
+    for (size_t m = 0; m < data.meshes.size(); m++) {
+        const Mesh &mesh = data.meshes[m];
+        if (mesh.vertex_count == 0) {
+            quantization[m] = MeshQuantization{glm::vec4(0.0f), glm::vec4(0.0f)};
+            continue;
+        }
+        const glm::vec3 extent = mesh.aabb_max - mesh.aabb_min;
+        const glm::vec3 inv_extent(extent.x > 0.0f ? 1.0f / extent.x : 0.0f,
+                                   extent.y > 0.0f ? 1.0f / extent.y : 0.0f,
+                                   extent.z > 0.0f ? 1.0f / extent.z : 0.0f);
+        quantization[m].offset = glm::vec4(mesh.aabb_min, 0.0f);
+        quantization[m].scale = glm::vec4(extent, 0.0f);
+
+        for (uint32_t v = mesh.vertex_offset; v < mesh.vertex_offset + mesh.vertex_count; v++) {
+            const Vertex &src = data.vertices[v];
+            QuantizedVertex &dst = vertices[v];
+            const glm::vec3 position = (src.position - mesh.aabb_min) * inv_extent;
+            const glm::vec2 normal = octahedral_encode(src.normal);
+            dst.position[0] = quantize_unorm16(position.x);
+            dst.position[1] = quantize_unorm16(position.y);
+            dst.position[2] = quantize_unorm16(position.z);
+            dst.position[3] = 0;
+            dst.normal[0] = quantize_snorm16(normal.x);
+            dst.normal[1] = quantize_snorm16(normal.y);
+            dst.uv[0] = glm::packHalf1x16(src.uv.x);
+            dst.uv[1] = glm::packHalf1x16(src.uv.y);
+        }
+    }
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace tine {
+
+struct Vertex {
+    glm::vec3 position;
+    glm::vec3 normal;
+    glm::vec2 uv;
+};
+static_assert(sizeof(Vertex) == 8 * sizeof(float), "Vertex must be tightly packed");
+
+// GPU vertex format, see basic_triangle.vert and skinning.comp for the decoding.
+struct QuantizedVertex {
+    uint16_t position[4]; // unorm, relative to the bounds of the mesh, w is unused
+    int16_t normal[2];    // snorm octahedral encoding
+    uint16_t uv[2];       // half float
+};
+static_assert(sizeof(QuantizedVertex) == 4 * sizeof(uint32_t), "QuantizedVertex must be packed");
+
+// position = offset + scale * quantized position, one per Mesh.
+struct MeshQuantization {
+    glm::vec4 offset;
+    glm::vec4 scale;
+};
+
+// Including the full detail mesh
+static const uint32_t MAX_MESH_LODS = 6;
+
+// Cluster limits, small enough for one workgroup to cull and compact a cluster
+static const uint32_t MESHLET_MAX_VERTICES = 64;
+static const uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+// A cluster of nearby triangles of a MeshLod, culled as a whole on the GPU.  Mirrors Meshlet in
+// meshlet_cull.comp.
+struct Meshlet {
+    glm::vec4 sphere; // Object space bounding sphere, w is the radius
+    // Average normal in xyz, w is the cone cutoff, 1 if the cluster can't be backface culled
+    glm::vec4 cone;
+    uint32_t vertex_offset;   // Into MeshData::meshlet_vertices
+    uint32_t triangle_offset; // Into MeshData::meshlet_triangles
+    uint32_t vertex_count;
+    uint32_t triangle_count;
+};
+static_assert(sizeof(Meshlet) == 12 * sizeof(uint32_t), "Meshlet must be tightly packed");
+
+// A simplified version of a Mesh, an index range over the same vertices.
+struct MeshLod {
+    uint32_t index_offset;
+    uint32_t index_count;
+    float error; // Largest deviation from the full detail mesh, in mesh units
+    // Into MeshData::meshlets, no meshlets if the level is too coarse to be worth culling
+    uint32_t meshlet_offset;
+    uint32_t meshlet_count;
+};
+
+// A range of the shared vertex and index buffers.  Indices are relative to vertex_offset.
+struct Mesh {
+    uint32_t vertex_offset;
+    uint32_t vertex_count;
+    uint32_t index_offset; // Full detail, same as LOD 0
+    uint32_t index_count;
+    uint32_t lod_offset; // Into MeshData::lods
+    uint32_t lod_count;
+    glm::vec3 aabb_min;
+    glm::vec3 aabb_max;
+};
+
+// CPU side copy of all the geometry in a scene, laid out exactly as it is uploaded to the GPU.
+struct MeshData {
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<Mesh> meshes;
+    std::vector<MeshLod> lods;
+    std::vector<Meshlet> meshlets;
+    std::vector<uint32_t> meshlet_vertices; // Relative to Mesh::vertex_offset
+    // One per triangle, three 8 bit indices into the meshlet's vertices
+    std::vector<uint32_t> meshlet_triangles;
+};
+
+// Import time optimizations, in the order they should be run.  indices are relative to the
+// first vertex of the mesh and are reordered in place.
+void optimize_vertex_cache(uint32_t *indices, size_t index_count, size_t vertex_count);
+void optimize_overdraw(uint32_t *indices, size_t index_count, const Vertex *vertices,
+                       size_t vertex_count);
+// Renumbers the vertices in the order they're first referenced and drops unused ones.
+// remap[old] is the new index, or UINT32_MAX if the vertex was dropped.  Returns the new count.
+size_t optimize_vertex_fetch(uint32_t *indices, size_t index_count, size_t vertex_count,
+                             std::vector<uint32_t> &remap);
+
+// Collapses edges until at most target_index_count indices remain or nothing more can go without
+// opening holes, writing the result to dst, which may alias indices.  Vertices are never moved or
+// added, so the result shares the vertex range of the input.  error is the largest deviation
+// introduced, in mesh units.  Returns the new index count.
+size_t simplify_mesh(uint32_t *dst, const uint32_t *indices, size_t index_count,
+                     const Vertex *vertices, size_t vertex_count, size_t target_index_count,
+                     float &error);
+
+// Appends the LOD chain of mesh to data, each level with about half the triangles of the last.
+// The mesh's vertices and indices must already be in data.
+void build_mesh_lods(MeshData &data, Mesh &mesh);
+
+// Splits every dense enough LOD of mesh into meshlets, in index order so that the vertex cache
+// optimization carries over.  Must run after build_mesh_lods.
+void build_mesh_meshlets(MeshData &data, const Mesh &mesh);
+
+// Applies a remap from optimize_vertex_fetch to any per vertex array.
+template <typename T>
+void remap_vertices(T *vertices, size_t vertex_count, const std::vector<uint32_t> &remap) {
+    const std::vector<T> original(vertices, vertices + vertex_count);
+    for (size_t v = 0; v < vertex_count; v++) {
+        if (remap[v] != UINT32_MAX) {
+            vertices[remap[v]] = original[v];
+        }
+    }
+}
+
+void quantize_mesh_data(const MeshData &data, std::vector<QuantizedVertex> &vertices,
+                        std::vector<MeshQuantization> &quantization);
+
+} // namespace tine
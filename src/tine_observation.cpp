@@ -0,0 +1,62 @@
+#include "tine_log.h"
+#include "tine_observation.h"
+#include "tine_animation.h"
+#include "tine_component.h"
+#include "tine_scene.h"
+#include <tracy/Tracy.hpp>
+
+bool tine::init_observations(Scene &scene, Observations &obs) {
+    entt::registry &registry = scene.get_registry();
+    const std::vector<entt::entity> &entities = scene.get_environment_entities();
+    const tine::AnimationData &anim = scene.get_animation_data();
+
+    obs.env_count = scene.get_environment_count();
+    TINE_CHECK(entities.size() % obs.env_count == 0, "Environments differ in size", Error);
+    obs.pose_entities.clear();
+    obs.action_entities.clear();
+    for (entt::entity entity : entities) {
+        if (registry.all_of<tine::TransformComponent>(entity)) {
+            obs.pose_entities.push_back(entity);
+        }
+        if (registry.all_of<tine::AnimationComponent>(entity)) {
+            obs.action_entities.push_back(entity);
+        }
+    }
+    obs.pose_count = static_cast<uint32_t>(obs.pose_entities.size() / obs.env_count);
+    obs.action_count = static_cast<uint32_t>(obs.action_entities.size() / obs.env_count);
+    obs.poses.resize(obs.pose_entities.size());
+
+    // Environments append their skinned clones in order, so each owns an equal run of the palette
+    obs.joint_count = static_cast<uint32_t>(anim.joint_palette.size() / obs.env_count);
+
+    update_observations(scene, obs);
+    return true;
+Error:
+    return false;
+}
+
+bool tine::apply_actions(Scene &scene, const Observations &obs, const float *actions,
+                         uint32_t env_cnt) {
+    entt::registry &registry = scene.get_registry();
+    TINE_CHECK(env_cnt == obs.env_count, "Actions don't cover every environment", Error);
+    if (actions == nullptr) {
+        return true;
+    }
+    for (size_t i = 0; i < obs.action_entities.size(); i++) {
+        registry.get<tine::AnimationComponent>(obs.action_entities[i]).speed = actions[i];
+    }
+    return true;
+Error:
+    return false;
+}
+
+void tine::update_observations(Scene &scene, Observations &obs) {
+    ZoneScoped;
+    entt::registry &registry = scene.get_registry();
+    const tine::AnimationData &anim = scene.get_animation_data();
+    for (size_t i = 0; i < obs.pose_entities.size(); i++) {
+        obs.poses[i] = registry.get<tine::TransformComponent>(obs.pose_entities[i]).transform;
+    }
+    // Skinned instances added since init_observations may have moved the palette
+    obs.joints = anim.joint_palette.empty() ? nullptr : anim.joint_palette.data();
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include <entt/entt.hpp>
+
+namespace tine {
+
+class Scene;
+
+// Engine owned per environment state handed out to training code.  The buffers are rewritten in
+// place by every step and never move while the scene stays loaded.  Everything is laid out
+// [env][slot], with slots in the entity order of Scene::get_environment_entities.  poses is the
+// one copy, of pose_count * env_count matrices per step: the TransformComponent pool also holds
+// entities outside the environments, such as streamed world cells, and reorders as entities come
+// and go, so it can't be handed out in that layout.
+struct Observations {
+    uint32_t env_count = 0;
+    uint32_t pose_count = 0;   // Per environment, entities with a TransformComponent
+    uint32_t joint_count = 0;  // Per environment, joint matrices of the skinned instances
+    uint32_t action_count = 0; // Per environment, entities with an AnimationComponent
+    std::vector<glm::mat4> poses;
+    // Views AnimationData::joint_palette, refreshed by update_observations in case it grew
+    const glm::mat4 *joints = nullptr;
+    std::vector<entt::entity> pose_entities;
+    std::vector<entt::entity> action_entities;
+};
+
+// Sizes the buffers for the scene's environments, after Scene::create_environments
+bool init_observations(Scene &scene, Observations &obs);
+// actions holds action_count playback speeds for each of env_cnt environments
+bool apply_actions(Scene &scene, const Observations &obs, const float *actions, uint32_t env_cnt);
+void update_observations(Scene &scene, Observations &obs);
+
+} // namespace tine
@@ -0,0 +1,464 @@
+#include "tine_physics.h"
+#include "tine_collision.h"
+#include "tine_component.h"
+#include "tine_jobs.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <vector>
+#include <glm/gtc/matrix_transform.hpp>
+#include <tracy/Tracy.hpp>
+
+static const float MAX_STEP = 1.0f / 30.0f;
+static const float DEFAULT_FRICTION = 0.5f;
+// Share of the penetration past the slop that is pushed out every step
+static const float BAUMGARTE = 0.2f;
+static const float PENETRATION_SLOP = 0.005f;
+static const float LINEAR_DAMPING = 0.01f;
+static const float ANGULAR_DAMPING = 0.05f;
+static const float MAX_ANGULAR_SPEED = 50.0f;
+static const float LINEAR_SLEEP_THRESHOLD = 0.05f;  // m/s
+static const float ANGULAR_SLEEP_THRESHOLD = 0.05f; // rad/s
+static const float TIME_TO_SLEEP = 0.5f;
+// Solver body standing in for every static collider, never written
+static const uint32_t STATIC_BODY = 0;
+
+struct SolverBody {
+    entt::entity entity;
+    glm::mat4 transform;
+    glm::vec3 local_center;
+    glm::vec3 center; // World space center of mass
+    glm::vec3 linear_velocity;
+    glm::vec3 angular_velocity;
+    glm::mat3 inverse_inertia; // World space
+    float inverse_mass;
+    float friction;
+    float sleep_time;
+    bool is_awake;
+};
+
+struct Island {
+    uint32_t body_offset; // Into island_bodies
+    uint32_t body_count;
+    uint32_t manifold_offset; // Into island_manifolds
+    uint32_t manifold_count;
+    bool is_awake;
+};
+
+struct ContactConstraint {
+    uint32_t a; // Solver bodies
+    uint32_t b;
+    tine::ContactPoint *point;
+    glm::vec3 normal;
+    glm::vec3 tangents[2];
+    glm::vec3 ra; // From the centers of mass to the contact
+    glm::vec3 rb;
+    float normal_mass;
+    float tangent_mass[2];
+    float bias;
+    float friction;
+};
+
+// The per-step containers are kept and only cleared, so a steady scene doesn't allocate
+struct tine::PhysicsWorld::Pimpl {
+    tine::CollisionWorld collision;
+    glm::vec3 gravity = glm::vec3(0.0f, -9.81f, 0.0f);
+    uint32_t velocity_iterations = 8;
+    std::vector<SolverBody> bodies;
+    // By entity index, stale entries are caught by checking the body's entity
+    std::vector<uint32_t> body_index;
+    std::vector<uint32_t> parents; // Union find over the bodies
+    std::vector<uint32_t> island_of;
+    std::vector<uint32_t> manifold_island;
+    std::vector<Island> islands;
+    std::vector<uint32_t> island_bodies;
+    std::vector<uint32_t> island_manifolds;
+    std::vector<uint32_t> awake_islands;
+    // MAX_MANIFOLD_POINTS per island manifold, so islands solved side by side get their own range
+    std::vector<ContactConstraint> constraints;
+    uint32_t awake_island_cnt = 0;
+};
+
+tine::RigidBodyComponent tine::make_rigid_body(const CollisionData &data, uint32_t hull,
+                                               const glm::mat4 &transform, float mass) {
+    RigidBodyComponent body = {};
+    const ConvexHull &h = data.hulls[hull];
+    const glm::vec3 scale(glm::length(glm::vec3(transform[0])),
+                          glm::length(glm::vec3(transform[1])),
+                          glm::length(glm::vec3(transform[2])));
+    const glm::vec3 e = 0.5f * (h.aabb_max - h.aabb_min) * scale;
+    body.local_center = 0.5f * (h.aabb_min + h.aabb_max);
+    body.friction = DEFAULT_FRICTION;
+    if (mass > 0.0f) {
+        body.inverse_mass = 1.0f / mass;
+        const glm::vec3 inertia = mass / 3.0f * glm::vec3(e.y * e.y + e.z * e.z,
+                                                          e.x * e.x + e.z * e.z,
+                                                          e.x * e.x + e.y * e.y);
+        body.inverse_inertia = glm::vec3(inertia.x > 0.0f ? 1.0f / inertia.x : 0.0f,
+                                         inertia.y > 0.0f ? 1.0f / inertia.y : 0.0f,
+                                         inertia.z > 0.0f ? 1.0f / inertia.z : 0.0f);
+    }
+    return body;
+}
+
+tine::PhysicsWorld::PhysicsWorld() : m_pimpl(new Pimpl) {}
+tine::PhysicsWorld::~PhysicsWorld() {}
+
+void tine::PhysicsWorld::set_gravity(const glm::vec3 &gravity) { m_pimpl->gravity = gravity; }
+
+void tine::PhysicsWorld::set_iterations(uint32_t velocity_iterations) {
+    m_pimpl->velocity_iterations = std::max(1u, velocity_iterations);
+}
+
+void tine::PhysicsWorld::clear() { m_pimpl->collision.clear(); }
+
+tine::CollisionWorld &tine::PhysicsWorld::get_collision_world() { return m_pimpl->collision; }
+
+uint32_t tine::PhysicsWorld::get_island_count() const {
+    return static_cast<uint32_t>(m_pimpl->islands.size());
+}
+
+uint32_t tine::PhysicsWorld::get_awake_island_count() const { return m_pimpl->awake_island_cnt; }
+
+// Returns whether any body is awake
+static bool gather_bodies(tine::PhysicsWorld::Pimpl &p, entt::registry &registry) {
+    bool is_any_awake = false;
+    p.bodies.clear();
+    p.bodies.push_back({});
+    p.bodies[STATIC_BODY].entity = entt::null;
+    p.bodies[STATIC_BODY].inverse_inertia = glm::mat3(0.0f);
+    p.bodies[STATIC_BODY].friction = DEFAULT_FRICTION;
+
+    auto view = registry.view<const tine::TransformComponent, const tine::RigidBodyComponent>();
+    for (entt::entity entity : view) {
+        const tine::RigidBodyComponent &rb = view.get<const tine::RigidBodyComponent>(entity);
+        // Bodies moved by hand take part as static colliders
+        if (rb.inverse_mass <= 0.0f) {
+            continue;
+        }
+        SolverBody body;
+        body.entity = entity;
+        body.transform = view.get<const tine::TransformComponent>(entity).transform;
+        body.local_center = rb.local_center;
+        body.center = glm::vec3(body.transform * glm::vec4(rb.local_center, 1.0f));
+        body.linear_velocity = rb.linear_velocity;
+        body.angular_velocity = rb.angular_velocity;
+        body.inverse_mass = rb.inverse_mass;
+        body.friction = rb.friction;
+        body.sleep_time = rb.sleep_time;
+        body.is_awake = !rb.is_sleeping;
+        const glm::mat3 m(body.transform);
+        const glm::mat3 rotation(glm::normalize(m[0]), glm::normalize(m[1]),
+                                 glm::normalize(m[2]));
+        const glm::mat3 inverse_inertia(glm::vec3(rb.inverse_inertia.x, 0.0f, 0.0f),
+                                        glm::vec3(0.0f, rb.inverse_inertia.y, 0.0f),
+                                        glm::vec3(0.0f, 0.0f, rb.inverse_inertia.z));
+        body.inverse_inertia = rotation * inverse_inertia * glm::transpose(rotation);
+        is_any_awake = is_any_awake || body.is_awake;
+        const size_t index = static_cast<size_t>(entt::to_entity(entity));
+        if (index >= p.body_index.size()) {
+            p.body_index.resize(index + 1, STATIC_BODY);
+        }
+        p.body_index[index] = static_cast<uint32_t>(p.bodies.size());
+        p.bodies.push_back(body);
+    }
+    return is_any_awake;
+}
+
+static uint32_t find_body(const tine::PhysicsWorld::Pimpl &p, entt::entity entity) {
+    if (entity == entt::null) {
+        return STATIC_BODY;
+    }
+    const size_t index = static_cast<size_t>(entt::to_entity(entity));
+    if (index >= p.body_index.size()) {
+        return STATIC_BODY;
+    }
+    const uint32_t body = p.body_index[index];
+    return body < p.bodies.size() && p.bodies[body].entity == entity ? body : STATIC_BODY;
+}
+
+static uint32_t find_root(std::vector<uint32_t> &parents, uint32_t i) {
+    while (parents[i] != i) {
+        parents[i] = parents[parents[i]];
+        i = parents[i];
+    }
+    return i;
+}
+
+// Bodies joined by manifolds end up in one island, static colliders join nothing.  Islands with
+// an awake body wake all of theirs.
+static void build_islands(tine::PhysicsWorld::Pimpl &p,
+                          const std::vector<tine::ContactManifold> &manifolds) {
+    ZoneScoped;
+    const uint32_t body_cnt = static_cast<uint32_t>(p.bodies.size());
+    std::vector<uint32_t> &island_of = p.island_of;
+    std::vector<uint32_t> &manifold_island = p.manifold_island;
+
+    island_of.assign(body_cnt, UINT32_MAX);
+    manifold_island.assign(manifolds.size(), UINT32_MAX);
+
+    p.parents.resize(body_cnt);
+    std::iota(p.parents.begin(), p.parents.end(), 0u);
+    for (const tine::ContactManifold &manifold : manifolds) {
+        const uint32_t a = find_body(p, manifold.a);
+        const uint32_t b = find_body(p, manifold.b);
+        if (a != STATIC_BODY && b != STATIC_BODY) {
+            p.parents[find_root(p.parents, a)] = find_root(p.parents, b);
+        }
+    }
+
+    p.islands.clear();
+    for (uint32_t i = 1; i < body_cnt; i++) {
+        const uint32_t root = find_root(p.parents, i);
+        if (island_of[root] == UINT32_MAX) {
+            island_of[root] = static_cast<uint32_t>(p.islands.size());
+            p.islands.push_back({});
+        }
+        island_of[i] = island_of[root];
+        Island &island = p.islands[island_of[i]];
+        island.body_count++;
+        island.is_awake = island.is_awake || p.bodies[i].is_awake;
+    }
+    for (size_t m = 0; m < manifolds.size(); m++) {
+        const uint32_t a = find_body(p, manifolds[m].a);
+        const uint32_t body = a != STATIC_BODY ? a : find_body(p, manifolds[m].b);
+        if (body != STATIC_BODY) {
+            manifold_island[m] = island_of[body];
+            p.islands[island_of[body]].manifold_count++;
+        }
+    }
+
+    // Bucket the bodies and manifolds by island
+    uint32_t body_offset = 0;
+    uint32_t manifold_offset = 0;
+    for (Island &island : p.islands) {
+        island.body_offset = body_offset;
+        island.manifold_offset = manifold_offset;
+        body_offset += island.body_count;
+        manifold_offset += island.manifold_count;
+        island.body_count = 0;
+        island.manifold_count = 0;
+    }
+    p.island_bodies.resize(body_offset);
+    p.island_manifolds.resize(manifold_offset);
+    p.constraints.resize(static_cast<size_t>(manifold_offset) * tine::MAX_MANIFOLD_POINTS);
+    for (uint32_t i = 1; i < body_cnt; i++) {
+        Island &island = p.islands[island_of[i]];
+        p.island_bodies[island.body_offset + island.body_count++] = i;
+        if (island.is_awake && !p.bodies[i].is_awake) {
+            p.bodies[i].is_awake = true;
+            p.bodies[i].sleep_time = 0.0f;
+        }
+    }
+    for (uint32_t m = 0; m < manifolds.size(); m++) {
+        if (manifold_island[m] != UINT32_MAX) {
+            Island &island = p.islands[manifold_island[m]];
+            p.island_manifolds[island.manifold_offset + island.manifold_count++] = m;
+        }
+    }
+}
+
+static void make_tangents(const glm::vec3 &n, glm::vec3 *tangents) {
+    tangents[0] = std::abs(n.x) >= 0.57735f ? glm::normalize(glm::vec3(n.y, -n.x, 0.0f))
+                                            : glm::normalize(glm::vec3(0.0f, n.z, -n.y));
+    tangents[1] = glm::cross(n, tangents[0]);
+}
+
+static float get_effective_mass(const SolverBody &a, const SolverBody &b, const glm::vec3 &ra,
+                                const glm::vec3 &rb, const glm::vec3 &direction) {
+    const glm::vec3 ta = glm::cross(a.inverse_inertia * glm::cross(ra, direction), ra);
+    const glm::vec3 tb = glm::cross(b.inverse_inertia * glm::cross(rb, direction), rb);
+    const float k = a.inverse_mass + b.inverse_mass + glm::dot(ta + tb, direction);
+    return k > 0.0f ? 1.0f / k : 0.0f;
+}
+
+static glm::vec3 get_relative_velocity(const std::vector<SolverBody> &bodies,
+                                       const ContactConstraint &c) {
+    const SolverBody &a = bodies[c.a];
+    const SolverBody &b = bodies[c.b];
+    return b.linear_velocity + glm::cross(b.angular_velocity, c.rb) - a.linear_velocity -
+           glm::cross(a.angular_velocity, c.ra);
+}
+
+static void apply_impulse(std::vector<SolverBody> &bodies, const ContactConstraint &c,
+                          const glm::vec3 &impulse) {
+    if (c.a != STATIC_BODY) {
+        SolverBody &a = bodies[c.a];
+        a.linear_velocity -= impulse * a.inverse_mass;
+        a.angular_velocity -= a.inverse_inertia * glm::cross(c.ra, impulse);
+    }
+    if (c.b != STATIC_BODY) {
+        SolverBody &b = bodies[c.b];
+        b.linear_velocity += impulse * b.inverse_mass;
+        b.angular_velocity += b.inverse_inertia * glm::cross(c.rb, impulse);
+    }
+}
+
+static void integrate_transform(SolverBody &body, float dt) {
+    const float speed = glm::length(body.angular_velocity);
+    if (speed > MAX_ANGULAR_SPEED) {
+        body.angular_velocity *= MAX_ANGULAR_SPEED / speed;
+    }
+    glm::mat3 m(body.transform);
+    const float angle = std::min(speed, MAX_ANGULAR_SPEED) * dt;
+    if (angle > 1e-7f) {
+        m = glm::mat3(glm::rotate(glm::mat4(1.0f), angle, body.angular_velocity / speed)) * m;
+    }
+    body.center += body.linear_velocity * dt;
+    body.transform = glm::mat4(m);
+    body.transform[3] = glm::vec4(body.center - m * body.local_center, 1.0f);
+}
+
+// Sequential impulses over one island.  Only its own bodies are written, which is what lets
+// islands run side by side.
+static void solve_island(tine::PhysicsWorld::Pimpl &p, const Island &island,
+                         std::vector<tine::ContactManifold> &manifolds, float dt) {
+    std::vector<SolverBody> &bodies = p.bodies;
+    const size_t constraint_offset =
+        static_cast<size_t>(island.manifold_offset) * tine::MAX_MANIFOLD_POINTS;
+    ContactConstraint *constraints = p.constraints.data() + constraint_offset;
+    uint32_t constraint_cnt = 0;
+    const float linear_damping = 1.0f / (1.0f + dt * LINEAR_DAMPING);
+    const float angular_damping = 1.0f / (1.0f + dt * ANGULAR_DAMPING);
+
+    for (uint32_t i = 0; i < island.body_count; i++) {
+        SolverBody &body = bodies[p.island_bodies[island.body_offset + i]];
+        body.linear_velocity = (body.linear_velocity + p.gravity * dt) * linear_damping;
+        body.angular_velocity *= angular_damping;
+    }
+
+    // Prepare the contacts and apply last step's impulses
+    for (uint32_t m = 0; m < island.manifold_count; m++) {
+        tine::ContactManifold &manifold = manifolds[p.island_manifolds[island.manifold_offset + m]];
+        const uint32_t a = find_body(p, manifold.a);
+        const uint32_t b = find_body(p, manifold.b);
+        for (uint32_t i = 0; i < manifold.point_count; i++) {
+            tine::ContactPoint &point = manifold.points[i];
+            ContactConstraint c;
+            c.a = a;
+            c.b = b;
+            c.point = &point;
+            c.normal = manifold.normal;
+            make_tangents(c.normal, c.tangents);
+            c.ra = point.position_a - bodies[a].center;
+            c.rb = point.position_b - bodies[b].center;
+            c.normal_mass = get_effective_mass(bodies[a], bodies[b], c.ra, c.rb, c.normal);
+            c.tangent_mass[0] = get_effective_mass(bodies[a], bodies[b], c.ra, c.rb,
+                                                   c.tangents[0]);
+            c.tangent_mass[1] = get_effective_mass(bodies[a], bodies[b], c.ra, c.rb,
+                                                   c.tangents[1]);
+            // Speculative contacts may close their gap this step but no more
+            c.bias = point.depth < 0.0f
+                         ? point.depth / dt
+                         : BAUMGARTE / dt * std::max(point.depth - PENETRATION_SLOP, 0.0f);
+            c.friction = std::sqrt(bodies[a].friction * bodies[b].friction);
+            apply_impulse(bodies, c,
+                          c.normal * point.normal_impulse +
+                              c.tangents[0] * point.tangent_impulse[0] +
+                              c.tangents[1] * point.tangent_impulse[1]);
+            constraints[constraint_cnt++] = c;
+        }
+    }
+
+    for (uint32_t iteration = 0; iteration < p.velocity_iterations; iteration++) {
+        for (uint32_t k = 0; k < constraint_cnt; k++) {
+            ContactConstraint &c = constraints[k];
+            tine::ContactPoint &point = *c.point;
+            const float max_friction = c.friction * point.normal_impulse;
+            for (uint32_t t = 0; t < 2; t++) {
+                const float vt = glm::dot(get_relative_velocity(bodies, c), c.tangents[t]);
+                const float old_impulse = point.tangent_impulse[t];
+                point.tangent_impulse[t] = glm::clamp(old_impulse - vt * c.tangent_mass[t],
+                                                      -max_friction, max_friction);
+                apply_impulse(bodies, c, c.tangents[t] * (point.tangent_impulse[t] - old_impulse));
+            }
+            const float vn = glm::dot(get_relative_velocity(bodies, c), c.normal);
+            const float old_impulse = point.normal_impulse;
+            point.normal_impulse = std::max(old_impulse - (vn - c.bias) * c.normal_mass, 0.0f);
+            apply_impulse(bodies, c, c.normal * (point.normal_impulse - old_impulse));
+        }
+    }
+
+    // The island sleeps as a whole once its slowest sleeper has been still long enough
+    float sleep_time = TIME_TO_SLEEP;
+    for (uint32_t i = 0; i < island.body_count; i++) {
+        SolverBody &body = bodies[p.island_bodies[island.body_offset + i]];
+        integrate_transform(body, dt);
+        const bool is_still =
+            glm::dot(body.linear_velocity, body.linear_velocity) <
+                LINEAR_SLEEP_THRESHOLD * LINEAR_SLEEP_THRESHOLD &&
+            glm::dot(body.angular_velocity, body.angular_velocity) <
+                ANGULAR_SLEEP_THRESHOLD * ANGULAR_SLEEP_THRESHOLD;
+        body.sleep_time = is_still ? body.sleep_time + dt : 0.0f;
+        sleep_time = std::min(sleep_time, body.sleep_time);
+    }
+    if (sleep_time >= TIME_TO_SLEEP) {
+        for (uint32_t i = 0; i < island.body_count; i++) {
+            SolverBody &body = bodies[p.island_bodies[island.body_offset + i]];
+            body.is_awake = false;
+            body.linear_velocity = glm::vec3(0.0f);
+            body.angular_velocity = glm::vec3(0.0f);
+        }
+    }
+}
+
+void tine::PhysicsWorld::step(const CollisionData &data, entt::registry &registry, float dt,
+                              JobSystem *jobs) {
+    ZoneScoped;
+    Pimpl &p = *m_pimpl;
+    std::vector<uint32_t> &awake = p.awake_islands;
+
+    dt = std::min(dt, MAX_STEP);
+    // Sleeping bodies and static clutter don't move, nothing to do without an awake body
+    if (dt <= 0.0f || !gather_bodies(p, registry)) {
+        p.awake_island_cnt = 0;
+        return;
+    }
+    p.collision.update(data, registry, jobs);
+    std::vector<ContactManifold> &manifolds = p.collision.get_manifolds();
+    build_islands(p, manifolds);
+
+    // Biggest islands first, dealt round robin over the jobs so each gets a similar share
+    awake.clear();
+    for (uint32_t i = 0; i < p.islands.size(); i++) {
+        if (p.islands[i].is_awake) {
+            awake.push_back(i);
+        }
+    }
+    std::sort(awake.begin(), awake.end(), [&p](uint32_t l, uint32_t r) {
+        const Island &a = p.islands[l];
+        const Island &b = p.islands[r];
+        return a.manifold_count != b.manifold_count ? a.manifold_count > b.manifold_count : l < r;
+    });
+    p.awake_island_cnt = static_cast<uint32_t>(awake.size());
+    if (jobs != nullptr) {
+        const size_t chunk_cnt = jobs->get_chunk_count(awake.size(), 1);
+        jobs->parallel_for("Solve islands", chunk_cnt, 1,
+                           [&p, &awake, &manifolds, dt, chunk_cnt](size_t begin, size_t end,
+                                                                    size_t) {
+                               ZoneScopedN("Solve islands");
+                               for (size_t k = begin; k < end; k++) {
+                                   for (size_t i = k; i < awake.size(); i += chunk_cnt) {
+                                       solve_island(p, p.islands[awake[i]], manifolds, dt);
+                                   }
+                               }
+                           });
+    } else {
+        for (uint32_t i : awake) {
+            solve_island(p, p.islands[i], manifolds, dt);
+        }
+    }
+
+    for (uint32_t i : awake) {
+        const Island &island = p.islands[i];
+        for (uint32_t b = 0; b < island.body_count; b++) {
+            const SolverBody &body = p.bodies[p.island_bodies[island.body_offset + b]];
+            RigidBodyComponent &rb = registry.get<RigidBodyComponent>(body.entity);
+            rb.linear_velocity = body.linear_velocity;
+            rb.angular_velocity = body.angular_velocity;
+            rb.sleep_time = body.sleep_time;
+            rb.is_sleeping = body.is_awake ? 0 : 1;
+            registry.get<TransformComponent>(body.entity).transform = body.transform;
+        }
+    }
+}
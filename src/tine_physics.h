@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <glm/glm.hpp>
+#include <entt/entt.hpp>
+
+namespace tine {
+
+class CollisionWorld;
+class JobSystem;
+struct CollisionData;
+struct RigidBodyComponent;
+
+// Box inertia of the hull's bounds under the transform's scale, friction 0.5.  A mass of 0 makes
+// a body that collides but is only ever moved by hand.
+RigidBodyComponent make_rigid_body(const CollisionData &data, uint32_t hull,
+                                   const glm::mat4 &transform, float mass);
+
+// Steps the RigidBodyComponents.  Every step the bodies touching through contact manifolds are
+// grouped into islands, static colliders don't join islands, and the islands are solved on
+// separate jobs with warm started sequential impulses.  An island whose bodies all stay below the
+// sleep thresholds for a while goes to sleep as a whole, and costs nothing until an awake body
+// touches it.
+class PhysicsWorld {
+  public:
+    struct Pimpl;
+
+    PhysicsWorld();
+    ~PhysicsWorld();
+    PhysicsWorld(const PhysicsWorld &) = delete;
+
+    void set_gravity(const glm::vec3 &gravity);
+    void set_iterations(uint32_t velocity_iterations);
+    // Longer steps are clamped, the solver loses stability well before
+    void step(const CollisionData &data, entt::registry &registry, float dt,
+              JobSystem *jobs = nullptr);
+    // Drops the cached contacts, after the bodies were moved by anything but step
+    void clear();
+
+    CollisionWorld &get_collision_world();
+    uint32_t get_island_count() const;
+    uint32_t get_awake_island_count() const;
+
+  private:
+    std::unique_ptr<Pimpl> m_pimpl;
+};
+
+} // namespace tine
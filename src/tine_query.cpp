@@ -0,0 +1,327 @@
+#include "tine_query.h"
+#include "tine_collision.h"
+#include "tine_component.h"
+#include "tine_jobs.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+#include <tracy/Tracy.hpp>
+
+static const uint32_t MAX_LEAF_COLLIDERS = 4;
+// Deep enough for any tree built from median splits
+static const uint32_t MAX_TRAVERSAL_DEPTH = 64;
+static const uint32_t CAST_MAX_ITERATIONS = 32;
+// Casts stop this close to the surface hit
+static const float CAST_TOLERANCE = 1e-3f;
+static const size_t MIN_QUERIES_PER_JOB = 16;
+
+// Shapes of the query primitives, a point and the corners of the [-1, 1] cube
+static const tine::HullVertexBlock POINT_BLOCKS[1] = {};
+static const tine::HullVertexBlock BOX_BLOCKS[2] = {
+    {{-1.0f, 1.0f, -1.0f, 1.0f}, {-1.0f, -1.0f, 1.0f, 1.0f}, {-1.0f, -1.0f, -1.0f, -1.0f}},
+    {{-1.0f, 1.0f, -1.0f, 1.0f}, {-1.0f, -1.0f, 1.0f, 1.0f}, {1.0f, 1.0f, 1.0f, 1.0f}}};
+
+using Collider = tine::QuerySnapshot::Collider;
+using Node = tine::QuerySnapshot::Node;
+
+static void get_world_bounds(const tine::ConvexHull &hull, const glm::mat4 &transform,
+                             glm::vec3 &aabb_min, glm::vec3 &aabb_max) {
+    const glm::vec3 center = 0.5f * (hull.aabb_min + hull.aabb_max);
+    const glm::vec3 extent = 0.5f * (hull.aabb_max - hull.aabb_min);
+    const glm::mat3 m(transform);
+    const glm::mat3 abs_m(glm::abs(m[0]), glm::abs(m[1]), glm::abs(m[2]));
+    const glm::vec3 world_center = glm::vec3(transform * glm::vec4(center, 1.0f));
+    aabb_min = world_center - abs_m * extent;
+    aabb_max = world_center + abs_m * extent;
+}
+
+static glm::vec3 get_center(const Collider &collider) {
+    return 0.5f * (collider.aabb_min + collider.aabb_max);
+}
+
+// Median split along the longest axis of the centers, returns the node's index
+static uint32_t build_node(std::vector<Node> &nodes, std::vector<Collider> &colliders,
+                           uint32_t first, uint32_t count) {
+    const uint32_t index = static_cast<uint32_t>(nodes.size());
+    Node node;
+    glm::vec3 center_min(FLT_MAX);
+    glm::vec3 center_max(-FLT_MAX);
+    node.aabb_min = glm::vec3(FLT_MAX);
+    node.aabb_max = glm::vec3(-FLT_MAX);
+    for (uint32_t i = first; i < first + count; i++) {
+        node.aabb_min = glm::min(node.aabb_min, colliders[i].aabb_min);
+        node.aabb_max = glm::max(node.aabb_max, colliders[i].aabb_max);
+        center_min = glm::min(center_min, get_center(colliders[i]));
+        center_max = glm::max(center_max, get_center(colliders[i]));
+    }
+    nodes.push_back(node);
+    if (count <= MAX_LEAF_COLLIDERS) {
+        nodes[index].first = first;
+        nodes[index].count = count;
+        return index;
+    }
+
+    const glm::vec3 size = center_max - center_min;
+    const int axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+    const uint32_t half = count / 2;
+    std::nth_element(colliders.begin() + first, colliders.begin() + first + half,
+                     colliders.begin() + first + count,
+                     [axis](const Collider &l, const Collider &r) {
+                         return get_center(l)[axis] < get_center(r)[axis];
+                     });
+    build_node(nodes, colliders, first, half);
+    nodes[index].first = build_node(nodes, colliders, first + half, count - half);
+    nodes[index].count = 0;
+    return index;
+}
+
+void tine::QuerySnapshot::build(const CollisionData &data, entt::registry &registry) {
+    ZoneScoped;
+    m_data = &data;
+    m_colliders.clear();
+    m_nodes.clear();
+
+    auto view = registry.view<const TransformComponent, const ColliderComponent>();
+    for (entt::entity entity : view) {
+        const uint32_t hull = view.get<const ColliderComponent>(entity).hull;
+        if (hull >= data.hulls.size() || data.hulls[hull].vertex_count == 0) {
+            continue;
+        }
+        const EnvironmentComponent *env = registry.try_get<EnvironmentComponent>(entity);
+        Collider collider;
+        collider.transform = view.get<const TransformComponent>(entity).transform;
+        collider.entity = entity;
+        collider.hull = hull;
+        collider.env = env != nullptr ? env->env : 0;
+        get_world_bounds(data.hulls[hull], collider.transform, collider.aabb_min,
+                         collider.aabb_max);
+        m_colliders.push_back(collider);
+    }
+    if (!m_colliders.empty()) {
+        m_nodes.reserve(2 * m_colliders.size() / MAX_LEAF_COLLIDERS + 1);
+        build_node(m_nodes, m_colliders, 0, static_cast<uint32_t>(m_colliders.size()));
+    }
+}
+
+static tine::ConvexShape make_point_shape(const glm::vec3 &position) {
+    tine::ConvexShape shape;
+    shape.blocks = POINT_BLOCKS;
+    shape.vertex_count = 1;
+    shape.transform = glm::translate(glm::mat4(1.0f), position);
+    return shape;
+}
+
+static bool overlaps(const glm::vec3 &min_a, const glm::vec3 &max_a, const glm::vec3 &min_b,
+                     const glm::vec3 &max_b) {
+    return min_a.x <= max_b.x && min_b.x <= max_a.x && min_a.y <= max_b.y &&
+           min_b.y <= max_a.y && min_a.z <= max_b.z && min_b.z <= max_a.z;
+}
+
+// Slab test of the ray against the box, within [0, max_distance]
+static bool ray_hits_box(const glm::vec3 &origin, const glm::vec3 &inverse_direction,
+                         const glm::vec3 &aabb_min, const glm::vec3 &aabb_max,
+                         float max_distance) {
+    float t_min = 0.0f;
+    float t_max = max_distance;
+    for (int axis = 0; axis < 3; axis++) {
+        const float t0 = (aabb_min[axis] - origin[axis]) * inverse_direction[axis];
+        const float t1 = (aabb_max[axis] - origin[axis]) * inverse_direction[axis];
+        // NaN from a ray lying in the slab's plane leaves the bounds alone
+        t_min = std::max(t_min, std::min(t0, t1));
+        t_max = std::min(t_max, std::max(t0, t1));
+    }
+    return t_min <= t_max;
+}
+
+// Conservative advancement, moves the shape along direction by the distance to the target over
+// the closing speed until the gap is within tolerance
+static bool cast_shape(const tine::ConvexShape &moving, const glm::vec3 &direction,
+                       float max_distance, const tine::ConvexShape &target, float &distance,
+                       glm::vec3 &position, glm::vec3 &normal) {
+    tine::ConvexShape shape = moving;
+    float t = 0.0f;
+    for (uint32_t iteration = 0; iteration < CAST_MAX_ITERATIONS; iteration++) {
+        shape.transform[3] = moving.transform[3] + glm::vec4(direction * t, 0.0f);
+        glm::vec3 point_a;
+        glm::vec3 point_b;
+        const float gap = tine::find_convex_distance(shape, target, point_a, point_b);
+        if (gap <= CAST_TOLERANCE) {
+            distance = t;
+            // Starting out inside leaves no surface to report
+            position = gap > 0.0f ? point_b : glm::vec3(shape.transform[3]);
+            normal = gap > 0.0f ? (point_a - point_b) / gap : -direction;
+            return true;
+        }
+        const float closing_speed = glm::dot(direction, (point_b - point_a) / gap);
+        if (closing_speed <= 0.0f) {
+            return false;
+        }
+        t += (gap - 0.5f * CAST_TOLERANCE) / closing_speed;
+        if (t > max_distance) {
+            return false;
+        }
+    }
+    return false;
+}
+
+// Closest hit of a shape swept from a box of half size extent around center
+static tine::QueryHit cast_query(const std::vector<Node> &nodes,
+                                 const std::vector<Collider> &colliders,
+                                 const tine::CollisionData &data, const tine::ConvexShape &moving,
+                                 const glm::vec3 &center, const glm::vec3 &extent,
+                                 const glm::vec3 &direction, float max_distance, uint32_t env,
+                                 entt::entity ignore) {
+    tine::QueryHit hit;
+    uint32_t stack[MAX_TRAVERSAL_DEPTH];
+    uint32_t stack_size = 0;
+    const glm::vec3 inverse_direction(1.0f / direction.x, 1.0f / direction.y,
+                                      1.0f / direction.z);
+
+    hit.entity = entt::null;
+    hit.distance = max_distance;
+    hit.position = glm::vec3(0.0f);
+    hit.normal = glm::vec3(0.0f);
+    if (!nodes.empty()) {
+        stack[stack_size++] = 0;
+    }
+    while (stack_size > 0) {
+        const uint32_t n = stack[--stack_size];
+        const Node &node = nodes[n];
+        if (!ray_hits_box(center, inverse_direction, node.aabb_min - extent,
+                          node.aabb_max + extent, hit.distance)) {
+            continue;
+        }
+        if (node.count == 0) {
+            stack[stack_size++] = node.first;
+            stack[stack_size++] = n + 1;
+            continue;
+        }
+        for (uint32_t c = node.first; c < node.first + node.count; c++) {
+            const Collider &collider = colliders[c];
+            if (collider.env != env || collider.entity == ignore ||
+                !ray_hits_box(center, inverse_direction, collider.aabb_min - extent,
+                              collider.aabb_max + extent, hit.distance)) {
+                continue;
+            }
+            const tine::ConvexShape target =
+                tine::make_convex_shape(data, collider.hull, collider.transform);
+            float distance;
+            glm::vec3 position;
+            glm::vec3 normal;
+            if (cast_shape(moving, direction, hit.distance, target, distance, position, normal) &&
+                (hit.entity == entt::null || distance < hit.distance)) {
+                hit.entity = collider.entity;
+                hit.distance = distance;
+                hit.position = position;
+                hit.normal = normal;
+            }
+        }
+    }
+    return hit;
+}
+
+static void run_batch(tine::JobSystem *jobs, const char *name, size_t count,
+                      const tine::JobSystem::RangeFunction &function) {
+    if (jobs != nullptr) {
+        jobs->parallel_for(name, count, MIN_QUERIES_PER_JOB, function);
+    } else {
+        function(0, count, 0);
+    }
+}
+
+void tine::QuerySnapshot::raycast(const RayQuery *queries, size_t count, QueryHit *hits,
+                                  JobSystem *jobs) const {
+    ZoneScoped;
+    run_batch(jobs, "Raycasts", count, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; i++) {
+            const RayQuery &q = queries[i];
+            hits[i] = cast_query(m_nodes, m_colliders, *m_data, make_point_shape(q.origin),
+                                 q.origin, glm::vec3(0.0f), q.direction, q.max_distance, q.env,
+                                 entt::null);
+        }
+    });
+}
+
+void tine::QuerySnapshot::sweep(const SweepQuery *queries, size_t count, QueryHit *hits,
+                                JobSystem *jobs) const {
+    ZoneScoped;
+    run_batch(jobs, "Sweeps", count, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; i++) {
+            const SweepQuery &q = queries[i];
+            glm::vec3 aabb_min;
+            glm::vec3 aabb_max;
+            if (q.hull >= m_data->hulls.size() || m_data->hulls[q.hull].vertex_count == 0) {
+                hits[i] = {};
+                hits[i].entity = entt::null;
+                continue;
+            }
+            get_world_bounds(m_data->hulls[q.hull], q.transform, aabb_min, aabb_max);
+            hits[i] = cast_query(m_nodes, m_colliders, *m_data,
+                                 make_convex_shape(*m_data, q.hull, q.transform),
+                                 0.5f * (aabb_min + aabb_max), 0.5f * (aabb_max - aabb_min),
+                                 q.direction, q.max_distance, q.env, q.ignore);
+        }
+    });
+}
+
+void tine::QuerySnapshot::overlap(const OverlapQuery *queries, size_t count,
+                                  entt::entity *results, uint32_t max_results,
+                                  uint32_t *result_counts, JobSystem *jobs) const {
+    ZoneScoped;
+    run_batch(jobs, "Overlaps", count, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; i++) {
+            const OverlapQuery &q = queries[i];
+            entt::entity *out = results + i * max_results;
+            uint32_t out_cnt = 0;
+            uint32_t stack[MAX_TRAVERSAL_DEPTH];
+            uint32_t stack_size = 0;
+            const bool is_sphere = q.shape == OverlapShape::SPHERE;
+            const glm::vec3 extent = is_sphere ? glm::vec3(q.radius) : q.half_extents;
+            const glm::vec3 aabb_min = q.center - extent;
+            const glm::vec3 aabb_max = q.center + extent;
+            ConvexShape shape;
+            if (is_sphere) {
+                shape = make_point_shape(q.center);
+            } else {
+                shape.blocks = BOX_BLOCKS;
+                shape.vertex_count = 8;
+                shape.transform = glm::scale(glm::translate(glm::mat4(1.0f), q.center),
+                                             q.half_extents);
+            }
+
+            if (!m_nodes.empty()) {
+                stack[stack_size++] = 0;
+            }
+            while (stack_size > 0 && out_cnt < max_results) {
+                const uint32_t n = stack[--stack_size];
+                const Node &node = m_nodes[n];
+                if (!overlaps(aabb_min, aabb_max, node.aabb_min, node.aabb_max)) {
+                    continue;
+                }
+                if (node.count == 0) {
+                    stack[stack_size++] = node.first;
+                    stack[stack_size++] = n + 1;
+                    continue;
+                }
+                for (uint32_t c = node.first;
+                     c < node.first + node.count && out_cnt < max_results; c++) {
+                    const Collider &collider = m_colliders[c];
+                    if (collider.env != q.env ||
+                        !overlaps(aabb_min, aabb_max, collider.aabb_min, collider.aabb_max)) {
+                        continue;
+                    }
+                    glm::vec3 point_a;
+                    glm::vec3 point_b;
+                    const float distance = find_convex_distance(
+                        shape, make_convex_shape(*m_data, collider.hull, collider.transform),
+                        point_a, point_b);
+                    if (distance <= (is_sphere ? q.radius : 0.0f)) {
+                        out[out_cnt++] = collider.entity;
+                    }
+                }
+            }
+            result_counts[i] = out_cnt;
+        }
+    });
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include <entt/entt.hpp>
+
+namespace tine {
+
+class JobSystem;
+struct CollisionData;
+
+struct RayQuery {
+    glm::vec3 origin;
+    glm::vec3 direction; // Normalized
+    float max_distance;
+    uint32_t env;
+};
+
+// A hull moved along direction from transform, see CollisionData::hulls
+struct SweepQuery {
+    glm::mat4 transform;
+    glm::vec3 direction; // Normalized
+    float max_distance;
+    uint32_t hull;
+    uint32_t env;
+    entt::entity ignore; // Usually the entity being swept, or entt::null
+};
+
+enum class OverlapShape : uint32_t { AABB, SPHERE };
+
+struct OverlapQuery {
+    OverlapShape shape;
+    glm::vec3 center;
+    glm::vec3 half_extents; // AABB only
+    float radius;           // SPHERE only
+    uint32_t env;
+};
+
+// entity is entt::null if nothing was hit
+struct QueryHit {
+    entt::entity entity;
+    float distance; // Along the query direction
+    glm::vec3 position;
+    glm::vec3 normal; // Of the surface hit
+};
+
+// Read only copy of every collider's placement with a bounding volume hierarchy over them.  Built
+// on the main thread, after which any number of threads may query it at once while the scene
+// carries on stepping.  The CollisionData it was built from must outlive it.  Batches write one
+// result per query into caller provided arrays and fan out over jobs if given.
+class QuerySnapshot {
+  public:
+    struct Collider {
+        glm::mat4 transform;
+        glm::vec3 aabb_min;
+        glm::vec3 aabb_max;
+        entt::entity entity;
+        uint32_t hull;
+        uint32_t env;
+    };
+
+    struct Node {
+        glm::vec3 aabb_min;
+        glm::vec3 aabb_max;
+        // First collider of a leaf.  Inner nodes are followed by their left child, this is the
+        // right one.
+        uint32_t first;
+        uint32_t count; // 0 for inner nodes
+    };
+
+    void build(const CollisionData &data, entt::registry &registry);
+
+    // Closest hit along each ray
+    void raycast(const RayQuery *queries, size_t count, QueryHit *hits,
+                 JobSystem *jobs = nullptr) const;
+    // First hit of each swept hull, distance 0 if it starts out touching something
+    void sweep(const SweepQuery *queries, size_t count, QueryHit *hits,
+               JobSystem *jobs = nullptr) const;
+    // Up to max_results colliders touching each shape, at results + i * max_results for query i
+    void overlap(const OverlapQuery *queries, size_t count, entt::entity *results,
+                 uint32_t max_results, uint32_t *result_counts, JobSystem *jobs = nullptr) const;
+
+    size_t get_collider_count() const { return m_colliders.size(); }
+
+  private:
+    const CollisionData *m_data = nullptr;
+    std::vector<Collider> m_colliders; // In leaf order
+    std::vector<Node> m_nodes;         // Depth first, root first
+};
+
+} // namespace tine
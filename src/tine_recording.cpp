@@ -0,0 +1,631 @@
+#include "tine_log.h"
+#include "tine_recording.h"
+#include "tine_component.h"
+#include "tine_snapshot.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <tracy/Tracy.hpp>
+
+static const uint32_t RECORDING_VERSION = 1;
+// Captured steps waiting for the background thread before record blocks
+static const size_t MAX_PENDING_STEPS = 8;
+static const uint32_t POOL_FULL = 0;
+static const uint32_t POOL_CHANGED = 1;
+
+static const size_t LZ_MIN_MATCH = 4;
+static const uint32_t LZ_HASH_BITS = 14;
+static const size_t LZ_MAX_OFFSET = 65535;
+
+static_assert(sizeof(entt::entity) == sizeof(uint32_t), "Entities are recorded as 32 bits");
+
+using Pools = std::vector<tine::RegistrySnapshot::Pool>;
+
+template <typename... Components> static std::vector<uint32_t> get_component_sizes() {
+    return {static_cast<uint32_t>(sizeof(Components))...};
+}
+
+template <typename Component, typename First, typename... Rest>
+static constexpr uint32_t get_pool_index() {
+    if constexpr (std::is_same<Component, First>::value) {
+        return 0;
+    } else {
+        return 1 + get_pool_index<Component, Rest...>();
+    }
+}
+
+static const uint32_t TRANSFORM_POOL =
+    get_pool_index<tine::TransformComponent, SIMULATION_COMPONENTS>();
+
+static void lz_write_length(std::vector<uint8_t> &dst, size_t length) {
+    for (; length >= 255; length -= 255) {
+        dst.push_back(255);
+    }
+    dst.push_back(static_cast<uint8_t>(length));
+}
+
+// The token holds the literal count in its high nibble and the match length past LZ_MIN_MATCH in
+// the low one, 15 continues in extra bytes.  The last sequence of a block has no match.
+static void lz_write_sequence(std::vector<uint8_t> &dst, const uint8_t *literals,
+                              size_t literal_cnt, size_t offset, size_t length) {
+    const size_t match_code = length > 0 ? length - LZ_MIN_MATCH : 0;
+    dst.push_back(static_cast<uint8_t>((std::min<size_t>(literal_cnt, 15) << 4) |
+                                       std::min<size_t>(match_code, 15)));
+    if (literal_cnt >= 15) {
+        lz_write_length(dst, literal_cnt - 15);
+    }
+    dst.insert(dst.end(), literals, literals + literal_cnt);
+    if (length == 0) {
+        return;
+    }
+    dst.push_back(static_cast<uint8_t>(offset & 0xff));
+    dst.push_back(static_cast<uint8_t>(offset >> 8));
+    if (match_code >= 15) {
+        lz_write_length(dst, match_code - 15);
+    }
+}
+
+// LZ4 style block compression, greedy matches found through a hash of their first four bytes.
+// Fast rather than small, component blobs are mostly runs of repeated floats and zeros.
+static void lz_compress(const uint8_t *src, size_t size, std::vector<uint8_t> &dst,
+                        std::vector<uint32_t> &table) {
+    size_t anchor = 0;
+    size_t pos = 0;
+    dst.clear();
+    table.assign(size_t(1) << LZ_HASH_BITS, 0);
+    while (pos + LZ_MIN_MATCH <= size) {
+        uint32_t prefix;
+        memcpy(&prefix, src + pos, sizeof(prefix));
+        const uint32_t hash = (prefix * 2654435761u) >> (32 - LZ_HASH_BITS);
+        const size_t candidate = table[hash];
+        table[hash] = static_cast<uint32_t>(pos);
+        if (candidate < pos && pos - candidate <= LZ_MAX_OFFSET &&
+            memcmp(src + candidate, &prefix, sizeof(prefix)) == 0) {
+            size_t length = LZ_MIN_MATCH;
+            while (pos + length < size && src[candidate + length] == src[pos + length]) {
+                length++;
+            }
+            lz_write_sequence(dst, src + anchor, pos - anchor, pos - candidate, length);
+            pos += length;
+            anchor = pos;
+        } else {
+            // Strides through data that doesn't compress
+            pos += 1 + ((pos - anchor) >> 6);
+        }
+    }
+    lz_write_sequence(dst, src + anchor, size - anchor, 0, 0);
+}
+
+static bool lz_read_length(const uint8_t *&in, const uint8_t *end, size_t &length) {
+    uint8_t byte = 0;
+    do {
+        if (in == end) {
+            return false;
+        }
+        byte = *in++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+static bool lz_decompress(const uint8_t *src, size_t size, uint8_t *dst, size_t raw_size) {
+    const uint8_t *in = src;
+    const uint8_t *end = src + size;
+    size_t out = 0;
+    while (in < end) {
+        const uint8_t token = *in++;
+        size_t literal_cnt = token >> 4;
+        size_t length = token & 15;
+        size_t offset = 0;
+        if (literal_cnt == 15 && !lz_read_length(in, end, literal_cnt)) {
+            return false;
+        }
+        if (literal_cnt > static_cast<size_t>(end - in) || literal_cnt > raw_size - out) {
+            return false;
+        }
+        memcpy(dst + out, in, literal_cnt);
+        in += literal_cnt;
+        out += literal_cnt;
+        if (in == end) {
+            break;
+        }
+        if (end - in < 2) {
+            return false;
+        }
+        offset = in[0] | (static_cast<size_t>(in[1]) << 8);
+        in += 2;
+        if (length == 15 && !lz_read_length(in, end, length)) {
+            return false;
+        }
+        length += LZ_MIN_MATCH;
+        if (offset == 0 || offset > out || length > raw_size - out) {
+            return false;
+        }
+        if (offset >= length) {
+            memcpy(dst + out, dst + out - offset, length);
+            out += length;
+        } else {
+            // Overlapping, repeats the last offset bytes
+            for (size_t i = 0; i < length; i++, out++) {
+                dst[out] = dst[out - offset];
+            }
+        }
+    }
+    return out == raw_size;
+}
+
+static void append(std::vector<uint8_t> &raw, const void *data, size_t size) {
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    if (size == 0) {
+        return;
+    }
+    raw.insert(raw.end(), bytes, bytes + size);
+}
+
+static bool read_bytes(const uint8_t *&in, const uint8_t *end, void *data, size_t size) {
+    if (size > static_cast<size_t>(end - in)) {
+        return false;
+    }
+    if (size == 0) {
+        return true;
+    }
+    memcpy(data, in, size);
+    in += size;
+    return true;
+}
+
+// Pools whose entities didn't change since previous only carry the components that did
+static void encode_step(const Pools &pools, const Pools *previous,
+                        const std::vector<uint32_t> &sizes, std::vector<uint8_t> &raw,
+                        std::vector<uint32_t> &changed) {
+    raw.clear();
+    for (size_t p = 0; p < pools.size(); p++) {
+        const tine::RegistrySnapshot::Pool &pool = pools[p];
+        const size_t size = sizes[p];
+        const uint32_t count = static_cast<uint32_t>(pool.entities.size());
+        if (previous == nullptr || (*previous)[p].entities != pool.entities) {
+            append(raw, &POOL_FULL, sizeof(POOL_FULL));
+            append(raw, &count, sizeof(count));
+            append(raw, pool.entities.data(), count * sizeof(entt::entity));
+            append(raw, pool.components.data(), pool.components.size());
+            continue;
+        }
+
+        const uint8_t *old_components = (*previous)[p].components.data();
+        changed.clear();
+        for (uint32_t i = 0; i < count; i++) {
+            if (memcmp(pool.components.data() + i * size, old_components + i * size, size) != 0) {
+                changed.push_back(i);
+            }
+        }
+        const uint32_t changed_cnt = static_cast<uint32_t>(changed.size());
+        append(raw, &POOL_CHANGED, sizeof(POOL_CHANGED));
+        append(raw, &changed_cnt, sizeof(changed_cnt));
+        append(raw, changed.data(), changed.size() * sizeof(uint32_t));
+        for (uint32_t i : changed) {
+            append(raw, pool.components.data() + i * size, size);
+        }
+    }
+}
+
+static bool decode_step(const std::vector<uint8_t> &raw, const std::vector<uint32_t> &sizes,
+                        Pools &pools) {
+    const uint8_t *in = raw.data();
+    const uint8_t *end = raw.data() + raw.size();
+    for (size_t p = 0; p < pools.size(); p++) {
+        tine::RegistrySnapshot::Pool &pool = pools[p];
+        const size_t size = sizes[p];
+        uint32_t mode = 0;
+        uint32_t count = 0;
+        if (!read_bytes(in, end, &mode, sizeof(mode)) ||
+            !read_bytes(in, end, &count, sizeof(count))) {
+            return false;
+        }
+        if (mode == POOL_FULL) {
+            if (count > static_cast<size_t>(end - in) / (sizeof(entt::entity) + size)) {
+                return false;
+            }
+            pool.entities.resize(count);
+            pool.components.resize(count * size);
+            read_bytes(in, end, pool.entities.data(), count * sizeof(entt::entity));
+            read_bytes(in, end, pool.components.data(), pool.components.size());
+        } else if (mode == POOL_CHANGED) {
+            const uint8_t *indices = in;
+            if (count > static_cast<size_t>(end - in) / (sizeof(uint32_t) + size)) {
+                return false;
+            }
+            in += count * sizeof(uint32_t);
+            for (uint32_t i = 0; i < count; i++) {
+                uint32_t index = 0;
+                memcpy(&index, indices + i * sizeof(uint32_t), sizeof(index));
+                if (index >= pool.entities.size()) {
+                    return false;
+                }
+                read_bytes(in, end, pool.components.data() + index * size, size);
+            }
+        } else {
+            return false;
+        }
+    }
+    return in == end;
+}
+
+struct PendingStep {
+    uint64_t step;
+    tine::RegistrySnapshot snapshot;
+};
+
+struct tine::Recorder::Pimpl {
+    std::ofstream file;
+    uint32_t keyframe_interval = 0;
+    std::vector<uint32_t> component_sizes;
+    std::thread thread;
+
+    std::mutex mutex;
+    std::condition_variable pending_cv; // Steps were queued or the recording is closing
+    std::condition_variable free_cv;    // A step was written
+    std::deque<std::unique_ptr<PendingStep>> pending;
+    std::vector<std::unique_ptr<PendingStep>> free_steps;
+    size_t step_cnt = 0; // Allocated, pending, free or previous
+    bool is_closing = false;
+    bool failed = false;
+
+    // Background thread only
+    std::unique_ptr<PendingStep> previous;
+    uint64_t steps_since_keyframe = 0;
+    uint64_t offset = 0;
+    std::vector<uint8_t> raw;
+    std::vector<uint8_t> packed;
+    std::vector<uint32_t> hash_table;
+    std::vector<uint32_t> changed;
+    std::vector<tine::RecordingKeyframe> keyframes;
+};
+
+static bool write_step(tine::Recorder::Pimpl &rec, const PendingStep &step) {
+    ZoneScoped;
+    const bool is_keyframe =
+        rec.previous == nullptr || rec.steps_since_keyframe >= rec.keyframe_interval;
+    tine::RecordingChunk chunk = {};
+
+    encode_step(step.snapshot.get_pools(),
+                is_keyframe ? nullptr : &rec.previous->snapshot.get_pools(), rec.component_sizes,
+                rec.raw, rec.changed);
+    TINE_CHECK(rec.raw.size() <= UINT32_MAX, "Step too large to record", Error);
+    lz_compress(rec.raw.data(), rec.raw.size(), rec.packed, rec.hash_table);
+
+    chunk.step = step.step;
+    chunk.is_keyframe = is_keyframe ? 1 : 0;
+    chunk.raw_size = static_cast<uint32_t>(rec.raw.size());
+    chunk.packed_size = static_cast<uint32_t>(rec.packed.size());
+    if (is_keyframe) {
+        rec.keyframes.push_back({step.step, rec.offset});
+        rec.steps_since_keyframe = 0;
+    }
+    rec.steps_since_keyframe++;
+    rec.file.write(reinterpret_cast<const char *>(&chunk), sizeof(chunk));
+    rec.file.write(reinterpret_cast<const char *>(rec.packed.data()),
+                   static_cast<std::streamsize>(rec.packed.size()));
+    rec.offset += sizeof(chunk) + rec.packed.size();
+    TINE_CHECK(rec.file.good(), "Failed to write recording", Error);
+    return true;
+Error:
+    return false;
+}
+
+static void write_steps(tine::Recorder::Pimpl &rec) {
+    for (;;) {
+        std::unique_ptr<PendingStep> step;
+        {
+            std::unique_lock<std::mutex> lock(rec.mutex);
+            rec.pending_cv.wait(lock, [&rec] { return !rec.pending.empty() || rec.is_closing; });
+            if (rec.pending.empty()) {
+                return;
+            }
+            step = std::move(rec.pending.front());
+            rec.pending.pop_front();
+        }
+        // Keeps going after a failure so record never waits on a dead thread
+        const bool ok = write_step(rec, *step);
+        {
+            std::lock_guard<std::mutex> lock(rec.mutex);
+            rec.failed = rec.failed || !ok;
+            if (rec.previous != nullptr) {
+                rec.free_steps.push_back(std::move(rec.previous));
+            }
+        }
+        rec.previous = std::move(step);
+        rec.free_cv.notify_one();
+    }
+}
+
+tine::Recorder::Recorder() : m_pimpl(new Pimpl()) {}
+tine::Recorder::~Recorder() {
+    close();
+}
+
+bool tine::Recorder::open(const std::string &path, uint32_t keyframe_interval) {
+    RecordingHeader header = {{'T', 'R', 'E', 'C'}, RECORDING_VERSION, 0, keyframe_interval};
+    Pimpl &rec = *m_pimpl;
+
+    close();
+    TINE_CHECK(keyframe_interval > 0, "Keyframe interval must be positive", Error);
+    rec.file.open(path, std::ios::binary | std::ios::trunc);
+    TINE_CHECK(rec.file.is_open(), path, Error);
+    rec.component_sizes = get_component_sizes<SIMULATION_COMPONENTS>();
+    header.pool_count = static_cast<uint32_t>(rec.component_sizes.size());
+    rec.file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    rec.file.write(reinterpret_cast<const char *>(rec.component_sizes.data()),
+                   static_cast<std::streamsize>(rec.component_sizes.size() * sizeof(uint32_t)));
+    TINE_CHECK(rec.file.good(), path, Error);
+
+    rec.keyframe_interval = keyframe_interval;
+    rec.is_closing = false;
+    rec.failed = false;
+    rec.previous.reset();
+    rec.steps_since_keyframe = 0;
+    rec.offset = sizeof(header) + rec.component_sizes.size() * sizeof(uint32_t);
+    rec.keyframes.clear();
+    rec.thread = std::thread(write_steps, std::ref(rec));
+    TINE_INFO("Recording to {0}", path);
+    return true;
+Error:
+    rec.file.close();
+    return false;
+}
+
+void tine::Recorder::record(entt::registry &registry, uint64_t step) {
+    ZoneScoped;
+    Pimpl &rec = *m_pimpl;
+    std::unique_ptr<PendingStep> pending;
+    if (!is_open()) {
+        return;
+    }
+    {
+        std::unique_lock<std::mutex> lock(rec.mutex);
+        rec.free_cv.wait(lock, [&rec] {
+            return !rec.free_steps.empty() || rec.step_cnt <= MAX_PENDING_STEPS;
+        });
+        if (!rec.free_steps.empty()) {
+            pending = std::move(rec.free_steps.back());
+            rec.free_steps.pop_back();
+        } else {
+            pending.reset(new PendingStep());
+            rec.step_cnt++;
+        }
+    }
+    // The only work left on the caller's thread, the pools reuse their storage from earlier steps
+    pending->step = step;
+    pending->snapshot.capture(registry);
+    {
+        std::lock_guard<std::mutex> lock(rec.mutex);
+        rec.pending.push_back(std::move(pending));
+    }
+    rec.pending_cv.notify_one();
+}
+
+bool tine::Recorder::close() {
+    Pimpl &rec = *m_pimpl;
+    RecordingFooter footer = {0, 0, 0, {'T', 'E', 'N', 'D'}};
+    bool ok = false;
+    if (!is_open()) {
+        return true;
+    }
+    {
+        std::lock_guard<std::mutex> lock(rec.mutex);
+        rec.is_closing = true;
+    }
+    rec.pending_cv.notify_one();
+    rec.thread.join();
+
+    footer.index_offset = rec.offset;
+    footer.last_step = rec.previous != nullptr ? rec.previous->step : 0;
+    footer.keyframe_count = static_cast<uint32_t>(rec.keyframes.size());
+    rec.file.write(reinterpret_cast<const char *>(rec.keyframes.data()),
+                   static_cast<std::streamsize>(rec.keyframes.size() * sizeof(RecordingKeyframe)));
+    rec.file.write(reinterpret_cast<const char *>(&footer), sizeof(footer));
+    ok = !rec.failed && rec.file.good();
+    rec.file.close();
+    rec.previous.reset();
+    rec.free_steps.clear();
+    rec.step_cnt = 0;
+    if (!ok) {
+        TINE_ERROR("Recording is incomplete");
+    }
+    return ok;
+}
+
+bool tine::Recorder::is_open() const {
+    return m_pimpl->thread.joinable();
+}
+
+struct tine::Replayer::Pimpl {
+    std::ifstream file;
+    std::vector<uint32_t> component_sizes;
+    std::vector<tine::RecordingKeyframe> keyframes;
+    uint64_t end_offset = 0; // Past the last chunk
+    uint64_t offset = 0;     // Of the next chunk
+    uint64_t step = 0;
+    uint64_t last_step = 0;
+    bool has_state = false;
+    Pools pools; // As of step
+    std::vector<uint8_t> packed;
+    std::vector<uint8_t> raw;
+};
+
+static bool read_chunk_header(tine::Replayer::Pimpl &rep, uint64_t offset,
+                              tine::RecordingChunk &chunk) {
+    if (offset + sizeof(chunk) > rep.end_offset) {
+        return false;
+    }
+    rep.file.seekg(static_cast<std::streamoff>(offset));
+    rep.file.read(reinterpret_cast<char *>(&chunk), sizeof(chunk));
+    return rep.file.good() && offset + sizeof(chunk) + chunk.packed_size <= rep.end_offset;
+}
+
+static bool read_chunk(tine::Replayer::Pimpl &rep) {
+    ZoneScoped;
+    tine::RecordingChunk chunk;
+    TINE_CHECK(read_chunk_header(rep, rep.offset, chunk), "Truncated recording", Error);
+    TINE_CHECK(chunk.is_keyframe || rep.has_state, "Recording doesn't start on a keyframe",
+               Error);
+    rep.packed.resize(chunk.packed_size);
+    rep.raw.resize(chunk.raw_size);
+    rep.file.read(reinterpret_cast<char *>(rep.packed.data()), chunk.packed_size);
+    TINE_CHECK(rep.file.good(), "Failed to read recording", Error);
+    TINE_CHECK(lz_decompress(rep.packed.data(), rep.packed.size(), rep.raw.data(),
+                             rep.raw.size()),
+               "Corrupt recording chunk", Error);
+    TINE_CHECK(decode_step(rep.raw, rep.component_sizes, rep.pools), "Corrupt recording step",
+               Error);
+    rep.offset += sizeof(chunk) + chunk.packed_size;
+    rep.step = chunk.step;
+    rep.has_state = true;
+    return true;
+Error:
+    rep.has_state = false;
+    return false;
+}
+
+// Finds the keyframes of a file whose recorder never wrote the index
+static void scan_chunks(tine::Replayer::Pimpl &rep, uint64_t offset, uint64_t file_size) {
+    tine::RecordingChunk chunk;
+    rep.end_offset = file_size;
+    while (read_chunk_header(rep, offset, chunk)) {
+        if (chunk.is_keyframe) {
+            rep.keyframes.push_back({chunk.step, offset});
+        }
+        rep.last_step = chunk.step;
+        offset += sizeof(chunk) + chunk.packed_size;
+    }
+    // Drops a chunk cut short by the crash
+    rep.end_offset = offset;
+    rep.file.clear();
+}
+
+tine::Replayer::Replayer() : m_pimpl(new Pimpl()) {}
+tine::Replayer::~Replayer() {}
+
+bool tine::Replayer::open(const std::string &path) {
+    Pimpl &rep = *m_pimpl;
+    RecordingHeader header;
+    RecordingFooter footer;
+    std::vector<uint32_t> sizes = get_component_sizes<SIMULATION_COMPONENTS>();
+    uint64_t data_offset = 0;
+    uint64_t file_size = 0;
+
+    close();
+    rep.file.open(path, std::ios::binary);
+    TINE_CHECK(rep.file.is_open(), path, Error);
+    rep.file.read(reinterpret_cast<char *>(&header), sizeof(header));
+    TINE_CHECK(rep.file.good() && memcmp(header.magic, "TREC", 4) == 0, "Not a recording", Error);
+    TINE_CHECK(header.version == RECORDING_VERSION, "Unsupported recording version", Error);
+    TINE_CHECK(header.pool_count == sizes.size(), "Recorded by another build", Error);
+    rep.component_sizes.resize(header.pool_count);
+    rep.file.read(reinterpret_cast<char *>(rep.component_sizes.data()),
+                  static_cast<std::streamsize>(sizes.size() * sizeof(uint32_t)));
+    TINE_CHECK(rep.file.good() && rep.component_sizes == sizes, "Recorded by another build",
+               Error);
+    data_offset = static_cast<uint64_t>(rep.file.tellg());
+    rep.file.seekg(0, std::ios::end);
+    file_size = static_cast<uint64_t>(rep.file.tellg());
+
+    if (file_size >= data_offset + sizeof(footer)) {
+        rep.file.seekg(static_cast<std::streamoff>(file_size - sizeof(footer)));
+        rep.file.read(reinterpret_cast<char *>(&footer), sizeof(footer));
+    }
+    if (file_size >= data_offset + sizeof(footer) && memcmp(footer.magic, "TEND", 4) == 0 &&
+        footer.index_offset >= data_offset &&
+        footer.index_offset + footer.keyframe_count * sizeof(RecordingKeyframe) + sizeof(footer) ==
+            file_size) {
+        rep.keyframes.resize(footer.keyframe_count);
+        rep.file.seekg(static_cast<std::streamoff>(footer.index_offset));
+        rep.file.read(reinterpret_cast<char *>(rep.keyframes.data()),
+                      static_cast<std::streamsize>(footer.keyframe_count *
+                                                   sizeof(RecordingKeyframe)));
+        TINE_CHECK(rep.file.good(), "Failed to read recording index", Error);
+        rep.end_offset = footer.index_offset;
+        rep.last_step = footer.last_step;
+    } else {
+        TINE_WARN("{0} wasn't closed, scanning it for keyframes", path);
+        rep.file.clear();
+        scan_chunks(rep, data_offset, file_size);
+    }
+    TINE_CHECK(!rep.keyframes.empty(), "Recording holds no keyframe", Error);
+    rep.pools.resize(sizes.size());
+    return seek(rep.keyframes.front().step);
+Error:
+    close();
+    return false;
+}
+
+void tine::Replayer::close() {
+    Pimpl &rep = *m_pimpl;
+    rep.file.close();
+    rep.file.clear();
+    rep.keyframes.clear();
+    rep.pools.clear();
+    rep.end_offset = 0;
+    rep.offset = 0;
+    rep.has_state = false;
+}
+
+bool tine::Replayer::seek(uint64_t step) {
+    ZoneScoped;
+    Pimpl &rep = *m_pimpl;
+    RecordingChunk chunk;
+    if (rep.keyframes.empty()) {
+        return false;
+    }
+    auto it = std::upper_bound(
+        rep.keyframes.begin(), rep.keyframes.end(), step,
+        [](uint64_t s, const RecordingKeyframe &keyframe) { return s < keyframe.step; });
+    if (it != rep.keyframes.begin()) {
+        --it;
+    }
+    rep.offset = it->offset;
+    rep.has_state = false;
+    // Rebuilds the state up to the step before, the next one is played by next
+    while (read_chunk_header(rep, rep.offset, chunk) && chunk.step < step) {
+        if (!read_chunk(rep)) {
+            return false;
+        }
+    }
+    rep.file.clear();
+    return true;
+}
+
+bool tine::Replayer::next(entt::registry &registry) {
+    ZoneScoped;
+    Pimpl &rep = *m_pimpl;
+    if (rep.offset >= rep.end_offset || !read_chunk(rep)) {
+        return false;
+    }
+    const RegistrySnapshot::Pool &pool = rep.pools[TRANSFORM_POOL];
+    for (size_t i = 0; i < pool.entities.size(); i++) {
+        TransformComponent *transform = registry.valid(pool.entities[i])
+                                            ? registry.try_get<TransformComponent>(pool.entities[i])
+                                            : nullptr;
+        if (transform != nullptr) {
+            memcpy(transform, pool.components.data() + i * sizeof(TransformComponent),
+                   sizeof(TransformComponent));
+        }
+    }
+    return true;
+}
+
+uint64_t tine::Replayer::get_first_step() const {
+    return m_pimpl->keyframes.empty() ? 0 : m_pimpl->keyframes.front().step;
+}
+
+uint64_t tine::Replayer::get_last_step() const {
+    return m_pimpl->last_step;
+}
+
+uint64_t tine::Replayer::get_step() const {
+    return m_pimpl->step;
+}
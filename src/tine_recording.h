@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <entt/entt.hpp>
+
+namespace tine {
+
+// Recording file layout, little endian:
+//   RecordingHeader
+//   uint32_t component sizes, one per pool
+//   RecordingChunk followed by packed_size bytes, one per step
+//   RecordingKeyframe[keyframe_count]
+//   RecordingFooter
+// A chunk unpacks to raw_size bytes with a record per pool of SIMULATION_COMPONENTS, in order.  A
+// record starts with its mode.  POOL_FULL is followed by the entity count, the entities and their
+// components.  POOL_CHANGED keeps the entities of the previous step and is followed by the count
+// of changed components, their indices and then the components.  Keyframes only hold POOL_FULL.
+// A file whose writer never closed it has no index, replay finds the keyframes by walking chunks.
+struct RecordingHeader {
+    char magic[4]; // "TREC"
+    uint32_t version;
+    uint32_t pool_count;
+    uint32_t keyframe_interval;
+};
+
+struct RecordingChunk {
+    uint64_t step;
+    uint32_t is_keyframe;
+    uint32_t raw_size;
+    uint32_t packed_size;
+    uint32_t pad;
+};
+
+struct RecordingKeyframe {
+    uint64_t step;
+    uint64_t offset; // Of its RecordingChunk from the start of the file
+};
+
+struct RecordingFooter {
+    uint64_t index_offset; // Of the first RecordingKeyframe
+    uint64_t last_step;
+    uint32_t keyframe_count;
+    char magic[4]; // "TEND"
+};
+
+// Streams the simulation state of every recorded step to a file.  The main thread only copies the
+// component pools out, a background thread diffs them against the previous step, compresses the
+// changed components and writes them.  Every keyframe_interval steps it writes every component
+// instead, which is where a Replayer can seek to.  An index of the keyframes is appended on close.
+class Recorder {
+  public:
+    struct Pimpl;
+
+    Recorder();
+    ~Recorder();
+    Recorder(const Recorder &) = delete;
+
+    bool open(const std::string &path, uint32_t keyframe_interval = 120);
+    // Blocks only when the background thread falls several steps behind
+    void record(entt::registry &registry, uint64_t step);
+    // Writes the remaining steps and the index, false if anything failed to write
+    bool close();
+    bool is_open() const;
+
+  private:
+    std::unique_ptr<Pimpl> m_pimpl;
+};
+
+// Plays a recording back into a registry loaded from the same scene, moving the entities by their
+// recorded TransformComponent and nothing else.
+class Replayer {
+  public:
+    struct Pimpl;
+
+    Replayer();
+    ~Replayer();
+    Replayer(const Replayer &) = delete;
+
+    bool open(const std::string &path);
+    void close();
+    // The next step played is the first recorded at or after step
+    bool seek(uint64_t step);
+    // false at the end of the recording or if it's corrupt
+    bool next(entt::registry &registry);
+
+    uint64_t get_first_step() const;
+    uint64_t get_last_step() const;
+    // Of the step last played
+    uint64_t get_step() const;
+
+  private:
+    std::unique_ptr<Pimpl> m_pimpl;
+};
+
+} // namespace tine
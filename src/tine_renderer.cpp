@@ -1,3 +1,7 @@
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <string>
 #include <vector>
 #define GLAD_VULKAN_IMPLEMENTATION 1
 #include <vulkan/vulkan.h>
@@ -13,13 +17,41 @@
 
 #include "tine_log.h"
 #include "tine_renderer.h"
+#include "tine_capture.h"
 #include "tine_engine.h"
 #include "tine_scene.h"
+#include "tine_component.h"
+#include "tine_mesh.h"
+#include "tine_animation.h"
+#include "tine_batch.h"
+#include "tine_material.h"
+#include "tine_texture.h"
+#include "tine_jobs.h"
+#include "tine_arena.h"
+#include "tine_frustum.h"
+#include "tine_shm.h"
 
 static const uint32_t MAX_FRAMES_IN_FLIGHT = 256;
 static const uint32_t TRANSFER_PIPELINE_DEPTH = 3;
 static const size_t STAGING_BUFFER_SIZE =
     TRANSFER_PIPELINE_DEPTH * 1ULL * 1024ULL * 1024ULL; // 1MiB per push
+// Texture copies go through a ring of this size, larger textures get a staging buffer of their own
+static const VkDeviceSize TEXTURE_RING_SIZE = 64ULL * 1024ULL * 1024ULL;
+// Bytes of texture data submitted per frame, the rest waits for the next
+static const VkDeviceSize TEXTURE_UPLOAD_BUDGET = 16ULL * 1024ULL * 1024ULL;
+static const VkDeviceSize DEDICATED_STAGING = UINT64_MAX;
+// Passes profiled per frame, later ones go unmeasured
+static const uint32_t MAX_GPU_PASSES = 32;
+// In result order, which is the order of the bits
+static const VkQueryPipelineStatisticFlags GPU_STATISTICS =
+    VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+static const uint32_t GPU_STATISTIC_CNT = 5;
+// Images are big, a consumer that falls further behind only ever wants the newest anyway
+static const uint32_t SHM_IMAGE_SLOTS = 3;
 
 // TODO: refactor me out
 extern const unsigned char vert_shader_code[];
@@ -28,6 +60,21 @@ extern const unsigned long long vert_shader_code_len;
 extern const unsigned char frag_shader_code[];
 extern const unsigned long long frag_shader_code_len;
 
+extern const unsigned char skinning_shader_code[];
+extern const unsigned long long skinning_shader_code_len;
+
+extern const unsigned char meshlet_cull_shader_code[];
+extern const unsigned long long meshlet_cull_shader_code_len;
+
+extern const unsigned char instance_cull_shader_code[];
+extern const unsigned long long instance_cull_shader_code_len;
+
+extern const unsigned char hiz_reduce_shader_code[];
+extern const unsigned long long hiz_reduce_shader_code_len;
+
+extern const unsigned char depth_points_shader_code[];
+extern const unsigned long long depth_points_shader_code_len;
+
 #define CHECK_VK(err, msg, label)                                                                  \
     do {                                                                                           \
         VkResult __err = (err);                                                                    \
@@ -37,6 +84,195 @@ extern const unsigned long long frag_shader_code_len;
         }                                                                                          \
     } while (0)
 
+struct GpuBuffer {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VmaAllocation alloc = VK_NULL_HANDLE;
+    VmaAllocationInfo info = {};
+};
+
+struct GpuImage {
+    VkImage image = VK_NULL_HANDLE;
+    VmaAllocation alloc = VK_NULL_HANDLE;
+};
+
+// A bindless texture slot
+struct GpuTexture {
+    GpuImage image;
+    VkImageView view = VK_NULL_HANDLE;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t stored_level_cnt = 0; // Copied from the file, the rest are blitted on the GPU
+    uint32_t level_cnt = 0;
+};
+
+struct LoadedTexture {
+    uint32_t slot;
+    tine::TextureImage image;
+};
+
+// Textures copied by one transfer queue submission.  Once its fence has signalled the graphics
+// queue takes them over, finishes their mip chains and hands them to the materials.
+struct TextureBatch {
+    VkCommandBuffer cmd_buffer = VK_NULL_HANDLE;
+    VkFence fence = VK_NULL_HANDLE;
+    VkDeviceSize ring_end = 0; // Ring space up to here is free again once the batch is done
+    std::vector<GpuBuffer> dedicated_staging;
+    std::vector<uint32_t> slots;
+};
+
+// Copy of a presented image for the frame capture, read once the frame's fence has signalled
+struct CaptureReadback {
+    GpuBuffer buffer;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint64_t frame = 0;
+    uint64_t step = 0; // Engine step the frame showed
+    uint32_t env = 0;
+    bool is_pending = false;
+};
+
+// Points of a frame, written by the GPU straight into host memory
+struct PointReadback {
+    GpuBuffer buffer;
+    uint32_t max_points = 0;
+    uint64_t frame = 0;
+    uint64_t step = 0; // Engine step the frame showed
+    uint32_t env = 0;
+    bool is_pending = false;
+};
+
+// Queries of a frame command buffer, two timestamps and a statistics query per pass
+struct GpuQueries {
+    VkQueryPool timestamps = VK_NULL_HANDLE;
+    VkQueryPool statistics = VK_NULL_HANDLE; // If supported
+    const char *names[MAX_GPU_PASSES] = {};
+    uint32_t pass_cnt = 0;
+    uint64_t frame = 0;
+    bool is_recording = false; // Reset at the start of this frame's commands
+    bool is_pending = false;   // Submitted, resolved once the command buffer comes around again
+    bool has_statistics = false;
+};
+
+// Farthest depth pyramid, level 0 is half the resolution of the depth target and every texel
+// covers the 2x2 texels below it
+struct HizPyramid {
+    GpuImage image;
+    VkImageView view = VK_NULL_HANDLE;    // Every level, sampled by the instance culling
+    std::vector<VkImageView> level_views; // One per level, written by the reduction
+};
+
+// Mirrors SkinInstance in skinning.comp
+struct SkinInstance {
+    uint32_t src_vertex;
+    uint32_t dst_vertex;
+    uint32_t vertex_count;
+    uint32_t palette_offset;
+    uint32_t skin_vertex;
+    uint32_t src_mesh; // For the quantization of the bind pose
+    uint32_t dst_mesh;
+    uint32_t pad;
+};
+
+// Mirrors MeshletJob in meshlet_cull.comp, one per instance drawn through meshlets
+struct MeshletJob {
+    glm::vec4 eye; // Camera position in the instance's object space
+    uint32_t instance;
+    uint32_t meshlet_offset;
+    uint32_t meshlet_count;
+    uint32_t command; // Into the frame's indirect command buffer
+};
+
+// With occlusion culling, the instances visible last frame are drawn first, the Hi-Z pyramid is
+// built from their depth, and the rest are tested against it and drawn second.  0 draws
+// everything in a single pass.
+static const uint32_t DRAW_EARLY = 1;
+static const uint32_t DRAW_LATE = 2;
+
+// Mirrors the push constants of meshlet_cull.comp
+struct MeshletCullConstants {
+    tine::Frustum frustum;   // World space
+    uint32_t job_offset;     // Jobs past the dispatch limit go in another dispatch
+    uint32_t command_offset; // Start of the phase's indirect draws
+    uint32_t phase;          // Only jobs whose instance is drawn in this phase, if not 0
+    uint32_t meshlet_offset; // Meshlets past the dispatch limit go in another dispatch
+};
+
+// Mirrors the push constants of skinning.comp
+struct SkinningConstants {
+    uint32_t instance_offset; // Instances past the dispatch limit go in another dispatch
+    uint32_t group_offset;    // Same for the vertex groups of the largest instance
+};
+
+// Mirrors the push constants of instance_cull.comp
+struct InstanceCullConstants {
+    glm::mat4 view_proj;
+    uint32_t depth_size[2];
+    uint32_t hiz_levels;
+    uint32_t instance_count;
+    uint32_t batch_count;
+    uint32_t phase;
+    uint32_t pad[2];
+};
+
+// Mirrors the push constants of hiz_reduce.comp
+struct HizConstants {
+    uint32_t src_size[2];
+    uint32_t dst_size[2];
+};
+
+// Mirrors the push constants of depth_points.comp
+struct PointCloudConstants {
+    glm::mat4 unproject; // Vulkan clip space to the output frame
+    glm::vec4 origin;    // Of the camera in the output frame
+    uint32_t depth_size[2];
+    uint32_t stride;
+    uint32_t max_points;
+    float min_range;
+    float max_range;
+    float noise;
+    float dropout;
+    uint32_t seed;
+    uint32_t pad[3];
+};
+static_assert(sizeof(PointCloudConstants) <= 128, "Push constants must fit the minimum limit");
+
+// The point count of depth_points.comp, padded to the alignment of the points
+static const VkDeviceSize POINT_HEADER_SIZE = 16;
+
+static const uint32_t MAX_COMPUTE_BINDINGS = 8;
+
+// A compute shader whose resources are all in set 0, one descriptor per binding
+struct ComputePipeline {
+    VkDescriptorSetLayout desc_layout = VK_NULL_HANDLE;
+    VkPipelineLayout layout = VK_NULL_HANDLE;
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    VkDescriptorType types[MAX_COMPUTE_BINDINGS] = {};
+    uint32_t binding_cnt = 0;
+};
+
+// A buffer, or an image view for the image bindings of a ComputePipeline
+struct ComputeBinding {
+    VkBuffer buffer;
+    VkImageView view;
+    VkImageLayout layout;
+};
+
+static ComputeBinding buffer_binding(VkBuffer buffer) {
+    return ComputeBinding{buffer, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_UNDEFINED};
+}
+
+static ComputeBinding image_binding(VkImageView view, VkImageLayout layout) {
+    return ComputeBinding{VK_NULL_HANDLE, view, layout};
+}
+
+static const uint32_t SKINNING_GROUP_SIZE = 64;
+static const uint32_t INSTANCE_CULL_GROUP_SIZE = 64;
+static const uint32_t HIZ_GROUP_SIZE = 8;
+static const uint32_t POINT_GROUP_SIZE = 8;
+static const uint32_t MAX_BINDLESS_TEXTURES = 4096;
+// Descriptors of each type that can be allocated per frame
+static const uint32_t FRAME_DESC_POOL_SIZE = 256;
+
 struct tine::Renderer::Pimpl {
     GLFWwindow *m_window = nullptr;
     // vulkan
@@ -56,23 +292,137 @@ struct tine::Renderer::Pimpl {
     std::vector<VkImageView> vk_swapchain_image_views;
     VkDescriptorPool vk_desc_pool = VK_NULL_HANDLE;
     std::vector<VkFramebuffer> vk_framebuffers;
-    VkRenderPass vk_renderpass = VK_NULL_HANDLE;
+    VkRenderPass vk_renderpass = VK_NULL_HANDLE;       // Whole frame in one pass
+    VkRenderPass vk_renderpass_early = VK_NULL_HANDLE; // Before the Hi-Z build, keeps the depth
+    VkRenderPass vk_renderpass_late = VK_NULL_HANDLE;  // After the Hi-Z build
+    // Same as the last two, but keep the depth for the point cloud
+    VkRenderPass vk_renderpass_keep = VK_NULL_HANDLE;
+    VkRenderPass vk_renderpass_late_keep = VK_NULL_HANDLE;
+    VkFormat vk_depth_format = VK_FORMAT_UNDEFINED;
+    std::vector<GpuImage> vk_depth_images; // One per swapchain image
+    std::vector<VkImageView> vk_depth_views;
+    uint32_t depth_width = 0;
+    uint32_t depth_height = 0;
     VkCommandPool vk_frame_cmd_pool = VK_NULL_HANDLE;
     std::vector<VkCommandBuffer> vk_frame_cmd_buffers;
     std::vector<TracyVkCtx> tracy_vk_frame_ctxs;
+    // gpu profiling, see GpuZone
+    bool gpu_profiling = false;
+    bool gpu_pipeline_statistics = false;
+    bool supports_timestamps = false;
+    bool supports_pipeline_statistics = false;
+    double timestamp_period = 0.0; // Nanoseconds per tick
+    uint64_t timestamp_mask = 0;
+    std::vector<GpuQueries> gpu_queries; // One per frame command buffer
+    uint64_t gpu_frame = 0;
+    bool has_gpu_timings = false;
+    tine::GpuFrameTimings gpu_timings; // Newest resolved frame
     VkCommandPool vk_transfer_cmd_pool = VK_NULL_HANDLE;
     std::vector<VkCommandBuffer> vk_transfer_cmd_buffers;
     std::vector<VkSemaphore> vk_image_acquired_sems;
     std::vector<VkSemaphore> vk_render_completed_sems;
     std::vector<VkFence> vk_render_completed_fences;
     VkPipeline vk_pipeline = VK_NULL_HANDLE;
+    VkPipeline vk_depth_pipeline = VK_NULL_HANDLE;
+    bool depth_prepass = false;
     VkPipelineLayout vk_pipeline_layout = VK_NULL_HANDLE;
     std::vector<VkFence> vk_transfer_fences;
     size_t vk_staging_buffer_size = STAGING_BUFFER_SIZE;
     VkBuffer vk_staging_buffer = VK_NULL_HANDLE;
     VmaAllocationInfo vk_staging_buffer_info = {};
     VmaAllocation vk_staging_alloc = VK_NULL_HANDLE;
+    // scene geometry
+    GpuBuffer vk_vertex_buffer;
+    GpuBuffer vk_index_buffer;
+    // skinning
+    ComputePipeline skin_pipeline;
+    GpuBuffer vk_skin_vertex_buffer;
+    GpuBuffer vk_skin_instance_buffer;
+    std::vector<GpuBuffer> vk_palette_buffers; // One per frame command buffer
+    uint32_t skin_instance_cnt = 0;
+    uint32_t skin_max_vertex_cnt = 0;
+    // gpu culling, needs drawIndirectFirstInstance
+    bool gpu_culling = false;
+    bool multi_draw_indirect = false;
+    uint32_t max_draw_indirect_cnt = 1;
+    uint32_t max_dispatch_x = 1;
+    uint32_t max_dispatch_y = 1;
+    VkSampler vk_point_sampler = VK_NULL_HANDLE; // Immutable sampler of the compute pipelines
+    // meshlet culling
+    uint32_t meshlet_draw_cnt = 0; // Indirect draws per phase this frame
+    uint32_t meshlet_max_cnt = 0;  // Meshlets of the largest job this frame
+    ComputePipeline cull_pipeline;
+    GpuBuffer vk_meshlet_buffer;
+    GpuBuffer vk_meshlet_vertex_buffer;
+    GpuBuffer vk_meshlet_triangle_buffer;
+    std::vector<GpuBuffer> vk_meshlet_job_buffers;     // One per frame command buffer
+    std::vector<GpuBuffer> vk_meshlet_command_buffers; // One per frame command buffer
+    std::vector<GpuBuffer> vk_culled_index_buffers;    // One per frame command buffer
+    // occlusion culling
+    bool occlusion_culling = true;
+    ComputePipeline instance_cull_pipeline;
+    ComputePipeline hiz_pipeline;
+    std::vector<HizPyramid> hiz_pyramids; // One per swapchain image
+    uint32_t hiz_levels = 0;
+    // Per entity index, whether it passed the occlusion test last frame
+    GpuBuffer vk_visibility_buffer;
+    uint32_t visibility_cap = 0;
+    std::vector<GpuBuffer> vk_batch_command_buffers;   // One per frame command buffer
+    std::vector<GpuBuffer> vk_culled_instance_buffers; // One per frame command buffer
+    std::vector<GpuBuffer> vk_instance_flag_buffers;   // One per frame command buffer
+    // bindless resources
+    VkSampler vk_default_sampler = VK_NULL_HANDLE;
+    VkDescriptorSetLayout vk_bindless_layout = VK_NULL_HANDLE;
+    VkDescriptorPool vk_bindless_pool = VK_NULL_HANDLE;
+    VkDescriptorSet vk_bindless_set = VK_NULL_HANDLE;
+    uint32_t bindless_texture_cap = MAX_BINDLESS_TEXTURES;
+    GpuBuffer vk_material_buffer;
+    // textures, streamed in by record_texture_uploads
+    tine::TextureFormatMask texture_formats = 0; // Sampleable with the default sampler
+    tine::TextureFormatMask mip_formats = 0;     // Blittable, mips are generated on the GPU
+    std::vector<GpuTexture> vk_textures;         // Indexed by bindless slot
+    std::vector<uint32_t> material_textures;     // Each material's texture, bound once uploaded
+    GpuBuffer vk_texture_ring;
+    VkDeviceSize texture_ring_head = 0; // Bytes allocated and retired, both wrap modulo the size
+    VkDeviceSize texture_ring_tail = 0;
+    std::deque<TextureBatch> texture_batches; // On the transfer queue, oldest first
+    // Scratch of record_texture_acquires and record_texture_publish, kept to not allocate per frame
+    std::vector<uint32_t> ready_slots;
+    std::vector<uint8_t> is_texture_ready; // By bindless slot
+    std::vector<VkDescriptorImageInfo> texture_image_infos;
+    std::vector<VkWriteDescriptorSet> texture_writes;
+    tine::JobSystem *jobs = nullptr;
+    tine::JobCounter texture_loads;
+    std::mutex loaded_mutex;
+    std::vector<LoadedTexture> loaded_textures; // Filled by the load jobs
+    GpuBuffer vk_mesh_quant_buffer;
+    // per frame transients, reset once the frame fence has signalled
+    std::vector<VkDescriptorPool> vk_frame_desc_pools;
+    tine::LinearArena frame_arena;
+    // instancing
+    tine::DrawList draw_list;
+    std::vector<GpuBuffer> vk_instance_buffers; // One per frame command buffer
     bool swapchain_is_stale = false;
+    // point clouds, see record_point_cloud
+    bool point_cloud = false;
+    tine::PointCloudSettings point_settings;
+    ComputePipeline point_pipeline;
+    std::vector<PointReadback> point_readbacks; // One per frame command buffer
+    uint64_t point_frame = 0;
+    bool has_point_cloud = false;
+    tine::PointCloud points; // Newest resolved frame
+    // frame capture, see record_capture
+    tine::FrameCapture *capture = nullptr;
+    bool supports_capture = false; // Swapchain images can be copied from
+    tine::CapturePixels capture_pixels = tine::CapturePixels::BGRA8;
+    std::vector<CaptureReadback> capture_readbacks; // One per frame command buffer
+    uint64_t capture_frame = 0;
+    // shared memory rings, see Renderer::set_shm.  Created by the first frame that fits them.
+    std::string shm_prefix;
+    tine::ShmWriter shm_color;
+    tine::ShmWriter shm_depth;
+    uint64_t frame_step = 0; // Of the frame being recorded
+    uint32_t frame_env = 0;
     // imgui
     bool imgui_initialized = false;
     bool imgui_show_demo_window = true;
@@ -182,6 +532,25 @@ Error:
     return false;
 }
 
+// Materials and textures are accessed through descriptor indexing, see vk_init_bindless
+static bool vk_supports_bindless(VkPhysicalDevice dev, const VkPhysicalDeviceProperties &props) {
+    VkPhysicalDeviceVulkan12Features features12 = {};
+    VkPhysicalDeviceFeatures2 features = {};
+
+    if (props.apiVersion < VK_API_VERSION_1_2) {
+        return false;
+    }
+    features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &features12;
+    vkGetPhysicalDeviceFeatures2(dev, &features);
+
+    return features12.runtimeDescriptorArray && features12.descriptorBindingPartiallyBound &&
+           features12.shaderSampledImageArrayNonUniformIndexing &&
+           features12.descriptorBindingSampledImageUpdateAfterBind &&
+           features12.descriptorBindingUpdateUnusedWhilePending;
+}
+
 static bool vk_select_dev(tine::Renderer::Pimpl &p) {
     std::vector<VkPhysicalDevice> devices;
     TINE_TRACE("Selecting rendering device");
@@ -216,6 +585,10 @@ static bool vk_select_dev(tine::Renderer::Pimpl &p) {
             }
         }
         vkGetPhysicalDeviceProperties(devices[dev], &properties);
+        if (!vk_supports_bindless(devices[dev], properties)) {
+            TINE_TRACE("Skipping {0}, no descriptor indexing support", properties.deviceName);
+            continue;
+        }
         {
             uint32_t q_family_cnt = 0;
             vkGetPhysicalDeviceQueueFamilyProperties(devices[dev], &q_family_cnt, nullptr);
@@ -257,6 +630,9 @@ Error:
 static bool vk_init_dev(tine::Renderer::Pimpl &p) {
     VkDeviceCreateInfo dev_cinfo = {};
     VkPhysicalDeviceFeatures dev_features = {};
+    VkPhysicalDeviceFeatures supported_features = {};
+    VkPhysicalDeviceProperties properties = {};
+    VkPhysicalDeviceVulkan12Features dev_features12 = {};
     VkDeviceQueueCreateInfo dev_queue_cinfos[2] = {};
     uint32_t dev_queue_cinfo_cnt = sizeof(dev_queue_cinfos) / sizeof(dev_queue_cinfos[0]);
     const char *dev_exts[] = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
@@ -280,7 +656,43 @@ static bool vk_init_dev(tine::Renderer::Pimpl &p) {
         dev_queue_cinfo_cnt--;
     }
 
+    // GPU culling writes indirect draws that address their instances through firstInstance
+    vkGetPhysicalDeviceFeatures(p.vk_phy_dev, &supported_features);
+    vkGetPhysicalDeviceProperties(p.vk_phy_dev, &properties);
+    p.max_draw_indirect_cnt = properties.limits.maxDrawIndirectCount;
+    p.max_dispatch_x = properties.limits.maxComputeWorkGroupCount[0];
+    p.max_dispatch_y = properties.limits.maxComputeWorkGroupCount[1];
+    dev_features.drawIndirectFirstInstance = supported_features.drawIndirectFirstInstance;
+    dev_features.multiDrawIndirect = supported_features.multiDrawIndirect;
+    p.gpu_culling = (supported_features.drawIndirectFirstInstance == VK_TRUE);
+    p.multi_draw_indirect = (supported_features.multiDrawIndirect == VK_TRUE);
+    if (!p.gpu_culling) {
+        TINE_WARN("No drawIndirectFirstInstance support, GPU culling disabled");
+    }
+    dev_features.pipelineStatisticsQuery = supported_features.pipelineStatisticsQuery;
+    p.supports_pipeline_statistics = (supported_features.pipelineStatisticsQuery == VK_TRUE);
+    {
+        std::vector<VkQueueFamilyProperties> q_families;
+        uint32_t q_family_cnt = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(p.vk_phy_dev, &q_family_cnt, nullptr);
+        q_families.resize(q_family_cnt);
+        vkGetPhysicalDeviceQueueFamilyProperties(p.vk_phy_dev, &q_family_cnt, q_families.data());
+        const uint32_t valid_bits = q_families[p.vk_queue_graphics_family].timestampValidBits;
+        p.supports_timestamps = valid_bits > 0 && properties.limits.timestampPeriod > 0.0f;
+        p.timestamp_mask = valid_bits >= 64 ? UINT64_MAX : (1ULL << valid_bits) - 1;
+        p.timestamp_period = properties.limits.timestampPeriod;
+    }
+
+    // Checked by vk_supports_bindless
+    dev_features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    dev_features12.runtimeDescriptorArray = VK_TRUE;
+    dev_features12.descriptorBindingPartiallyBound = VK_TRUE;
+    dev_features12.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+    dev_features12.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+    dev_features12.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+
     dev_cinfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    dev_cinfo.pNext = &dev_features12;
     dev_cinfo.pQueueCreateInfos = dev_queue_cinfos;
     dev_cinfo.queueCreateInfoCount = dev_queue_cinfo_cnt;
     dev_cinfo.pEnabledFeatures = &dev_features;
@@ -302,6 +714,72 @@ Error:
     return false;
 }
 
+// The depth target is also sampled by the Hi-Z build
+static bool vk_select_depth_format(tine::Renderer::Pimpl &p) {
+    const VkFormat candidates[] = {VK_FORMAT_D32_SFLOAT, VK_FORMAT_X8_D24_UNORM_PACK32,
+                                   VK_FORMAT_D16_UNORM};
+    const VkFormatFeatureFlags features =
+        VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+
+    for (VkFormat format : candidates) {
+        VkFormatProperties props = {};
+        vkGetPhysicalDeviceFormatProperties(p.vk_phy_dev, format, &props);
+        if ((props.optimalTilingFeatures & features) == features) {
+            p.vk_depth_format = format;
+            return true;
+        }
+    }
+    TINE_ERROR("No sampleable depth format");
+    return false;
+}
+
+static VkFormat vk_texture_format(tine::TextureFormat format, bool srgb) {
+    switch (format) {
+    case tine::TextureFormat::BC1:
+        return srgb ? VK_FORMAT_BC1_RGBA_SRGB_BLOCK : VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+    case tine::TextureFormat::BC3:
+        return srgb ? VK_FORMAT_BC3_SRGB_BLOCK : VK_FORMAT_BC3_UNORM_BLOCK;
+    case tine::TextureFormat::BC5:
+        return VK_FORMAT_BC5_UNORM_BLOCK;
+    case tine::TextureFormat::BC7:
+        return srgb ? VK_FORMAT_BC7_SRGB_BLOCK : VK_FORMAT_BC7_UNORM_BLOCK;
+    default:
+        return srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+    }
+}
+
+// Block compressed textures are only loaded as such if the device can filter them, in both
+// color spaces, otherwise they are decoded or transcoded to RGBA8 which every device supports
+static void vk_select_texture_formats(tine::Renderer::Pimpl &p) {
+    const VkFormatFeatureFlags features =
+        VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    const VkFormatFeatureFlags mip_features =
+        features | VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT;
+
+    p.texture_formats = 0;
+    p.mip_formats = 0;
+    for (uint32_t f = 0; f < static_cast<uint32_t>(tine::TextureFormat::COUNT); f++) {
+        const tine::TextureFormat format = static_cast<tine::TextureFormat>(f);
+        VkFormatProperties unorm_props = {};
+        VkFormatProperties srgb_props = {};
+        vkGetPhysicalDeviceFormatProperties(p.vk_phy_dev, vk_texture_format(format, false),
+                                            &unorm_props);
+        vkGetPhysicalDeviceFormatProperties(p.vk_phy_dev, vk_texture_format(format, true),
+                                            &srgb_props);
+        if ((unorm_props.optimalTilingFeatures & features) == features &&
+            (srgb_props.optimalTilingFeatures & features) == features) {
+            p.texture_formats |= tine::texture_format_bit(format);
+        }
+        if ((unorm_props.optimalTilingFeatures & mip_features) == mip_features &&
+            (srgb_props.optimalTilingFeatures & mip_features) == mip_features) {
+            p.mip_formats |= tine::texture_format_bit(format);
+        }
+    }
+    if (p.texture_formats == tine::texture_format_bit(tine::TextureFormat::RGBA8)) {
+        TINE_WARN("No BC texture support, textures will be decoded to RGBA8");
+    }
+}
+
 static bool vk_init_allocator(tine::Renderer::Pimpl &p) {
     VmaAllocatorCreateInfo vma_allocator_cinfo = {};
 
@@ -317,6 +795,7 @@ Error:
     return false;
 }
 
+// Long lived descriptor sets (ImGui), per frame ones come from vk_frame_desc_pools
 static bool vk_init_desc_pool(tine::Renderer::Pimpl &p) {
     VkDescriptorPoolCreateInfo pool_info = {};
     VkDescriptorPoolSize pool_sizes[] = {
@@ -349,6 +828,162 @@ Error:
     return false;
 }
 
+// Descriptor sets that only live for one frame are never freed individually, their pool is reset
+// wholesale when the frame's fence has signalled.
+static bool vk_init_frame_desc_pools(tine::Renderer::Pimpl &p) {
+    VkDescriptorPoolCreateInfo pool_info = {};
+    VkDescriptorPoolSize pool_sizes[] = {
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, FRAME_DESC_POOL_SIZE},
+        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, FRAME_DESC_POOL_SIZE},
+        {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, FRAME_DESC_POOL_SIZE},
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, FRAME_DESC_POOL_SIZE},
+        {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, FRAME_DESC_POOL_SIZE}};
+
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.maxSets = FRAME_DESC_POOL_SIZE;
+    pool_info.poolSizeCount = sizeof(pool_sizes) / sizeof(pool_sizes[0]);
+    pool_info.pPoolSizes = pool_sizes;
+
+    p.vk_frame_desc_pools.resize(p.vk_frame_cmd_buffers.size(), VK_NULL_HANDLE);
+    for (VkDescriptorPool &pool : p.vk_frame_desc_pools) {
+        CHECK_VK(vkCreateDescriptorPool(p.vk_dev, &pool_info, nullptr, &pool),
+                 "Failed to create frame descriptor pool", Error);
+    }
+
+    return true;
+Error:
+    return false;
+}
+
+static VkDescriptorSet alloc_frame_desc_set(tine::Renderer::Pimpl &p, uint32_t image_idx,
+                                            VkDescriptorSetLayout layout) {
+    VkDescriptorSetAllocateInfo desc_set_ainfo = {};
+    VkDescriptorSet desc_set = VK_NULL_HANDLE;
+
+    desc_set_ainfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    desc_set_ainfo.descriptorPool = p.vk_frame_desc_pools[image_idx];
+    desc_set_ainfo.descriptorSetCount = 1;
+    desc_set_ainfo.pSetLayouts = &layout;
+    CHECK_VK(vkAllocateDescriptorSets(p.vk_dev, &desc_set_ainfo, &desc_set),
+             "Frame descriptor pool exhausted", Error);
+    return desc_set;
+Error:
+    return VK_NULL_HANDLE;
+}
+
+// A single descriptor set shared by every draw: all the material parameters in one storage buffer
+// and all the textures in one partially bound array, both indexed by material ID in the shaders.
+static bool vk_init_bindless(tine::Renderer::Pimpl &p) {
+    VkSamplerCreateInfo sampler_cinfo = {};
+    VkDescriptorSetLayoutBinding bindings[4] = {};
+    VkDescriptorBindingFlags binding_flags[4] = {};
+    const uint32_t binding_cnt = sizeof(bindings) / sizeof(bindings[0]);
+    VkDescriptorSetLayoutBindingFlagsCreateInfo binding_flags_cinfo = {};
+    VkDescriptorSetLayoutCreateInfo desc_layout_cinfo = {};
+    VkDescriptorPoolSize pool_sizes[3] = {};
+    VkDescriptorPoolCreateInfo pool_cinfo = {};
+    VkDescriptorSetAllocateInfo desc_set_ainfo = {};
+    VkPhysicalDeviceVulkan12Properties props12 = {};
+    VkPhysicalDeviceProperties2 props = {};
+
+    TINE_TRACE("Initializing bindless resources");
+
+    props12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+    props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    props.pNext = &props12;
+    vkGetPhysicalDeviceProperties2(p.vk_phy_dev, &props);
+    p.bindless_texture_cap = std::min(
+        MAX_BINDLESS_TEXTURES, props12.maxPerStageDescriptorUpdateAfterBindSampledImages);
+
+    sampler_cinfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampler_cinfo.magFilter = VK_FILTER_LINEAR;
+    sampler_cinfo.minFilter = VK_FILTER_LINEAR;
+    sampler_cinfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    sampler_cinfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    sampler_cinfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    sampler_cinfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    sampler_cinfo.maxLod = VK_LOD_CLAMP_NONE;
+    CHECK_VK(vkCreateSampler(p.vk_dev, &sampler_cinfo, nullptr, &p.vk_default_sampler),
+             "Failed to create default sampler", Error);
+
+    // Materials
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[0].descriptorCount = 1;
+    bindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    binding_flags[0] = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+    // Sampler shared by every texture
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+    bindings[1].descriptorCount = 1;
+    bindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    bindings[1].pImmutableSamplers = &p.vk_default_sampler;
+    // Textures, filled in as they're uploaded without waiting for frames in flight
+    bindings[2].binding = 2;
+    bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+    bindings[2].descriptorCount = p.bindless_texture_cap;
+    bindings[2].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    binding_flags[2] = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+                       VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+                       VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+    // Vertex dequantization, see tine::MeshQuantization
+    bindings[3].binding = 3;
+    bindings[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[3].descriptorCount = 1;
+    bindings[3].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    binding_flags[3] = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+
+    binding_flags_cinfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    binding_flags_cinfo.bindingCount = binding_cnt;
+    binding_flags_cinfo.pBindingFlags = binding_flags;
+
+    desc_layout_cinfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    desc_layout_cinfo.pNext = &binding_flags_cinfo;
+    desc_layout_cinfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    desc_layout_cinfo.bindingCount = binding_cnt;
+    desc_layout_cinfo.pBindings = bindings;
+    CHECK_VK(vkCreateDescriptorSetLayout(p.vk_dev, &desc_layout_cinfo, nullptr,
+                                         &p.vk_bindless_layout),
+             "Failed to create bindless descriptor set layout", Error);
+
+    pool_sizes[0] = {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2};
+    pool_sizes[1] = {VK_DESCRIPTOR_TYPE_SAMPLER, 1};
+    pool_sizes[2] = {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, p.bindless_texture_cap};
+    pool_cinfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_cinfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    pool_cinfo.maxSets = 1;
+    pool_cinfo.poolSizeCount = sizeof(pool_sizes) / sizeof(pool_sizes[0]);
+    pool_cinfo.pPoolSizes = pool_sizes;
+    CHECK_VK(vkCreateDescriptorPool(p.vk_dev, &pool_cinfo, nullptr, &p.vk_bindless_pool),
+             "Failed to create bindless descriptor pool", Error);
+
+    desc_set_ainfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    desc_set_ainfo.descriptorPool = p.vk_bindless_pool;
+    desc_set_ainfo.descriptorSetCount = 1;
+    desc_set_ainfo.pSetLayouts = &p.vk_bindless_layout;
+    CHECK_VK(vkAllocateDescriptorSets(p.vk_dev, &desc_set_ainfo, &p.vk_bindless_set),
+             "Failed to allocate bindless descriptor set", Error);
+
+    return true;
+Error:
+    return false;
+}
+
+static bool get_capture_pixels(VkFormat format, tine::CapturePixels &pixels) {
+    switch (format) {
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+        pixels = tine::CapturePixels::RGBA8;
+        return true;
+    case VK_FORMAT_B8G8R8A8_UNORM:
+    case VK_FORMAT_B8G8R8A8_SRGB:
+        pixels = tine::CapturePixels::BGRA8;
+        return true;
+    default:
+        return false;
+    }
+}
+
 static bool vk_init_swapchain(tine::Renderer::Pimpl &p, int width, int height) {
     VkSwapchainCreateInfoKHR swapchain_cinfo = {};
     VkSurfaceCapabilitiesKHR capabilities = {};
@@ -419,6 +1054,13 @@ static bool vk_init_swapchain(tine::Renderer::Pimpl &p, int width, int height) {
     swapchain_cinfo.imageExtent = extent;
     swapchain_cinfo.imageArrayLayers = 1;
     swapchain_cinfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    // Frame capture copies the presented images out
+    p.supports_capture =
+        (capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) &&
+        get_capture_pixels(p.vk_image_format.format, p.capture_pixels);
+    if (p.supports_capture) {
+        swapchain_cinfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    }
     swapchain_cinfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
     swapchain_cinfo.queueFamilyIndexCount = 0;
     swapchain_cinfo.pQueueFamilyIndices = nullptr;
@@ -538,6 +1180,152 @@ Error:
     return false;
 }
 
+static bool vk_init_gpu_queries(tine::Renderer::Pimpl &p) {
+    VkQueryPoolCreateInfo pool_cinfo = {};
+    if (!p.supports_timestamps) {
+        TINE_WARN("No timestamp support on the graphics queue, GPU profiling disabled");
+        return true;
+    }
+    p.gpu_queries.resize(p.vk_frame_cmd_buffers.size());
+    pool_cinfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    for (GpuQueries &queries : p.gpu_queries) {
+        pool_cinfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        pool_cinfo.queryCount = 2 * MAX_GPU_PASSES;
+        pool_cinfo.pipelineStatistics = 0;
+        CHECK_VK(vkCreateQueryPool(p.vk_dev, &pool_cinfo, nullptr, &queries.timestamps),
+                 "Failed to create timestamp query pool", Error);
+        if (p.supports_pipeline_statistics) {
+            pool_cinfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+            pool_cinfo.queryCount = MAX_GPU_PASSES;
+            pool_cinfo.pipelineStatistics = GPU_STATISTICS;
+            CHECK_VK(vkCreateQueryPool(p.vk_dev, &pool_cinfo, nullptr, &queries.statistics),
+                     "Failed to create pipeline statistics query pool", Error);
+        }
+    }
+    return true;
+Error:
+    return false;
+}
+
+static void vk_cleanup_gpu_queries(tine::Renderer::Pimpl &p) {
+    for (GpuQueries &queries : p.gpu_queries) {
+        if (queries.timestamps != VK_NULL_HANDLE) {
+            vkDestroyQueryPool(p.vk_dev, queries.timestamps, nullptr);
+        }
+        if (queries.statistics != VK_NULL_HANDLE) {
+            vkDestroyQueryPool(p.vk_dev, queries.statistics, nullptr);
+        }
+    }
+    p.gpu_queries.clear();
+}
+
+// Timestamps around a pass of the frame command buffer, with a pipeline statistics query between
+// them if enabled.  Zones can't nest, the statistics queries of a pool may not overlap.
+struct GpuZone {
+    GpuQueries *queries = nullptr;
+    VkCommandBuffer cmd_buffer = VK_NULL_HANDLE;
+    uint32_t pass = 0;
+
+    GpuZone(tine::Renderer::Pimpl &p, VkCommandBuffer cmd, uint32_t image_idx, const char *name)
+        : cmd_buffer(cmd) {
+        if (image_idx >= p.gpu_queries.size() || !p.gpu_queries[image_idx].is_recording ||
+            p.gpu_queries[image_idx].pass_cnt == MAX_GPU_PASSES) {
+            return;
+        }
+        queries = &p.gpu_queries[image_idx];
+        pass = queries->pass_cnt++;
+        queries->names[pass] = name;
+        vkCmdWriteTimestamp(cmd_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queries->timestamps,
+                            2 * pass);
+        if (queries->has_statistics) {
+            vkCmdBeginQuery(cmd_buffer, queries->statistics, pass, 0);
+        }
+    }
+    ~GpuZone() {
+        if (queries == nullptr) {
+            return;
+        }
+        if (queries->has_statistics) {
+            vkCmdEndQuery(cmd_buffer, queries->statistics, pass);
+        }
+        vkCmdWriteTimestamp(cmd_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queries->timestamps,
+                            2 * pass + 1);
+    }
+    GpuZone(const GpuZone &) = delete;
+};
+
+static void reset_gpu_queries(tine::Renderer::Pimpl &p, VkCommandBuffer &cmd_buffer,
+                              uint32_t image_idx) {
+    if (image_idx >= p.gpu_queries.size()) {
+        return;
+    }
+    GpuQueries &queries = p.gpu_queries[image_idx];
+    queries.pass_cnt = 0;
+    queries.is_recording = p.gpu_profiling;
+    if (!queries.is_recording) {
+        return;
+    }
+    queries.frame = p.gpu_frame++;
+    queries.has_statistics = p.gpu_pipeline_statistics && queries.statistics != VK_NULL_HANDLE;
+    vkCmdResetQueryPool(cmd_buffer, queries.timestamps, 0, 2 * MAX_GPU_PASSES);
+    if (queries.has_statistics) {
+        vkCmdResetQueryPool(cmd_buffer, queries.statistics, 0, MAX_GPU_PASSES);
+    }
+}
+
+// Reads back the queries of the last frame recorded into the command buffer.  Its fence has
+// signalled, so they're available without waiting.
+static void resolve_gpu_queries(tine::Renderer::Pimpl &p, uint32_t image_idx) {
+    uint64_t timestamps[2 * MAX_GPU_PASSES] = {};
+    uint64_t statistics[GPU_STATISTIC_CNT * MAX_GPU_PASSES] = {};
+    uint64_t first = UINT64_MAX;
+    uint64_t last = 0;
+    if (image_idx >= p.gpu_queries.size() || !p.gpu_queries[image_idx].is_pending) {
+        return;
+    }
+    GpuQueries &queries = p.gpu_queries[image_idx];
+    queries.is_pending = false;
+    if (queries.pass_cnt == 0 ||
+        vkGetQueryPoolResults(p.vk_dev, queries.timestamps, 0, 2 * queries.pass_cnt,
+                              sizeof(timestamps), timestamps, sizeof(uint64_t),
+                              VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+        return;
+    }
+    if (queries.has_statistics &&
+        vkGetQueryPoolResults(p.vk_dev, queries.statistics, 0, queries.pass_cnt,
+                              sizeof(statistics), statistics,
+                              GPU_STATISTIC_CNT * sizeof(uint64_t),
+                              VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+        memset(statistics, 0, sizeof(statistics));
+    }
+
+    p.gpu_timings.frame = queries.frame;
+    p.gpu_timings.passes.clear();
+    for (uint32_t pass = 0; pass < queries.pass_cnt; pass++) {
+        const uint64_t begin = timestamps[2 * pass] & p.timestamp_mask;
+        const uint64_t end = timestamps[2 * pass + 1] & p.timestamp_mask;
+        const uint64_t *stats = &statistics[GPU_STATISTIC_CNT * pass];
+        auto it = std::find_if(p.gpu_timings.passes.begin(), p.gpu_timings.passes.end(),
+                               [&](const tine::GpuPassTiming &timing) {
+                                   return strcmp(timing.name, queries.names[pass]) == 0;
+                               });
+        if (it == p.gpu_timings.passes.end()) {
+            p.gpu_timings.passes.push_back({queries.names[pass], 0.0, 0, 0, 0, 0, 0});
+            it = p.gpu_timings.passes.end() - 1;
+        }
+        it->milliseconds += ((end - begin) & p.timestamp_mask) * p.timestamp_period * 1e-6;
+        it->input_vertices += stats[0];
+        it->vertex_invocations += stats[1];
+        it->clipped_primitives += stats[2];
+        it->fragment_invocations += stats[3];
+        it->compute_invocations += stats[4];
+        first = std::min(first, begin);
+        last = std::max(last, end);
+    }
+    p.gpu_timings.milliseconds = ((last - first) & p.timestamp_mask) * p.timestamp_period * 1e-6;
+    p.has_gpu_timings = true;
+}
+
 static bool vk_init_staging_buffer(tine::Renderer::Pimpl &p) {
     VkBufferCreateInfo buffer_cinfo = {};
     VmaAllocationCreateInfo alloc_cinfo = {};
@@ -559,6 +1347,227 @@ Error:
     return false;
 }
 
+static bool vk_create_buffer(tine::Renderer::Pimpl &p, GpuBuffer &buf, VkDeviceSize size,
+                             VkBufferUsageFlags usage, bool host_visible) {
+    VkBufferCreateInfo buffer_cinfo = {};
+    VmaAllocationCreateInfo alloc_cinfo = {};
+    const uint32_t queue_families[] = {p.vk_queue_graphics_family, p.vk_queue_transfer_family};
+
+    buffer_cinfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_cinfo.size = size;
+    buffer_cinfo.usage = usage;
+    buffer_cinfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (host_visible) {
+        alloc_cinfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_HOST;
+        alloc_cinfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+                            VMA_ALLOCATION_CREATE_MAPPED_BIT;
+    } else {
+        // Device local buffers are filled from the transfer queue, share them rather than
+        // transferring ownership when it's a separate family
+        alloc_cinfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+        buffer_cinfo.usage |= VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        if (p.vk_queue_graphics_family != p.vk_queue_transfer_family) {
+            buffer_cinfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+            buffer_cinfo.queueFamilyIndexCount = 2;
+            buffer_cinfo.pQueueFamilyIndices = queue_families;
+        }
+    }
+
+    CHECK_VK(vmaCreateBuffer(p.vk_allocator, &buffer_cinfo, &alloc_cinfo, &buf.buffer, &buf.alloc,
+                             &buf.info),
+             "Failed to allocate buffer", Error);
+
+    return true;
+Error:
+    return false;
+}
+
+static void vk_destroy_buffer(tine::Renderer::Pimpl &p, GpuBuffer &buf) {
+    if (buf.buffer != VK_NULL_HANDLE) {
+        vmaDestroyBuffer(p.vk_allocator, buf.buffer, buf.alloc);
+        buf = GpuBuffer();
+    }
+}
+
+// Host cached, for reading back what the GPU wrote
+static bool vk_create_readback_buffer(tine::Renderer::Pimpl &p, GpuBuffer &buf,
+                                      VkDeviceSize size, VkBufferUsageFlags usage) {
+    VkBufferCreateInfo buffer_cinfo = {};
+    VmaAllocationCreateInfo alloc_cinfo = {};
+
+    buffer_cinfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_cinfo.size = size;
+    buffer_cinfo.usage = usage;
+    buffer_cinfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    alloc_cinfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_HOST;
+    alloc_cinfo.flags =
+        VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+    CHECK_VK(vmaCreateBuffer(p.vk_allocator, &buffer_cinfo, &alloc_cinfo, &buf.buffer, &buf.alloc,
+                             &buf.info),
+             "Failed to allocate readback buffer", Error);
+
+    return true;
+Error:
+    return false;
+}
+
+static void vk_release_texture_batch(tine::Renderer::Pimpl &p, TextureBatch &batch) {
+    for (GpuBuffer &buf : batch.dedicated_staging) {
+        vk_destroy_buffer(p, buf);
+    }
+    if (batch.cmd_buffer != VK_NULL_HANDLE) {
+        vkFreeCommandBuffers(p.vk_dev, p.vk_transfer_cmd_pool, 1, &batch.cmd_buffer);
+    }
+    if (batch.fence != VK_NULL_HANDLE) {
+        vkDestroyFence(p.vk_dev, batch.fence, nullptr);
+    }
+    batch = TextureBatch();
+}
+
+static bool vk_init_texture_ring(tine::Renderer::Pimpl &p) {
+    TINE_CHECK(vk_create_buffer(p, p.vk_texture_ring, TEXTURE_RING_SIZE,
+                                VK_BUFFER_USAGE_TRANSFER_SRC_BIT, true),
+               "Failed to allocate texture staging ring", Error);
+    return true;
+Error:
+    return false;
+}
+
+static bool vk_create_image(tine::Renderer::Pimpl &p, GpuImage &img, VkFormat format,
+                            uint32_t width, uint32_t height, uint32_t levels,
+                            VkImageUsageFlags usage) {
+    VkImageCreateInfo image_cinfo = {};
+    VmaAllocationCreateInfo alloc_cinfo = {};
+
+    image_cinfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_cinfo.imageType = VK_IMAGE_TYPE_2D;
+    image_cinfo.format = format;
+    image_cinfo.extent = {width, height, 1};
+    image_cinfo.mipLevels = levels;
+    image_cinfo.arrayLayers = 1;
+    image_cinfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_cinfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_cinfo.usage = usage;
+    image_cinfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_cinfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    alloc_cinfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+
+    CHECK_VK(vmaCreateImage(p.vk_allocator, &image_cinfo, &alloc_cinfo, &img.image, &img.alloc,
+                            nullptr),
+             "Failed to allocate image", Error);
+    return true;
+Error:
+    return false;
+}
+
+static void vk_destroy_image(tine::Renderer::Pimpl &p, GpuImage &img) {
+    if (img.image != VK_NULL_HANDLE) {
+        vmaDestroyImage(p.vk_allocator, img.image, img.alloc);
+    }
+    img = GpuImage();
+}
+
+static bool vk_create_image_view(tine::Renderer::Pimpl &p, VkImage image, VkFormat format,
+                                 VkImageAspectFlags aspect, uint32_t base_level,
+                                 uint32_t level_cnt, VkImageView &view) {
+    VkImageViewCreateInfo image_view_cinfo = {};
+    image_view_cinfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    image_view_cinfo.image = image;
+    image_view_cinfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    image_view_cinfo.format = format;
+    image_view_cinfo.subresourceRange.aspectMask = aspect;
+    image_view_cinfo.subresourceRange.baseMipLevel = base_level;
+    image_view_cinfo.subresourceRange.levelCount = level_cnt;
+    image_view_cinfo.subresourceRange.baseArrayLayer = 0;
+    image_view_cinfo.subresourceRange.layerCount = 1;
+    CHECK_VK(vkCreateImageView(p.vk_dev, &image_view_cinfo, nullptr, &view),
+             "Failed to create image view", Error);
+    return true;
+Error:
+    return false;
+}
+
+static void vk_destroy_frame_buffers(tine::Renderer::Pimpl &p, std::vector<GpuBuffer> &buffers) {
+    for (GpuBuffer &buf : buffers) {
+        vk_destroy_buffer(p, buf);
+    }
+    buffers.clear();
+}
+
+static void vk_cleanup_depth_targets(tine::Renderer::Pimpl &p) {
+    for (HizPyramid &hiz : p.hiz_pyramids) {
+        for (VkImageView view : hiz.level_views) {
+            vkDestroyImageView(p.vk_dev, view, nullptr);
+        }
+        if (hiz.view != VK_NULL_HANDLE) {
+            vkDestroyImageView(p.vk_dev, hiz.view, nullptr);
+        }
+        vk_destroy_image(p, hiz.image);
+    }
+    p.hiz_pyramids.clear();
+    for (VkImageView view : p.vk_depth_views) {
+        vkDestroyImageView(p.vk_dev, view, nullptr);
+    }
+    p.vk_depth_views.clear();
+    for (GpuImage &img : p.vk_depth_images) {
+        vk_destroy_image(p, img);
+    }
+    p.vk_depth_images.clear();
+}
+
+// A depth target and a Hi-Z pyramid for every swapchain image
+static bool vk_init_depth_targets(tine::Renderer::Pimpl &p, int width, int height) {
+    const size_t image_cnt = p.vk_swapchain_images.size();
+    uint32_t hiz_width = 0;
+    uint32_t hiz_height = 0;
+
+    TINE_TRACE("Initializing depth targets");
+
+    p.depth_width = static_cast<uint32_t>(width);
+    p.depth_height = static_cast<uint32_t>(height);
+    hiz_width = std::max(1u, (p.depth_width + 1) / 2);
+    hiz_height = std::max(1u, (p.depth_height + 1) / 2);
+    p.hiz_levels = 1;
+    while ((hiz_width >> p.hiz_levels) > 0 || (hiz_height >> p.hiz_levels) > 0) {
+        p.hiz_levels++;
+    }
+
+    p.vk_depth_images.resize(image_cnt);
+    p.vk_depth_views.resize(image_cnt, VK_NULL_HANDLE);
+    p.hiz_pyramids.resize(image_cnt);
+    for (size_t i = 0; i < image_cnt; i++) {
+        HizPyramid &hiz = p.hiz_pyramids[i];
+        TINE_CHECK(vk_create_image(p, p.vk_depth_images[i], p.vk_depth_format, p.depth_width,
+                                   p.depth_height, 1,
+                                   VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+                                       VK_IMAGE_USAGE_SAMPLED_BIT),
+                   "Failed to allocate depth target", Error);
+        TINE_CHECK(vk_create_image_view(p, p.vk_depth_images[i].image, p.vk_depth_format,
+                                        VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, p.vk_depth_views[i]),
+                   "Failed to create depth target view", Error);
+
+        TINE_CHECK(vk_create_image(p, hiz.image, VK_FORMAT_R32_SFLOAT, hiz_width, hiz_height,
+                                   p.hiz_levels,
+                                   VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT),
+                   "Failed to allocate Hi-Z pyramid", Error);
+        TINE_CHECK(vk_create_image_view(p, hiz.image.image, VK_FORMAT_R32_SFLOAT,
+                                        VK_IMAGE_ASPECT_COLOR_BIT, 0, p.hiz_levels, hiz.view),
+                   "Failed to create Hi-Z view", Error);
+        hiz.level_views.resize(p.hiz_levels, VK_NULL_HANDLE);
+        for (uint32_t level = 0; level < p.hiz_levels; level++) {
+            TINE_CHECK(vk_create_image_view(p, hiz.image.image, VK_FORMAT_R32_SFLOAT,
+                                            VK_IMAGE_ASPECT_COLOR_BIT, level, 1,
+                                            hiz.level_views[level]),
+                       "Failed to create Hi-Z level view", Error);
+        }
+    }
+    return true;
+Error:
+    return false;
+}
+
 static bool vk_init_shader_pipeline(tine::Renderer::Pimpl &p) {
     VkShaderModule vert_shader = VK_NULL_HANDLE;
     VkShaderModule frag_shader = VK_NULL_HANDLE;
@@ -571,10 +1580,14 @@ static bool vk_init_shader_pipeline(tine::Renderer::Pimpl &p) {
     VkPipelineMultisampleStateCreateInfo multisample_state_cinfo = {};
     VkPipelineColorBlendStateCreateInfo color_blend_state_cinfo = {};
     VkPipelineColorBlendAttachmentState color_blend_attach_state = {};
+    VkPipelineDepthStencilStateCreateInfo depth_state_cinfo = {};
     VkDynamicState dynamic_states[] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
     VkPipelineDynamicStateCreateInfo dynamic_state_cinfo = {};
     VkPipelineViewportStateCreateInfo viewport_state_cinfo = {};
     VkGraphicsPipelineCreateInfo gfx_pipeline_cinfo = {};
+    VkVertexInputBindingDescription vertex_bindings[2] = {};
+    VkVertexInputAttributeDescription vertex_attributes[9] = {};
+    VkPushConstantRange push_constant_range = {};
 
     shader_cinfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
     shader_cinfo.pCode = reinterpret_cast<const uint32_t *>(vert_shader_code);
@@ -597,9 +1610,45 @@ static bool vk_init_shader_pipeline(tine::Renderer::Pimpl &p) {
     shader_pipeline_cinfos[1].module = frag_shader;
     shader_pipeline_cinfos[1].pName = "main";
 
+    vertex_bindings[0].binding = 0;
+    vertex_bindings[0].stride = sizeof(tine::QuantizedVertex);
+    vertex_bindings[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    // Per instance model matrix
+    vertex_bindings[1].binding = 1;
+    vertex_bindings[1].stride = sizeof(tine::InstanceData);
+    vertex_bindings[1].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+    vertex_attributes[0].location = 0;
+    vertex_attributes[0].format = VK_FORMAT_R16G16B16A16_UNORM;
+    vertex_attributes[0].offset = offsetof(tine::QuantizedVertex, position);
+    vertex_attributes[1].location = 1;
+    vertex_attributes[1].format = VK_FORMAT_R16G16_SNORM;
+    vertex_attributes[1].offset = offsetof(tine::QuantizedVertex, normal);
+    vertex_attributes[2].location = 2;
+    vertex_attributes[2].format = VK_FORMAT_R16G16_SFLOAT;
+    vertex_attributes[2].offset = offsetof(tine::QuantizedVertex, uv);
+    for (uint32_t col = 0; col < 4; col++) {
+        vertex_attributes[3 + col].location = 3 + col;
+        vertex_attributes[3 + col].binding = 1;
+        vertex_attributes[3 + col].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+        vertex_attributes[3 + col].offset = col * sizeof(glm::vec4);
+    }
+    vertex_attributes[7].location = 7;
+    vertex_attributes[7].binding = 1;
+    vertex_attributes[7].format = VK_FORMAT_R32_UINT;
+    vertex_attributes[7].offset = offsetof(tine::InstanceData, material);
+    vertex_attributes[8].location = 8;
+    vertex_attributes[8].binding = 1;
+    vertex_attributes[8].format = VK_FORMAT_R32_UINT;
+    vertex_attributes[8].offset = offsetof(tine::InstanceData, mesh);
+
     vertex_input_state_cinfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertex_input_state_cinfo.vertexBindingDescriptionCount = 0;
-    vertex_input_state_cinfo.vertexAttributeDescriptionCount = 0;
+    vertex_input_state_cinfo.vertexBindingDescriptionCount =
+        sizeof(vertex_bindings) / sizeof(vertex_bindings[0]);
+    vertex_input_state_cinfo.pVertexBindingDescriptions = vertex_bindings;
+    vertex_input_state_cinfo.vertexAttributeDescriptionCount =
+        sizeof(vertex_attributes) / sizeof(vertex_attributes[0]);
+    vertex_input_state_cinfo.pVertexAttributeDescriptions = vertex_attributes;
 
     input_asm_state_cinfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
     input_asm_state_cinfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
@@ -632,13 +1681,26 @@ static bool vk_init_shader_pipeline(tine::Renderer::Pimpl &p) {
     color_blend_state_cinfo.attachmentCount = 1;
     color_blend_state_cinfo.pAttachments = &color_blend_attach_state;
 
+    // LESS_OR_EQUAL so the color pass passes on the depth laid down by the prepass
+    depth_state_cinfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depth_state_cinfo.depthTestEnable = VK_TRUE;
+    depth_state_cinfo.depthWriteEnable = VK_TRUE;
+    depth_state_cinfo.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+
     dynamic_state_cinfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
     dynamic_state_cinfo.pDynamicStates = dynamic_states;
     dynamic_state_cinfo.dynamicStateCount = sizeof(dynamic_states) / sizeof(dynamic_states[0]);
 
+    // View projection matrix
+    push_constant_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    push_constant_range.offset = 0;
+    push_constant_range.size = sizeof(glm::mat4);
+
     pipeline_layout_cinfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipeline_layout_cinfo.setLayoutCount = 0;
-    pipeline_layout_cinfo.pushConstantRangeCount = 0;
+    pipeline_layout_cinfo.setLayoutCount = 1;
+    pipeline_layout_cinfo.pSetLayouts = &p.vk_bindless_layout;
+    pipeline_layout_cinfo.pushConstantRangeCount = 1;
+    pipeline_layout_cinfo.pPushConstantRanges = &push_constant_range;
     CHECK_VK(
         vkCreatePipelineLayout(p.vk_dev, &pipeline_layout_cinfo, nullptr, &p.vk_pipeline_layout),
         "Failed to create pipeline layout", Error);
@@ -653,6 +1715,7 @@ static bool vk_init_shader_pipeline(tine::Renderer::Pimpl &p) {
     gfx_pipeline_cinfo.pRasterizationState = &raster_state_cinfo;
     gfx_pipeline_cinfo.pMultisampleState = &multisample_state_cinfo;
     gfx_pipeline_cinfo.pColorBlendState = &color_blend_state_cinfo;
+    gfx_pipeline_cinfo.pDepthStencilState = &depth_state_cinfo;
     gfx_pipeline_cinfo.pDynamicState = &dynamic_state_cinfo;
     gfx_pipeline_cinfo.layout = p.vk_pipeline_layout;
     gfx_pipeline_cinfo.renderPass = p.vk_renderpass;
@@ -661,6 +1724,13 @@ static bool vk_init_shader_pipeline(tine::Renderer::Pimpl &p) {
                                        &p.vk_pipeline),
              "Failed to create graphics pipeline", Error);
 
+    // Depth prepass, same vertex stage without any fragment shading
+    color_blend_attach_state.colorWriteMask = 0;
+    gfx_pipeline_cinfo.stageCount = 1;
+    CHECK_VK(vkCreateGraphicsPipelines(p.vk_dev, VK_NULL_HANDLE, 1, &gfx_pipeline_cinfo, nullptr,
+                                       &p.vk_depth_pipeline),
+             "Failed to create depth prepass pipeline", Error);
+
     vkDestroyShaderModule(p.vk_dev, frag_shader, nullptr);
     vkDestroyShaderModule(p.vk_dev, vert_shader, nullptr);
 
@@ -669,46 +1739,261 @@ Error:
     return false;
 }
 
-static bool vk_init_renderpass(tine::Renderer::Pimpl &p) {
-    VkAttachmentDescription attachment = {};
+// Combined image samplers use the immutable point sampler.
+static bool vk_init_compute_pipeline(tine::Renderer::Pimpl &p, ComputePipeline &pipeline,
+                                     const unsigned char *code, unsigned long long code_len,
+                                     const VkDescriptorType *types, uint32_t binding_cnt,
+                                     uint32_t push_constant_size) {
+    VkShaderModule comp_shader = VK_NULL_HANDLE;
+    VkShaderModuleCreateInfo shader_cinfo = {};
+    VkDescriptorSetLayoutBinding bindings[MAX_COMPUTE_BINDINGS] = {};
+    VkDescriptorSetLayoutCreateInfo desc_layout_cinfo = {};
+    VkPushConstantRange push_constant_range = {};
+    VkPipelineLayoutCreateInfo pipeline_layout_cinfo = {};
+    VkComputePipelineCreateInfo comp_pipeline_cinfo = {};
+
+    shader_cinfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    shader_cinfo.pCode = reinterpret_cast<const uint32_t *>(code);
+    shader_cinfo.codeSize = code_len;
+    CHECK_VK(vkCreateShaderModule(p.vk_dev, &shader_cinfo, nullptr, &comp_shader),
+             "Failed to create compute shader", Error);
+
+    TINE_CHECK(binding_cnt <= MAX_COMPUTE_BINDINGS, "Too many compute bindings", Error);
+    for (uint32_t b = 0; b < binding_cnt; b++) {
+        bindings[b].binding = b;
+        bindings[b].descriptorType = types[b];
+        bindings[b].descriptorCount = 1;
+        bindings[b].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        if (types[b] == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER) {
+            bindings[b].pImmutableSamplers = &p.vk_point_sampler;
+        }
+        pipeline.types[b] = types[b];
+    }
+    pipeline.binding_cnt = binding_cnt;
+    desc_layout_cinfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    desc_layout_cinfo.bindingCount = binding_cnt;
+    desc_layout_cinfo.pBindings = bindings;
+    CHECK_VK(vkCreateDescriptorSetLayout(p.vk_dev, &desc_layout_cinfo, nullptr,
+                                         &pipeline.desc_layout),
+             "Failed to create compute descriptor set layout", Error);
+
+    push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    push_constant_range.size = push_constant_size;
+    pipeline_layout_cinfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipeline_layout_cinfo.setLayoutCount = 1;
+    pipeline_layout_cinfo.pSetLayouts = &pipeline.desc_layout;
+    pipeline_layout_cinfo.pushConstantRangeCount = (push_constant_size > 0) ? 1 : 0;
+    pipeline_layout_cinfo.pPushConstantRanges = &push_constant_range;
+    CHECK_VK(vkCreatePipelineLayout(p.vk_dev, &pipeline_layout_cinfo, nullptr, &pipeline.layout),
+             "Failed to create compute pipeline layout", Error);
+
+    comp_pipeline_cinfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    comp_pipeline_cinfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    comp_pipeline_cinfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    comp_pipeline_cinfo.stage.module = comp_shader;
+    comp_pipeline_cinfo.stage.pName = "main";
+    comp_pipeline_cinfo.layout = pipeline.layout;
+    CHECK_VK(vkCreateComputePipelines(p.vk_dev, VK_NULL_HANDLE, 1, &comp_pipeline_cinfo, nullptr,
+                                      &pipeline.pipeline),
+             "Failed to create compute pipeline", Error);
+
+    vkDestroyShaderModule(p.vk_dev, comp_shader, nullptr);
+
+    return true;
+Error:
+    if (comp_shader != VK_NULL_HANDLE) {
+        vkDestroyShaderModule(p.vk_dev, comp_shader, nullptr);
+    }
+    return false;
+}
+
+static void vk_destroy_compute_pipeline(tine::Renderer::Pimpl &p, ComputePipeline &pipeline) {
+    if (pipeline.pipeline != VK_NULL_HANDLE) {
+        vkDestroyPipeline(p.vk_dev, pipeline.pipeline, nullptr);
+        pipeline.pipeline = VK_NULL_HANDLE;
+    }
+    if (pipeline.layout != VK_NULL_HANDLE) {
+        vkDestroyPipelineLayout(p.vk_dev, pipeline.layout, nullptr);
+        pipeline.layout = VK_NULL_HANDLE;
+    }
+    if (pipeline.desc_layout != VK_NULL_HANDLE) {
+        vkDestroyDescriptorSetLayout(p.vk_dev, pipeline.desc_layout, nullptr);
+        pipeline.desc_layout = VK_NULL_HANDLE;
+    }
+}
+
+// Binds one resource per binding through a descriptor set from the frame's pool.
+static bool bind_compute_resources(tine::Renderer::Pimpl &p, ComputePipeline &pipeline,
+                                   VkCommandBuffer &cmd_buffer, uint32_t image_idx,
+                                   const ComputeBinding *resources) {
+    VkDescriptorBufferInfo buffer_infos[MAX_COMPUTE_BINDINGS] = {};
+    VkDescriptorImageInfo image_infos[MAX_COMPUTE_BINDINGS] = {};
+    VkWriteDescriptorSet writes[MAX_COMPUTE_BINDINGS] = {};
+    const VkDescriptorSet desc_set = alloc_frame_desc_set(p, image_idx, pipeline.desc_layout);
+
+    TINE_CHECK(desc_set != VK_NULL_HANDLE, "Failed to allocate compute descriptor set", Error);
+    for (uint32_t b = 0; b < pipeline.binding_cnt; b++) {
+        writes[b].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[b].dstSet = desc_set;
+        writes[b].dstBinding = b;
+        writes[b].descriptorCount = 1;
+        writes[b].descriptorType = pipeline.types[b];
+        if (pipeline.types[b] == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER) {
+            buffer_infos[b] = {resources[b].buffer, 0, VK_WHOLE_SIZE};
+            writes[b].pBufferInfo = &buffer_infos[b];
+        } else {
+            image_infos[b] = {VK_NULL_HANDLE, resources[b].view, resources[b].layout};
+            writes[b].pImageInfo = &image_infos[b];
+        }
+    }
+    vkUpdateDescriptorSets(p.vk_dev, pipeline.binding_cnt, writes, 0, nullptr);
+
+    vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.pipeline);
+    vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.layout, 0, 1,
+                            &desc_set, 0, nullptr);
+    return true;
+Error:
+    return false;
+}
+
+static bool vk_init_compute_pipelines(tine::Renderer::Pimpl &p) {
+    const VkDescriptorType buffer = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    const VkDescriptorType sampled = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    // Vertices, skin vertices, instances, joint palette, mesh quantization
+    const VkDescriptorType skin_types[] = {buffer, buffer, buffer, buffer, buffer};
+    // Meshlets, meshlet vertices, meshlet triangles, jobs, instances, commands, indices, flags
+    const VkDescriptorType meshlet_types[] = {buffer, buffer, buffer, buffer,
+                                              buffer, buffer, buffer, buffer};
+    // Instances, mesh quantization, visibility, flags, culled instances, commands, Hi-Z
+    const VkDescriptorType instance_types[] = {buffer, buffer, buffer, buffer,
+                                               buffer, buffer, sampled};
+    // Source level, destination level
+    const VkDescriptorType hiz_types[] = {sampled, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE};
+    // Depth, points
+    const VkDescriptorType point_types[] = {sampled, buffer};
+    VkSamplerCreateInfo sampler_cinfo = {};
+
+    TINE_TRACE("Initializing compute pipelines");
+
+    // Only ever used with texelFetch
+    sampler_cinfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampler_cinfo.magFilter = VK_FILTER_NEAREST;
+    sampler_cinfo.minFilter = VK_FILTER_NEAREST;
+    sampler_cinfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    sampler_cinfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_cinfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_cinfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_cinfo.maxLod = VK_LOD_CLAMP_NONE;
+    CHECK_VK(vkCreateSampler(p.vk_dev, &sampler_cinfo, nullptr, &p.vk_point_sampler),
+             "Failed to create point sampler", Error);
+
+    TINE_CHECK(vk_init_compute_pipeline(p, p.skin_pipeline, skinning_shader_code,
+                                        skinning_shader_code_len, skin_types, 5,
+                                        sizeof(SkinningConstants)),
+               "Failed to create skinning pipeline", Error);
+    TINE_CHECK(vk_init_compute_pipeline(p, p.cull_pipeline, meshlet_cull_shader_code,
+                                        meshlet_cull_shader_code_len, meshlet_types, 8,
+                                        sizeof(MeshletCullConstants)),
+               "Failed to create meshlet culling pipeline", Error);
+    TINE_CHECK(vk_init_compute_pipeline(p, p.instance_cull_pipeline, instance_cull_shader_code,
+                                        instance_cull_shader_code_len, instance_types, 7,
+                                        sizeof(InstanceCullConstants)),
+               "Failed to create instance culling pipeline", Error);
+    TINE_CHECK(vk_init_compute_pipeline(p, p.hiz_pipeline, hiz_reduce_shader_code,
+                                        hiz_reduce_shader_code_len, hiz_types, 2,
+                                        sizeof(HizConstants)),
+               "Failed to create Hi-Z pipeline", Error);
+    TINE_CHECK(vk_init_compute_pipeline(p, p.point_pipeline, depth_points_shader_code,
+                                        depth_points_shader_code_len, point_types, 2,
+                                        sizeof(PointCloudConstants)),
+               "Failed to create point cloud pipeline", Error);
+    return true;
+Error:
+    return false;
+}
+
+// The frame is either drawn in one pass, or split around the Hi-Z build for occlusion culling.
+// The variants only differ in load/store ops and layouts so they stay compatible, and the
+// pipelines and framebuffers created against one work with all of them.  Depth is only stored
+// when something reads it after the pass.
+static bool vk_create_renderpass(tine::Renderer::Pimpl &p, bool clear, bool present,
+                                 bool keep_depth, VkRenderPass &renderpass) {
+    VkAttachmentDescription attachments[2] = {};
     VkAttachmentReference color_attachment = {};
+    VkAttachmentReference depth_attachment = {};
     VkSubpassDescription subpass = {};
-    VkSubpassDependency dependency = {};
+    VkSubpassDependency dependencies[2] = {};
     VkRenderPassCreateInfo renderpass_cinfo = {};
 
-    TINE_TRACE("Initializing renderpass");
-
-    attachment.format = p.vk_image_format.format;
-    attachment.samples = VK_SAMPLE_COUNT_1_BIT;
-    attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    attachments[0].format = p.vk_image_format.format;
+    attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
+    attachments[0].loadOp = clear ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_LOAD;
+    attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachments[0].initialLayout =
+        clear ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    attachments[0].finalLayout =
+        present ? VK_IMAGE_LAYOUT_PRESENT_SRC_KHR : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    // Kept for the Hi-Z build when the frame continues in another pass, or for the point cloud
+    attachments[1].format = p.vk_depth_format;
+    attachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
+    attachments[1].loadOp = clear ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_LOAD;
+    attachments[1].storeOp =
+        keep_depth ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachments[1].initialLayout =
+        clear ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+    attachments[1].finalLayout = keep_depth ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL
+                                            : VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
     color_attachment.attachment = 0;
     color_attachment.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    depth_attachment.attachment = 1;
+    depth_attachment.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
     subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
     subpass.colorAttachmentCount = 1;
     subpass.pColorAttachments = &color_attachment;
-
-    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-    dependency.dstSubpass = 0;
-    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.srcAccessMask = 0;
-    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    subpass.pDepthStencilAttachment = &depth_attachment;
+
+    // The Hi-Z build reads the depth of the first pass in between
+    dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[0].dstSubpass = 0;
+    dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                                   VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+                                   VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                                   VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                                   VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependencies[0].srcAccessMask = 0;
+    dependencies[0].dstAccessMask =
+        VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+    dependencies[1].srcSubpass = 0;
+    dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[1].srcStageMask =
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependencies[1].dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+                                   VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                                   VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                                   VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependencies[1].srcAccessMask =
+        VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT | dependencies[0].dstAccessMask;
 
     renderpass_cinfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    renderpass_cinfo.attachmentCount = 1;
-    renderpass_cinfo.pAttachments = &attachment;
+    renderpass_cinfo.attachmentCount = 2;
+    renderpass_cinfo.pAttachments = attachments;
     renderpass_cinfo.subpassCount = 1;
     renderpass_cinfo.pSubpasses = &subpass;
-    renderpass_cinfo.dependencyCount = 1;
-    renderpass_cinfo.pDependencies = &dependency;
+    renderpass_cinfo.dependencyCount = 2;
+    renderpass_cinfo.pDependencies = dependencies;
 
-    CHECK_VK(vkCreateRenderPass(p.vk_dev, &renderpass_cinfo, nullptr, &p.vk_renderpass),
+    CHECK_VK(vkCreateRenderPass(p.vk_dev, &renderpass_cinfo, nullptr, &renderpass),
              "Failed to create renderpass", Error);
 
     return true;
@@ -716,6 +2001,23 @@ Error:
     return false;
 }
 
+static bool vk_init_renderpass(tine::Renderer::Pimpl &p) {
+    TINE_TRACE("Initializing renderpass");
+    TINE_CHECK(vk_create_renderpass(p, true, true, false, p.vk_renderpass),
+               "Failed to create frame renderpass", Error);
+    TINE_CHECK(vk_create_renderpass(p, true, false, true, p.vk_renderpass_early),
+               "Failed to create early renderpass", Error);
+    TINE_CHECK(vk_create_renderpass(p, false, true, false, p.vk_renderpass_late),
+               "Failed to create late renderpass", Error);
+    TINE_CHECK(vk_create_renderpass(p, true, true, true, p.vk_renderpass_keep),
+               "Failed to create frame renderpass", Error);
+    TINE_CHECK(vk_create_renderpass(p, false, true, true, p.vk_renderpass_late_keep),
+               "Failed to create late renderpass", Error);
+    return true;
+Error:
+    return false;
+}
+
 static bool vk_init_framebuffers(tine::Renderer::Pimpl &p, int width, int height) {
     VkFramebufferCreateInfo framebuffer_cinfo = {};
     TINE_TRACE("Initializing framebuffers");
@@ -725,11 +2027,12 @@ static bool vk_init_framebuffers(tine::Renderer::Pimpl &p, int width, int height
     framebuffer_cinfo.width = width;
     framebuffer_cinfo.height = height;
     framebuffer_cinfo.renderPass = p.vk_renderpass;
-    framebuffer_cinfo.attachmentCount = 1;
+    framebuffer_cinfo.attachmentCount = 2;
 
     p.vk_framebuffers.resize(p.vk_swapchain_image_views.size());
     for (size_t i = 0; i < p.vk_framebuffers.size(); i++) {
-        framebuffer_cinfo.pAttachments = &p.vk_swapchain_image_views[i];
+        const VkImageView attachments[] = {p.vk_swapchain_image_views[i], p.vk_depth_views[i]};
+        framebuffer_cinfo.pAttachments = attachments;
         CHECK_VK(vkCreateFramebuffer(p.vk_dev, &framebuffer_cinfo, nullptr, &p.vk_framebuffers[i]),
                  "Failed to allocate framebuffer", Error);
     }
@@ -743,7 +2046,10 @@ static bool vk_reinit_swap_chain(tine::Renderer::Pimpl &p, int width, int height
     TINE_TRACE("Reinitializing swapchain");
     CHECK_VK(vkDeviceWaitIdle(p.vk_dev), "Failed to idle device", Error);
     vk_cleanup_swapchain(p);
+    vk_cleanup_depth_targets(p);
     TINE_CHECK(vk_init_swapchain(p, width, height), "Failed to initialize swapchain", Error);
+    TINE_CHECK(vk_init_depth_targets(p, width, height), "Failed to initialize depth targets",
+               Error);
     TINE_CHECK(vk_init_framebuffers(p, width, height), "Failed to initialize framebuffers", Error);
 
     return true;
@@ -811,16 +2117,25 @@ static bool vk_init(tine::Renderer::Pimpl &p, int width, int height) {
     TINE_CHECK(gladLoaderLoadVulkan(p.vk_inst, p.vk_phy_dev, nullptr),
                "Failed to load GLAD Vulkan physical device interface", Error);
     TINE_CHECK(vk_init_dev(p), "Failed to initialize device", Error);
+    TINE_CHECK(vk_select_depth_format(p), "Failed to select depth format", Error);
+    vk_select_texture_formats(p);
     TINE_CHECK(gladLoaderLoadVulkan(p.vk_inst, p.vk_phy_dev, p.vk_dev),
                "Failed to load GLAD Vulkan device interface", Error);
     TINE_CHECK(vk_init_allocator(p), "Failed to initialize memory allocator", Error);
     TINE_CHECK(vk_init_staging_buffer(p), "Failed to initialize staging buffers", Error);
+    TINE_CHECK(vk_init_texture_ring(p), "Failed to initialize texture staging ring", Error);
     TINE_CHECK(vk_init_desc_pool(p), "Failed to create descriptor pool", Error);
     TINE_CHECK(vk_init_swapchain(p, width, height), "Failed to initialize swap chain", Error);
+    TINE_CHECK(vk_init_depth_targets(p, width, height), "Failed to initialize depth targets",
+               Error);
     TINE_CHECK(vk_init_renderpass(p), "Failed to initialize renderpass", Error);
+    TINE_CHECK(vk_init_bindless(p), "Failed to initialize bindless resources", Error);
     TINE_CHECK(vk_init_shader_pipeline(p), "Failed to initialize shaders", Error);
+    TINE_CHECK(vk_init_compute_pipelines(p), "Failed to initialize compute pipelines", Error);
     TINE_CHECK(vk_init_framebuffers(p, width, height), "Failed to allocate framebuffers", Error);
     TINE_CHECK(vk_init_cmd_buffers(p), "Failed to initialize command buffers", Error);
+    TINE_CHECK(vk_init_gpu_queries(p), "Failed to initialize GPU queries", Error);
+    TINE_CHECK(vk_init_frame_desc_pools(p), "Failed to create frame descriptor pools", Error);
     TINE_CHECK(vk_init_sync(p), "Failed to initialize synchronization objects", Error);
 
     return true;
@@ -890,18 +2205,1261 @@ Error:
     return false;
 }
 
-static bool record_render_frame(tine::Renderer::Pimpl &p, TracyVkCtx &ctx,
-                                VkCommandBuffer &cmd_buffer, VkFramebuffer &frame_buffer, int width,
-                                int height) {
-    VkCommandBufferBeginInfo cmd_buffer_binfo = {};
-    VkClearValue clearValue = {0.0f, 0.0f, 0.0f, 1.0f};
+static bool record_skinning(tine::Renderer::Pimpl &p, tine::Scene &scene, TracyVkCtx &ctx,
+                            VkCommandBuffer &cmd_buffer, uint32_t image_idx) {
+    const tine::AnimationData &anim = scene.get_animation_data();
+    const uint32_t group_cnt = (p.skin_max_vertex_cnt + SKINNING_GROUP_SIZE - 1) /
+                               SKINNING_GROUP_SIZE;
+    SkinningConstants constants = {};
+    VkBufferMemoryBarrier barrier = {};
+    (void)ctx;
+
+    if (p.skin_instance_cnt == 0) {
+        return true;
+    }
+
+    TracyVkZone(ctx, cmd_buffer, "Skinning");
+    GpuZone gpu_zone(p, cmd_buffer, image_idx, "Skinning");
+
+    {
+        GpuBuffer &palette = p.vk_palette_buffers[image_idx];
+        memcpy(palette.info.pMappedData, anim.joint_palette.data(),
+               anim.joint_palette.size() * sizeof(glm::mat4));
+        vmaFlushAllocation(p.vk_allocator, palette.alloc, 0, VK_WHOLE_SIZE);
+    }
+
+    // Previously submitted frames may still be fetching the vertices we're about to overwrite
+    vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 0,
+                         nullptr);
+
+    {
+        const ComputeBinding bindings[] = {buffer_binding(p.vk_vertex_buffer.buffer),
+                                           buffer_binding(p.vk_skin_vertex_buffer.buffer),
+                                           buffer_binding(p.vk_skin_instance_buffer.buffer),
+                                           buffer_binding(p.vk_palette_buffers[image_idx].buffer),
+                                           buffer_binding(p.vk_mesh_quant_buffer.buffer)};
+        TINE_CHECK(bind_compute_resources(p, p.skin_pipeline, cmd_buffer, image_idx, bindings),
+                   "Failed to bind skinning buffers", Error);
+    }
+    for (uint32_t instance = 0; instance < p.skin_instance_cnt; instance += p.max_dispatch_y) {
+        for (uint32_t group = 0; group < group_cnt; group += p.max_dispatch_x) {
+            constants.instance_offset = instance;
+            constants.group_offset = group;
+            vkCmdPushConstants(cmd_buffer, p.skin_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                               sizeof(constants), &constants);
+            vkCmdDispatch(cmd_buffer, std::min(group_cnt - group, p.max_dispatch_x),
+                          std::min(p.skin_instance_cnt - instance, p.max_dispatch_y), 1);
+        }
+    }
+
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = p.vk_vertex_buffer.buffer;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 0, nullptr, 1, &barrier, 0,
+                         nullptr);
+    return true;
+Error:
+    return false;
+}
+
+// The primary camera, or an identity one if the scene doesn't have any
+static tine::CameraComponent get_camera(tine::Scene &scene) {
+    entt::registry &registry = scene.get_registry();
+    const entt::entity camera_entity = scene.get_primary_camera();
+    tine::CameraComponent camera = {glm::mat4(1.0f), glm::mat4(1.0f), 0.0f};
+    if (registry.valid(camera_entity)) {
+        const tine::CameraComponent *primary =
+            registry.try_get<tine::CameraComponent>(camera_entity);
+        if (primary != nullptr) {
+            camera = *primary;
+        }
+    }
+    return camera;
+}
+
+static glm::mat4 get_view_proj(tine::Scene &scene) {
+    const tine::CameraComponent camera = get_camera(scene);
+    // Vulkan clip space points y down and keeps depth in [0, 1] rather than [-1, 1]
+    glm::mat4 clip(1.0f);
+    clip[1][1] = -1.0f;
+    clip[2][2] = 0.5f;
+    clip[3][2] = 0.5f;
+    return clip * camera.projection_matrix * camera.view_matrix;
+}
+
+static bool upload_instances(tine::Renderer::Pimpl &p, uint32_t image_idx) {
+    const size_t size = p.draw_list.instances.size() * sizeof(tine::InstanceData);
+
+    if (p.vk_instance_buffers.size() != p.vk_frame_cmd_buffers.size()) {
+        p.vk_instance_buffers.resize(p.vk_frame_cmd_buffers.size());
+    }
+    if (size == 0) {
+        return true;
+    }
+
+    {
+        GpuBuffer &instances = p.vk_instance_buffers[image_idx];
+        // The frame fence has been waited on, so nothing is reading the old buffer anymore
+        if (instances.info.size < size) {
+            vk_destroy_buffer(p, instances);
+            TINE_CHECK(vk_create_buffer(p, instances, size + size / 2,
+                                        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+                                            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                        true),
+                       "Failed to allocate instance buffer", Error);
+        }
+        memcpy(instances.info.pMappedData, p.draw_list.instances.data(), size);
+        vmaFlushAllocation(p.vk_allocator, instances.alloc, 0, size);
+    }
+    return true;
+Error:
+    return false;
+}
+// Grows a per frame host visible buffer to hold at least size bytes
+static bool reserve_frame_buffer(tine::Renderer::Pimpl &p, std::vector<GpuBuffer> &buffers,
+                                 uint32_t image_idx, VkDeviceSize size, VkBufferUsageFlags usage,
+                                 bool host_visible) {
+    if (buffers.size() != p.vk_frame_cmd_buffers.size()) {
+        buffers.resize(p.vk_frame_cmd_buffers.size());
+    }
+    GpuBuffer &buf = buffers[image_idx];
+    // The frame fence has been waited on, so nothing is reading the old buffer anymore
+    if (buf.info.size < size) {
+        vk_destroy_buffer(p, buf);
+        TINE_CHECK(vk_create_buffer(p, buf, size + size / 2, usage, host_visible),
+                   "Failed to allocate frame buffer", Error);
+    }
+    return true;
+Error:
+    return false;
+}
+
+// Indirect draws of a phase start at this multiple of the draws per phase
+static uint32_t phase_region(uint32_t phase) { return (phase == DRAW_LATE) ? 1 : 0; }
+
+// Every instance of a batch with meshlets gets its own job and indirect draw, repeated for each
+// of region_cnt phases.  Each instance reserves room for all of its LOD's triangles in the frame's
+// index buffer, the culling shader counts up indexCount as it compacts the survivors.
+static bool prepare_meshlet_jobs(tine::Renderer::Pimpl &p, tine::Scene &scene, uint32_t image_idx,
+                                 uint32_t region_cnt) {
+    const tine::MeshData &mesh_data = scene.get_mesh_data();
+    const tine::CameraComponent camera = get_camera(scene);
+    const glm::vec4 eye = glm::inverse(camera.view_matrix)[3];
+    MeshletJob *jobs = nullptr;
+    VkDrawIndexedIndirectCommand *commands = nullptr;
+    uint32_t job_cnt = 0;
+    size_t index_cnt = 0;
+
+    p.meshlet_draw_cnt = 0;
+    p.meshlet_max_cnt = 0;
+    if (p.vk_meshlet_buffer.buffer == VK_NULL_HANDLE) {
+        return true;
+    }
+    for (const tine::DrawBatch &batch : p.draw_list.batches) {
+        const tine::Mesh &mesh = mesh_data.meshes[batch.mesh];
+        const tine::MeshLod &lod = mesh_data.lods[mesh.lod_offset + batch.lod];
+        if (lod.meshlet_count > 0) {
+            job_cnt += batch.instance_count;
+            index_cnt += static_cast<size_t>(batch.instance_count) * lod.index_count;
+            p.meshlet_max_cnt = std::max(p.meshlet_max_cnt, lod.meshlet_count);
+        }
+    }
+    if (job_cnt == 0) {
+        return true;
+    }
+
+    TINE_CHECK(reserve_frame_buffer(p, p.vk_meshlet_job_buffers, image_idx,
+                                    job_cnt * sizeof(MeshletJob),
+                                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, true),
+               "Failed to allocate meshlet jobs", Error);
+    TINE_CHECK(reserve_frame_buffer(p, p.vk_meshlet_command_buffers, image_idx,
+                                    region_cnt * job_cnt * sizeof(VkDrawIndexedIndirectCommand),
+                                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                        VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                                    true),
+               "Failed to allocate indirect draws", Error);
+    TINE_CHECK(reserve_frame_buffer(p, p.vk_culled_index_buffers, image_idx,
+                                    index_cnt * sizeof(uint32_t),
+                                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                        VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                                    false),
+               "Failed to allocate culled indices", Error);
+    // Only read with occlusion culling, but always bound
+    TINE_CHECK(reserve_frame_buffer(p, p.vk_instance_flag_buffers, image_idx,
+                                    p.draw_list.instances.size() * sizeof(uint32_t),
+                                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, false),
+               "Failed to allocate instance flags", Error);
+
+    jobs = static_cast<MeshletJob *>(p.vk_meshlet_job_buffers[image_idx].info.pMappedData);
+    commands = static_cast<VkDrawIndexedIndirectCommand *>(
+        p.vk_meshlet_command_buffers[image_idx].info.pMappedData);
+    index_cnt = 0;
+    for (const tine::DrawBatch &batch : p.draw_list.batches) {
+        const tine::Mesh &mesh = mesh_data.meshes[batch.mesh];
+        const tine::MeshLod &lod = mesh_data.lods[mesh.lod_offset + batch.lod];
+        if (lod.meshlet_count == 0) {
+            continue;
+        }
+        for (uint32_t i = batch.first_instance; i < batch.first_instance + batch.instance_count;
+             i++) {
+            const glm::mat4 &transform = p.draw_list.instances[i].transform;
+            MeshletJob &job = jobs[p.meshlet_draw_cnt];
+            VkDrawIndexedIndirectCommand command = {};
+            job.eye = glm::inverse(transform) * eye;
+            job.instance = i;
+            job.meshlet_offset = lod.meshlet_offset;
+            job.meshlet_count = lod.meshlet_count;
+            job.command = p.meshlet_draw_cnt;
+            command.indexCount = 0;
+            command.instanceCount = 1;
+            command.firstIndex = static_cast<uint32_t>(index_cnt);
+            command.vertexOffset = static_cast<int32_t>(mesh.vertex_offset);
+            command.firstInstance = i;
+            for (uint32_t r = 0; r < region_cnt; r++) {
+                commands[r * job_cnt + p.meshlet_draw_cnt] = command;
+            }
+            index_cnt += lod.index_count;
+            p.meshlet_draw_cnt++;
+        }
+    }
+    vmaFlushAllocation(p.vk_allocator, p.vk_meshlet_job_buffers[image_idx].alloc, 0,
+                       job_cnt * sizeof(MeshletJob));
+    vmaFlushAllocation(p.vk_allocator, p.vk_meshlet_command_buffers[image_idx].alloc, 0,
+                       region_cnt * job_cnt * sizeof(VkDrawIndexedIndirectCommand));
+    return true;
+Error:
+    p.meshlet_draw_cnt = 0;
+    return false;
+}
+
+// Culls the meshlets of the jobs drawn in phase against the frustum and their normal cones, and
+// compacts the triangles of the survivors into the frame's index buffer.
+static bool record_meshlet_culling(tine::Renderer::Pimpl &p, tine::Scene &scene,
+                                   TracyVkCtx &ctx, VkCommandBuffer &cmd_buffer,
+                                   uint32_t image_idx, uint32_t phase) {
+    const tine::CameraComponent camera = get_camera(scene);
+    MeshletCullConstants constants = {};
+    VkBufferMemoryBarrier barriers[2] = {};
+    (void)ctx;
+
+    if (p.meshlet_draw_cnt == 0) {
+        return true;
+    }
+
+    TracyVkZone(ctx, cmd_buffer, "Meshlet culling");
+    GpuZone gpu_zone(p, cmd_buffer, image_idx, "Meshlet culling");
+
+    {
+        const ComputeBinding bindings[] = {
+            buffer_binding(p.vk_meshlet_buffer.buffer),
+            buffer_binding(p.vk_meshlet_vertex_buffer.buffer),
+            buffer_binding(p.vk_meshlet_triangle_buffer.buffer),
+            buffer_binding(p.vk_meshlet_job_buffers[image_idx].buffer),
+            buffer_binding(p.vk_instance_buffers[image_idx].buffer),
+            buffer_binding(p.vk_meshlet_command_buffers[image_idx].buffer),
+            buffer_binding(p.vk_culled_index_buffers[image_idx].buffer),
+            buffer_binding(p.vk_instance_flag_buffers[image_idx].buffer)};
+        TINE_CHECK(bind_compute_resources(p, p.cull_pipeline, cmd_buffer, image_idx, bindings),
+                   "Failed to bind meshlet culling buffers", Error);
+    }
+    constants.frustum = tine::Frustum::from_matrix(camera.projection_matrix * camera.view_matrix);
+    constants.command_offset = phase_region(phase) * p.meshlet_draw_cnt;
+    constants.phase = phase;
+    for (uint32_t offset = 0; offset < p.meshlet_draw_cnt; offset += p.max_dispatch_y) {
+        for (uint32_t meshlet = 0; meshlet < p.meshlet_max_cnt; meshlet += p.max_dispatch_x) {
+            constants.job_offset = offset;
+            constants.meshlet_offset = meshlet;
+            vkCmdPushConstants(cmd_buffer, p.cull_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                               sizeof(constants), &constants);
+            vkCmdDispatch(cmd_buffer, std::min(p.meshlet_max_cnt - meshlet, p.max_dispatch_x),
+                          std::min(p.meshlet_draw_cnt - offset, p.max_dispatch_y), 1);
+        }
+    }
+
+    for (VkBufferMemoryBarrier &barrier : barriers) {
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.offset = 0;
+        barrier.size = VK_WHOLE_SIZE;
+    }
+    barriers[0].dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+    barriers[0].buffer = p.vk_meshlet_command_buffers[image_idx].buffer;
+    barriers[1].dstAccessMask = VK_ACCESS_INDEX_READ_BIT;
+    barriers[1].buffer = p.vk_culled_index_buffers[image_idx].buffer;
+    vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                         0, 0, nullptr, 2, barriers, 0, nullptr);
+    return true;
+Error:
+    return false;
+}
+
+// Per batch indirect draw templates for both phases, the occlusion history, and the Hi-Z pyramid
+// ready to be bound.  Must run after prepare_meshlet_jobs.
+static bool prepare_occlusion_culling(tine::Renderer::Pimpl &p, tine::Scene &scene,
+                                      VkCommandBuffer &cmd_buffer, uint32_t image_idx) {
+    const tine::MeshData &mesh_data = scene.get_mesh_data();
+    const uint32_t batch_cnt = static_cast<uint32_t>(p.draw_list.batches.size());
+    const uint32_t instance_cnt = static_cast<uint32_t>(p.draw_list.instances.size());
+    VkDrawIndexedIndirectCommand *commands = nullptr;
+    VkMemoryBarrier barrier = {};
+    VkImageMemoryBarrier hiz_barrier = {};
+    uint32_t entity_cnt = 0;
+
+    for (const tine::InstanceData &instance : p.draw_list.instances) {
+        entity_cnt = std::max(entity_cnt, instance.entity + 1);
+    }
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    if (entity_cnt > p.visibility_cap) {
+        // Rare, frames in flight may still be using the old history
+        CHECK_VK(vkDeviceWaitIdle(p.vk_dev), "Failed to idle device", Error);
+        vk_destroy_buffer(p, p.vk_visibility_buffer);
+        p.visibility_cap = entity_cnt + entity_cnt / 2;
+        TINE_CHECK(vk_create_buffer(p, p.vk_visibility_buffer, p.visibility_cap * sizeof(uint32_t),
+                                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                        VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                    false),
+                   "Failed to allocate visibility history", Error);
+        // Nothing was visible, everything gets tested against this frame's pyramid
+        vkCmdFillBuffer(cmd_buffer, p.vk_visibility_buffer.buffer, 0, VK_WHOLE_SIZE, 0);
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0,
+                             nullptr);
+    } else {
+        // Written by the late phase of the previous frame
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0,
+                             nullptr);
+    }
+
+    TINE_CHECK(reserve_frame_buffer(p, p.vk_culled_instance_buffers, image_idx,
+                                    2 * instance_cnt * sizeof(tine::InstanceData),
+                                    VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+                                        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                    false),
+               "Failed to allocate culled instances", Error);
+    TINE_CHECK(reserve_frame_buffer(p, p.vk_instance_flag_buffers, image_idx,
+                                    instance_cnt * sizeof(uint32_t),
+                                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, false),
+               "Failed to allocate instance flags", Error);
+    TINE_CHECK(reserve_frame_buffer(p, p.vk_batch_command_buffers, image_idx,
+                                    2 * batch_cnt * sizeof(VkDrawIndexedIndirectCommand),
+                                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                        VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                                    true),
+               "Failed to allocate batch draws", Error);
+
+    // The culling counts up instanceCount, each phase has its own region of the culled instances
+    commands = static_cast<VkDrawIndexedIndirectCommand *>(
+        p.vk_batch_command_buffers[image_idx].info.pMappedData);
+    for (uint32_t b = 0; b < batch_cnt; b++) {
+        const tine::DrawBatch &batch = p.draw_list.batches[b];
+        const tine::Mesh &mesh = mesh_data.meshes[batch.mesh];
+        const tine::MeshLod &lod = mesh_data.lods[mesh.lod_offset + batch.lod];
+        for (uint32_t r = 0; r < 2; r++) {
+            VkDrawIndexedIndirectCommand &command = commands[r * batch_cnt + b];
+            // Batches drawn through meshlets only need their instances culled
+            command.indexCount =
+                (p.meshlet_draw_cnt > 0 && lod.meshlet_count > 0) ? 0 : lod.index_count;
+            command.instanceCount = 0;
+            command.firstIndex = lod.index_offset;
+            command.vertexOffset = static_cast<int32_t>(mesh.vertex_offset);
+            command.firstInstance = r * instance_cnt + batch.first_instance;
+        }
+    }
+    vmaFlushAllocation(p.vk_allocator, p.vk_batch_command_buffers[image_idx].alloc, 0,
+                       2 * batch_cnt * sizeof(VkDrawIndexedIndirectCommand));
+
+    // Rebuilt every frame, so the old contents can go
+    hiz_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    hiz_barrier.srcAccessMask = 0;
+    hiz_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    hiz_barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    hiz_barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    hiz_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    hiz_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    hiz_barrier.image = p.hiz_pyramids[image_idx].image.image;
+    hiz_barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, p.hiz_levels, 0, 1};
+    vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1,
+                         &hiz_barrier);
+    return true;
+Error:
+    return false;
+}
+
+static bool record_instance_culling(tine::Renderer::Pimpl &p, tine::Scene &scene,
+                                    TracyVkCtx &ctx, VkCommandBuffer &cmd_buffer,
+                                    uint32_t image_idx, uint32_t phase) {
+    InstanceCullConstants constants = {};
+    VkMemoryBarrier barrier = {};
+    (void)ctx;
+
+    TracyVkZone(ctx, cmd_buffer, "Instance culling");
+    GpuZone gpu_zone(p, cmd_buffer, image_idx, "Instance culling");
+
+    {
+        const ComputeBinding bindings[] = {
+            buffer_binding(p.vk_instance_buffers[image_idx].buffer),
+            buffer_binding(p.vk_mesh_quant_buffer.buffer),
+            buffer_binding(p.vk_visibility_buffer.buffer),
+            buffer_binding(p.vk_instance_flag_buffers[image_idx].buffer),
+            buffer_binding(p.vk_culled_instance_buffers[image_idx].buffer),
+            buffer_binding(p.vk_batch_command_buffers[image_idx].buffer),
+            image_binding(p.hiz_pyramids[image_idx].view, VK_IMAGE_LAYOUT_GENERAL)};
+        TINE_CHECK(bind_compute_resources(p, p.instance_cull_pipeline, cmd_buffer, image_idx,
+                                          bindings),
+                   "Failed to bind instance culling resources", Error);
+    }
+    constants.view_proj = get_view_proj(scene);
+    constants.depth_size[0] = p.depth_width;
+    constants.depth_size[1] = p.depth_height;
+    constants.hiz_levels = p.hiz_levels;
+    constants.instance_count = static_cast<uint32_t>(p.draw_list.instances.size());
+    constants.batch_count = static_cast<uint32_t>(p.draw_list.batches.size());
+    constants.phase = phase;
+    vkCmdPushConstants(cmd_buffer, p.instance_cull_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                       sizeof(constants), &constants);
+    vkCmdDispatch(cmd_buffer,
+                  (constants.instance_count + INSTANCE_CULL_GROUP_SIZE - 1) /
+                      INSTANCE_CULL_GROUP_SIZE,
+                  1, 1);
+
+    // The flags feed the meshlet culling, the rest the draws
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT |
+                            VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+    vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+                             VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+                             VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                         0, 1, &barrier, 0, nullptr, 0, nullptr);
+    return true;
+Error:
+    return false;
+}
+
+// Reduces the depth of the early phase into the frame's Hi-Z pyramid, one dispatch per level.
+static bool record_hiz_build(tine::Renderer::Pimpl &p, TracyVkCtx &ctx,
+                             VkCommandBuffer &cmd_buffer, uint32_t image_idx) {
+    HizPyramid &hiz = p.hiz_pyramids[image_idx];
+    HizConstants constants = {};
+    VkMemoryBarrier barrier = {};
+    uint32_t hiz_width = std::max(1u, (p.depth_width + 1) / 2);
+    uint32_t hiz_height = std::max(1u, (p.depth_height + 1) / 2);
+    uint32_t src_width = p.depth_width;
+    uint32_t src_height = p.depth_height;
+    (void)ctx;
+
+    TracyVkZone(ctx, cmd_buffer, "Hi-Z build");
+    GpuZone gpu_zone(p, cmd_buffer, image_idx, "Hi-Z build");
+
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    for (uint32_t level = 0; level < p.hiz_levels; level++) {
+        const ComputeBinding bindings[] = {
+            (level == 0) ? image_binding(p.vk_depth_views[image_idx],
+                                         VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL)
+                         : image_binding(hiz.level_views[level - 1], VK_IMAGE_LAYOUT_GENERAL),
+            image_binding(hiz.level_views[level], VK_IMAGE_LAYOUT_GENERAL)};
+        constants.src_size[0] = src_width;
+        constants.src_size[1] = src_height;
+        // Sized like the image's mips
+        constants.dst_size[0] = std::max(1u, hiz_width >> level);
+        constants.dst_size[1] = std::max(1u, hiz_height >> level);
+        TINE_CHECK(bind_compute_resources(p, p.hiz_pipeline, cmd_buffer, image_idx, bindings),
+                   "Failed to bind Hi-Z level", Error);
+        vkCmdPushConstants(cmd_buffer, p.hiz_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                           sizeof(constants), &constants);
+        vkCmdDispatch(cmd_buffer, (constants.dst_size[0] + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE,
+                      (constants.dst_size[1] + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, 1);
+        vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0,
+                             nullptr);
+        src_width = constants.dst_size[0];
+        src_height = constants.dst_size[1];
+    }
+    return true;
+Error:
+    return false;
+}
+
+static void record_indirect_draws(tine::Renderer::Pimpl &p, VkCommandBuffer &cmd_buffer,
+                                  VkBuffer commands, uint32_t first, uint32_t count) {
+    const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+    const uint32_t max_draws = p.multi_draw_indirect ? p.max_draw_indirect_cnt : 1;
+    for (uint32_t draw = first; draw < first + count; draw += max_draws) {
+        vkCmdDrawIndexedIndirect(cmd_buffer, commands, draw * stride,
+                                 std::min(first + count - draw, max_draws), stride);
+    }
+}
+
+// Draws what phase covers, see DRAW_EARLY, with either the color or the depth prepass pipeline.
+static void record_draws(tine::Renderer::Pimpl &p, tine::Scene &scene, VkCommandBuffer &cmd_buffer,
+                         uint32_t image_idx, VkPipeline pipeline, uint32_t phase) {
+    const tine::MeshData &mesh_data = scene.get_mesh_data();
+    const glm::mat4 view_proj = get_view_proj(scene);
+    const VkDeviceSize offsets[] = {0, 0};
+    VkBuffer vertex_buffers[2] = {};
+
+    if ((p.vk_vertex_buffer.buffer == VK_NULL_HANDLE) ||
+        (p.vk_index_buffer.buffer == VK_NULL_HANDLE) || p.draw_list.batches.empty()) {
+        return;
+    }
+
+    vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+    vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p.vk_pipeline_layout, 0, 1,
+                            &p.vk_bindless_set, 0, nullptr);
+    vkCmdPushConstants(cmd_buffer, p.vk_pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0,
+                       sizeof(view_proj), &view_proj);
+    vertex_buffers[0] = p.vk_vertex_buffer.buffer;
+
+    if (phase == 0) {
+        vertex_buffers[1] = p.vk_instance_buffers[image_idx].buffer;
+        vkCmdBindVertexBuffers(cmd_buffer, 0, 2, vertex_buffers, offsets);
+        vkCmdBindIndexBuffer(cmd_buffer, p.vk_index_buffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+        for (const tine::DrawBatch &batch : p.draw_list.batches) {
+            const tine::Mesh &mesh = mesh_data.meshes[batch.mesh];
+            const tine::MeshLod &lod = mesh_data.lods[mesh.lod_offset + batch.lod];
+            // Drawn below from the culled indices
+            if (p.meshlet_draw_cnt > 0 && lod.meshlet_count > 0) {
+                continue;
+            }
+            vkCmdDrawIndexed(cmd_buffer, lod.index_count, batch.instance_count, lod.index_offset,
+                             static_cast<int32_t>(mesh.vertex_offset), batch.first_instance);
+        }
+    } else {
+        // The instances that survived occlusion culling, compacted per batch
+        const uint32_t batch_cnt = static_cast<uint32_t>(p.draw_list.batches.size());
+        vertex_buffers[1] = p.vk_culled_instance_buffers[image_idx].buffer;
+        vkCmdBindVertexBuffers(cmd_buffer, 0, 2, vertex_buffers, offsets);
+        vkCmdBindIndexBuffer(cmd_buffer, p.vk_index_buffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+        record_indirect_draws(p, cmd_buffer, p.vk_batch_command_buffers[image_idx].buffer,
+                              phase_region(phase) * batch_cnt, batch_cnt);
+    }
+
+    if (p.meshlet_draw_cnt > 0) {
+        // Meshlet draws address the instances as build_draw_list laid them out
+        vertex_buffers[1] = p.vk_instance_buffers[image_idx].buffer;
+        vkCmdBindVertexBuffers(cmd_buffer, 0, 2, vertex_buffers, offsets);
+        vkCmdBindIndexBuffer(cmd_buffer, p.vk_culled_index_buffers[image_idx].buffer, 0,
+                             VK_INDEX_TYPE_UINT32);
+        record_indirect_draws(p, cmd_buffer, p.vk_meshlet_command_buffers[image_idx].buffer,
+                              phase_region(phase) * p.meshlet_draw_cnt, p.meshlet_draw_cnt);
+    }
+}
+
+static void record_scene_pass(tine::Renderer::Pimpl &p, tine::Scene &scene, TracyVkCtx &ctx,
+                              VkCommandBuffer &cmd_buffer, uint32_t image_idx,
+                              VkRenderPass renderpass, VkFramebuffer &frame_buffer, int width,
+                              int height, uint32_t phase, ImDrawData *draw_data) {
+    VkClearValue clear_values[2] = {};
     VkRenderPassBeginInfo render_pass_binfo = {};
     VkExtent2D window_extent = {(uint32_t)width, (uint32_t)height};
     VkViewport viewport{};
     VkRect2D scissor{};
-    ImDrawData *draw_data = nullptr;
     (void)ctx;
 
+    TracyVkZone(ctx, cmd_buffer, "Render pass");
+    GpuZone gpu_zone(p, cmd_buffer, image_idx, "Render pass");
+    clear_values[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+    clear_values[1].depthStencil = {1.0f, 0};
+    render_pass_binfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    render_pass_binfo.clearValueCount = 2;
+    render_pass_binfo.pClearValues = clear_values;
+    render_pass_binfo.renderPass = renderpass;
+    render_pass_binfo.framebuffer = frame_buffer;
+    render_pass_binfo.renderArea.offset.x = 0;
+    render_pass_binfo.renderArea.offset.y = 0;
+    render_pass_binfo.renderArea.extent = window_extent;
+
+    vkCmdBeginRenderPass(cmd_buffer, &render_pass_binfo, VK_SUBPASS_CONTENTS_INLINE);
+
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = (float)width;
+    viewport.height = (float)height;
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(cmd_buffer, 0, 1, &viewport);
+
+    scissor.offset = {0, 0};
+    scissor.extent = window_extent;
+    vkCmdSetScissor(cmd_buffer, 0, 1, &scissor);
+
+    // The color pass only shades what survives the depth test against the prepass
+    if (p.depth_prepass) {
+        record_draws(p, scene, cmd_buffer, image_idx, p.vk_depth_pipeline, phase);
+    }
+    record_draws(p, scene, cmd_buffer, image_idx, p.vk_pipeline, phase);
+
+    if (draw_data != nullptr) {
+        ImGui_ImplVulkan_RenderDrawData(draw_data, cmd_buffer);
+    }
+
+    vkCmdEndRenderPass(cmd_buffer);
+}
+
+// Space for size bytes in the texture ring, contiguous so no copy wraps.  Fails while it's full.
+static bool texture_ring_alloc(tine::Renderer::Pimpl &p, VkDeviceSize size, VkDeviceSize &offset) {
+    // Copies start on texel block boundaries
+    VkDeviceSize head = (p.texture_ring_head + 15) & ~VkDeviceSize(15);
+
+    if ((head % TEXTURE_RING_SIZE) + size > TEXTURE_RING_SIZE) {
+        head += TEXTURE_RING_SIZE - (head % TEXTURE_RING_SIZE);
+    }
+    if (head + size - p.texture_ring_tail > TEXTURE_RING_SIZE) {
+        return false;
+    }
+    offset = head % TEXTURE_RING_SIZE;
+    p.texture_ring_head = head + size;
+    return true;
+}
+
+// The graphics queue's half of the ownership transfer, then the mip chain blitted level by level
+// from the stored ones.  Only textures with a single stored level get one.
+static void record_texture_mips(tine::Renderer::Pimpl &p, VkCommandBuffer &cmd_buffer,
+                                const GpuTexture &tex) {
+    VkImageMemoryBarrier barrier = {};
+
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    if (p.vk_queue_graphics_family != p.vk_queue_transfer_family) {
+        barrier.srcQueueFamilyIndex = p.vk_queue_transfer_family;
+        barrier.dstQueueFamilyIndex = p.vk_queue_graphics_family;
+    }
+    barrier.image = tex.image.image;
+    barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, tex.level_cnt, 0, 1};
+    vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+
+    for (uint32_t l = tex.stored_level_cnt; l < tex.level_cnt; l++) {
+        VkImageBlit blit = {};
+
+        barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, l - 1, 1, 0, 1};
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1,
+                             &barrier);
+
+        blit.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, l - 1, 0, 1};
+        blit.srcOffsets[1] = {static_cast<int32_t>(std::max<uint32_t>(tex.width >> (l - 1), 1)),
+                              static_cast<int32_t>(std::max<uint32_t>(tex.height >> (l - 1), 1)),
+                              1};
+        blit.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, l, 0, 1};
+        blit.dstOffsets[1] = {static_cast<int32_t>(std::max<uint32_t>(tex.width >> l, 1)),
+                              static_cast<int32_t>(std::max<uint32_t>(tex.height >> l, 1)), 1};
+        vkCmdBlitImage(cmd_buffer, tex.image.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                       tex.image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit,
+                       VK_FILTER_LINEAR);
+
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1,
+                             &barrier);
+    }
+
+    // Every level that wasn't a blit source, the last generated one or all the stored ones
+    if (tex.level_cnt > tex.stored_level_cnt) {
+        barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, tex.level_cnt - 1, 1, 0, 1};
+    } else {
+        barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, tex.level_cnt, 0, 1};
+    }
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1,
+                         &barrier);
+}
+
+// Points the materials using the newly uploaded textures at them.  Those slots were never bound
+// before, which is what allows writing them while earlier frames are still in flight.
+static void record_texture_publish(tine::Renderer::Pimpl &p, TracyVkCtx &ctx,
+                                   VkCommandBuffer &cmd_buffer,
+                                   const std::vector<uint32_t> &slots) {
+    std::vector<uint8_t> &is_ready = p.is_texture_ready;
+    std::vector<VkDescriptorImageInfo> &image_infos = p.texture_image_infos;
+    std::vector<VkWriteDescriptorSet> &writes = p.texture_writes;
+    VkMemoryBarrier barrier = {};
+    (void)ctx;
+
+    TracyVkZone(ctx, cmd_buffer, "Texture uploads");
+
+    is_ready.assign(p.vk_textures.size(), 0);
+    image_infos.assign(slots.size(), {});
+    writes.assign(slots.size(), {});
+    for (size_t i = 0; i < slots.size(); i++) {
+        const GpuTexture &tex = p.vk_textures[slots[i]];
+        record_texture_mips(p, cmd_buffer, tex);
+        is_ready[slots[i]] = 1;
+
+        image_infos[i].imageView = tex.view;
+        image_infos[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = p.vk_bindless_set;
+        writes[i].dstBinding = 2;
+        writes[i].dstArrayElement = slots[i];
+        writes[i].descriptorCount = 1;
+        writes[i].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+        writes[i].pImageInfo = &image_infos[i];
+    }
+    vkUpdateDescriptorSets(p.vk_dev, static_cast<uint32_t>(writes.size()), writes.data(), 0,
+                           nullptr);
+
+    // Previously submitted frames may still be reading the materials
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(cmd_buffer,
+                         VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+                             VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    for (size_t m = 0; m < p.material_textures.size(); m++) {
+        const uint32_t texture = p.material_textures[m];
+        if (texture != tine::NO_TEXTURE && is_ready[texture]) {
+            vkCmdUpdateBuffer(cmd_buffer, p.vk_material_buffer.buffer,
+                              m * sizeof(tine::Material) +
+                                  offsetof(tine::Material, base_color_texture),
+                              sizeof(texture), &texture);
+        }
+    }
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+                             VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                         0, 1, &barrier, 0, nullptr, 0, nullptr);
+    TINE_TRACE("{0} textures ready", slots.size());
+}
+
+// Finishes the batches the transfer queue is done with, oldest first
+static bool record_texture_acquires(tine::Renderer::Pimpl &p, TracyVkCtx &ctx,
+                                    VkCommandBuffer &cmd_buffer) {
+    std::vector<uint32_t> &slots = p.ready_slots;
+
+    slots.clear();
+    while (!p.texture_batches.empty()) {
+        TextureBatch &batch = p.texture_batches.front();
+        const VkResult vk_res = vkGetFenceStatus(p.vk_dev, batch.fence);
+        if (vk_res == VK_NOT_READY) {
+            break;
+        }
+        CHECK_VK(vk_res, "Failed to get texture upload status", Error);
+        slots.insert(slots.end(), batch.slots.begin(), batch.slots.end());
+        p.texture_ring_tail = batch.ring_end;
+        vk_release_texture_batch(p, batch);
+        p.texture_batches.pop_front();
+    }
+    if (!slots.empty()) {
+        record_texture_publish(p, ctx, cmd_buffer, slots);
+    }
+    return true;
+Error:
+    return false;
+}
+
+static bool record_texture_copies(tine::Renderer::Pimpl &p, const tine::TextureImage &image,
+                                  uint32_t slot, VkDeviceSize ring_offset, TextureBatch &batch) {
+    GpuTexture &tex = p.vk_textures[slot];
+    const VkFormat format = vk_texture_format(image.format, image.srgb);
+    VkBuffer src = p.vk_texture_ring.buffer;
+    VkDeviceSize src_offset = ring_offset;
+    std::vector<VkBufferImageCopy> copies;
+    VkImageMemoryBarrier barrier = {};
+
+    tex.width = image.width;
+    tex.height = image.height;
+    tex.stored_level_cnt = static_cast<uint32_t>(image.levels.size());
+    tex.level_cnt = tex.stored_level_cnt;
+    if (tex.stored_level_cnt == 1 && (p.mip_formats & tine::texture_format_bit(image.format))) {
+        tex.level_cnt = tine::get_mip_count(image.width, image.height);
+    }
+
+    if (ring_offset == DEDICATED_STAGING) {
+        batch.dedicated_staging.emplace_back();
+        TINE_CHECK(vk_create_buffer(p, batch.dedicated_staging.back(), image.data.size(),
+                                    VK_BUFFER_USAGE_TRANSFER_SRC_BIT, true),
+                   "Failed to allocate texture staging buffer", Error);
+        memcpy(batch.dedicated_staging.back().info.pMappedData, image.data.data(),
+               image.data.size());
+        vmaFlushAllocation(p.vk_allocator, batch.dedicated_staging.back().alloc, 0,
+                           VK_WHOLE_SIZE);
+        src = batch.dedicated_staging.back().buffer;
+        src_offset = 0;
+    } else {
+        memcpy(static_cast<uint8_t *>(p.vk_texture_ring.info.pMappedData) + ring_offset,
+               image.data.data(), image.data.size());
+        vmaFlushAllocation(p.vk_allocator, p.vk_texture_ring.alloc, ring_offset,
+                           image.data.size());
+    }
+
+    TINE_CHECK(vk_create_image(p, tex.image, format, tex.width, tex.height, tex.level_cnt,
+                               VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+                                   VK_IMAGE_USAGE_SAMPLED_BIT),
+               "Failed to allocate texture", Error);
+    TINE_CHECK(vk_create_image_view(p, tex.image.image, format, VK_IMAGE_ASPECT_COLOR_BIT, 0,
+                                    tex.level_cnt, tex.view),
+               "Failed to create texture view", Error);
+
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = tex.image.image;
+    barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, tex.level_cnt, 0, 1};
+    vkCmdPipelineBarrier(batch.cmd_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    for (uint32_t l = 0; l < tex.stored_level_cnt; l++) {
+        VkBufferImageCopy copy = {};
+        copy.bufferOffset = src_offset + image.levels[l].offset;
+        copy.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, l, 0, 1};
+        copy.imageExtent = {image.levels[l].width, image.levels[l].height, 1};
+        copies.push_back(copy);
+    }
+    vkCmdCopyBufferToImage(batch.cmd_buffer, src, tex.image.image,
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                           static_cast<uint32_t>(copies.size()), copies.data());
+
+    // Release to the graphics queue, see record_texture_mips for the acquire
+    if (p.vk_queue_graphics_family != p.vk_queue_transfer_family) {
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = 0;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcQueueFamilyIndex = p.vk_queue_transfer_family;
+        barrier.dstQueueFamilyIndex = p.vk_queue_graphics_family;
+        vkCmdPipelineBarrier(batch.cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1,
+                             &barrier);
+    }
+    batch.slots.push_back(slot);
+    return true;
+Error:
+    return false;
+}
+
+// Copies the textures the jobs have finished into their images on the transfer queue, as many as
+// the frame's budget and the ring allow.  Nothing waits on the copies, record_texture_acquires
+// picks them up in a later frame.
+static bool submit_texture_copies(tine::Renderer::Pimpl &p) {
+    std::vector<LoadedTexture> loaded;
+    std::vector<VkDeviceSize> ring_offsets;
+    TextureBatch batch;
+    VkCommandBufferAllocateInfo cmd_buffer_ainfo = {};
+    VkCommandBufferBeginInfo cmd_buffer_binfo = {};
+    VkFenceCreateInfo fence_cinfo = {};
+    VkSubmitInfo submit_info = {};
+    VkDeviceSize bytes = 0;
+
+    if (p.texture_batches.empty()) {
+        p.texture_ring_head = 0;
+        p.texture_ring_tail = 0;
+    }
+    {
+        std::lock_guard<std::mutex> lock(p.loaded_mutex);
+        size_t taken = 0;
+        for (; taken < p.loaded_textures.size(); taken++) {
+            const VkDeviceSize size = p.loaded_textures[taken].image.data.size();
+            VkDeviceSize offset = DEDICATED_STAGING;
+            // The first always goes, or a texture over the budget would never be uploaded
+            if (taken > 0 && bytes + size > TEXTURE_UPLOAD_BUDGET) {
+                break;
+            }
+            if (size <= TEXTURE_RING_SIZE && !texture_ring_alloc(p, size, offset)) {
+                break;
+            }
+            ring_offsets.push_back(offset);
+            bytes += size;
+        }
+        loaded.assign(std::make_move_iterator(p.loaded_textures.begin()),
+                      std::make_move_iterator(p.loaded_textures.begin() + taken));
+        p.loaded_textures.erase(p.loaded_textures.begin(), p.loaded_textures.begin() + taken);
+    }
+    if (loaded.empty()) {
+        return true;
+    }
+    ZoneScopedN("Texture copies");
+    batch.ring_end = p.texture_ring_head;
+
+    cmd_buffer_ainfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    cmd_buffer_ainfo.commandPool = p.vk_transfer_cmd_pool;
+    cmd_buffer_ainfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    cmd_buffer_ainfo.commandBufferCount = 1;
+    CHECK_VK(vkAllocateCommandBuffers(p.vk_dev, &cmd_buffer_ainfo, &batch.cmd_buffer),
+             "Failed to allocate texture copy command buffer", Error);
+    fence_cinfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    CHECK_VK(vkCreateFence(p.vk_dev, &fence_cinfo, nullptr, &batch.fence),
+             "Failed to create texture copy fence", Error);
+    cmd_buffer_binfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    cmd_buffer_binfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    CHECK_VK(vkBeginCommandBuffer(batch.cmd_buffer, &cmd_buffer_binfo),
+             "Failed to begin command buffer recording", Error);
+    for (size_t i = 0; i < loaded.size(); i++) {
+        TINE_CHECK(record_texture_copies(p, loaded[i].image, loaded[i].slot, ring_offsets[i],
+                                         batch),
+                   "Failed to record texture copies", Error);
+    }
+    CHECK_VK(vkEndCommandBuffer(batch.cmd_buffer), "Failed to end command buffer", Error);
+
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &batch.cmd_buffer;
+    CHECK_VK(vkQueueSubmit(p.vk_transfer_queues[0], 1, &submit_info, batch.fence),
+             "Failed to submit texture copies", Error);
+    p.texture_batches.push_back(std::move(batch));
+    return true;
+Error:
+    // Images already created are left to vk_cleanup_scene
+    vk_release_texture_batch(p, batch);
+    return false;
+}
+
+static bool record_texture_uploads(tine::Renderer::Pimpl &p, TracyVkCtx &ctx,
+                                   VkCommandBuffer &cmd_buffer) {
+    TINE_CHECK(record_texture_acquires(p, ctx, cmd_buffer), "Failed to record texture acquires",
+               Error);
+    TINE_CHECK(submit_texture_copies(p), "Failed to submit texture copies", Error);
+    return true;
+Error:
+    return false;
+}
+
+// Unprojects the finished depth target of the primary camera into the frame's point buffer, for
+// resolve_point_cloud
+static bool record_point_cloud(tine::Renderer::Pimpl &p, tine::Scene &scene, TracyVkCtx &ctx,
+                               VkCommandBuffer &cmd_buffer, uint32_t image_idx) {
+    const tine::PointCloudSettings &settings = p.point_settings;
+    const tine::CameraComponent camera = get_camera(scene);
+    const VkDeviceSize size =
+        POINT_HEADER_SIZE + VkDeviceSize(settings.max_points) * sizeof(glm::vec4);
+    const uint32_t sample_width = (p.depth_width + settings.stride - 1) / settings.stride;
+    const uint32_t sample_height = (p.depth_height + settings.stride - 1) / settings.stride;
+    entt::registry &registry = scene.get_registry();
+    glm::mat4 output_from_world(1.0f);
+    PointCloudConstants constants = {};
+    VkBufferMemoryBarrier barrier = {};
+    (void)ctx;
+
+    if (!p.point_cloud || p.depth_width == 0 || p.depth_height == 0) {
+        return true;
+    }
+    switch (settings.frame) {
+    case tine::PointFrame::CAMERA:
+        output_from_world = camera.view_matrix;
+        break;
+    case tine::PointFrame::WORLD:
+        break;
+    case tine::PointFrame::ENTITY: {
+        const entt::entity entity = static_cast<entt::entity>(settings.entity);
+        if (!registry.valid(entity) || !registry.all_of<tine::TransformComponent>(entity)) {
+            // Nothing to report the points relative to until the entity shows up
+            return true;
+        }
+        output_from_world = glm::inverse(registry.get<tine::TransformComponent>(entity).transform);
+        break;
+    }
+    }
+
+    TracyVkZone(ctx, cmd_buffer, "Point cloud");
+    GpuZone gpu_zone(p, cmd_buffer, image_idx, "Point cloud");
+
+    if (p.point_readbacks.size() != p.vk_frame_cmd_buffers.size()) {
+        p.point_readbacks.resize(p.vk_frame_cmd_buffers.size());
+    }
+    PointReadback &readback = p.point_readbacks[image_idx];
+    // The frame fence has been waited on and resolve_point_cloud is done with the old buffer
+    if (readback.buffer.info.size < size) {
+        vk_destroy_buffer(p, readback.buffer);
+        TINE_CHECK(vk_create_readback_buffer(p, readback.buffer, size,
+                                             VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                                 VK_BUFFER_USAGE_TRANSFER_DST_BIT),
+                   "Failed to allocate point buffer", Error);
+    }
+
+    vkCmdFillBuffer(cmd_buffer, readback.buffer.buffer, 0, POINT_HEADER_SIZE, 0);
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = readback.buffer.buffer;
+    barrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &barrier, 0,
+                         nullptr);
+
+    {
+        const ComputeBinding bindings[] = {
+            image_binding(p.vk_depth_views[image_idx],
+                          VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL),
+            buffer_binding(readback.buffer.buffer)};
+        TINE_CHECK(bind_compute_resources(p, p.point_pipeline, cmd_buffer, image_idx, bindings),
+                   "Failed to bind point cloud resources", Error);
+    }
+    constants.unproject = output_from_world * glm::inverse(get_view_proj(scene));
+    constants.origin = output_from_world * glm::inverse(camera.view_matrix)[3];
+    constants.depth_size[0] = p.depth_width;
+    constants.depth_size[1] = p.depth_height;
+    constants.stride = settings.stride;
+    constants.max_points = settings.max_points;
+    constants.min_range = settings.min_range;
+    constants.max_range = settings.max_range;
+    constants.noise = settings.noise;
+    constants.dropout = settings.dropout;
+    // New noise every frame
+    constants.seed = static_cast<uint32_t>(p.point_frame * 2654435761u);
+    vkCmdPushConstants(cmd_buffer, p.point_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                       sizeof(constants), &constants);
+    vkCmdDispatch(cmd_buffer, (sample_width + POINT_GROUP_SIZE - 1) / POINT_GROUP_SIZE,
+                  (sample_height + POINT_GROUP_SIZE - 1) / POINT_GROUP_SIZE, 1);
+
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+    readback.max_points = settings.max_points;
+    readback.frame = p.point_frame++;
+    readback.step = p.frame_step;
+    readback.env = p.frame_env;
+    readback.is_pending = true;
+    return true;
+Error:
+    return false;
+}
+
+// Writes a frame to one of the shared memory rings, replacing the ring under the same name if
+// slot_size outgrew it.  Readers then have to open it again.
+static void publish_shm_frame(tine::Renderer::Pimpl &p, tine::ShmWriter &ring, const char *suffix,
+                              uint32_t slot_size, const tine::ShmFrameHeader &header,
+                              const void *data) {
+    ZoneScoped;
+    void *payload = nullptr;
+    if (!ring.is_open() || ring.get_slot_size() < slot_size) {
+        TINE_CHECK(ring.create("/" + p.shm_prefix + suffix, SHM_IMAGE_SLOTS, slot_size),
+                   "Failed to create shared memory", Error);
+    }
+    payload = ring.begin_frame(header);
+    if (payload == nullptr) {
+        return;
+    }
+    memcpy(payload, data, header.size);
+    ring.commit_frame();
+Error:
+    return;
+}
+
+// Copies out the points last written by this command buffer, only the compacted ones cross the
+// bus
+static void resolve_point_cloud(tine::Renderer::Pimpl &p, uint32_t image_idx) {
+    ZoneScoped;
+    const uint8_t *data = nullptr;
+    uint32_t found = 0;
+    if (image_idx >= p.point_readbacks.size() || !p.point_readbacks[image_idx].is_pending) {
+        return;
+    }
+    PointReadback &readback = p.point_readbacks[image_idx];
+    readback.is_pending = false;
+    vmaInvalidateAllocation(p.vk_allocator, readback.buffer.alloc, 0, VK_WHOLE_SIZE);
+    data = static_cast<const uint8_t *>(readback.buffer.info.pMappedData);
+    memcpy(&found, data, sizeof(found));
+    const tine::CloudPoint *points =
+        reinterpret_cast<const tine::CloudPoint *>(data + POINT_HEADER_SIZE);
+    p.points.frame = readback.frame;
+    p.points.found = found;
+    p.points.points.assign(points, points + std::min(found, readback.max_points));
+    p.has_point_cloud = true;
+
+    if (!p.shm_prefix.empty()) {
+        tine::ShmFrameHeader header = {};
+        header.step = readback.step;
+        header.kind = tine::ShmFrameKind::DEPTH;
+        header.env = readback.env;
+        header.width = static_cast<uint32_t>(p.points.points.size());
+        header.height = 1;
+        header.format = VK_FORMAT_R32G32B32A32_SFLOAT;
+        header.size = header.width * static_cast<uint32_t>(sizeof(tine::CloudPoint));
+        // Sized for max_points so the ring isn't replaced as the point count changes
+        publish_shm_frame(p, p.shm_depth, "_depth",
+                          readback.max_points * static_cast<uint32_t>(sizeof(tine::CloudPoint)),
+                          header, points);
+    }
+}
+
+// Whether the presented images are copied out, for the capture or the shared memory ring
+static bool needs_color_readback(const tine::Renderer::Pimpl &p) {
+    return p.supports_capture && (p.capture != nullptr || !p.shm_prefix.empty());
+}
+
+// Copies the finished swapchain image into the frame's readback buffer, for resolve_capture
+static bool record_capture(tine::Renderer::Pimpl &p, TracyVkCtx &ctx, VkCommandBuffer &cmd_buffer,
+                           uint32_t image_idx, int width, int height) {
+    const VkDeviceSize size = VkDeviceSize(width) * height * 4;
+    VkImageMemoryBarrier image_barrier = {};
+    VkBufferMemoryBarrier buffer_barrier = {};
+    VkBufferImageCopy region = {};
+    (void)ctx;
+
+    if (!needs_color_readback(p) || width <= 0 || height <= 0) {
+        return true;
+    }
+
+    TracyVkZone(ctx, cmd_buffer, "Frame capture");
+    GpuZone gpu_zone(p, cmd_buffer, image_idx, "Frame capture");
+
+    if (p.capture_readbacks.size() != p.vk_frame_cmd_buffers.size()) {
+        p.capture_readbacks.resize(p.vk_frame_cmd_buffers.size());
+    }
+    CaptureReadback &readback = p.capture_readbacks[image_idx];
+    // The frame fence has been waited on and resolve_capture is done with the old buffer
+    if (readback.buffer.info.size < size) {
+        vk_destroy_buffer(p, readback.buffer);
+        TINE_CHECK(vk_create_readback_buffer(p, readback.buffer, size,
+                                             VK_BUFFER_USAGE_TRANSFER_DST_BIT),
+                   "Failed to allocate capture buffer", Error);
+    }
+
+    image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    image_barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    image_barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    image_barrier.oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    image_barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    image_barrier.image = p.vk_swapchain_images[image_idx];
+    image_barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    image_barrier.subresourceRange.levelCount = 1;
+    image_barrier.subresourceRange.layerCount = 1;
+    vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1,
+                         &image_barrier);
+
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent = {static_cast<uint32_t>(width), static_cast<uint32_t>(height), 1};
+    vkCmdCopyImageToBuffer(cmd_buffer, image_barrier.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                           readback.buffer.buffer, 1, &region);
+
+    // Back for presentation, which the semaphore orders after the copy
+    image_barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    image_barrier.dstAccessMask = 0;
+    image_barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    image_barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    buffer_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    buffer_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    buffer_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    buffer_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    buffer_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    buffer_barrier.buffer = readback.buffer.buffer;
+    buffer_barrier.size = size;
+    vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0,
+                         nullptr, 1, &buffer_barrier, 1, &image_barrier);
+
+    readback.width = static_cast<uint32_t>(width);
+    readback.height = static_cast<uint32_t>(height);
+    readback.frame = p.capture_frame++;
+    readback.step = p.frame_step;
+    readback.env = p.frame_env;
+    readback.is_pending = true;
+    return true;
+Error:
+    return false;
+}
+
+// Hands the frame last copied by this command buffer to the capture and the shared memory ring,
+// which only copy it out before the command buffer is reused
+static void resolve_capture(tine::Renderer::Pimpl &p, uint32_t image_idx) {
+    ZoneScoped;
+    if (image_idx >= p.capture_readbacks.size() || !p.capture_readbacks[image_idx].is_pending) {
+        return;
+    }
+    CaptureReadback &readback = p.capture_readbacks[image_idx];
+    readback.is_pending = false;
+    if (p.capture == nullptr && p.shm_prefix.empty()) {
+        return;
+    }
+    vmaInvalidateAllocation(p.vk_allocator, readback.buffer.alloc, 0, VK_WHOLE_SIZE);
+    if (p.capture != nullptr) {
+        p.capture->submit(readback.frame, readback.width, readback.height, readback.width * 4,
+                          p.capture_pixels, readback.buffer.info.pMappedData);
+    }
+    if (!p.shm_prefix.empty()) {
+        tine::ShmFrameHeader header = {};
+        header.step = readback.step;
+        header.kind = tine::ShmFrameKind::COLOR;
+        header.env = readback.env;
+        header.width = readback.width;
+        header.height = readback.height;
+        header.format = p.vk_image_format.format;
+        header.size = readback.width * readback.height * 4;
+        publish_shm_frame(p, p.shm_color, "_color", header.size, header,
+                          readback.buffer.info.pMappedData);
+    }
+}
+
+// Hands the frames still in flight to the capture they were copied for, before it's detached
+static bool flush_capture(tine::Renderer::Pimpl &p) {
+    bool is_pending = false;
+
+    for (const CaptureReadback &readback : p.capture_readbacks) {
+        is_pending = is_pending || readback.is_pending;
+    }
+    if (!is_pending) {
+        return true;
+    }
+    CHECK_VK(vkDeviceWaitIdle(p.vk_dev), "Failed to idle device", Error);
+    for (uint32_t i = 0; i < p.capture_readbacks.size(); i++) {
+        // A frame whose submission failed never signals its fence
+        if (vkGetFenceStatus(p.vk_dev, p.vk_render_completed_fences[i]) == VK_SUCCESS) {
+            resolve_capture(p, i);
+        }
+        p.capture_readbacks[i].is_pending = false;
+    }
+    return true;
+Error:
+    return false;
+}
+
+static bool record_render_frame(tine::Renderer::Pimpl &p, tine::Scene &scene, uint32_t image_idx,
+                                TracyVkCtx &ctx, VkCommandBuffer &cmd_buffer,
+                                VkFramebuffer &frame_buffer, int width, int height) {
+    VkCommandBufferBeginInfo cmd_buffer_binfo = {};
+    ImDrawData *draw_data = nullptr;
+
     ImGui_ImplVulkan_NewFrame();
     ImGui_ImplGlfw_NewFrame();
     ImGui::NewFrame();
@@ -911,53 +3469,64 @@ static bool record_render_frame(tine::Renderer::Pimpl &p, TracyVkCtx &ctx,
     }
 
     ImGui::Render();
-    draw_data = ImGui::GetDrawData();
+    // Captured and published frames show the scene only
+    if (!needs_color_readback(p)) {
+        draw_data = ImGui::GetDrawData();
+    }
 
     cmd_buffer_binfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
     cmd_buffer_binfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
     CHECK_VK(vkBeginCommandBuffer(cmd_buffer, &cmd_buffer_binfo),
              "Failed to begin command buffer recording", Error);
-    {
-        TracyVkZone(ctx, cmd_buffer, "Render pass");
-        render_pass_binfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        render_pass_binfo.clearValueCount = 1;
-        render_pass_binfo.pClearValues = &clearValue;
-        render_pass_binfo.renderPass = p.vk_renderpass;
-        render_pass_binfo.framebuffer = frame_buffer;
-        render_pass_binfo.renderArea.offset.x = 0;
-        render_pass_binfo.renderArea.offset.y = 0;
-        render_pass_binfo.renderArea.extent = window_extent;
-
-        vkCmdBeginRenderPass(cmd_buffer, &render_pass_binfo, VK_SUBPASS_CONTENTS_INLINE);
-
-        vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, p.vk_pipeline);
-        viewport.x = 0.0f;
-        viewport.y = 0.0f;
-        viewport.width = (float)width;
-        viewport.height = (float)height;
-        viewport.minDepth = 0.0f;
-        viewport.maxDepth = 1.0f;
-        vkCmdSetViewport(cmd_buffer, 0, 1, &viewport);
-
-        scissor.offset = {0, 0};
-        scissor.extent = window_extent;
-        vkCmdSetScissor(cmd_buffer, 0, 1, &scissor);
-
-        vkCmdDraw(cmd_buffer, 3, 1, 0, 0);
-
-        ImGui_ImplVulkan_RenderDrawData(draw_data, cmd_buffer);
-
-        vkCmdEndRenderPass(cmd_buffer);
+    reset_gpu_queries(p, cmd_buffer, image_idx);
+    TINE_CHECK(record_texture_uploads(p, ctx, cmd_buffer), "Failed to record texture uploads",
+               Error);
+    TINE_CHECK(record_skinning(p, scene, ctx, cmd_buffer, image_idx), "Failed to record skinning",
+               Error);
+    TINE_CHECK(upload_instances(p, image_idx), "Failed to upload instances", Error);
+    if (p.gpu_culling && p.occlusion_culling && !p.draw_list.batches.empty()) {
+        // Last frame's visible set first, then whatever the Hi-Z pyramid of that reveals
+        TINE_CHECK(prepare_meshlet_jobs(p, scene, image_idx, 2), "Failed to prepare meshlets",
+                   Error);
+        TINE_CHECK(prepare_occlusion_culling(p, scene, cmd_buffer, image_idx),
+                   "Failed to prepare occlusion culling", Error);
+        TINE_CHECK(record_instance_culling(p, scene, ctx, cmd_buffer, image_idx, DRAW_EARLY),
+                   "Failed to record early instance culling", Error);
+        TINE_CHECK(record_meshlet_culling(p, scene, ctx, cmd_buffer, image_idx, DRAW_EARLY),
+                   "Failed to record early meshlet culling", Error);
+        record_scene_pass(p, scene, ctx, cmd_buffer, image_idx, p.vk_renderpass_early,
+                          frame_buffer, width, height, DRAW_EARLY, nullptr);
+        TINE_CHECK(record_hiz_build(p, ctx, cmd_buffer, image_idx), "Failed to record Hi-Z build",
+                   Error);
+        TINE_CHECK(record_instance_culling(p, scene, ctx, cmd_buffer, image_idx, DRAW_LATE),
+                   "Failed to record late instance culling", Error);
+        TINE_CHECK(record_meshlet_culling(p, scene, ctx, cmd_buffer, image_idx, DRAW_LATE),
+                   "Failed to record late meshlet culling", Error);
+        record_scene_pass(p, scene, ctx, cmd_buffer, image_idx,
+                          p.point_cloud ? p.vk_renderpass_late_keep : p.vk_renderpass_late,
+                          frame_buffer, width, height, DRAW_LATE, draw_data);
+    } else {
+        TINE_CHECK(prepare_meshlet_jobs(p, scene, image_idx, 1), "Failed to prepare meshlets",
+                   Error);
+        TINE_CHECK(record_meshlet_culling(p, scene, ctx, cmd_buffer, image_idx, 0),
+                   "Failed to record meshlet culling", Error);
+        record_scene_pass(p, scene, ctx, cmd_buffer, image_idx,
+                          p.point_cloud ? p.vk_renderpass_keep : p.vk_renderpass, frame_buffer,
+                          width, height, 0, draw_data);
     }
+    TINE_CHECK(record_point_cloud(p, scene, ctx, cmd_buffer, image_idx),
+               "Failed to record point cloud", Error);
+    TINE_CHECK(record_capture(p, ctx, cmd_buffer, image_idx, width, height),
+               "Failed to record frame capture", Error);
     CHECK_VK(vkEndCommandBuffer(cmd_buffer), "Failed to end command buffer", Error);
     return true;
 Error:
     return false;
 }
 
-static bool render_frame(tine::Renderer::Pimpl &p, bool &timeout, size_t frame, uint32_t &image_idx,
-                         int width, int height) {
+static bool render_frame(tine::Renderer::Pimpl &p, tine::Scene &scene, bool &timeout, size_t frame,
+                         uint32_t &image_idx, int width, int height) {
     VkResult vk_res = VK_SUCCESS;
     VkSubmitInfo submit_info = {};
     VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
@@ -988,11 +3557,16 @@ static bool render_frame(tine::Renderer::Pimpl &p, bool &timeout, size_t frame,
         "Failed to wait for render fence", Error);
     CHECK_VK(vkResetFences(p.vk_dev, 1, &p.vk_render_completed_fences[image_idx]),
              "Failed to reset render fence", Error);
+    resolve_gpu_queries(p, image_idx);
+    resolve_point_cloud(p, image_idx);
+    resolve_capture(p, image_idx);
 
     CHECK_VK(vkResetCommandBuffer(p.vk_frame_cmd_buffers[image_idx], 0),
              "Failed to reset command buffer", Error);
+    CHECK_VK(vkResetDescriptorPool(p.vk_dev, p.vk_frame_desc_pools[image_idx], 0),
+             "Failed to reset frame descriptor pool", Error);
 
-    TINE_CHECK(record_render_frame(p, p.tracy_vk_frame_ctxs[image_idx],
+    TINE_CHECK(record_render_frame(p, scene, image_idx, p.tracy_vk_frame_ctxs[image_idx],
                                    p.vk_frame_cmd_buffers[image_idx], p.vk_framebuffers[image_idx],
                                    width, height),
                "Failed to record render frame", Error);
@@ -1014,6 +3588,10 @@ static bool render_frame(tine::Renderer::Pimpl &p, bool &timeout, size_t frame,
     CHECK_VK(vkQueueSubmit(p.vk_graphics_queues[0], 1, &submit_info,
                            p.vk_render_completed_fences[image_idx]),
              "Failed to submit render command buffer", Error);
+    if (image_idx < p.gpu_queries.size()) {
+        p.gpu_queries[image_idx].is_pending = p.gpu_queries[image_idx].is_recording;
+        p.gpu_queries[image_idx].is_recording = false;
+    }
 
     return true;
 Error:
@@ -1046,7 +3624,7 @@ Error:
     return false;
 }
 
-static bool copy_data_staging(tine::Renderer::Pimpl &p, VkBuffer dst, void *src, size_t sz) {
+static bool copy_data_staging(tine::Renderer::Pimpl &p, VkBuffer dst, const void *src, size_t sz) {
     VkCommandBufferBeginInfo cmd_buffer_binfo = {};
     VkSubmitInfo submit_info = {};
     VkBufferCopy buffer_copy = {};
@@ -1054,7 +3632,7 @@ static bool copy_data_staging(tine::Renderer::Pimpl &p, VkBuffer dst, void *src,
     const size_t chunk_size = p.vk_staging_buffer_size / p.vk_transfer_cmd_buffers.size();
     unsigned char *pstaging_buffer =
         reinterpret_cast<unsigned char *>(p.vk_staging_buffer_info.pMappedData);
-    unsigned char *psrc = reinterpret_cast<unsigned char *>(src);
+    const unsigned char *psrc = reinterpret_cast<const unsigned char *>(src);
 
     cmd_buffer_binfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
     cmd_buffer_binfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
@@ -1089,7 +3667,7 @@ static bool copy_data_staging(tine::Renderer::Pimpl &p, VkBuffer dst, void *src,
         CHECK_VK(vkEndCommandBuffer(cmd_buffer), "", Error);
 
         // Copy the data to the staging buffer
-        memcpy(pstaging_buffer + staging_offset, psrc + offset, chunk_size);
+        memcpy(pstaging_buffer + staging_offset, psrc + offset, copy_size);
 
         // Submit the cmd buffer
         submit_info.pCommandBuffers = &cmd_buffer;
@@ -1102,6 +3680,270 @@ Error:
     return false;
 }
 
+static void vk_cleanup_scene(tine::Renderer::Pimpl &p) {
+    if (p.jobs != nullptr) {
+        // Loads still running would hand their textures to the next scene
+        p.jobs->wait(p.texture_loads);
+    }
+    p.loaded_textures.clear();
+    for (TextureBatch &batch : p.texture_batches) {
+        (void)vkWaitForFences(p.vk_dev, 1, &batch.fence, VK_TRUE, UINT64_MAX);
+        vk_release_texture_batch(p, batch);
+    }
+    p.texture_batches.clear();
+    p.texture_ring_head = 0;
+    p.texture_ring_tail = 0;
+    for (GpuTexture &tex : p.vk_textures) {
+        if (tex.view != VK_NULL_HANDLE) {
+            vkDestroyImageView(p.vk_dev, tex.view, nullptr);
+        }
+        vk_destroy_image(p, tex.image);
+    }
+    p.vk_textures.clear();
+    p.material_textures.clear();
+    for (GpuBuffer &buf : p.vk_palette_buffers) {
+        vk_destroy_buffer(p, buf);
+    }
+    p.vk_palette_buffers.clear();
+    vk_destroy_buffer(p, p.vk_skin_instance_buffer);
+    vk_destroy_buffer(p, p.vk_skin_vertex_buffer);
+    vk_destroy_buffer(p, p.vk_index_buffer);
+    vk_destroy_buffer(p, p.vk_vertex_buffer);
+    vk_destroy_buffer(p, p.vk_material_buffer);
+    vk_destroy_buffer(p, p.vk_mesh_quant_buffer);
+    vk_destroy_buffer(p, p.vk_meshlet_buffer);
+    vk_destroy_buffer(p, p.vk_meshlet_vertex_buffer);
+    vk_destroy_buffer(p, p.vk_meshlet_triangle_buffer);
+    vk_destroy_buffer(p, p.vk_visibility_buffer);
+    p.skin_instance_cnt = 0;
+    p.visibility_cap = 0;
+    p.skin_max_vertex_cnt = 0;
+}
+
+static bool vk_upload_skinning(tine::Renderer::Pimpl &p, tine::Scene &scene) {
+    const tine::MeshData &mesh_data = scene.get_mesh_data();
+    const tine::AnimationData &anim = scene.get_animation_data();
+    entt::registry &registry = scene.get_registry();
+    const size_t frame_cnt = p.vk_frame_cmd_buffers.size();
+    std::vector<SkinInstance> instances;
+
+    {
+        auto view = registry.view<const tine::SkinComponent, const tine::MeshComponent>();
+        for (entt::entity entity : view) {
+            const tine::SkinComponent &skin_comp = view.get<const tine::SkinComponent>(entity);
+            const tine::Skin &skin = anim.skins[skin_comp.skin];
+            const tine::Mesh &src = mesh_data.meshes[skin.mesh];
+            const tine::Mesh &dst =
+                mesh_data.meshes[view.get<const tine::MeshComponent>(entity).mesh];
+            SkinInstance instance = {};
+            instance.src_vertex = src.vertex_offset;
+            instance.dst_vertex = dst.vertex_offset;
+            instance.vertex_count = src.vertex_count;
+            instance.palette_offset = skin_comp.palette_offset;
+            instance.skin_vertex = skin.skin_vertex_offset;
+            instance.src_mesh = skin.mesh;
+            instance.dst_mesh = view.get<const tine::MeshComponent>(entity).mesh;
+            instances.push_back(instance);
+            p.skin_max_vertex_cnt = std::max(p.skin_max_vertex_cnt, src.vertex_count);
+        }
+    }
+    if (instances.empty()) {
+        return true;
+    }
+
+    TINE_TRACE("Uploading {0} skinned instances", instances.size());
+
+    TINE_CHECK(vk_create_buffer(p, p.vk_skin_vertex_buffer,
+                                anim.skin_vertices.size() * sizeof(tine::SkinVertex),
+                                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, false),
+               "Failed to allocate skin vertex buffer", Error);
+    TINE_CHECK(copy_data_staging(p, p.vk_skin_vertex_buffer.buffer, anim.skin_vertices.data(),
+                                 anim.skin_vertices.size() * sizeof(tine::SkinVertex)),
+               "Failed to upload skin vertices", Error);
+    TINE_CHECK(vk_create_buffer(p, p.vk_skin_instance_buffer,
+                                instances.size() * sizeof(SkinInstance),
+                                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, false),
+               "Failed to allocate skin instance buffer", Error);
+    TINE_CHECK(copy_data_staging(p, p.vk_skin_instance_buffer.buffer, instances.data(),
+                                 instances.size() * sizeof(SkinInstance)),
+               "Failed to upload skin instances", Error);
+
+    p.vk_palette_buffers.resize(frame_cnt);
+    for (size_t i = 0; i < frame_cnt; i++) {
+        TINE_CHECK(vk_create_buffer(p, p.vk_palette_buffers[i],
+                                    anim.joint_palette.size() * sizeof(glm::mat4),
+                                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, true),
+                   "Failed to allocate joint palette", Error);
+    }
+
+    p.skin_instance_cnt = (uint32_t)instances.size();
+    return true;
+Error:
+    return false;
+}
+
+static bool vk_upload_materials(tine::Renderer::Pimpl &p, tine::Scene &scene) {
+    std::vector<tine::Material> materials = scene.get_material_data().materials;
+    const size_t size = materials.size() * sizeof(tine::Material);
+    VkDescriptorBufferInfo buffer_info = {};
+    VkWriteDescriptorSet write = {};
+
+    // Textures are patched in as they finish uploading
+    p.material_textures.resize(materials.size());
+    for (size_t i = 0; i < materials.size(); i++) {
+        p.material_textures[i] = materials[i].base_color_texture;
+        materials[i].base_color_texture = tine::NO_TEXTURE;
+    }
+
+    TINE_CHECK(size > 0, "Scene has no materials", Error);
+    TINE_CHECK(vk_create_buffer(p, p.vk_material_buffer, size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                false),
+               "Failed to allocate material buffer", Error);
+    TINE_CHECK(copy_data_staging(p, p.vk_material_buffer.buffer, materials.data(), size),
+               "Failed to upload materials", Error);
+
+    buffer_info.buffer = p.vk_material_buffer.buffer;
+    buffer_info.offset = 0;
+    buffer_info.range = VK_WHOLE_SIZE;
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = p.vk_bindless_set;
+    write.dstBinding = 0;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    write.pBufferInfo = &buffer_info;
+    vkUpdateDescriptorSets(p.vk_dev, 1, &write, 0, nullptr);
+
+    return true;
+Error:
+    return false;
+}
+
+// Queues the scene's textures to load on the jobs.  Materials start out untextured and pick up
+// their texture once it's on the GPU, see record_texture_uploads, so nothing waits on them.
+static bool vk_start_texture_loads(tine::Renderer::Pimpl &p, tine::Scene &scene,
+                                   tine::JobSystem *jobs) {
+    const std::vector<tine::TextureSource> &sources = scene.get_material_data().textures;
+
+    TINE_CHECK(sources.size() <= p.bindless_texture_cap,
+               "Too many textures for the bindless array", Error);
+    p.jobs = jobs;
+    p.vk_textures.resize(sources.size());
+    for (size_t i = 0; i < sources.size(); i++) {
+        // A copy, the scene may be replaced while the loads still run
+        auto load = [&p, source = sources[i], i]() {
+            LoadedTexture loaded = {static_cast<uint32_t>(i), tine::TextureImage()};
+            if (!tine::load_texture(source, p.texture_formats, loaded.image)) {
+                TINE_WARN("Failed to load texture {0}", source.path);
+                return;
+            }
+            std::lock_guard<std::mutex> lock(p.loaded_mutex);
+            p.loaded_textures.push_back(std::move(loaded));
+        };
+        if (jobs != nullptr) {
+            jobs->submit("Load texture", load, &p.texture_loads);
+        } else {
+            load();
+        }
+    }
+    return true;
+Error:
+    return false;
+}
+
+static bool vk_upload_meshlets(tine::Renderer::Pimpl &p, tine::Scene &scene) {
+    const tine::MeshData &mesh_data = scene.get_mesh_data();
+
+    if (!p.gpu_culling || mesh_data.meshlets.empty()) {
+        return true;
+    }
+
+    TINE_CHECK(vk_create_buffer(p, p.vk_meshlet_buffer,
+                                mesh_data.meshlets.size() * sizeof(tine::Meshlet),
+                                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, false),
+               "Failed to allocate meshlet buffer", Error);
+    TINE_CHECK(copy_data_staging(p, p.vk_meshlet_buffer.buffer, mesh_data.meshlets.data(),
+                                 mesh_data.meshlets.size() * sizeof(tine::Meshlet)),
+               "Failed to upload meshlets", Error);
+    TINE_CHECK(vk_create_buffer(p, p.vk_meshlet_vertex_buffer,
+                                mesh_data.meshlet_vertices.size() * sizeof(uint32_t),
+                                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, false),
+               "Failed to allocate meshlet vertex buffer", Error);
+    TINE_CHECK(copy_data_staging(p, p.vk_meshlet_vertex_buffer.buffer,
+                                 mesh_data.meshlet_vertices.data(),
+                                 mesh_data.meshlet_vertices.size() * sizeof(uint32_t)),
+               "Failed to upload meshlet vertices", Error);
+    TINE_CHECK(vk_create_buffer(p, p.vk_meshlet_triangle_buffer,
+                                mesh_data.meshlet_triangles.size() * sizeof(uint32_t),
+                                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, false),
+               "Failed to allocate meshlet triangle buffer", Error);
+    TINE_CHECK(copy_data_staging(p, p.vk_meshlet_triangle_buffer.buffer,
+                                 mesh_data.meshlet_triangles.data(),
+                                 mesh_data.meshlet_triangles.size() * sizeof(uint32_t)),
+               "Failed to upload meshlet triangles", Error);
+    return true;
+Error:
+    return false;
+}
+
+static bool vk_upload_scene(tine::Renderer::Pimpl &p, tine::Scene &scene,
+                            tine::JobSystem *jobs) {
+    const tine::MeshData &mesh_data = scene.get_mesh_data();
+    std::vector<tine::QuantizedVertex> vertices;
+    std::vector<tine::MeshQuantization> quantization;
+    VkDescriptorBufferInfo buffer_info = {};
+    VkWriteDescriptorSet write = {};
+
+    TINE_TRACE("Uploading scene geometry");
+
+    CHECK_VK(vkDeviceWaitIdle(p.vk_dev), "Failed to idle device", Error);
+    vk_cleanup_scene(p);
+
+    if (mesh_data.vertices.empty() || mesh_data.indices.empty()) {
+        return true;
+    }
+
+    tine::quantize_mesh_data(mesh_data, vertices, quantization);
+    TINE_CHECK(vk_create_buffer(p, p.vk_vertex_buffer,
+                                vertices.size() * sizeof(tine::QuantizedVertex),
+                                VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+                                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                false),
+               "Failed to allocate vertex buffer", Error);
+    TINE_CHECK(copy_data_staging(p, p.vk_vertex_buffer.buffer, vertices.data(),
+                                 vertices.size() * sizeof(tine::QuantizedVertex)),
+               "Failed to upload vertices", Error);
+    TINE_CHECK(vk_create_buffer(p, p.vk_mesh_quant_buffer,
+                                quantization.size() * sizeof(tine::MeshQuantization),
+                                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, false),
+               "Failed to allocate mesh quantization buffer", Error);
+    TINE_CHECK(copy_data_staging(p, p.vk_mesh_quant_buffer.buffer, quantization.data(),
+                                 quantization.size() * sizeof(tine::MeshQuantization)),
+               "Failed to upload mesh quantization", Error);
+    buffer_info = {p.vk_mesh_quant_buffer.buffer, 0, VK_WHOLE_SIZE};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = p.vk_bindless_set;
+    write.dstBinding = 3;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    write.pBufferInfo = &buffer_info;
+    vkUpdateDescriptorSets(p.vk_dev, 1, &write, 0, nullptr);
+    TINE_CHECK(vk_create_buffer(p, p.vk_index_buffer, mesh_data.indices.size() * sizeof(uint32_t),
+                                VK_BUFFER_USAGE_INDEX_BUFFER_BIT, false),
+               "Failed to allocate index buffer", Error);
+    TINE_CHECK(copy_data_staging(p, p.vk_index_buffer.buffer, mesh_data.indices.data(),
+                                 mesh_data.indices.size() * sizeof(uint32_t)),
+               "Failed to upload indices", Error);
+    TINE_CHECK(vk_upload_materials(p, scene), "Failed to upload materials", Error);
+    TINE_CHECK(vk_start_texture_loads(p, scene, jobs), "Failed to load textures", Error);
+    TINE_CHECK(vk_upload_skinning(p, scene), "Failed to upload skinning data", Error);
+    TINE_CHECK(vk_upload_meshlets(p, scene), "Failed to upload meshlets", Error);
+
+    return true;
+Error:
+    vk_cleanup_scene(p);
+    return false;
+}
+
 // --- Renderer implementation
 
 tine::Renderer::Renderer(tine::Engine *eng) : m_engine(eng), m_pimpl(new tine::Renderer::Pimpl) {}
@@ -1143,9 +3985,21 @@ Error:
     return false;
 }
 
+bool tine::Renderer::upload_scene(tine::Scene *scene) {
+    TINE_CHECK(scene != nullptr, "No scene to upload", Error);
+    TINE_CHECK(vk_upload_scene(*m_pimpl, *scene, m_engine->get_jobs()), "Failed to upload scene",
+               Error);
+    return true;
+Error:
+    return false;
+}
+
 void tine::Renderer::cleanup() {
 
     (void)vkDeviceWaitIdle(m_pimpl->vk_dev);
+    (void)flush_capture(*m_pimpl);
+    m_pimpl->shm_color.destroy();
+    m_pimpl->shm_depth.destroy();
 
     if (m_pimpl->imgui_initialized) {
         ImGui_ImplVulkan_Shutdown();
@@ -1174,6 +4028,44 @@ void tine::Renderer::cleanup() {
         }
         m_pimpl->vk_image_acquired_sems.clear();
     }
+    vk_cleanup_scene(*m_pimpl);
+    vk_destroy_frame_buffers(*m_pimpl, m_pimpl->vk_instance_buffers);
+    for (CaptureReadback &readback : m_pimpl->capture_readbacks) {
+        vk_destroy_buffer(*m_pimpl, readback.buffer);
+    }
+    m_pimpl->capture_readbacks.clear();
+    for (PointReadback &readback : m_pimpl->point_readbacks) {
+        vk_destroy_buffer(*m_pimpl, readback.buffer);
+    }
+    m_pimpl->point_readbacks.clear();
+    vk_destroy_frame_buffers(*m_pimpl, m_pimpl->vk_meshlet_job_buffers);
+    vk_destroy_frame_buffers(*m_pimpl, m_pimpl->vk_meshlet_command_buffers);
+    vk_destroy_frame_buffers(*m_pimpl, m_pimpl->vk_culled_index_buffers);
+    vk_destroy_frame_buffers(*m_pimpl, m_pimpl->vk_batch_command_buffers);
+    vk_destroy_frame_buffers(*m_pimpl, m_pimpl->vk_culled_instance_buffers);
+    vk_destroy_frame_buffers(*m_pimpl, m_pimpl->vk_instance_flag_buffers);
+    vk_destroy_compute_pipeline(*m_pimpl, m_pimpl->skin_pipeline);
+    vk_destroy_compute_pipeline(*m_pimpl, m_pimpl->cull_pipeline);
+    vk_destroy_compute_pipeline(*m_pimpl, m_pimpl->instance_cull_pipeline);
+    vk_destroy_compute_pipeline(*m_pimpl, m_pimpl->hiz_pipeline);
+    vk_destroy_compute_pipeline(*m_pimpl, m_pimpl->point_pipeline);
+    if (m_pimpl->vk_point_sampler != VK_NULL_HANDLE) {
+        vkDestroySampler(m_pimpl->vk_dev, m_pimpl->vk_point_sampler, nullptr);
+        m_pimpl->vk_point_sampler = VK_NULL_HANDLE;
+    }
+    if (m_pimpl->vk_bindless_pool != VK_NULL_HANDLE) {
+        vkDestroyDescriptorPool(m_pimpl->vk_dev, m_pimpl->vk_bindless_pool, nullptr);
+        m_pimpl->vk_bindless_pool = VK_NULL_HANDLE;
+        m_pimpl->vk_bindless_set = VK_NULL_HANDLE;
+    }
+    if (m_pimpl->vk_bindless_layout != VK_NULL_HANDLE) {
+        vkDestroyDescriptorSetLayout(m_pimpl->vk_dev, m_pimpl->vk_bindless_layout, nullptr);
+        m_pimpl->vk_bindless_layout = VK_NULL_HANDLE;
+    }
+    if (m_pimpl->vk_default_sampler != VK_NULL_HANDLE) {
+        vkDestroySampler(m_pimpl->vk_dev, m_pimpl->vk_default_sampler, nullptr);
+        m_pimpl->vk_default_sampler = VK_NULL_HANDLE;
+    }
     if (m_pimpl->vk_pipeline_layout != VK_NULL_HANDLE) {
         vkDestroyPipelineLayout(m_pimpl->vk_dev, m_pimpl->vk_pipeline_layout, nullptr);
         m_pimpl->vk_pipeline_layout = VK_NULL_HANDLE;
@@ -1182,10 +4074,31 @@ void tine::Renderer::cleanup() {
         vkDestroyPipeline(m_pimpl->vk_dev, m_pimpl->vk_pipeline, nullptr);
         m_pimpl->vk_pipeline = VK_NULL_HANDLE;
     }
+    if (m_pimpl->vk_depth_pipeline != VK_NULL_HANDLE) {
+        vkDestroyPipeline(m_pimpl->vk_dev, m_pimpl->vk_depth_pipeline, nullptr);
+        m_pimpl->vk_depth_pipeline = VK_NULL_HANDLE;
+    }
     if (m_pimpl->vk_renderpass != VK_NULL_HANDLE) {
         vkDestroyRenderPass(m_pimpl->vk_dev, m_pimpl->vk_renderpass, nullptr);
         m_pimpl->vk_renderpass = VK_NULL_HANDLE;
     }
+    if (m_pimpl->vk_renderpass_early != VK_NULL_HANDLE) {
+        vkDestroyRenderPass(m_pimpl->vk_dev, m_pimpl->vk_renderpass_early, nullptr);
+        m_pimpl->vk_renderpass_early = VK_NULL_HANDLE;
+    }
+    if (m_pimpl->vk_renderpass_late != VK_NULL_HANDLE) {
+        vkDestroyRenderPass(m_pimpl->vk_dev, m_pimpl->vk_renderpass_late, nullptr);
+        m_pimpl->vk_renderpass_late = VK_NULL_HANDLE;
+    }
+    if (m_pimpl->vk_renderpass_keep != VK_NULL_HANDLE) {
+        vkDestroyRenderPass(m_pimpl->vk_dev, m_pimpl->vk_renderpass_keep, nullptr);
+        m_pimpl->vk_renderpass_keep = VK_NULL_HANDLE;
+    }
+    if (m_pimpl->vk_renderpass_late_keep != VK_NULL_HANDLE) {
+        vkDestroyRenderPass(m_pimpl->vk_dev, m_pimpl->vk_renderpass_late_keep, nullptr);
+        m_pimpl->vk_renderpass_late_keep = VK_NULL_HANDLE;
+    }
+    vk_cleanup_gpu_queries(*m_pimpl);
 #ifdef TRACY_ENABLE
     if (m_pimpl->tracy_vk_frame_ctxs.size() > 0) {
         for (TracyVkCtx &ctx : m_pimpl->tracy_vk_frame_ctxs) {
@@ -1203,6 +4116,11 @@ void tine::Renderer::cleanup() {
         m_pimpl->vk_frame_cmd_pool = VK_NULL_HANDLE;
     }
     vk_cleanup_swapchain(*m_pimpl);
+    vk_cleanup_depth_targets(*m_pimpl);
+    for (VkDescriptorPool pool : m_pimpl->vk_frame_desc_pools) {
+        vkDestroyDescriptorPool(m_pimpl->vk_dev, pool, nullptr);
+    }
+    m_pimpl->vk_frame_desc_pools.clear();
     if (m_pimpl->vk_desc_pool != VK_NULL_HANDLE) {
         vkDestroyDescriptorPool(m_pimpl->vk_dev, m_pimpl->vk_desc_pool, nullptr);
         m_pimpl->vk_desc_pool = VK_NULL_HANDLE;
@@ -1211,6 +4129,7 @@ void tine::Renderer::cleanup() {
         vmaDestroyBuffer(m_pimpl->vk_allocator, m_pimpl->vk_staging_buffer,
                          m_pimpl->vk_staging_alloc);
     }
+    vk_destroy_buffer(*m_pimpl, m_pimpl->vk_texture_ring);
     if (m_pimpl->vk_allocator != VK_NULL_HANDLE) {
         vmaDestroyAllocator(m_pimpl->vk_allocator);
         m_pimpl->vk_allocator = VK_NULL_HANDLE;
@@ -1241,7 +4160,6 @@ void tine::Renderer::cleanup() {
 void tine::Renderer::render(tine::Scene *scene) {
     uint32_t image_idx = 0;
     bool timedout = false;
-    (void)scene;
 
     glfwPollEvents();
 
@@ -1265,9 +4183,15 @@ void tine::Renderer::render(tine::Scene *scene) {
     FrameMarkStart("");
 
     scene->on_render(this);
-
-    if (!render_frame(*m_pimpl, timedout, m_frame % MAX_FRAMES_IN_FLIGHT, image_idx, m_width,
-                      m_height)) {
+    m_pimpl->frame_step = m_engine->get_step_count();
+    m_pimpl->frame_env = scene->get_view_environment();
+    m_pimpl->frame_arena.reset();
+    tine::build_draw_list(scene->get_registry(), scene->get_mesh_data(), get_camera(*scene),
+                          scene->get_view_environment(), m_pimpl->frame_arena,
+                          m_pimpl->draw_list);
+
+    if (!render_frame(*m_pimpl, *scene, timedout, m_frame % MAX_FRAMES_IN_FLIGHT, image_idx,
+                      m_width, m_height)) {
         goto Error;
     }
 
@@ -1285,4 +4209,74 @@ Error:
     m_engine->on_exit();
 }
 
-void tine::Renderer::on_resize() { m_pimpl->swapchain_is_stale = true; }
\ No newline at end of file
+void tine::Renderer::on_resize() { m_pimpl->swapchain_is_stale = true; }
+
+void tine::Renderer::set_depth_prepass(bool enabled) { m_pimpl->depth_prepass = enabled; }
+
+void tine::Renderer::set_occlusion_culling(bool enabled) { m_pimpl->occlusion_culling = enabled; }
+
+void tine::Renderer::set_gpu_profiling(bool enabled, bool pipeline_statistics) {
+    if (enabled && m_pimpl->gpu_queries.empty()) {
+        TINE_WARN("GPU profiling is not supported");
+    }
+    if (enabled && pipeline_statistics && !m_pimpl->supports_pipeline_statistics) {
+        TINE_WARN("Pipeline statistics queries are not supported");
+    }
+    m_pimpl->gpu_profiling = enabled;
+    m_pimpl->gpu_pipeline_statistics = pipeline_statistics;
+}
+
+bool tine::Renderer::set_point_cloud(bool enabled, const PointCloudSettings &settings) {
+    TINE_CHECK(settings.stride > 0 && settings.max_points > 0, "Bad point cloud sampling", Error);
+    TINE_CHECK(settings.min_range <= settings.max_range && settings.noise >= 0.0f &&
+                   settings.dropout >= 0.0f && settings.dropout <= 1.0f,
+               "Bad point cloud settings", Error);
+    m_pimpl->point_cloud = enabled;
+    m_pimpl->point_settings = settings;
+    return true;
+Error:
+    return false;
+}
+
+bool tine::Renderer::get_point_cloud(PointCloud &cloud) const {
+    if (!m_pimpl->has_point_cloud) {
+        return false;
+    }
+    cloud = m_pimpl->points;
+    return true;
+}
+
+bool tine::Renderer::set_capture(FrameCapture *capture) {
+    TINE_CHECK(capture == nullptr || m_pimpl->supports_capture,
+               "Frame capture is not supported by the swapchain", Error);
+    if (capture != m_pimpl->capture) {
+        TINE_CHECK(flush_capture(*m_pimpl), "Failed to flush frame capture", Error);
+    }
+    m_pimpl->capture = capture;
+    return true;
+Error:
+    return false;
+}
+
+bool tine::Renderer::set_shm(const std::string &prefix) {
+    TINE_CHECK(prefix.empty() || m_pimpl->supports_capture,
+               "Publishing images is not supported by the swapchain", Error);
+    if (prefix != m_pimpl->shm_prefix) {
+        // Frames in flight went to the old capture or the old rings
+        TINE_CHECK(flush_capture(*m_pimpl), "Failed to flush frame capture", Error);
+        m_pimpl->shm_color.destroy();
+        m_pimpl->shm_depth.destroy();
+    }
+    m_pimpl->shm_prefix = prefix;
+    return true;
+Error:
+    return false;
+}
+
+bool tine::Renderer::get_gpu_timings(GpuFrameTimings &timings) const {
+    if (!m_pimpl->has_gpu_timings) {
+        return false;
+    }
+    timings = m_pimpl->gpu_timings;
+    return true;
+}
\ No newline at end of file
@@ -1,12 +1,63 @@
 #pragma once
 
+#include <cstdint>
 #include <memory>
+#include <string>
+#include <vector>
 
 namespace tine {
 
 class Engine;
+class FrameCapture;
 class Scene;
 
+// GPU cost of one kind of pass in a frame, summed if the frame ran it more than once
+struct GpuPassTiming {
+    const char *name; // Static string
+    double milliseconds;
+    // Pipeline statistics, zero unless enabled and supported
+    uint64_t input_vertices;
+    uint64_t vertex_invocations;
+    uint64_t clipped_primitives;
+    uint64_t fragment_invocations;
+    uint64_t compute_invocations;
+};
+
+struct GpuFrameTimings {
+    uint64_t frame;      // Counts the frames recorded while profiling
+    double milliseconds; // From the start of the first pass to the end of the last
+    std::vector<GpuPassTiming> passes; // In the order the frame first ran them
+};
+
+// Frame the points of a PointCloud are in
+enum class PointFrame : uint32_t {
+    CAMERA, // View space of the camera, looking down -z
+    WORLD,
+    ENTITY, // Of an entity's TransformComponent, such as a robot's base
+};
+
+struct PointCloudSettings {
+    PointFrame frame = PointFrame::CAMERA;
+    uint32_t entity = 0;            // entt::entity of the ENTITY frame
+    uint32_t stride = 1;            // Samples every stride-th depth texel in both directions
+    uint32_t max_points = 1u << 20; // Found points past this are lost
+    float min_range = 0.0f;         // Meters from the camera
+    float max_range = 100.0f;
+    float noise = 0.0f;   // Standard deviation of the range, in meters
+    float dropout = 0.0f; // Chance of losing a point
+};
+
+struct CloudPoint {
+    float position[3];
+    float range;
+};
+
+struct PointCloud {
+    uint64_t frame; // Counts the frames rendered with point clouds on
+    uint32_t found; // Can exceed points.size() once max_points is hit
+    std::vector<CloudPoint> points;
+};
+
 class Renderer {
   public:
     struct Pimpl;
@@ -15,12 +66,36 @@ class Renderer {
     ~Renderer();
     Renderer(const Renderer &) = delete;
     void render(Scene *scene);
+    bool upload_scene(Scene *scene);
     bool init(int width, int height);
     void cleanup();
     void get_extents(int &w, int &h) { w = m_width; h = m_height; }
     tine::Engine *get_engine() const { return m_engine; }
 
     void on_resize();
+    // Lays down depth before shading, pays off when overdraw is high
+    void set_depth_prepass(bool enabled);
+    // Two phase Hi-Z occlusion culling, needs GPU culling support
+    void set_occlusion_culling(bool enabled);
+    // Timestamps around every pass, optionally with pipeline statistics.  Results come back
+    // without stalling once the frame's command buffer is reused, a few frames later.
+    void set_gpu_profiling(bool enabled, bool pipeline_statistics = false);
+    // The newest frame whose results came back, false if there's none yet
+    bool get_gpu_timings(GpuFrameTimings &timings) const;
+    // Unprojects the depth of every frame into a point cloud on the GPU.  The primary camera is
+    // the sensor, its points come back a few frames later without stalling.
+    bool set_point_cloud(bool enabled, const PointCloudSettings &settings = PointCloudSettings());
+    // The newest frame whose points came back, false if there's none yet
+    bool get_point_cloud(PointCloud &cloud) const;
+    // Hands every presented frame to capture once the GPU is done with it, without the UI, which
+    // isn't drawn while capturing.  nullptr stops.  Frames still in flight go to the old capture,
+    // which must stay open until it's replaced.
+    bool set_capture(FrameCapture *capture);
+    // Publishes every presented frame, without the UI, to the shared memory ring
+    // /<prefix>_color and with the point cloud on its points to /<prefix>_depth, see ShmReader.
+    // Both show the scene's view environment only.  A ring is replaced under the same name when
+    // the window grows or max_points does.  An empty prefix stops.
+    bool set_shm(const std::string &prefix);
 
   private:
     tine::Engine *m_engine = nullptr;
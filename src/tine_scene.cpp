@@ -1,46 +1,133 @@
 #include "tine_log.h"
 #include "tine_scene.h"
 #include "tine_component.h"
+#include "tine_mesh.h"
+#include "tine_animation.h"
+#include "tine_collision.h"
+#include "tine_physics.h"
+#include "tine_query.h"
+#include "tine_material.h"
+#include "tine_arena.h"
+#include "tine_snapshot.h"
+#include <algorithm>
+#include <limits>
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
+#include <assimp/postprocess.h>
+#include <glm/gtc/type_ptr.hpp>
+#include <tracy/Tracy.hpp>
 
 struct tine::Scene::Pimpl {
     entt::registry m_registry;
-    entt::entity m_primary_camera;
+    entt::entity m_primary_camera = entt::null;
+    tine::MeshData m_mesh_data;
+    tine::AnimationData m_animation_data;
+    tine::MaterialData m_material_data;
+    tine::CollisionData m_collision_data;
+    tine::PhysicsWorld m_physics;
+    // Rebuilt on demand once an update has moved things
+    std::shared_ptr<tine::QuerySnapshot> m_query_snapshot;
+    bool m_is_query_snapshot_stale = true;
+    // Simulation temporaries, reset at the start of every update
+    tine::LinearArena m_frame_arena;
+    tine::JobSystem *m_jobs = nullptr;
+    std::vector<entt::entity> m_env_cameras; // Primary camera of each environment
+    std::vector<entt::entity> m_env_entities; // [env][entity], clones share the template's slot
+    uint32_t m_view_env = 0;
 };
 
 tine::Scene::Scene() : m_pimpl(new Pimpl) {}
 tine::Scene::~Scene() {}
 
-void tine::Scene::on_update(tine::Renderer *) {}
+entt::registry &tine::Scene::get_registry() { return m_pimpl->m_registry; }
+
+entt::entity tine::Scene::get_primary_camera() const {
+    return m_pimpl->m_env_cameras.empty() ? m_pimpl->m_primary_camera
+                                          : m_pimpl->m_env_cameras[m_pimpl->m_view_env];
+}
+
+const tine::MeshData &tine::Scene::get_mesh_data() const { return m_pimpl->m_mesh_data; }
+
+const tine::AnimationData &tine::Scene::get_animation_data() const {
+    return m_pimpl->m_animation_data;
+}
+
+const tine::MaterialData &tine::Scene::get_material_data() const {
+    return m_pimpl->m_material_data;
+}
+
+const tine::CollisionData &tine::Scene::get_collision_data() const {
+    return m_pimpl->m_collision_data;
+}
+
+tine::PhysicsWorld &tine::Scene::get_physics_world() { return m_pimpl->m_physics; }
+
+std::shared_ptr<const tine::QuerySnapshot> tine::Scene::get_query_snapshot() {
+    Pimpl &p = *m_pimpl;
+    if (p.m_query_snapshot && !p.m_is_query_snapshot_stale) {
+        return p.m_query_snapshot;
+    }
+    // Threads still querying the last snapshot keep it, otherwise its memory is reused
+    if (!p.m_query_snapshot || p.m_query_snapshot.use_count() > 1) {
+        p.m_query_snapshot = std::make_shared<tine::QuerySnapshot>();
+    }
+    p.m_query_snapshot->build(p.m_collision_data, p.m_registry);
+    p.m_is_query_snapshot_stale = false;
+    return p.m_query_snapshot;
+}
+
+void tine::Scene::on_update(tine::Renderer *, double dt) {
+    m_pimpl->m_frame_arena.reset();
+    tine::sample_animations(m_pimpl->m_animation_data, m_pimpl->m_registry,
+                            static_cast<float>(dt), m_pimpl->m_frame_arena, m_pimpl->m_jobs);
+    m_pimpl->m_physics.step(m_pimpl->m_collision_data, m_pimpl->m_registry,
+                            static_cast<float>(dt), m_pimpl->m_jobs);
+    m_pimpl->m_is_query_snapshot_stale = true;
+}
 
 void tine::Scene::on_render(tine::Renderer *) {}
 
+void tine::Scene::save_snapshot(tine::RegistrySnapshot &snapshot) {
+    snapshot.capture(m_pimpl->m_registry);
+}
+
+bool tine::Scene::restore_snapshot(tine::RegistrySnapshot &snapshot) {
+    // Cached contacts belong to the poses being replaced
+    m_pimpl->m_physics.clear();
+    m_pimpl->m_is_query_snapshot_stale = true;
+    return snapshot.restore(m_pimpl->m_registry);
+}
+
 glm::vec3 convert_to_glm(const aiVector3D &v) { return glm::vec3(v.x, v.y, v.z); }
 
+glm::quat convert_to_glm(const aiQuaternion &q) { return glm::quat(q.w, q.x, q.y, q.z); }
+
+// assimp matrices are row major
+glm::mat4 convert_to_glm(const aiMatrix4x4 &m) { return glm::transpose(glm::make_mat4(&m.a1)); }
+
 static bool load_cameras(tine::Scene::Pimpl &scene, aiCamera **cameras, unsigned int camera_cnt) {
     entt::registry &registry = scene.m_registry;
     for (unsigned int i = 0; i < camera_cnt; i++) {
         aiCamera &imported_camera = *cameras[i];
         entt::entity camera_entity = registry.create();
-        tine::CameraComponent &camera =
-            registry.get_or_emplace<tine::CameraComponent>(scene.m_primary_camera);
+        registry.emplace<tine::EnvironmentComponent>(camera_entity, 0u);
+        tine::CameraComponent &camera = registry.emplace<tine::CameraComponent>(camera_entity);
         if (imported_camera.mOrthographicWidth != 0) {
             TINE_ERROR("Ortho camera not supported");
             goto Error;
         } else {
             camera.set_perspective(imported_camera.mHorizontalFOV, imported_camera.mAspect,
-                                   imported_camera.mClipPlaneNear, imported_camera.mClipPlaneNear);
+                                   imported_camera.mClipPlaneNear, imported_camera.mClipPlaneFar);
             camera.look_at(convert_to_glm(imported_camera.mPosition), convert_to_glm(imported_camera.mLookAt), convert_to_glm(imported_camera.mUp));
         }
-        if (scene.m_primary_camera == entt::entity{}) {
+        if (scene.m_primary_camera == entt::null) {
             scene.m_primary_camera = camera_entity;
         }
     }
-    if (scene.m_primary_camera == entt::entity{}) {
+    if (scene.m_primary_camera == entt::null) {
         entt::entity camera_entity = registry.create();
-        tine::CameraComponent &camera =
-            registry.get_or_emplace<tine::CameraComponent>(scene.m_primary_camera);
+        registry.emplace<tine::EnvironmentComponent>(camera_entity, 0u);
+        tine::CameraComponent &camera = registry.emplace<tine::CameraComponent>(camera_entity);
         camera.look_at({0.0f, 0.0f, -5.0f}, {0.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f});
         camera.set_perspective(90, 16.0f / 4.0f, 0.1f, 100.0f);
         scene.m_primary_camera = camera_entity;
@@ -50,19 +137,507 @@ Error:
     return false;
 }
 
-static bool load_meshes(tine::Scene::Pimpl &scene, aiMesh **meshes, uint32_t mesh_cnt) {
-    entt::registry &registry = scene.m_registry;
+static bool load_nodes(tine::Scene::Pimpl &scene, const aiNode *root,
+                       std::vector<const aiNode *> &flattened) {
+    tine::NodeHierarchy &nodes = scene.m_animation_data.nodes;
+    std::vector<std::pair<const aiNode *, int32_t>> stack;
+
+    TINE_CHECK(root != nullptr, "Scene has no root node", Error);
+
+    // Depth first, so parents are always flattened before their children
+    stack.push_back(std::make_pair(root, -1));
+    while (!stack.empty()) {
+        const aiNode *node = stack.back().first;
+        const int32_t parent = stack.back().second;
+        const int32_t index = static_cast<int32_t>(flattened.size());
+        const glm::mat4 local = convert_to_glm(node->mTransformation);
+        stack.pop_back();
+
+        flattened.push_back(node);
+        nodes.names.push_back(node->mName.C_Str());
+        nodes.parents.push_back(parent);
+        nodes.local_transforms.push_back(local);
+        nodes.global_transforms.push_back(parent >= 0 ? nodes.global_transforms[parent] * local
+                                                      : local);
+        for (unsigned int c = node->mNumChildren; c > 0; c--) {
+            stack.push_back(std::make_pair(node->mChildren[c - 1], index));
+        }
+    }
+    return true;
+Error:
+    return false;
+}
+
+static bool load_skin(tine::Scene::Pimpl &scene, const aiMesh &mesh, uint32_t mesh_idx) {
+    tine::AnimationData &anim = scene.m_animation_data;
+    const tine::NodeHierarchy &nodes = anim.nodes;
+    tine::Skin skin;
+    std::vector<int32_t> skeleton_idx(nodes.names.size(), -1);
+    std::vector<int32_t> bone_nodes(mesh.mNumBones, -1);
+
+    skin.mesh = mesh_idx;
+    skin.skin_vertex_offset = static_cast<uint32_t>(anim.skin_vertices.size());
+    anim.skin_vertices.resize(anim.skin_vertices.size() + mesh.mNumVertices,
+                              tine::SkinVertex{glm::uvec4(0), glm::vec4(0.0f)});
+
+    // Collect the joints and every ancestor needed to pose them
+    for (unsigned int b = 0; b < mesh.mNumBones; b++) {
+        int32_t node = nodes.find(mesh.mBones[b]->mName.C_Str());
+        TINE_CHECK(node >= 0, "Bone is not part of the node hierarchy", Error);
+        bone_nodes[b] = node;
+        for (; node >= 0 && skeleton_idx[node] < 0; node = nodes.parents[node]) {
+            skeleton_idx[node] = 0;
+        }
+    }
+    for (size_t n = 0; n < skeleton_idx.size(); n++) {
+        if (skeleton_idx[n] < 0) {
+            continue;
+        }
+        skeleton_idx[n] = static_cast<int32_t>(skin.nodes.size());
+        skin.nodes.push_back(static_cast<uint32_t>(n));
+        skin.parents.push_back(nodes.parents[n] >= 0 ? skeleton_idx[nodes.parents[n]] : -1);
+    }
+
+    for (unsigned int b = 0; b < mesh.mNumBones; b++) {
+        const aiBone &bone = *mesh.mBones[b];
+        skin.joints.push_back(static_cast<uint32_t>(skeleton_idx[bone_nodes[b]]));
+        skin.inverse_bind_matrices.push_back(convert_to_glm(bone.mOffsetMatrix));
+        for (unsigned int w = 0; w < bone.mNumWeights; w++) {
+            tine::SkinVertex &sv = anim.skin_vertices[skin.skin_vertex_offset + bone.mWeights[w].mVertexId];
+            // Keep the four strongest influences
+            int slot = 0;
+            for (int s = 1; s < 4; s++) {
+                if (sv.weights[s] < sv.weights[slot]) {
+                    slot = s;
+                }
+            }
+            if (bone.mWeights[w].mWeight > sv.weights[slot]) {
+                sv.joints[slot] = b;
+                sv.weights[slot] = bone.mWeights[w].mWeight;
+            }
+        }
+    }
+
+    for (unsigned int v = 0; v < mesh.mNumVertices; v++) {
+        tine::SkinVertex &sv = anim.skin_vertices[skin.skin_vertex_offset + v];
+        const float total = sv.weights.x + sv.weights.y + sv.weights.z + sv.weights.w;
+        if (total > 0.0f) {
+            sv.weights /= total;
+        }
+    }
+
+    anim.skins.push_back(skin);
+    return true;
+Error:
+    return false;
+}
+
+// Reorders the triangles for the post transform cache and overdraw, then the vertices for fetch
+// locality, dropping any that aren't referenced.  skin is the mesh's skin or -1.
+static void optimize_mesh(tine::Scene::Pimpl &scene, tine::Mesh &m, int32_t skin,
+                          std::vector<uint32_t> &remap) {
+    tine::MeshData &data = scene.m_mesh_data;
+    uint32_t *indices = data.indices.data() + m.index_offset;
+    tine::Vertex *vertices = data.vertices.data() + m.vertex_offset;
+    size_t vertex_cnt = 0;
+
+    tine::optimize_vertex_cache(indices, m.index_count, m.vertex_count);
+    tine::optimize_overdraw(indices, m.index_count, vertices, m.vertex_count);
+    vertex_cnt = tine::optimize_vertex_fetch(indices, m.index_count, m.vertex_count, remap);
+
+    tine::remap_vertices(vertices, m.vertex_count, remap);
+    data.vertices.resize(m.vertex_offset + vertex_cnt);
+    if (skin >= 0) {
+        tine::AnimationData &anim = scene.m_animation_data;
+        const uint32_t offset = anim.skins[skin].skin_vertex_offset;
+        tine::remap_vertices(anim.skin_vertices.data() + offset, m.vertex_count, remap);
+        anim.skin_vertices.resize(offset + vertex_cnt);
+    }
+    m.vertex_count = static_cast<uint32_t>(vertex_cnt);
+}
+
+static bool load_meshes(tine::Scene::Pimpl &scene, aiMesh **meshes, uint32_t mesh_cnt,
+                        std::vector<int32_t> &mesh_skins) {
+    tine::MeshData &data = scene.m_mesh_data;
+    std::vector<uint32_t> remap;
+    mesh_skins.assign(mesh_cnt, -1);
     for (unsigned int i = 0; i < mesh_cnt; i++) {
         aiMesh &mesh = *meshes[i];
-        // Preprocess all the meshes, find out the size needed for the vertex, index, texture coordinate, and transform buffers
-        // Then add the mesh as an entity component
+        tine::Mesh m = {};
+        m.vertex_offset = static_cast<uint32_t>(data.vertices.size());
+        m.vertex_count = mesh.mNumVertices;
+        m.index_offset = static_cast<uint32_t>(data.indices.size());
+        m.aabb_min = glm::vec3(std::numeric_limits<float>::max());
+        m.aabb_max = glm::vec3(-std::numeric_limits<float>::max());
+
+        for (unsigned int v = 0; v < mesh.mNumVertices; v++) {
+            tine::Vertex vertex = {};
+            vertex.position = convert_to_glm(mesh.mVertices[v]);
+            if (mesh.HasNormals()) {
+                vertex.normal = convert_to_glm(mesh.mNormals[v]);
+            }
+            if (mesh.HasTextureCoords(0)) {
+                vertex.uv = glm::vec2(mesh.mTextureCoords[0][v].x, mesh.mTextureCoords[0][v].y);
+            }
+            data.vertices.push_back(vertex);
+        }
+        for (unsigned int f = 0; f < mesh.mNumFaces; f++) {
+            const aiFace &face = mesh.mFaces[f];
+            // Points and lines aren't rendered
+            if (face.mNumIndices != 3) {
+                continue;
+            }
+            data.indices.insert(data.indices.end(), face.mIndices, face.mIndices + 3);
+        }
+        m.index_count = static_cast<uint32_t>(data.indices.size()) - m.index_offset;
+
+        if (mesh.HasBones()) {
+            mesh_skins[i] = static_cast<int32_t>(scene.m_animation_data.skins.size());
+            TINE_CHECK(load_skin(scene, mesh, i), "Failed to load skin", Error);
+        }
+
+        optimize_mesh(scene, m, mesh_skins[i], remap);
+        for (uint32_t v = m.vertex_offset; v < m.vertex_offset + m.vertex_count; v++) {
+            m.aabb_min = glm::min(m.aabb_min, data.vertices[v].position);
+            m.aabb_max = glm::max(m.aabb_max, data.vertices[v].position);
+        }
+        // Bind pose hulls for skinned meshes too, so hull indices match the imported meshes
+        tine::build_convex_hull(scene.m_collision_data, &data.vertices[m.vertex_offset],
+                                m.vertex_count);
+        tine::build_mesh_lods(data, m);
+        // Skinned instances move their vertices away from the clusters' bounds
+        if (mesh_skins[i] < 0) {
+            tine::build_mesh_meshlets(data, m);
+        }
+        data.meshes.push_back(m);
+    }
+    return true;
+Error:
+    return false;
+}
+
+static bool load_animations(tine::Scene::Pimpl &scene, aiAnimation **animations,
+                            unsigned int animation_cnt) {
+    tine::AnimationData &anim = scene.m_animation_data;
+    for (unsigned int a = 0; a < animation_cnt; a++) {
+        const aiAnimation &imported = *animations[a];
+        const double ticks_per_second =
+            imported.mTicksPerSecond != 0.0 ? imported.mTicksPerSecond : 25.0;
+        tine::AnimationClip clip;
+        clip.name = imported.mName.C_Str();
+        clip.duration = static_cast<float>(imported.mDuration / ticks_per_second);
+        for (unsigned int c = 0; c < imported.mNumChannels; c++) {
+            const aiNodeAnim &imported_channel = *imported.mChannels[c];
+            const int32_t node = anim.nodes.find(imported_channel.mNodeName.C_Str());
+            tine::AnimationChannel channel;
+            if (node < 0) {
+                TINE_WARN("Animation {0} targets unknown node {1}", clip.name,
+                          imported_channel.mNodeName.C_Str());
+                continue;
+            }
+            channel.node = static_cast<uint32_t>(node);
+            for (unsigned int k = 0; k < imported_channel.mNumPositionKeys; k++) {
+                const aiVectorKey &key = imported_channel.mPositionKeys[k];
+                channel.position_times.push_back(static_cast<float>(key.mTime / ticks_per_second));
+                channel.positions.push_back(convert_to_glm(key.mValue));
+            }
+            for (unsigned int k = 0; k < imported_channel.mNumRotationKeys; k++) {
+                const aiQuatKey &key = imported_channel.mRotationKeys[k];
+                channel.rotation_times.push_back(static_cast<float>(key.mTime / ticks_per_second));
+                channel.rotations.push_back(convert_to_glm(key.mValue));
+            }
+            for (unsigned int k = 0; k < imported_channel.mNumScalingKeys; k++) {
+                const aiVectorKey &key = imported_channel.mScalingKeys[k];
+                channel.scale_times.push_back(static_cast<float>(key.mTime / ticks_per_second));
+                channel.scales.push_back(convert_to_glm(key.mValue));
+            }
+            clip.channels.push_back(channel);
+        }
+        anim.clips.push_back(clip);
+    }
+
+    // Resolve which channel drives each skeleton node, so sampling doesn't search by name
+    for (tine::Skin &skin : anim.skins) {
+        skin.clip_channels.resize(anim.clips.size());
+        for (size_t c = 0; c < anim.clips.size(); c++) {
+            std::vector<int32_t> &channels = skin.clip_channels[c];
+            channels.assign(skin.nodes.size(), -1);
+            for (size_t ch = 0; ch < anim.clips[c].channels.size(); ch++) {
+                const uint32_t node = anim.clips[c].channels[ch].node;
+                std::vector<uint32_t>::const_iterator it =
+                    std::find(skin.nodes.begin(), skin.nodes.end(), node);
+                if (it != skin.nodes.end()) {
+                    channels[it - skin.nodes.begin()] = static_cast<int32_t>(ch);
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// Embedded textures are referenced as "*N" into aiScene::mTextures, or by their file name in
+// binary glTF.  Everything else is a path relative to the scene file in dir.
+static tine::TextureSource get_texture_source(const aiScene &i_scene, const char *ref,
+                                              const std::string &dir) {
+    tine::TextureSource source;
+    const aiTexture *texture = i_scene.GetEmbeddedTexture(ref);
+    if (texture == nullptr) {
+        source.path = dir + ref;
+        return source;
     }
+    source.path = ref;
+    if (texture->mHeight == 0) {
+        // A whole image file of mWidth bytes
+        const uint8_t *file = reinterpret_cast<const uint8_t *>(texture->pcData);
+        source.data.assign(file, file + texture->mWidth);
+        return source;
+    }
+    source.width = texture->mWidth;
+    source.height = texture->mHeight;
+    source.data.resize(static_cast<size_t>(source.width) * source.height * 4);
+    for (size_t i = 0; i < static_cast<size_t>(source.width) * source.height; i++) {
+        const aiTexel &texel = texture->pcData[i];
+        source.data[i * 4 + 0] = texel.r;
+        source.data[i * 4 + 1] = texel.g;
+        source.data[i * 4 + 2] = texel.b;
+        source.data[i * 4 + 3] = texel.a;
+    }
+    return source;
+}
+
+// Materials whose texture can't be loaded, PNG or JPEG say, are left untextured with a warning
+static bool load_materials(tine::Scene::Pimpl &scene, const aiScene &i_scene,
+                           const std::string &dir) {
+    tine::MaterialData &data = scene.m_material_data;
+    TINE_CHECK(data.materials.size() + i_scene.mNumMaterials <= tine::MAX_MATERIALS,
+               "Too many materials", Error);
+    for (unsigned int i = 0; i < i_scene.mNumMaterials; i++) {
+        const aiMaterial &imported = *i_scene.mMaterials[i];
+        tine::Material material = {};
+        aiColor4D color = {1.0f, 1.0f, 1.0f, 1.0f};
+        aiString path;
+
+        if (imported.Get(AI_MATKEY_BASE_COLOR, color) != aiReturn_SUCCESS) {
+            imported.Get(AI_MATKEY_COLOR_DIFFUSE, color);
+        }
+        material.base_color = glm::vec4(color.r, color.g, color.b, color.a);
+        material.base_color_texture = tine::NO_TEXTURE;
+        if ((imported.GetTexture(aiTextureType_BASE_COLOR, 0, &path) == aiReturn_SUCCESS) ||
+            (imported.GetTexture(aiTextureType_DIFFUSE, 0, &path) == aiReturn_SUCCESS)) {
+            tine::TextureSource source = get_texture_source(i_scene, path.C_Str(), dir);
+            for (size_t t = 0; t < data.textures.size(); t++) {
+                if (data.textures[t].path == source.path) {
+                    material.base_color_texture = static_cast<uint32_t>(t);
+                    break;
+                }
+            }
+            if (material.base_color_texture != tine::NO_TEXTURE) {
+                // Shared with an earlier material
+            } else if (tine::is_texture_supported(source)) {
+                material.base_color_texture = static_cast<uint32_t>(data.textures.size());
+                data.textures.push_back(std::move(source));
+            } else {
+                TINE_WARN("Material {0} left untextured, {1} is not a KTX2 texture", i,
+                          path.C_Str());
+            }
+        }
+        data.materials.push_back(material);
+    }
+
+    // Everything indexes the material buffer, so there is always at least one
+    if (data.materials.empty()) {
+        tine::Material material = {};
+        material.base_color = glm::vec4(1.0f);
+        material.base_color_texture = tine::NO_TEXTURE;
+        data.materials.push_back(material);
+    }
+    return true;
+Error:
     return false;
 }
 
-bool tine::Scene::load_from_file(std::unique_ptr<tine::Scene> &scene, const std::string &fname) {
+// Skinned instances get their own copy of the bind pose vertices for the skinning pass to write.
+static uint32_t add_skinned_instance(tine::Scene::Pimpl &scene, entt::entity entity,
+                                     uint32_t mesh_idx, uint32_t skin_idx, uint32_t node) {
+    tine::MeshData &data = scene.m_mesh_data;
+    tine::AnimationData &anim = scene.m_animation_data;
+    tine::Mesh instance = data.meshes[mesh_idx];
+    tine::SkinComponent skin = {};
+    tine::AnimationComponent animation = {};
+
+    instance.vertex_offset = static_cast<uint32_t>(data.vertices.size());
+    data.vertices.resize(data.vertices.size() + instance.vertex_count);
+    std::copy(data.vertices.begin() + data.meshes[mesh_idx].vertex_offset,
+              data.vertices.begin() + data.meshes[mesh_idx].vertex_offset + instance.vertex_count,
+              data.vertices.begin() + instance.vertex_offset);
+    // Poses can leave the bind pose bounds, and the instance is both culled and quantized against
+    // them.  Use a cube that holds the bind pose under any rotation about its center, with slack.
+    {
+        const glm::vec3 center = 0.5f * (instance.aabb_min + instance.aabb_max);
+        const float radius = 0.75f * glm::length(instance.aabb_max - instance.aabb_min);
+        instance.aabb_min = center - glm::vec3(radius);
+        instance.aabb_max = center + glm::vec3(radius);
+    }
+    data.meshes.push_back(instance);
+
+    skin.skin = skin_idx;
+    skin.palette_offset = static_cast<uint32_t>(anim.joint_palette.size());
+    skin.inverse_mesh_transform = glm::inverse(anim.nodes.global_transforms[node]);
+    anim.joint_palette.resize(anim.joint_palette.size() + anim.skins[skin_idx].joints.size(),
+                              glm::mat4(1.0f));
+    scene.m_registry.emplace<tine::SkinComponent>(entity, skin);
+
+    animation.clip = anim.clips.empty() ? UINT32_MAX : 0;
+    animation.speed = 1.0f;
+    scene.m_registry.emplace<tine::AnimationComponent>(entity, animation);
+
+    return static_cast<uint32_t>(data.meshes.size() - 1);
+}
+
+static bool load_entities(tine::Scene::Pimpl &scene, const std::vector<const aiNode *> &flattened,
+                          aiMesh **meshes, const std::vector<int32_t> &mesh_skins) {
+    entt::registry &registry = scene.m_registry;
+    for (size_t n = 0; n < flattened.size(); n++) {
+        const aiNode &node = *flattened[n];
+        for (unsigned int m = 0; m < node.mNumMeshes; m++) {
+            const uint32_t mesh_idx = node.mMeshes[m];
+            entt::entity entity = registry.create();
+            registry.emplace<tine::EnvironmentComponent>(entity, 0u);
+            tine::TransformComponent transform = {scene.m_animation_data.nodes.global_transforms[n]};
+            tine::MeshComponent mesh = {mesh_idx};
+            tine::MaterialComponent material = {};
+            TINE_CHECK(mesh_idx < mesh_skins.size(), "Node references unknown mesh", Error);
+            material.material = meshes[mesh_idx]->mMaterialIndex;
+            if (mesh_skins[mesh_idx] >= 0) {
+                mesh.mesh = add_skinned_instance(scene, entity, mesh_idx,
+                                                 static_cast<uint32_t>(mesh_skins[mesh_idx]),
+                                                 static_cast<uint32_t>(n));
+            }
+            registry.emplace<tine::TransformComponent>(entity, transform);
+            registry.emplace<tine::MeshComponent>(entity, mesh);
+            registry.emplace<tine::MaterialComponent>(entity, material);
+            // Posed skinned instances would leave their bind pose hull behind
+            if (mesh_skins[mesh_idx] < 0) {
+                registry.emplace<tine::ColliderComponent>(entity, mesh_idx);
+            }
+        }
+    }
+    return true;
+Error:
+    return false;
+}
+
+// Skinned instances write their own vertices, so every clone needs its own copy of them and of
+// the joint palette.  Unlike add_skinned_instance the source is already an instance.
+static void clone_skinned_instance(tine::Scene::Pimpl &scene, entt::entity entity) {
+    tine::MeshData &data = scene.m_mesh_data;
+    tine::AnimationData &anim = scene.m_animation_data;
+    tine::MeshComponent &mesh = scene.m_registry.get<tine::MeshComponent>(entity);
+    tine::SkinComponent &skin = scene.m_registry.get<tine::SkinComponent>(entity);
+    tine::Mesh instance = data.meshes[mesh.mesh];
+
+    instance.vertex_offset = static_cast<uint32_t>(data.vertices.size());
+    data.vertices.resize(data.vertices.size() + instance.vertex_count);
+    std::copy(data.vertices.begin() + data.meshes[mesh.mesh].vertex_offset,
+              data.vertices.begin() + data.meshes[mesh.mesh].vertex_offset + instance.vertex_count,
+              data.vertices.begin() + instance.vertex_offset);
+    data.meshes.push_back(instance);
+    mesh.mesh = static_cast<uint32_t>(data.meshes.size() - 1);
+
+    skin.palette_offset = static_cast<uint32_t>(anim.joint_palette.size());
+    anim.joint_palette.resize(anim.joint_palette.size() + anim.skins[skin.skin].joints.size(),
+                              glm::mat4(1.0f));
+}
+
+template <typename Component>
+static void clone_component(entt::registry &registry, entt::entity src, entt::entity dst) {
+    const Component *component = registry.try_get<Component>(src);
+    if (component != nullptr) {
+        registry.emplace<Component>(dst, *component);
+    }
+}
+
+template <typename... Components>
+static void clone_entity(entt::registry &registry, entt::entity src, entt::entity dst) {
+    (clone_component<Components>(registry, src, dst), ...);
+}
+
+bool tine::Scene::create_environments(uint32_t count) {
+    ZoneScoped;
+    Pimpl &p = *m_pimpl;
+    entt::registry &registry = p.m_registry;
+    std::vector<entt::entity> templates;
+
+    TINE_CHECK(count > 0, "Need at least one environment", Error);
+    TINE_CHECK(p.m_env_entities.empty(), "Environments were already created", Error);
+    {
+        auto view = registry.view<const tine::EnvironmentComponent>();
+        for (entt::entity entity : view) {
+            templates.push_back(entity);
+        }
+    }
+    // Clones follow their template in creation order, not pool iteration order
+    std::sort(templates.begin(), templates.end());
+
+    p.m_env_cameras.assign(1, p.m_primary_camera);
+    p.m_env_cameras.reserve(count);
+    p.m_env_entities.reserve(count * templates.size());
+    p.m_env_entities.insert(p.m_env_entities.end(), templates.begin(), templates.end());
+    for (uint32_t env = 1; env < count; env++) {
+        entt::entity camera = entt::null;
+        for (entt::entity src : templates) {
+            const entt::entity dst = registry.create();
+            p.m_env_entities.push_back(dst);
+            clone_entity<SIMULATION_COMPONENTS>(registry, src, dst);
+            registry.get<tine::EnvironmentComponent>(dst).env = env;
+            if (registry.all_of<tine::SkinComponent>(dst)) {
+                clone_skinned_instance(p, dst);
+            }
+            if (src == p.m_primary_camera) {
+                camera = dst;
+            }
+        }
+        p.m_env_cameras.push_back(camera);
+    }
+    p.m_is_query_snapshot_stale = true;
+    TINE_INFO("Created {0} environments of {1} entities", count, templates.size());
+    return true;
+Error:
+    return false;
+}
+
+uint32_t tine::Scene::get_environment_count() const {
+    return std::max<uint32_t>(1, static_cast<uint32_t>(m_pimpl->m_env_cameras.size()));
+}
+
+entt::entity tine::Scene::get_environment_camera(uint32_t env) const {
+    if (m_pimpl->m_env_cameras.empty()) {
+        return (env == 0) ? m_pimpl->m_primary_camera : entt::null;
+    }
+    return (env < m_pimpl->m_env_cameras.size()) ? m_pimpl->m_env_cameras[env] : entt::null;
+}
+
+const std::vector<entt::entity> &tine::Scene::get_environment_entities() const {
+    return m_pimpl->m_env_entities;
+}
+
+void tine::Scene::set_view_environment(uint32_t env) {
+    if (env < get_environment_count()) {
+        m_pimpl->m_view_env = env;
+    } else {
+        TINE_WARN("No environment {0}", env);
+    }
+}
+
+uint32_t tine::Scene::get_view_environment() const { return m_pimpl->m_view_env; }
+
+bool tine::Scene::load_from_file(std::unique_ptr<tine::Scene> &scene, const std::string &fname,
+                                 tine::JobSystem *jobs) {
     ::Assimp::Importer importer;
     const aiScene *i_scene = nullptr;
+    std::vector<const aiNode *> flattened;
+    std::vector<int32_t> mesh_skins;
+    const std::string dir = fname.substr(0, fname.find_last_of("/\\") + 1);
 
     TINE_TRACE("Loading scene {0}", fname);
 
@@ -71,17 +646,32 @@ bool tine::Scene::load_from_file(std::unique_ptr<tine::Scene> &scene, const std:
     if (!scene) {
         goto Error;
     }
+    scene->m_pimpl->m_jobs = jobs;
 
     // TODO: Put this in an asynchronous task...
     // TODO: figure out how to cache the same textures, etc
-    i_scene = importer.ReadFile(fname, 0);
+    // Mesh optimization and quantization happen in load_meshes and the renderer, but they need
+    // shared vertices and triangles to work with
+    i_scene = importer.ReadFile(fname, aiProcess_Triangulate | aiProcess_JoinIdenticalVertices |
+                                           aiProcess_GenSmoothNormals | aiProcess_LimitBoneWeights |
+                                           aiProcess_SortByPType | aiProcess_FindDegenerates |
+                                           aiProcess_FindInvalidData |
+                                           aiProcess_RemoveRedundantMaterials |
+                                           aiProcess_ValidateDataStructure);
     TINE_CHECK(i_scene != nullptr, "Failed to load file", Error);
 
     TINE_CHECK(load_cameras(*scene->m_pimpl, i_scene->mCameras, i_scene->mNumCameras), "Failed to load cameras", Error);
-    TINE_CHECK(load_meshes(*scene->m_pimpl, i_scene->mMeshes, i_scene->mNumMeshes), "Failed to load meshes", Error);
+    TINE_CHECK(load_nodes(*scene->m_pimpl, i_scene->mRootNode, flattened), "Failed to load nodes", Error);
+    TINE_CHECK(load_meshes(*scene->m_pimpl, i_scene->mMeshes, i_scene->mNumMeshes, mesh_skins), "Failed to load meshes", Error);
+    TINE_CHECK(load_materials(*scene->m_pimpl, *i_scene, dir), "Failed to load materials", Error);
+    TINE_CHECK(load_animations(*scene->m_pimpl, i_scene->mAnimations, i_scene->mNumAnimations), "Failed to load animations", Error);
+    TINE_CHECK(load_entities(*scene->m_pimpl, flattened, i_scene->mMeshes, mesh_skins), "Failed to load entities", Error);
     //TINE_CHECK(load_textures(*scene->m_pimpl, i_scene->mTextures, i_scene->mNumTextures), "Failed to load textures", Error);
     //TINE_CHECK(load_lights(*scene->m_pimpl, i_scene->mLights, i_scene->mNumLights), "Failed to load lights", Error);
-    //TINE_CHECK(load_materials(*scene->m_pimpl, i_scene->mMaterials, i_scene->mNumMaterials), "Failed to load materials", Error);
+
+    // Pose the skinned instances before the first frame is rendered
+    tine::sample_animations(scene->m_pimpl->m_animation_data, scene->m_pimpl->m_registry, 0.0f,
+                            scene->m_pimpl->m_frame_arena, jobs);
 
     return true;
 Error:
@@ -89,4 +679,4 @@ Error:
         scene.release();
     }
     return false;
-}
\ No newline at end of file
+}
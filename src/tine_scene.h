@@ -1,12 +1,22 @@
 #pragma once
 
+#include <memory>
 #include <string>
+#include <vector>
 #include <entt/entt.hpp>
 
 namespace tine {
 
 class Engine;
+class JobSystem;
 class Renderer;
+class RegistrySnapshot;
+class PhysicsWorld;
+class QuerySnapshot;
+struct MeshData;
+struct AnimationData;
+struct MaterialData;
+struct CollisionData;
 
 class Scene {
 public:
@@ -15,22 +25,40 @@ public:
     Scene();
     ~Scene();
     entt::registry &get_registry();
-    void on_update(tine::Renderer *renderer);
+    // The camera of the environment being viewed
+    entt::entity get_primary_camera() const;
+    const tine::MeshData &get_mesh_data() const;
+    const tine::AnimationData &get_animation_data() const;
+    const tine::MaterialData &get_material_data() const;
+    const tine::CollisionData &get_collision_data() const;
+    tine::PhysicsWorld &get_physics_world();
+    // Collider placements as of the last update, for ray, sweep and overlap batches from any
+    // thread.  Main thread only, the snapshot itself is safe to share.
+    std::shared_ptr<const tine::QuerySnapshot> get_query_snapshot();
+    void on_update(tine::Renderer *renderer, double dt);
     void on_render(tine::Renderer *renderer);
+    // Turns the loaded entities into environment 0 and clones them into count - 1 more isolated
+    // environments sharing every asset.  The entities of each environment are created together,
+    // so every component pool stores them contiguously.  Call once, before uploading the scene.
+    bool create_environments(uint32_t count);
+    uint32_t get_environment_count() const;
+    entt::entity get_environment_camera(uint32_t env) const;
+    // Every environment's entities in the same order, get_environment_count() equal runs
+    const std::vector<entt::entity> &get_environment_entities() const;
+    // Only this environment is drawn, see build_draw_list
+    void set_view_environment(uint32_t env);
+    uint32_t get_view_environment() const;
+    // Episode resets, GPU resident data stays as uploaded
+    void save_snapshot(tine::RegistrySnapshot &snapshot);
+    bool restore_snapshot(tine::RegistrySnapshot &snapshot);
 
-    static bool load_from_file(std::unique_ptr<tine::Scene> &scene, const std::string &fname);
+    // Simulation fans out over jobs if given, which must outlive the scene
+    static bool load_from_file(std::unique_ptr<tine::Scene> &scene, const std::string &fname,
+                               tine::JobSystem *jobs = nullptr);
 private:
     std::unique_ptr<Pimpl> m_pimpl;
-    // Camera component
-    // TransformComponents
-    // RenderableComponents
     // LightComponents
-    // VertexBuffer
-    // IndexBuffer
-    // Meshes
-    // Materials
-    // Textures
     // Shaders
 };
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,198 @@
+#include "tine_log.h"
+#include "tine_shm.h"
+#include <cstring>
+#include <new>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const uint32_t MAX_SHM_SLOTS = 1024;
+
+static uint64_t get_slot_stride(uint32_t slot_size) {
+    const uint64_t align = alignof(tine::ShmSlotHeader);
+    return (sizeof(tine::ShmSlotHeader) + slot_size + align - 1) / align * align;
+}
+
+tine::ShmWriter::~ShmWriter() {
+    destroy();
+}
+
+bool tine::ShmWriter::create(const std::string &name, uint32_t slot_count, uint32_t slot_size) {
+    const uint64_t stride = get_slot_stride(slot_size);
+    const size_t size = sizeof(ShmRingHeader) + static_cast<size_t>(stride * slot_count);
+    void *base = MAP_FAILED;
+    int fd = -1;
+
+    destroy();
+    TINE_CHECK(slot_count > 0 && slot_count <= MAX_SHM_SLOTS, "Bad shared memory slot count",
+               Error);
+    // A stale object may have another size, start over rather than resize it under its readers
+    shm_unlink(name.c_str());
+    fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    TINE_CHECK(fd >= 0, name, Error);
+    TINE_CHECK(ftruncate(fd, static_cast<off_t>(size)) == 0, name, Error);
+    base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    TINE_CHECK(base != MAP_FAILED, name, Error);
+    close(fd);
+
+    // ftruncate zeroed everything, so every slot starts with sequence 0
+    m_ring = new (base) ShmRingHeader();
+    m_ring->slot_count = slot_count;
+    m_ring->slot_size = slot_size;
+    m_ring->slot_stride = stride;
+    m_ring->version = SHM_VERSION;
+    m_ring->published.store(0, std::memory_order_relaxed);
+    m_size = size;
+    m_name = name;
+    m_next = 0;
+    // Readers take a valid magic to mean the rest of the header is there
+    std::atomic_thread_fence(std::memory_order_release);
+    m_ring->magic = SHM_MAGIC;
+    TINE_INFO("Publishing {0}, {1} slots of {2} bytes", name, slot_count, slot_size);
+    return true;
+Error:
+    if (fd >= 0) {
+        close(fd);
+        shm_unlink(name.c_str());
+    }
+    return false;
+}
+
+void tine::ShmWriter::destroy() {
+    if (m_ring == nullptr) {
+        return;
+    }
+    munmap(m_ring, m_size);
+    // Readers keep their mappings, only new ones fail to open
+    shm_unlink(m_name.c_str());
+    m_ring = nullptr;
+    m_size = 0;
+    m_name.clear();
+}
+
+tine::ShmSlotHeader *tine::ShmWriter::get_slot(uint64_t index) const {
+    uint8_t *slots = reinterpret_cast<uint8_t *>(m_ring + 1);
+    return reinterpret_cast<ShmSlotHeader *>(slots + m_ring->slot_stride *
+                                                         (index % m_ring->slot_count));
+}
+
+void *tine::ShmWriter::begin_frame(const ShmFrameHeader &header) {
+    ShmSlotHeader *slot = nullptr;
+    if (m_ring == nullptr || header.size > m_ring->slot_size) {
+        return nullptr;
+    }
+    slot = get_slot(m_next);
+    slot->sequence.store(2 * m_next + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot->frame = header;
+    return slot + 1;
+}
+
+void tine::ShmWriter::commit_frame() {
+    get_slot(m_next)->sequence.store(2 * m_next + 2, std::memory_order_release);
+    m_next++;
+    m_ring->published.store(m_next, std::memory_order_release);
+}
+
+bool tine::ShmWriter::write_frame(const ShmFrameHeader &header, const void *data) {
+    void *payload = begin_frame(header);
+    if (payload == nullptr) {
+        return false;
+    }
+    std::memcpy(payload, data, header.size);
+    commit_frame();
+    return true;
+}
+
+tine::ShmReader::~ShmReader() {
+    close();
+}
+
+bool tine::ShmReader::open(const std::string &name) {
+    uint32_t magic = 0;
+    uint32_t slot_count = 0;
+    uint64_t stride = 0;
+    struct stat info;
+    void *base = MAP_FAILED;
+    int fd = -1;
+
+    close();
+    fd = shm_open(name.c_str(), O_RDONLY, 0);
+    TINE_CHECK(fd >= 0, name, Error);
+    TINE_CHECK(fstat(fd, &info) == 0, name, Error);
+    TINE_CHECK(static_cast<size_t>(info.st_size) >= sizeof(ShmRingHeader),
+               "Shared memory object too small", Error);
+    base = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    TINE_CHECK(base != MAP_FAILED, name, Error);
+    ::close(fd);
+    fd = -1;
+
+    m_ring = static_cast<const ShmRingHeader *>(base);
+    m_size = static_cast<size_t>(info.st_size);
+    magic = m_ring->magic;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    slot_count = m_ring->slot_count;
+    stride = m_ring->slot_stride;
+    TINE_CHECK(magic == SHM_MAGIC, "Not a tine shared memory ring, or not ready yet", Error);
+    TINE_CHECK(m_ring->version == SHM_VERSION, "Unsupported shared memory version", Error);
+    TINE_CHECK(slot_count > 0 && slot_count <= MAX_SHM_SLOTS &&
+                   stride >= get_slot_stride(m_ring->slot_size) &&
+                   sizeof(ShmRingHeader) + stride * slot_count <= m_size,
+               "Corrupt shared memory header", Error);
+    return true;
+Error:
+    if (fd >= 0) {
+        ::close(fd);
+    }
+    close();
+    return false;
+}
+
+void tine::ShmReader::close() {
+    if (m_ring == nullptr) {
+        return;
+    }
+    munmap(const_cast<ShmRingHeader *>(m_ring), m_size);
+    m_ring = nullptr;
+    m_size = 0;
+}
+
+uint64_t tine::ShmReader::get_published() const {
+    return m_ring != nullptr ? m_ring->published.load(std::memory_order_acquire) : 0;
+}
+
+const tine::ShmSlotHeader *tine::ShmReader::get_slot(uint64_t index) const {
+    const uint8_t *slots = reinterpret_cast<const uint8_t *>(m_ring + 1);
+    return reinterpret_cast<const ShmSlotHeader *>(slots + m_ring->slot_stride *
+                                                               (index % m_ring->slot_count));
+}
+
+bool tine::ShmReader::acquire_latest(ShmFrame &frame) const {
+    const uint64_t published = get_published();
+    return published > 0 && acquire(published - 1, frame);
+}
+
+bool tine::ShmReader::acquire(uint64_t index, ShmFrame &frame) const {
+    const ShmSlotHeader *slot = nullptr;
+    uint64_t sequence = 0;
+    if (m_ring == nullptr || index >= get_published()) {
+        return false;
+    }
+    slot = get_slot(index);
+    sequence = slot->sequence.load(std::memory_order_acquire);
+    if (sequence != 2 * index + 2) {
+        return false;
+    }
+    frame.index = index;
+    std::memcpy(&frame.header, &slot->frame, sizeof(frame.header));
+    frame.data = slot + 1;
+    // A frame whose header was torn would also be caught by is_valid, but its size can't be
+    // trusted for reading the payload
+    return is_valid(frame) && frame.header.size <= m_ring->slot_size;
+}
+
+bool tine::ShmReader::is_valid(const ShmFrame &frame) const {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return get_slot(frame.index)->sequence.load(std::memory_order_relaxed) == 2 * frame.index + 2;
+}
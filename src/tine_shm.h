@@ -0,0 +1,112 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace tine {
+
+// A ring of frames in a POSIX shared memory object, published by one writer and read in place by
+// any number of processes on the same host.  The object starts with a ShmRingHeader followed by
+// slot_count slots of slot_stride bytes, each a ShmSlotHeader and then up to slot_size payload
+// bytes.  Slots carry a sequence number that's odd while the writer fills them, so a reader can
+// tell a frame it's looking at from one being overwritten without any lock.
+static const uint32_t SHM_MAGIC = 0x656e6974; // "tine"
+static const uint32_t SHM_VERSION = 1;
+
+enum class ShmFrameKind : uint32_t {
+    POSES, // [env][pose] column major mat4s, width poses by height environments
+    COLOR, // Rows of width texels in format, the rendered frame without the UI
+    DEPTH, // width CloudPoints of the point cloud, x y z and range as R32G32B32A32_SFLOAT
+};
+
+struct ShmFrameHeader {
+    uint64_t step;
+    ShmFrameKind kind;
+    uint32_t env;
+    uint32_t width;
+    uint32_t height;
+    uint32_t format; // VkFormat of images, 0 for poses
+    uint32_t size;   // Payload bytes
+};
+
+struct alignas(64) ShmRingHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_count;
+    uint32_t slot_size;
+    uint64_t slot_stride;
+    // Frames published so far, frame i lives in slot i % slot_count
+    alignas(64) std::atomic<uint64_t> published;
+};
+
+struct alignas(64) ShmSlotHeader {
+    std::atomic<uint64_t> sequence; // 2 * i + 1 while frame i is written, 2 * i + 2 after
+    ShmFrameHeader frame;
+};
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "Shared atomics must be lock free");
+
+// A published frame as seen by a reader, data points into the mapping
+struct ShmFrame {
+    uint64_t index;
+    ShmFrameHeader header;
+    const void *data;
+};
+
+// Creates the object, replacing any left behind by a writer that crashed, and unlinks it again
+// when destroyed.  Frames are filled in place between begin_frame and commit_frame.
+class ShmWriter {
+  public:
+    ShmWriter() = default;
+    ~ShmWriter();
+    ShmWriter(const ShmWriter &) = delete;
+
+    // name is a POSIX shared memory name such as "/tine_poses"
+    bool create(const std::string &name, uint32_t slot_count, uint32_t slot_size);
+    void destroy();
+
+    // Payload of the next frame, nullptr if header.size doesn't fit a slot
+    void *begin_frame(const ShmFrameHeader &header);
+    void commit_frame();
+    bool write_frame(const ShmFrameHeader &header, const void *data);
+
+    bool is_open() const { return m_ring != nullptr; }
+    uint32_t get_slot_size() const { return m_ring != nullptr ? m_ring->slot_size : 0; }
+
+  private:
+    ShmSlotHeader *get_slot(uint64_t index) const;
+
+    ShmRingHeader *m_ring = nullptr;
+    size_t m_size = 0;
+    std::string m_name;
+    uint64_t m_next = 0;
+};
+
+// Maps a writer's object read only.  Frames are read straight from the mapping, a reader that
+// can't keep up just finds the frames it asks for overwritten.
+class ShmReader {
+  public:
+    ShmReader() = default;
+    ~ShmReader();
+    ShmReader(const ShmReader &) = delete;
+
+    bool open(const std::string &name);
+    void close();
+
+    uint64_t get_published() const;
+    // The newest frame, false before the first one
+    bool acquire_latest(ShmFrame &frame) const;
+    // Frame index, false if it's not published yet or already overwritten
+    bool acquire(uint64_t index, ShmFrame &frame) const;
+    // Whether the writer left the frame alone, to check after reading its payload
+    bool is_valid(const ShmFrame &frame) const;
+
+  private:
+    const ShmSlotHeader *get_slot(uint64_t index) const;
+
+    const ShmRingHeader *m_ring = nullptr;
+    size_t m_size = 0;
+};
+
+} // namespace tine
@@ -0,0 +1,118 @@
+#include "tine_log.h"
+#include "tine_snapshot.h"
+#include "tine_component.h"
+#include <algorithm>
+#include <cstring>
+#include <tracy/Tracy.hpp>
+
+// A storage and its entities iterate in step, which is what lets the blob skip the entities
+template <typename Component>
+static void capture_pool(entt::registry &registry, tine::RegistrySnapshot::Pool &pool) {
+    static_assert(std::is_pod<Component>::value, "Snapshot components are copied as raw bytes");
+    static_assert(!std::is_empty<Component>::value, "Empty components have no storage to copy");
+    auto &storage = registry.storage<Component>();
+    const entt::sparse_set &set = storage;
+    uint8_t *dst = nullptr;
+
+    pool.entities.assign(set.begin(), set.end());
+    pool.components.resize(pool.entities.size() * sizeof(Component));
+    dst = pool.components.data();
+    for (const Component &component : storage) {
+        memcpy(dst, &component, sizeof(Component));
+        dst += sizeof(Component);
+    }
+}
+
+// Fails without touching anything if the pool no longer holds the same entities in the same order
+template <typename Component>
+static bool restore_pool(entt::registry &registry, const tine::RegistrySnapshot::Pool &pool) {
+    auto &storage = registry.storage<Component>();
+    const entt::sparse_set &set = storage;
+    const uint8_t *src = pool.components.data();
+
+    if (set.size() != pool.entities.size() ||
+        !std::equal(set.begin(), set.end(), pool.entities.begin())) {
+        return false;
+    }
+    for (Component &component : storage) {
+        memcpy(&component, src, sizeof(Component));
+        src += sizeof(Component);
+    }
+    return true;
+}
+
+template <typename Component>
+static void insert_pool(entt::registry &registry, const tine::RegistrySnapshot::Pool &pool) {
+    std::vector<Component> components(pool.entities.size());
+    if (!components.empty()) {
+        memcpy(components.data(), pool.components.data(), pool.components.size());
+    }
+    registry.insert<Component>(pool.entities.begin(), pool.entities.end(), components.begin());
+}
+
+template <typename... Components>
+static void capture_pools(entt::registry &registry,
+                          std::vector<tine::RegistrySnapshot::Pool> &pools) {
+    size_t pool = 0;
+    pools.resize(sizeof...(Components));
+    (capture_pool<Components>(registry, pools[pool++]), ...);
+}
+
+// Stops at the first mismatch, the caller rebuilds everything anyway
+template <typename... Components>
+static bool restore_pools(entt::registry &registry,
+                          const std::vector<tine::RegistrySnapshot::Pool> &pools) {
+    size_t pool = 0;
+    return (restore_pool<Components>(registry, pools[pool++]) && ...);
+}
+
+template <typename... Components>
+static void insert_pools(entt::registry &registry,
+                         const std::vector<tine::RegistrySnapshot::Pool> &pools) {
+    size_t pool = 0;
+    (insert_pool<Components>(registry, pools[pool++]), ...);
+}
+
+void tine::RegistrySnapshot::capture(entt::registry &registry) {
+    ZoneScoped;
+    capture_pools<SIMULATION_COMPONENTS>(registry, m_pools);
+}
+
+bool tine::RegistrySnapshot::restore(entt::registry &registry) {
+    ZoneScoped;
+    // Owning a component of any of the pools, only needed on the slow path so capture stays a
+    // plain copy for the recorder
+    std::vector<entt::entity> entities;
+    TINE_CHECK(!m_pools.empty(), "Snapshot was never captured", Error);
+    if (restore_pools<SIMULATION_COMPONENTS>(registry, m_pools)) {
+        return true;
+    }
+
+    {
+        // Entities came or went since the capture, start over with the same identifiers
+        ZoneScopedN("Rebuild registry");
+        for (const Pool &pool : m_pools) {
+            entities.insert(entities.end(), pool.entities.begin(), pool.entities.end());
+        }
+        std::sort(entities.begin(), entities.end());
+        entities.erase(std::unique(entities.begin(), entities.end()), entities.end());
+        registry.clear();
+        for (entt::entity entity : entities) {
+            TINE_CHECK(registry.create(entity) == entity, "Failed to recreate entity", Error);
+        }
+        insert_pools<SIMULATION_COMPONENTS>(registry, m_pools);
+    }
+    // The rebuilt pools may iterate in another order, relearn it so the next restore is fast
+    capture(registry);
+    return true;
+Error:
+    return false;
+}
+
+size_t tine::RegistrySnapshot::get_size() const {
+    size_t size = 0;
+    for (const Pool &pool : m_pools) {
+        size += pool.components.size();
+    }
+    return size;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <entt/entt.hpp>
+
+namespace tine {
+
+// Simulation state of a registry, every pool of SIMULATION_COMPONENTS copied out as a raw blob.
+// Mesh, material and animation data aren't part of it, they don't change after load.  Restoring
+// into a registry whose pools hold the same entities as at capture, the common case for episode
+// resets, is a straight copy of each pool.  Otherwise the registry is rebuilt with the same entity
+// identifiers, and the snapshot relearns the layout for the next restore.
+class RegistrySnapshot {
+  public:
+    void capture(entt::registry &registry);
+    bool restore(entt::registry &registry);
+
+    struct Pool {
+        std::vector<entt::entity> entities; // In pool iteration order
+        std::vector<uint8_t> components;    // Same order as entities
+    };
+
+    bool is_empty() const { return m_pools.empty(); }
+    // One per SIMULATION_COMPONENTS type, in that order
+    const std::vector<Pool> &get_pools() const { return m_pools; }
+    // Bytes held by the component blobs
+    size_t get_size() const;
+
+  private:
+    std::vector<Pool> m_pools; // One per snapshot component type
+};
+
+} // namespace tine
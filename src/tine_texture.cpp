@@ -0,0 +1,656 @@
+#include "tine_log.h"
+#include "tine_texture.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <utility>
+#include <tracy/Tracy.hpp>
+#ifdef TINE_HAS_BASISU
+#include <basisu_transcoder.h>
+#endif
+
+static const uint8_t KTX2_IDENTIFIER[12] = {0xAB, 'K', 'T', 'X', ' ', '2',
+                                            '0',  0xBB, '\r', '\n', 0x1A, '\n'};
+static const uint32_t KTX2_SUPERCOMPRESSION_NONE = 0;
+// VK_FORMAT_UNDEFINED, what Basis Universal payloads are stored as
+static const uint32_t KTX2_FORMAT_BASIS = 0;
+// Anything larger is taken for a corrupt header rather than allocated
+static const uint32_t MAX_TEXTURE_SIZE = 16384;
+
+struct Ktx2Header {
+    uint8_t identifier[12];
+    uint32_t vk_format;
+    uint32_t type_size;
+    uint32_t pixel_width;
+    uint32_t pixel_height;
+    uint32_t pixel_depth;
+    uint32_t layer_count;
+    uint32_t face_count;
+    uint32_t level_count; // 0 asks the loader to generate mips, only the base is stored
+    uint32_t supercompression_scheme;
+    uint32_t dfd_byte_offset;
+    uint32_t dfd_byte_length;
+    uint32_t kvd_byte_offset;
+    uint32_t kvd_byte_length;
+    uint64_t sgd_byte_offset;
+    uint64_t sgd_byte_length;
+};
+static_assert(sizeof(Ktx2Header) == 80, "Ktx2Header is read raw");
+
+// Follows the header, one per level, the base level first
+struct Ktx2Level {
+    uint64_t byte_offset;
+    uint64_t byte_length;
+    uint64_t uncompressed_byte_length;
+};
+
+// The VkFormat values KTX2 files are accepted in, stored raw in the header
+struct Ktx2Format {
+    uint32_t vk_format;
+    tine::TextureFormat format;
+    bool srgb;
+};
+
+static const Ktx2Format KTX2_FORMATS[] = {
+    {37, tine::TextureFormat::RGBA8, false},  // VK_FORMAT_R8G8B8A8_UNORM
+    {43, tine::TextureFormat::RGBA8, true},   // VK_FORMAT_R8G8B8A8_SRGB
+    {131, tine::TextureFormat::BC1, false},   // VK_FORMAT_BC1_RGB_UNORM_BLOCK
+    {132, tine::TextureFormat::BC1, true},    // VK_FORMAT_BC1_RGB_SRGB_BLOCK
+    {133, tine::TextureFormat::BC1, false},   // VK_FORMAT_BC1_RGBA_UNORM_BLOCK
+    {134, tine::TextureFormat::BC1, true},    // VK_FORMAT_BC1_RGBA_SRGB_BLOCK
+    {137, tine::TextureFormat::BC3, false},   // VK_FORMAT_BC3_UNORM_BLOCK
+    {138, tine::TextureFormat::BC3, true},    // VK_FORMAT_BC3_SRGB_BLOCK
+    {141, tine::TextureFormat::BC5, false},   // VK_FORMAT_BC5_UNORM_BLOCK
+    {145, tine::TextureFormat::BC7, false},   // VK_FORMAT_BC7_UNORM_BLOCK
+    {146, tine::TextureFormat::BC7, true},    // VK_FORMAT_BC7_SRGB_BLOCK
+};
+
+size_t tine::get_texture_block_size(TextureFormat format) {
+    switch (format) {
+    case TextureFormat::RGBA8:
+        return 4;
+    case TextureFormat::BC1:
+        return 8;
+    default:
+        return 16;
+    }
+}
+
+bool tine::is_block_compressed(TextureFormat format) { return format != TextureFormat::RGBA8; }
+
+uint32_t tine::get_mip_count(uint32_t width, uint32_t height) {
+    uint32_t level_cnt = 1;
+    while ((std::max(width, height) >> level_cnt) > 0) {
+        level_cnt++;
+    }
+    return level_cnt;
+}
+
+static size_t get_level_size(tine::TextureFormat format, uint32_t width, uint32_t height) {
+    if (!tine::is_block_compressed(format)) {
+        return static_cast<size_t>(width) * height * 4;
+    }
+    return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) *
+           tine::get_texture_block_size(format);
+}
+
+static bool read_file(const std::string &path, std::vector<uint8_t> &data) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    std::streamsize size = 0;
+
+    TINE_CHECK(file.good(), "Failed to open file", Error);
+    size = file.tellg();
+    TINE_CHECK(size > 0, "File is empty", Error);
+    data.resize(static_cast<size_t>(size));
+    file.seekg(0);
+    file.read(reinterpret_cast<char *>(data.data()), size);
+    TINE_CHECK(file.good(), "Failed to read file", Error);
+    return true;
+Error:
+    data.clear();
+    return false;
+}
+
+// --- Block decoding, for devices that can't sample the stored format
+
+static void unpack_565(uint16_t color, uint8_t *rgb) {
+    const uint32_t r = (color >> 11) & 31;
+    const uint32_t g = (color >> 5) & 63;
+    const uint32_t b = color & 31;
+    rgb[0] = static_cast<uint8_t>((r << 3) | (r >> 2));
+    rgb[1] = static_cast<uint8_t>((g << 2) | (g >> 4));
+    rgb[2] = static_cast<uint8_t>((b << 3) | (b >> 2));
+}
+
+// The colors of BC1, and of BC3 which always interpolates four of them.  BC1 blocks with
+// c0 <= c1 have three and transparent black instead.
+static void decode_color_block(const uint8_t *block, bool three_color, uint8_t texels[16][4]) {
+    const uint16_t c0 = static_cast<uint16_t>(block[0] | (block[1] << 8));
+    const uint16_t c1 = static_cast<uint16_t>(block[2] | (block[3] << 8));
+    const uint32_t indices = block[4] | (block[5] << 8) | (block[6] << 16) |
+                             (static_cast<uint32_t>(block[7]) << 24);
+    uint8_t palette[4][4] = {{0, 0, 0, 255}, {0, 0, 0, 255}, {0, 0, 0, 255}, {0, 0, 0, 255}};
+
+    unpack_565(c0, palette[0]);
+    unpack_565(c1, palette[1]);
+    for (int c = 0; c < 3; c++) {
+        if (c0 > c1 || !three_color) {
+            palette[2][c] = static_cast<uint8_t>((2 * palette[0][c] + palette[1][c]) / 3);
+            palette[3][c] = static_cast<uint8_t>((palette[0][c] + 2 * palette[1][c]) / 3);
+        } else {
+            palette[2][c] = static_cast<uint8_t>((palette[0][c] + palette[1][c]) / 2);
+            palette[3][c] = 0;
+            palette[3][3] = 0;
+        }
+    }
+    for (int i = 0; i < 16; i++) {
+        memcpy(texels[i], palette[(indices >> (2 * i)) & 3], 4);
+    }
+}
+
+// One 8 bit channel with 3 bit indices, the alpha of BC3 and both channels of BC5
+static void decode_channel_block(const uint8_t *block, int channel, uint8_t texels[16][4]) {
+    const uint32_t a0 = block[0];
+    const uint32_t a1 = block[1];
+    uint64_t indices = 0;
+    uint8_t palette[8] = {};
+
+    for (int i = 0; i < 6; i++) {
+        indices |= static_cast<uint64_t>(block[2 + i]) << (8 * i);
+    }
+    palette[0] = static_cast<uint8_t>(a0);
+    palette[1] = static_cast<uint8_t>(a1);
+    if (a0 > a1) {
+        for (uint32_t i = 1; i < 7; i++) {
+            palette[i + 1] = static_cast<uint8_t>(((7 - i) * a0 + i * a1) / 7);
+        }
+    } else {
+        for (uint32_t i = 1; i < 5; i++) {
+            palette[i + 1] = static_cast<uint8_t>(((5 - i) * a0 + i * a1) / 5);
+        }
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+    for (int i = 0; i < 16; i++) {
+        texels[i][channel] = palette[(indices >> (3 * i)) & 7];
+    }
+}
+
+// The field widths of BC7's eight modes, the block's lowest set bit picks one
+struct Bc7Mode {
+    uint32_t subset_cnt;
+    uint32_t partition_bits;
+    uint32_t rotation_bits;  // Which channel swaps places with alpha
+    uint32_t selection_bits; // Whether color or alpha takes the wider indices
+    uint32_t color_bits;
+    uint32_t alpha_bits;     // 0 for opaque modes
+    uint32_t endpoint_pbits; // One low bit per endpoint
+    uint32_t shared_pbits;   // One low bit per subset
+    uint32_t index_bits;
+    uint32_t alpha_index_bits; // Separate alpha indices, 0 if alpha shares the color's
+};
+
+static const Bc7Mode BC7_MODES[8] = {
+    {3, 4, 0, 0, 4, 0, 1, 0, 3, 0}, {2, 6, 0, 0, 6, 0, 0, 1, 3, 0},
+    {3, 6, 0, 0, 5, 0, 0, 0, 2, 0}, {2, 6, 0, 0, 7, 0, 1, 0, 2, 0},
+    {1, 0, 2, 1, 5, 6, 0, 0, 2, 3}, {1, 0, 2, 0, 7, 8, 0, 0, 2, 2},
+    {1, 0, 0, 0, 7, 7, 1, 0, 4, 0}, {2, 6, 0, 0, 5, 5, 1, 0, 2, 0},
+};
+
+// Bit i is the subset of texel i
+static const uint16_t BC7_PARTITIONS_2[64] = {
+    0xcccc, 0x8888, 0xeeee, 0xecc8, 0xc880, 0xfeec, 0xfec8, 0xec80,
+    0xc800, 0xffec, 0xfe80, 0xe800, 0xffe8, 0xff00, 0xfff0, 0xf000,
+    0xf710, 0x008e, 0x7100, 0x08ce, 0x008c, 0x7310, 0x3100, 0x8cce,
+    0x088c, 0x3110, 0x6666, 0x366c, 0x17e8, 0x0ff0, 0x718e, 0x399c,
+    0xaaaa, 0xf0f0, 0x5a5a, 0x33cc, 0x3c3c, 0x55aa, 0x9696, 0xa55a,
+    0x73ce, 0x13c8, 0x324c, 0x3bdc, 0x6996, 0xc33c, 0x9966, 0x0660,
+    0x0272, 0x04e4, 0x4e40, 0x2720, 0xc936, 0x936c, 0x39c6, 0x639c,
+    0x9336, 0x9cc6, 0x817e, 0xe718, 0xccf0, 0x0fcc, 0x7744, 0xee22,
+};
+
+// Bits 2i and 2i+1 are the subset of texel i
+static const uint32_t BC7_PARTITIONS_3[64] = {
+    0xaa685050, 0x6a5a5040, 0x5a5a4200, 0x5450a0a8, 0xa5a50000, 0xa0a05050,
+    0x5555a0a0, 0x5a5a5050, 0xaa550000, 0xaa555500, 0xaaaa5500, 0x90909090,
+    0x94949494, 0xa4a4a4a4, 0xa9a59450, 0x2a0a4250, 0xa5945040, 0x0a425054,
+    0xa5a5a500, 0x55a0a0a0, 0xa8a85454, 0x6a6a4040, 0xa4a45000, 0x1a1a0500,
+    0x0050a4a4, 0xaaa59090, 0x14696914, 0x69691400, 0xa08585a0, 0xaa821414,
+    0x50a4a450, 0x6a5a0200, 0xa9a58000, 0x5090a0a8, 0xa8a09050, 0x24242424,
+    0x00aa5500, 0x24924924, 0x24499224, 0x50a50a50, 0x500aa550, 0xaaaa4444,
+    0x66660000, 0xa5a0a5a0, 0x50a050a0, 0x69286928, 0x44aaaa44, 0x66666600,
+    0xaa444444, 0x54a854a8, 0x95809580, 0x96969600, 0xa85454a8, 0x80959580,
+    0xaa141414, 0x96960000, 0xaaaa1414, 0xa05050a0, 0xa0a5a5a0, 0x96000000,
+    0x40804080, 0xa9a8a9a8, 0xaaaaaa44, 0x2a4a5254,
+};
+
+// Texels whose index drops its top bit, besides texel 0: the one of the second subset, then the
+// one of the third
+static const uint8_t BC7_ANCHORS_2[64] = {
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+    15, 2, 8, 2, 2, 8, 8, 15, 2, 8, 2, 2, 8, 8, 2, 2,
+    15, 15, 6, 8, 2, 8, 15, 15, 2, 8, 2, 2, 2, 15, 15, 6,
+    6, 2, 6, 8, 15, 15, 2, 2, 15, 15, 15, 15, 15, 2, 2, 15,
+};
+
+static const uint8_t BC7_ANCHORS_3[2][64] = {
+    {
+        3, 3, 15, 15, 8, 3, 15, 15, 8, 8, 6, 6, 6, 5, 3, 3,
+        3, 3, 8, 15, 3, 3, 6, 10, 5, 8, 8, 6, 8, 5, 15, 15,
+        8, 15, 3, 5, 6, 10, 8, 15, 15, 3, 15, 5, 15, 15, 15, 15,
+        3, 15, 5, 5, 5, 8, 5, 10, 5, 10, 8, 13, 15, 12, 3, 3,
+    },
+    {
+        15, 8, 8, 3, 15, 15, 3, 8, 15, 15, 15, 15, 15, 15, 15, 8,
+        15, 8, 15, 3, 15, 8, 15, 8, 3, 15, 6, 10, 15, 15, 10, 8,
+        15, 3, 15, 10, 10, 8, 9, 10, 6, 15, 8, 15, 3, 6, 6, 8,
+        15, 3, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 3, 15, 15, 8,
+    },
+};
+
+static const uint8_t BC7_WEIGHTS_2[4] = {0, 21, 43, 64};
+static const uint8_t BC7_WEIGHTS_3[8] = {0, 9, 18, 27, 37, 46, 55, 64};
+static const uint8_t BC7_WEIGHTS_4[16] = {0,  4,  9,  13, 17, 21, 26, 30,
+                                          34, 38, 43, 47, 51, 55, 60, 64};
+
+// Reads a BC7 block's fields, least significant bit first
+struct Bc7Bits {
+    const uint8_t *block;
+    uint32_t pos;
+
+    uint32_t read(uint32_t cnt) {
+        uint32_t value = 0;
+        for (uint32_t i = 0; i < cnt; i++, pos++) {
+            value |= ((block[pos >> 3] >> (pos & 7)) & 1u) << i;
+        }
+        return value;
+    }
+};
+
+static uint32_t bc7_weight(uint32_t bits, uint32_t index) {
+    switch (bits) {
+    case 2:
+        return BC7_WEIGHTS_2[index];
+    case 3:
+        return BC7_WEIGHTS_3[index];
+    default:
+        return BC7_WEIGHTS_4[index];
+    }
+}
+
+// Replicates the top bits into the bottom ones
+static uint8_t bc7_expand(uint32_t value, uint32_t bits) {
+    return static_cast<uint8_t>((value << (8 - bits)) | (value >> (2 * bits - 8)));
+}
+
+static void decode_bc7_block(const uint8_t *block, uint8_t texels[16][4]) {
+    Bc7Bits bits = {block, 0};
+    uint32_t mode_idx = 0;
+    uint32_t partition = 0;
+    uint32_t rotation = 0;
+    uint32_t selection = 0;
+    uint32_t endpoints[3][2][4] = {}; // [subset][endpoint][channel]
+    uint32_t color_indices[16] = {};
+    uint32_t alpha_indices[16] = {};
+    uint32_t color_index_bits = 0;
+    uint32_t alpha_index_bits = 0;
+
+    while (mode_idx < 8 && bits.read(1) == 0) {
+        mode_idx++;
+    }
+    if (mode_idx == 8) {
+        // Reserved, decodes to transparent black
+        memset(texels, 0, 16 * 4);
+        return;
+    }
+    const Bc7Mode &mode = BC7_MODES[mode_idx];
+    partition = bits.read(mode.partition_bits);
+    rotation = bits.read(mode.rotation_bits);
+    selection = bits.read(mode.selection_bits);
+
+    for (uint32_t c = 0; c < 4; c++) {
+        const uint32_t channel_bits = (c < 3) ? mode.color_bits : mode.alpha_bits;
+        for (uint32_t s = 0; s < mode.subset_cnt; s++) {
+            endpoints[s][0][c] = bits.read(channel_bits);
+            endpoints[s][1][c] = bits.read(channel_bits);
+        }
+    }
+    for (uint32_t s = 0; s < mode.subset_cnt; s++) {
+        uint32_t pbits[2] = {};
+        if (mode.endpoint_pbits != 0) {
+            pbits[0] = bits.read(1);
+            pbits[1] = bits.read(1);
+        } else if (mode.shared_pbits != 0) {
+            pbits[0] = pbits[1] = bits.read(1);
+        }
+        for (uint32_t e = 0; e < 2; e++) {
+            for (uint32_t c = 0; c < 4; c++) {
+                const uint32_t channel_bits = (c < 3) ? mode.color_bits : mode.alpha_bits;
+                const uint32_t pbit_cnt = mode.endpoint_pbits | mode.shared_pbits;
+                uint32_t &value = endpoints[s][e][c];
+                if (channel_bits == 0) {
+                    value = 255;
+                    continue;
+                }
+                value = (value << pbit_cnt) | (pbits[e] & pbit_cnt);
+                value = bc7_expand(value, channel_bits + pbit_cnt);
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < 16; i++) {
+        bool is_anchor = (i == 0);
+        if (mode.subset_cnt == 2) {
+            is_anchor = is_anchor || i == BC7_ANCHORS_2[partition];
+        } else if (mode.subset_cnt == 3) {
+            is_anchor = is_anchor || i == BC7_ANCHORS_3[0][partition] ||
+                        i == BC7_ANCHORS_3[1][partition];
+        }
+        color_indices[i] = bits.read(mode.index_bits - (is_anchor ? 1 : 0));
+    }
+    color_index_bits = mode.index_bits;
+    if (mode.alpha_index_bits != 0) {
+        for (uint32_t i = 0; i < 16; i++) {
+            alpha_indices[i] = bits.read(mode.alpha_index_bits - ((i == 0) ? 1 : 0));
+        }
+        alpha_index_bits = mode.alpha_index_bits;
+        if (selection != 0) {
+            std::swap(color_indices, alpha_indices);
+            std::swap(color_index_bits, alpha_index_bits);
+        }
+    } else {
+        memcpy(alpha_indices, color_indices, sizeof(alpha_indices));
+        alpha_index_bits = color_index_bits;
+    }
+
+    for (uint32_t i = 0; i < 16; i++) {
+        uint32_t subset = 0;
+        if (mode.subset_cnt == 2) {
+            subset = (BC7_PARTITIONS_2[partition] >> i) & 1;
+        } else if (mode.subset_cnt == 3) {
+            subset = (BC7_PARTITIONS_3[partition] >> (2 * i)) & 3;
+        }
+        const uint32_t(&e)[2][4] = endpoints[subset];
+        for (uint32_t c = 0; c < 4; c++) {
+            const uint32_t weight = (c < 3) ? bc7_weight(color_index_bits, color_indices[i])
+                                            : bc7_weight(alpha_index_bits, alpha_indices[i]);
+            texels[i][c] =
+                static_cast<uint8_t>(((64 - weight) * e[0][c] + weight * e[1][c] + 32) >> 6);
+        }
+        if (rotation != 0) {
+            std::swap(texels[i][rotation - 1], texels[i][3]);
+        }
+    }
+}
+
+static bool decode_block(tine::TextureFormat format, const uint8_t *block,
+                         uint8_t texels[16][4]) {
+    for (int i = 0; i < 16; i++) {
+        texels[i][0] = texels[i][1] = texels[i][2] = 0;
+        texels[i][3] = 255;
+    }
+    switch (format) {
+    case tine::TextureFormat::BC1:
+        decode_color_block(block, true, texels);
+        return true;
+    case tine::TextureFormat::BC3:
+        decode_color_block(block + 8, false, texels);
+        decode_channel_block(block, 3, texels);
+        return true;
+    case tine::TextureFormat::BC5:
+        decode_channel_block(block, 0, texels);
+        decode_channel_block(block + 8, 1, texels);
+        return true;
+    case tine::TextureFormat::BC7:
+        decode_bc7_block(block, texels);
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool decode_to_rgba8(tine::TextureImage &image) {
+    ZoneScoped;
+    const size_t block_size = tine::get_texture_block_size(image.format);
+    std::vector<tine::TextureLevel> levels;
+    std::vector<uint8_t> data;
+    uint8_t texels[16][4] = {};
+
+    for (const tine::TextureLevel &src : image.levels) {
+        const uint32_t blocks_x = (src.width + 3) / 4;
+        const uint32_t blocks_y = (src.height + 3) / 4;
+        tine::TextureLevel dst = {src.width, src.height, data.size(),
+                                  get_level_size(tine::TextureFormat::RGBA8, src.width,
+                                                 src.height)};
+        data.resize(dst.offset + dst.size);
+        for (uint32_t by = 0; by < blocks_y; by++) {
+            for (uint32_t bx = 0; bx < blocks_x; bx++) {
+                const uint8_t *block =
+                    &image.data[src.offset + (by * blocks_x + bx) * block_size];
+                TINE_CHECK(decode_block(image.format, block, texels), "No decoder for format",
+                           Error);
+                // Blocks hang over the edges of levels that aren't a multiple of 4
+                for (uint32_t y = 0; y < 4 && by * 4 + y < src.height; y++) {
+                    for (uint32_t x = 0; x < 4 && bx * 4 + x < src.width; x++) {
+                        const size_t texel = (by * 4 + y) * src.width + bx * 4 + x;
+                        memcpy(&data[dst.offset + texel * 4], texels[y * 4 + x], 4);
+                    }
+                }
+            }
+        }
+        levels.push_back(dst);
+    }
+    image.format = tine::TextureFormat::RGBA8;
+    image.levels.swap(levels);
+    image.data.swap(data);
+    return true;
+Error:
+    return false;
+}
+
+// --- KTX2 loading
+
+static bool load_ktx2_levels(const std::vector<uint8_t> &file, const Ktx2Header &header,
+                             tine::TextureFormatMask supported, tine::TextureImage &image) {
+    const Ktx2Format *format = nullptr;
+    const uint32_t level_cnt = std::max<uint32_t>(header.level_count, 1);
+
+    for (const Ktx2Format &candidate : KTX2_FORMATS) {
+        if (candidate.vk_format == header.vk_format) {
+            format = &candidate;
+        }
+    }
+    TINE_CHECK(format != nullptr, "Unsupported KTX2 format", Error);
+    TINE_CHECK(header.supercompression_scheme == KTX2_SUPERCOMPRESSION_NONE,
+               "Unsupported KTX2 supercompression", Error);
+    TINE_CHECK(sizeof(Ktx2Header) + level_cnt * sizeof(Ktx2Level) <= file.size(),
+               "Truncated KTX2 level index", Error);
+
+    image.format = format->format;
+    image.srgb = format->srgb;
+    for (uint32_t l = 0; l < level_cnt; l++) {
+        Ktx2Level level = {};
+        tine::TextureLevel dst = {};
+        memcpy(&level, &file[sizeof(Ktx2Header) + l * sizeof(Ktx2Level)], sizeof(level));
+        dst.width = std::max<uint32_t>(image.width >> l, 1);
+        dst.height = std::max<uint32_t>(image.height >> l, 1);
+        dst.offset = image.data.size();
+        dst.size = get_level_size(image.format, dst.width, dst.height);
+        TINE_CHECK(level.byte_length == dst.size, "KTX2 level size doesn't match its format",
+                   Error);
+        TINE_CHECK(level.byte_offset <= file.size() &&
+                       level.byte_length <= file.size() - level.byte_offset,
+                   "KTX2 level is out of bounds", Error);
+        image.data.insert(image.data.end(), file.begin() + level.byte_offset,
+                          file.begin() + level.byte_offset + level.byte_length);
+        image.levels.push_back(dst);
+    }
+
+    if (!(supported & tine::texture_format_bit(image.format))) {
+        TINE_CHECK(decode_to_rgba8(image), "Failed to decode texture", Error);
+    }
+    return true;
+Error:
+    return false;
+}
+
+#ifdef TINE_HAS_BASISU
+static void init_basis() {
+    static std::once_flag once;
+    std::call_once(once, []() { basist::basisu_transcoder_init(); });
+}
+
+struct BasisTarget {
+    tine::TextureFormat format;
+    basist::transcoder_texture_format basis_format;
+};
+
+// Both BC1 and BC3 are what ETC1S is designed around, UASTC keeps its quality only in BC7
+static BasisTarget select_basis_target(const basist::ktx2_transcoder &transcoder,
+                                       tine::TextureFormatMask supported) {
+    using basist::transcoder_texture_format;
+    static const BasisTarget BC1 = {tine::TextureFormat::BC1,
+                                    transcoder_texture_format::cTFBC1_RGB};
+    static const BasisTarget BC3 = {tine::TextureFormat::BC3,
+                                    transcoder_texture_format::cTFBC3_RGBA};
+    static const BasisTarget BC7 = {tine::TextureFormat::BC7,
+                                    transcoder_texture_format::cTFBC7_RGBA};
+    static const BasisTarget RGBA8 = {tine::TextureFormat::RGBA8,
+                                      transcoder_texture_format::cTFRGBA32};
+    const BasisTarget *candidates[2] = {&BC7, &BC1};
+
+    if (transcoder.get_has_alpha()) {
+        candidates[0] = transcoder.is_uastc() ? &BC7 : &BC3;
+        candidates[1] = transcoder.is_uastc() ? &BC3 : &BC7;
+    } else if (transcoder.is_etc1s()) {
+        candidates[0] = &BC1;
+        candidates[1] = &BC7;
+    }
+    for (const BasisTarget *target : candidates) {
+        if (supported & tine::texture_format_bit(target->format)) {
+            return *target;
+        }
+    }
+    return RGBA8;
+}
+
+static bool transcode_basis(const std::vector<uint8_t> &file, tine::TextureFormatMask supported,
+                            tine::TextureImage &image) {
+    ZoneScoped;
+    basist::ktx2_transcoder transcoder;
+    BasisTarget target = {};
+
+    init_basis();
+    TINE_CHECK(transcoder.init(file.data(), static_cast<uint32_t>(file.size())),
+               "Invalid Basis Universal KTX2 file", Error);
+    TINE_CHECK(transcoder.start_transcoding(), "Failed to start transcoding", Error);
+
+    target = select_basis_target(transcoder, supported);
+    image.format = target.format;
+    image.srgb = (transcoder.get_dfd_transfer_func() == basist::KTX2_KHR_DF_TRANSFER_SRGB);
+    for (uint32_t l = 0; l < transcoder.get_levels(); l++) {
+        basist::ktx2_image_level_info info = {};
+        tine::TextureLevel dst = {};
+        uint32_t out_cnt = 0;
+
+        TINE_CHECK(transcoder.get_image_level_info(info, l, 0, 0), "Failed to get level info",
+                   Error);
+        dst.width = info.m_orig_width;
+        dst.height = info.m_orig_height;
+        dst.offset = image.data.size();
+        dst.size = get_level_size(image.format, dst.width, dst.height);
+        // Blocks for the BC targets, pixels for RGBA32
+        out_cnt = tine::is_block_compressed(image.format) ? info.m_total_blocks
+                                                          : dst.width * dst.height;
+        image.data.resize(dst.offset + dst.size);
+        TINE_CHECK(transcoder.transcode_image_level(l, 0, 0, &image.data[dst.offset], out_cnt,
+                                                    target.basis_format),
+                   "Failed to transcode level", Error);
+        image.levels.push_back(dst);
+    }
+    return true;
+Error:
+    return false;
+}
+#else
+static bool transcode_basis(const std::vector<uint8_t> &, tine::TextureFormatMask,
+                            tine::TextureImage &) {
+    TINE_ERROR("Built without Basis Universal, configure with TINE_BASISU_DIR to transcode");
+    return false;
+}
+#endif
+
+static bool is_ktx2(const uint8_t *data, size_t size) {
+    return size >= sizeof(Ktx2Header) &&
+           memcmp(data, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) == 0;
+}
+
+// Embedded texels are base colors, which are always sRGB
+static bool load_texels(const tine::TextureSource &source, tine::TextureImage &image) {
+    const size_t size = static_cast<size_t>(source.width) * source.height * 4;
+    TINE_CHECK(source.width <= MAX_TEXTURE_SIZE && source.height > 0 &&
+                   source.height <= MAX_TEXTURE_SIZE && source.data.size() == size,
+               "Invalid texture size", Error);
+    image.format = tine::TextureFormat::RGBA8;
+    image.srgb = true;
+    image.width = source.width;
+    image.height = source.height;
+    image.levels.push_back({source.width, source.height, 0, size});
+    image.data = source.data;
+    return true;
+Error:
+    return false;
+}
+
+bool tine::is_texture_supported(const TextureSource &source) {
+    uint8_t head[sizeof(Ktx2Header)] = {};
+    if (source.width > 0) {
+        return true;
+    }
+    if (!source.data.empty()) {
+        return is_ktx2(source.data.data(), source.data.size());
+    }
+    std::ifstream file(source.path, std::ios::binary);
+    file.read(reinterpret_cast<char *>(head), sizeof(head));
+    return file.good() && is_ktx2(head, sizeof(head));
+}
+
+bool tine::load_texture(const TextureSource &source, TextureFormatMask supported,
+                        TextureImage &image) {
+    ZoneScoped;
+    std::vector<uint8_t> read;
+    const std::vector<uint8_t> *file = &source.data;
+    Ktx2Header header = {};
+
+    image = TextureImage();
+    if (source.width > 0) {
+        TINE_CHECK(load_texels(source, image), "Failed to load embedded texture", Error);
+        return true;
+    }
+    if (source.data.empty()) {
+        TINE_CHECK(read_file(source.path, read), "Failed to read texture", Error);
+        file = &read;
+    }
+    TINE_CHECK(is_ktx2(file->data(), file->size()), "Not a KTX2 file", Error);
+    memcpy(&header, file->data(), sizeof(header));
+    TINE_CHECK(header.pixel_width > 0 && header.pixel_width <= MAX_TEXTURE_SIZE &&
+                   header.pixel_height > 0 && header.pixel_height <= MAX_TEXTURE_SIZE,
+               "Invalid texture size", Error);
+    TINE_CHECK(header.pixel_depth == 0 && header.layer_count <= 1 && header.face_count == 1,
+               "Only 2D textures are supported", Error);
+
+    image.width = header.pixel_width;
+    image.height = header.pixel_height;
+    if (header.vk_format == KTX2_FORMAT_BASIS) {
+        TINE_CHECK(transcode_basis(*file, supported, image), "Failed to transcode texture",
+                   Error);
+    } else {
+        TINE_CHECK(load_ktx2_levels(*file, header, supported, image), "Failed to load texture",
+                   Error);
+    }
+    return true;
+Error:
+    image = TextureImage();
+    return false;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace tine {
+
+// Formats textures are uploaded in.  The block compressed ones store 4x4 texel blocks.
+enum class TextureFormat : uint32_t {
+    RGBA8,
+    BC1, // RGB and 1 bit alpha, 8 bytes per block
+    BC3, // RGBA, 16 bytes per block
+    BC5, // RG, 16 bytes per block, normal maps
+    BC7, // RGBA, 16 bytes per block
+    COUNT
+};
+
+// Bit (1 << format) is set for every format the device can sample from
+typedef uint32_t TextureFormatMask;
+
+inline TextureFormatMask texture_format_bit(TextureFormat format) {
+    return 1u << static_cast<uint32_t>(format);
+}
+
+// Bytes per 4x4 block, or per texel for RGBA8
+size_t get_texture_block_size(TextureFormat format);
+bool is_block_compressed(TextureFormat format);
+
+struct TextureLevel {
+    uint32_t width;
+    uint32_t height;
+    size_t offset; // Into TextureImage::data
+    size_t size;
+};
+
+// Where a texture comes from, a KTX2 file or one embedded in the scene file
+struct TextureSource {
+    std::string path;          // File to read, or the embedded texture's name for logs
+    std::vector<uint8_t> data; // Embedded KTX2 file, or width * height RGBA8 texels
+    uint32_t width = 0;        // Of embedded texels, 0 otherwise
+    uint32_t height = 0;
+};
+
+struct TextureImage {
+    TextureFormat format = TextureFormat::RGBA8;
+    bool srgb = false;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<TextureLevel> levels; // Largest first, empty if loading failed
+    std::vector<uint8_t> data;
+};
+
+// Loads a KTX2 texture in one of the supported formats, from any thread.  Block compressed data
+// the device can't sample is decoded to RGBA8.  Basis Universal payloads, BasisLZ/ETC1S or UASTC,
+// are transcoded to the best supported BC format, or RGBA8 without any, which needs
+// TINE_HAS_BASISU.  Embedded texels load as a single RGBA8 level.
+bool load_texture(const TextureSource &source, TextureFormatMask supported, TextureImage &image);
+// Whether load_texture can read source at all, only looks at the KTX2 identifier.  PNG, JPEG and
+// other image files aren't decoded.
+bool is_texture_supported(const TextureSource &source);
+// Levels of a full mip chain down to 1x1
+uint32_t get_mip_count(uint32_t width, uint32_t height);
+
+} // namespace tine
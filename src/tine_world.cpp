@@ -0,0 +1,372 @@
+#include "tine_log.h"
+#include "tine_world.h"
+#include "tine_collision.h"
+#include "tine_component.h"
+#include "tine_jobs.h"
+#include "tine_mesh.h"
+#include "tine_scene.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <tracy/Tracy.hpp>
+
+static const uint32_t WORLD_VERSION = 1;
+// Cells are far from free to sanity check, but a corrupt table shouldn't allocate gigabytes
+static const uint32_t MAX_WORLD_CELLS = 1 << 24;
+static const uint32_t MAX_CELL_INSTANCES = 1 << 20;
+// Spreads the registry work of cells finishing together over several frames
+static const size_t MAX_CELLS_INTEGRATED_PER_UPDATE = 4;
+
+enum class CellState { UNLOADED, LOADING, RESIDENT };
+
+struct StreamCell {
+    tine::WorldCellEntry entry;
+    CellState state = CellState::UNLOADED;
+    uint32_t generation = 0; // Bumped on unload, stale loads are dropped
+    std::vector<entt::entity> entities;
+};
+
+struct LoadedCell {
+    uint64_t key;
+    uint32_t generation;
+    bool ok;
+    std::vector<tine::CellInstance> instances;
+};
+
+struct tine::WorldStreamer::Pimpl {
+    std::string path;
+    tine::JobSystem *jobs = nullptr;
+    uint32_t env = 0;
+    float cell_size = 1.0f;
+    float load_radius = 50.0f;
+    float unload_radius = 75.0f;
+    uint32_t max_cells = 64;
+    std::unordered_map<uint64_t, StreamCell> cells;
+    uint32_t active_cnt = 0; // Cells loading or resident
+
+    // Filled by the load jobs, drained by update
+    std::mutex loaded_mutex;
+    std::vector<LoadedCell> loaded;
+    tine::JobCounter loads;
+};
+
+static uint64_t cell_key(int32_t x, int32_t z) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(z);
+}
+
+static bool read_cell(const std::string &path, const tine::WorldCellEntry &entry,
+                      std::vector<tine::CellInstance> &instances) {
+    std::ifstream file(path, std::ios::binary);
+    TINE_CHECK(file.good(), "Failed to open world", Error);
+    instances.resize(entry.instance_count);
+    file.seekg(static_cast<std::streamoff>(entry.offset));
+    file.read(reinterpret_cast<char *>(instances.data()),
+              static_cast<std::streamsize>(instances.size() * sizeof(tine::CellInstance)));
+    TINE_CHECK(file.good(), "Failed to read cell", Error);
+    return true;
+Error:
+    instances.clear();
+    return false;
+}
+
+bool tine::write_world_file(const std::string &path, float cell_size,
+                            const std::vector<CellInstance> &instances) {
+    std::map<std::pair<int32_t, int32_t>, std::vector<CellInstance>> cells;
+    std::vector<WorldCellEntry> entries;
+    WorldHeader header = {};
+    std::ofstream file;
+    uint64_t offset = 0;
+
+    TINE_CHECK(cell_size > 0.0f, "Cell size must be positive", Error);
+    for (const CellInstance &instance : instances) {
+        const int32_t x = static_cast<int32_t>(std::floor(instance.transform[3].x / cell_size));
+        const int32_t z = static_cast<int32_t>(std::floor(instance.transform[3].z / cell_size));
+        cells[std::make_pair(x, z)].push_back(instance);
+    }
+
+    memcpy(header.magic, "TWLD", sizeof(header.magic));
+    header.version = WORLD_VERSION;
+    header.cell_size = cell_size;
+    header.cell_count = static_cast<uint32_t>(cells.size());
+    offset = sizeof(WorldHeader) + cells.size() * sizeof(WorldCellEntry);
+    for (const auto &cell : cells) {
+        WorldCellEntry entry = {};
+        entry.x = cell.first.first;
+        entry.z = cell.first.second;
+        entry.offset = offset;
+        entry.instance_count = static_cast<uint32_t>(cell.second.size());
+        entries.push_back(entry);
+        offset += cell.second.size() * sizeof(CellInstance);
+    }
+
+    file.open(path, std::ios::binary | std::ios::trunc);
+    TINE_CHECK(file.good(), "Failed to create world file", Error);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(entries.data()),
+               static_cast<std::streamsize>(entries.size() * sizeof(WorldCellEntry)));
+    for (const auto &cell : cells) {
+        file.write(reinterpret_cast<const char *>(cell.second.data()),
+                   static_cast<std::streamsize>(cell.second.size() * sizeof(CellInstance)));
+    }
+    TINE_CHECK(file.good(), "Failed to write world file", Error);
+    return true;
+Error:
+    return false;
+}
+
+tine::WorldStreamer::WorldStreamer() : m_pimpl(new Pimpl) {}
+
+tine::WorldStreamer::~WorldStreamer() {
+    // The load jobs write into the pimpl
+    if (m_pimpl->jobs != nullptr) {
+        m_pimpl->jobs->wait(m_pimpl->loads);
+    }
+}
+
+bool tine::WorldStreamer::open(const std::string &path, JobSystem *jobs, uint32_t env) {
+    Pimpl &p = *m_pimpl;
+    std::ifstream file(path, std::ios::binary);
+    WorldHeader header = {};
+    std::vector<WorldCellEntry> entries;
+
+    TINE_CHECK(p.cells.empty(), "World already open", Error);
+    TINE_CHECK(file.good(), "Failed to open world", Error);
+    file.read(reinterpret_cast<char *>(&header), sizeof(header));
+    TINE_CHECK(file.good() && memcmp(header.magic, "TWLD", sizeof(header.magic)) == 0,
+               "Not a world file", Error);
+    TINE_CHECK(header.version == WORLD_VERSION, "Unsupported world version", Error);
+    TINE_CHECK(header.cell_size > 0.0f && header.cell_count <= MAX_WORLD_CELLS,
+               "Invalid world header", Error);
+    entries.resize(header.cell_count);
+    file.read(reinterpret_cast<char *>(entries.data()),
+              static_cast<std::streamsize>(entries.size() * sizeof(WorldCellEntry)));
+    TINE_CHECK(file.good(), "Failed to read cell table", Error);
+
+    for (const WorldCellEntry &entry : entries) {
+        TINE_CHECK(entry.instance_count <= MAX_CELL_INSTANCES, "Invalid cell", Error);
+        p.cells[cell_key(entry.x, entry.z)].entry = entry;
+    }
+    p.path = path;
+    p.jobs = jobs;
+    p.env = env;
+    p.cell_size = header.cell_size;
+    TINE_INFO("Opened world {0}, {1} cells of {2}m", path, header.cell_count, header.cell_size);
+    return true;
+Error:
+    p.cells.clear();
+    return false;
+}
+
+void tine::WorldStreamer::set_radii(float load_radius, float unload_radius) {
+    m_pimpl->load_radius = load_radius;
+    m_pimpl->unload_radius = std::max(load_radius, unload_radius);
+}
+
+void tine::WorldStreamer::set_max_resident_cells(uint32_t max_cells) {
+    m_pimpl->max_cells = max_cells;
+}
+
+size_t tine::WorldStreamer::get_resident_cell_count() const { return m_pimpl->active_cnt; }
+
+static void unload_cell(tine::WorldStreamer::Pimpl &p, entt::registry &registry,
+                        StreamCell &cell) {
+    for (entt::entity entity : cell.entities) {
+        // A snapshot restore may have taken it already
+        if (registry.valid(entity)) {
+            registry.destroy(entity);
+        }
+    }
+    cell.entities.clear();
+    cell.entities.shrink_to_fit();
+    cell.state = CellState::UNLOADED;
+    cell.generation++;
+    p.active_cnt--;
+}
+
+void tine::WorldStreamer::close(Scene &scene) {
+    Pimpl &p = *m_pimpl;
+    if (p.jobs != nullptr) {
+        p.jobs->wait(p.loads);
+    }
+    for (auto &cell : p.cells) {
+        if (cell.second.state != CellState::UNLOADED) {
+            unload_cell(p, scene.get_registry(), cell.second);
+        }
+    }
+    p.cells.clear();
+    p.loaded.clear();
+}
+
+static void start_load(tine::WorldStreamer::Pimpl &p, uint64_t key, StreamCell &cell) {
+    const tine::WorldCellEntry entry = cell.entry;
+    const uint32_t generation = cell.generation;
+    tine::WorldStreamer::Pimpl *pimpl = &p;
+    auto load = [pimpl, key, generation, entry]() {
+        LoadedCell loaded = {key, generation, false, {}};
+        loaded.ok = read_cell(pimpl->path, entry, loaded.instances);
+        std::lock_guard<std::mutex> lock(pimpl->loaded_mutex);
+        pimpl->loaded.push_back(std::move(loaded));
+    };
+
+    cell.state = CellState::LOADING;
+    p.active_cnt++;
+    if (p.jobs != nullptr) {
+        p.jobs->submit("Load world cell", load, &p.loads);
+    } else {
+        load();
+    }
+}
+
+static void integrate_cells(tine::WorldStreamer::Pimpl &p, tine::Scene &scene) {
+    entt::registry &registry = scene.get_registry();
+    const tine::MeshData &mesh_data = scene.get_mesh_data();
+    const tine::CollisionData &collision_data = scene.get_collision_data();
+    std::vector<LoadedCell> loaded;
+    {
+        std::lock_guard<std::mutex> lock(p.loaded_mutex);
+        const size_t cnt = std::min(p.loaded.size(), MAX_CELLS_INTEGRATED_PER_UPDATE);
+        loaded.assign(std::make_move_iterator(p.loaded.begin()),
+                      std::make_move_iterator(p.loaded.begin() + cnt));
+        p.loaded.erase(p.loaded.begin(), p.loaded.begin() + cnt);
+    }
+
+    for (LoadedCell &result : loaded) {
+        auto it = p.cells.find(result.key);
+        if (it == p.cells.end() || it->second.state != CellState::LOADING ||
+            it->second.generation != result.generation) {
+            continue;
+        }
+        StreamCell &cell = it->second;
+        if (!result.ok) {
+            TINE_WARN("Failed to load cell ({0}, {1})", cell.entry.x, cell.entry.z);
+        }
+        cell.entities.reserve(result.instances.size());
+        for (const tine::CellInstance &instance : result.instances) {
+            if (instance.mesh >= mesh_data.meshes.size()) {
+                continue;
+            }
+            const entt::entity entity = registry.create();
+            registry.emplace<tine::EnvironmentComponent>(entity, p.env);
+            registry.emplace<tine::TransformComponent>(entity, instance.transform);
+            registry.emplace<tine::MeshComponent>(entity, instance.mesh);
+            registry.emplace<tine::MaterialComponent>(entity, instance.material);
+            if (instance.mesh < collision_data.hulls.size()) {
+                registry.emplace<tine::ColliderComponent>(entity, instance.mesh);
+            }
+            cell.entities.push_back(entity);
+        }
+        // Failed cells stay resident and empty rather than being retried every frame
+        cell.state = CellState::RESIDENT;
+    }
+}
+
+// Anchor positions with their load radius in w
+static void gather_anchors(tine::WorldStreamer::Pimpl &p, entt::registry &registry,
+                           std::vector<glm::vec4> &anchors) {
+    {
+        auto view = registry.view<const tine::CameraComponent, const tine::EnvironmentComponent>();
+        for (entt::entity entity : view) {
+            if (view.get<const tine::EnvironmentComponent>(entity).env == p.env) {
+                const glm::mat4 &view_matrix =
+                    view.get<const tine::CameraComponent>(entity).view_matrix;
+                anchors.push_back(glm::vec4(glm::vec3(glm::inverse(view_matrix)[3]),
+                                            p.load_radius));
+            }
+        }
+    }
+    {
+        auto view = registry.view<const tine::StreamingAnchorComponent,
+                                  const tine::TransformComponent,
+                                  const tine::EnvironmentComponent>();
+        for (entt::entity entity : view) {
+            if (view.get<const tine::EnvironmentComponent>(entity).env == p.env) {
+                const float radius = view.get<const tine::StreamingAnchorComponent>(entity).radius;
+                anchors.push_back(
+                    glm::vec4(glm::vec3(view.get<const tine::TransformComponent>(entity)
+                                            .transform[3]),
+                              std::max(radius, p.load_radius)));
+            }
+        }
+    }
+}
+
+// How far inside the anchor's reach the cell is, negative once it is out of reach.  The unload
+// slack is added to the reach when deciding whether resident cells stay.
+static float cell_reach(const tine::WorldStreamer::Pimpl &p, const tine::WorldCellEntry &entry,
+                        const glm::vec4 &anchor, float slack) {
+    const float x0 = entry.x * p.cell_size;
+    const float z0 = entry.z * p.cell_size;
+    const float dx = std::max(std::max(x0 - anchor.x, 0.0f), anchor.x - (x0 + p.cell_size));
+    const float dz = std::max(std::max(z0 - anchor.z, 0.0f), anchor.z - (z0 + p.cell_size));
+    return anchor.w + slack - std::sqrt(dx * dx + dz * dz);
+}
+
+void tine::WorldStreamer::update(Scene &scene) {
+    ZoneScoped;
+    Pimpl &p = *m_pimpl;
+    entt::registry &registry = scene.get_registry();
+    const float slack = p.unload_radius - p.load_radius;
+    std::vector<glm::vec4> anchors;
+    std::vector<std::pair<float, uint64_t>> wanted;
+
+    if (p.cells.empty()) {
+        return;
+    }
+    integrate_cells(p, scene);
+    gather_anchors(p, registry, anchors);
+
+    for (auto &it : p.cells) {
+        StreamCell &cell = it.second;
+        bool keep = false;
+        if (cell.state == CellState::UNLOADED) {
+            continue;
+        }
+        // Restoring a snapshot rebuilds the registry without the streamed entities
+        if (cell.state == CellState::RESIDENT && !cell.entities.empty() &&
+            !registry.valid(cell.entities[0])) {
+            unload_cell(p, registry, cell);
+            continue;
+        }
+        for (const glm::vec4 &anchor : anchors) {
+            keep = keep || cell_reach(p, cell.entry, anchor, slack) >= 0.0f;
+        }
+        if (!keep) {
+            unload_cell(p, registry, cell);
+        }
+    }
+
+    // Only the cells the anchors overlap need looking at, nearest first
+    for (const glm::vec4 &anchor : anchors) {
+        const int32_t x0 = static_cast<int32_t>(std::floor((anchor.x - anchor.w) / p.cell_size));
+        const int32_t x1 = static_cast<int32_t>(std::floor((anchor.x + anchor.w) / p.cell_size));
+        const int32_t z0 = static_cast<int32_t>(std::floor((anchor.z - anchor.w) / p.cell_size));
+        const int32_t z1 = static_cast<int32_t>(std::floor((anchor.z + anchor.w) / p.cell_size));
+        for (int32_t x = x0; x <= x1; x++) {
+            for (int32_t z = z0; z <= z1; z++) {
+                auto it = p.cells.find(cell_key(x, z));
+                if (it == p.cells.end() || it->second.state != CellState::UNLOADED) {
+                    continue;
+                }
+                const float reach = cell_reach(p, it->second.entry, anchor, 0.0f);
+                if (reach >= 0.0f) {
+                    wanted.push_back(std::make_pair(-reach, it->first));
+                }
+            }
+        }
+    }
+    std::sort(wanted.begin(), wanted.end());
+    for (const std::pair<float, uint64_t> &want : wanted) {
+        StreamCell &cell = p.cells[want.second];
+        if (p.active_cnt >= p.max_cells) {
+            break;
+        }
+        // Anchors can overlap the same cell
+        if (cell.state == CellState::UNLOADED) {
+            start_load(p, want.second, cell);
+        }
+    }
+}
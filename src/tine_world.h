@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace tine {
+
+class JobSystem;
+class Scene;
+
+// A placed instance of one of the scene's meshes, as stored in a world file.
+struct CellInstance {
+    glm::mat4 transform;
+    uint32_t mesh;     // Index into MeshData::meshes
+    uint32_t material; // Index of the imported material
+};
+static_assert(sizeof(CellInstance) == 18 * sizeof(uint32_t), "CellInstance is stored raw");
+
+// World file layout, little endian:
+//   WorldHeader
+//   WorldCellEntry[cell_count]
+//   CellInstance runs, one per cell
+// Cells tile the xz plane, cell (x, z) covers [x, x + 1) * cell_size by [z, z + 1) * cell_size.
+struct WorldHeader {
+    char magic[4]; // "TWLD"
+    uint32_t version;
+    float cell_size;
+    uint32_t cell_count;
+};
+
+struct WorldCellEntry {
+    int32_t x;
+    int32_t z;
+    uint64_t offset; // Of the cell's first CellInstance from the start of the file
+    uint32_t instance_count;
+    uint32_t pad;
+};
+
+// Bins instances into cells by their position and writes them out as a world file.
+bool write_world_file(const std::string &path, float cell_size,
+                      const std::vector<CellInstance> &instances);
+
+// Keeps the cells around the cameras and StreamingAnchorComponents of an environment resident in
+// the registry, reading them on background jobs.  Cells load within the load radius of an anchor
+// and only unload once past the larger unload radius, so anchors moving along a cell border don't
+// thrash.  At most max_resident_cells are loaded or loading at once, nearest first, which bounds
+// memory whatever the size of the world.  The meshes themselves are the scene's, already on the
+// GPU, so cells only carry their placements.
+class WorldStreamer {
+  public:
+    struct Pimpl;
+
+    WorldStreamer();
+    ~WorldStreamer();
+    WorldStreamer(const WorldStreamer &) = delete;
+
+    bool open(const std::string &path, JobSystem *jobs, uint32_t env = 0);
+    // Unloads every cell from scene, call before the scene goes away
+    void close(Scene &scene);
+    void set_radii(float load_radius, float unload_radius);
+    void set_max_resident_cells(uint32_t max_cells);
+    // Main thread only, once per frame or step
+    void update(Scene &scene);
+
+    size_t get_resident_cell_count() const;
+
+  private:
+    std::unique_ptr<Pimpl> m_pimpl;
+};
+
+} // namespace tine